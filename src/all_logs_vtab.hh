@@ -45,6 +45,10 @@ public:
 
     void get_columns(std::vector<vtab_column> &cols) const override;
 
+    int get_format_column() const override {
+        return VT_COL_MAX + this->alv_value_meta.lvm_column;
+    };
+
     void extract(std::shared_ptr<logfile> lf,
                  uint64_t line_number,
                  shared_buffer_ref &line,
@@ -78,9 +78,16 @@ const char *date_time_scanner::scan(const char *time_dest,
         time_fmt = PTIMEC_FORMAT_STR;
     }
 
-    while (next_format(time_fmt,
-                       curr_time_fmt,
-                       this->dts_fmt_lock)) {
+    if (this->dts_use_memo &&
+        this->memo_lookup(time_dest, time_len, time_fmt, convert_local,
+                          tm_out, tv_out)) {
+        retval = &time_dest[this->dts_fmt_len];
+        found = true;
+    }
+
+    while (!found && next_format(time_fmt,
+                                 curr_time_fmt,
+                                 this->dts_fmt_lock)) {
         *tm_out = this->dts_base_tm;
         tm_out->et_flags = 0;
         if (time_len > 1 &&
@@ -141,6 +148,10 @@ const char *date_time_scanner::scan(const char *time_dest,
 
                 this->dts_fmt_lock = curr_time_fmt;
                 this->dts_fmt_len  = retval - time_dest;
+                if (this->dts_use_memo) {
+                    this->memo_store(time_dest, time_len, time_fmt,
+                                     convert_local, *tm_out, tv_out);
+                }
 
                 found = true;
                 break;
@@ -154,7 +165,9 @@ const char *date_time_scanner::scan(const char *time_dest,
                 tm_out->et_tm.tm_zone = nullptr;
             }
 #endif
-            if (ptime_fmt(time_fmt[curr_time_fmt], tm_out, time_dest, off, time_len) &&
+            const auto &compiled = this->compiled_fmt(time_fmt, curr_time_fmt);
+
+            if (compiled.parse(tm_out, time_dest, off, time_len) &&
                 (time_dest[off] == '.' || time_dest[off] == ',' || off == (off_t)time_len)) {
                 retval = &time_dest[off];
                 if (tm_out->et_tm.tm_year < 70) {
@@ -177,6 +190,10 @@ const char *date_time_scanner::scan(const char *time_dest,
 
                 this->dts_fmt_lock = curr_time_fmt;
                 this->dts_fmt_len  = retval - time_dest;
+                if (this->dts_use_memo) {
+                    this->memo_store(time_dest, time_len, time_fmt,
+                                     convert_local, *tm_out, tv_out);
+                }
 
                 found = true;
                 break;
@@ -209,6 +226,168 @@ const char *date_time_scanner::scan(const char *time_dest,
     return retval;
 }
 
+const ptime_compiled_fmt &
+date_time_scanner::compiled_fmt(const char * const time_fmt[], int index)
+{
+    // The format strings come from the intern table or are static, so a
+    // matching pointer means the compiled steps are still valid.
+    if (this->dts_compiled_fmts == nullptr ||
+        (size_t) index >= this->dts_compiled_fmts->size() ||
+        (*this->dts_compiled_fmts)[index].pcf_fmt != time_fmt[index]) {
+        auto fmts = std::make_shared<std::vector<ptime_compiled_fmt>>();
+
+        for (int lpc = 0; time_fmt[lpc] != nullptr; lpc++) {
+            fmts->emplace_back(ptime_compiled_fmt::compile(time_fmt[lpc]));
+        }
+        this->dts_compiled_fmts = fmts;
+    }
+
+    return (*this->dts_compiled_fmts)[index];
+}
+
+bool date_time_scanner::memo_lookup(const char *time_src,
+                                    size_t time_len,
+                                    const char * const time_fmt[],
+                                    bool convert_local,
+                                    struct exttm *tm_out,
+                                    struct timeval &tv_out)
+{
+    const auto &memo = this->dts_memo;
+
+    if (this->dts_fmt_lock == -1 ||
+        memo.m_fmt_lock != this->dts_fmt_lock ||
+        memo.m_time_fmt != time_fmt ||
+        memo.m_convert_local != convert_local ||
+        memo.m_local_time != this->dts_local_time ||
+        memo.m_keep_base_tz != this->dts_keep_base_tz ||
+        memo.m_base_time != this->dts_base_time ||
+        time_len < memo.m_key_len) {
+        return false;
+    }
+
+    if (memo.m_at_end) {
+        if (time_len != memo.m_key_len) {
+            return false;
+        }
+    }
+    else if (time_len == memo.m_key_len ||
+             time_src[memo.m_key_len] != memo.m_next_char) {
+        return false;
+    }
+
+    if (memo.m_frac_off == -1) {
+        if (memcmp(time_src, memo.m_key, memo.m_key_len) != 0) {
+            return false;
+        }
+        *tm_out = memo.m_tm;
+    }
+    else {
+        size_t frac_end = memo.m_frac_off + memo.m_frac_width;
+        off_t off = memo.m_frac_off;
+
+        if (memcmp(time_src, memo.m_key, memo.m_frac_off) != 0 ||
+            memcmp(&time_src[frac_end],
+                   &memo.m_key[frac_end],
+                   memo.m_key_len - frac_end) != 0) {
+            return false;
+        }
+        *tm_out = memo.m_tm;
+        if (!memo.m_frac_func(tm_out, time_src, off, time_len)) {
+            return false;
+        }
+    }
+
+    tv_out.tv_sec = memo.m_tv_sec;
+    tv_out.tv_usec = tm_out->et_nsec / 1000;
+    this->dts_fmt_len = memo.m_key_len;
+
+    return true;
+}
+
+void date_time_scanner::memo_store(const char *time_src,
+                                   size_t time_len,
+                                   const char * const time_fmt[],
+                                   bool convert_local,
+                                   const struct exttm &tm,
+                                   const struct timeval &tv)
+{
+    auto &memo = this->dts_memo;
+    size_t key_len = this->dts_fmt_len;
+    const char *fmt = time_fmt[this->dts_fmt_lock];
+
+    memo.m_fmt_lock = -1;
+    if (key_len == 0 || key_len > sizeof(memo.m_key)) {
+        return;
+    }
+
+    if (memo.m_analyzed_fmt != fmt) {
+        // Look for fractional seconds that follow the seconds field, like
+        // "%S.%f", so they can be left out of the comparison.
+        const char *secs = strstr(fmt, "%S");
+
+        memo.m_analyzed_fmt = fmt;
+        memo.m_frac_head.reset();
+        memo.m_analyzed_func = nullptr;
+        if (secs != nullptr && secs[2] != '\0' && secs[2] != '%' &&
+            secs[3] == '%') {
+            switch (secs[4]) {
+                case 'f':
+                    memo.m_analyzed_func = ptime_f;
+                    memo.m_analyzed_width = 6;
+                    break;
+                case 'L':
+                    memo.m_analyzed_func = ptime_L;
+                    memo.m_analyzed_width = 3;
+                    break;
+                case 'N':
+                    memo.m_analyzed_func = ptime_N;
+                    memo.m_analyzed_width = 9;
+                    break;
+            }
+        }
+        if (memo.m_analyzed_func != nullptr) {
+            std::string head(fmt, secs + 3 - fmt);
+            auto compiled = ptime_compiled_fmt::compile(head.c_str());
+
+            compiled.pcf_fmt = fmt;
+            memo.m_frac_head = std::make_shared<const ptime_compiled_fmt>(
+                std::move(compiled));
+        }
+    }
+
+    memo.m_frac_off = -1;
+    if (memo.m_frac_head != nullptr) {
+        struct exttm scratch = tm;
+        off_t off = 0;
+
+        // Double check the location by parsing the fraction again.
+        if (memo.m_frac_head->parse(&scratch, time_src, off, time_len) &&
+            (size_t) (off + memo.m_analyzed_width) <= key_len) {
+            off_t frac_off = off;
+
+            if (memo.m_analyzed_func(&scratch, time_src, off, time_len) &&
+                scratch.et_nsec == tm.et_nsec) {
+                memo.m_frac_off = frac_off;
+                memo.m_frac_width = memo.m_analyzed_width;
+                memo.m_frac_func = memo.m_analyzed_func;
+            }
+        }
+    }
+
+    memcpy(memo.m_key, time_src, key_len);
+    memo.m_key_len = key_len;
+    memo.m_at_end = key_len == time_len;
+    memo.m_next_char = memo.m_at_end ? '\0' : time_src[key_len];
+    memo.m_tm = tm;
+    memo.m_tv_sec = tv.tv_sec;
+    memo.m_time_fmt = time_fmt;
+    memo.m_convert_local = convert_local;
+    memo.m_local_time = this->dts_local_time;
+    memo.m_keep_base_tz = this->dts_keep_base_tz;
+    memo.m_base_time = this->dts_base_time;
+    memo.m_fmt_lock = this->dts_fmt_lock;
+}
+
 void date_time_scanner::to_localtime(time_t t, exttm &tm_out)
 {
     if (t < (24 * 60 * 60)) {
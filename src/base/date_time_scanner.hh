@@ -35,10 +35,14 @@
 #include <time.h>
 #include <sys/types.h>
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "time_util.hh"
 
+class ptime_compiled_fmt;
+
 /**
  * Scans a timestamp string to discover the date-time format using the custom
  * ptimec parser.  Once a format is found, it is locked in so that the next
@@ -56,6 +60,7 @@ struct date_time_scanner {
         memset(&this->dts_base_tm, 0, sizeof(this->dts_base_tm));
         this->dts_fmt_lock = -1;
         this->dts_fmt_len = -1;
+        this->dts_memo.m_fmt_lock = -1;
     };
 
     /**
@@ -89,6 +94,57 @@ struct date_time_scanner {
     time_t dts_local_offset_cache{0};
     time_t dts_local_offset_valid{0};
     time_t dts_local_offset_expiry{0};
+    /**
+     * The custom formats passed to scan() compiled into parsing steps.  The
+     * vector is shared between copies of this scanner.
+     */
+    std::shared_ptr<const std::vector<ptime_compiled_fmt>> dts_compiled_fmts;
+
+    /**
+     * The result of the last successful scan.  Busy logs have many lines in
+     * a row with the same timestamp down to the second, so a timestamp that
+     * matches the previous one, except for the fractional seconds, can reuse
+     * the converted time instead of being parsed again.
+     */
+    struct memo {
+        static const size_t MAX_KEY_LEN = 64;
+
+        typedef bool (*frac_func)(struct exttm *dst,
+                                  const char *str,
+                                  off_t &off,
+                                  ssize_t len);
+
+        const char * const *m_time_fmt{nullptr};
+        int m_fmt_lock{-1};
+        bool m_convert_local{false};
+        bool m_local_time{false};
+        bool m_keep_base_tz{false};
+        time_t m_base_time{0};
+        /** The timestamp text that was parsed by the locked format. */
+        char m_key[MAX_KEY_LEN];
+        size_t m_key_len{0};
+        /**
+         * The parser looks one byte past the end of the timestamp when it
+         * decides where a field stops, so that byte has to match as well.
+         */
+        bool m_at_end{false};
+        char m_next_char{'\0'};
+        /** The location of fractional seconds inside of the key, if any. */
+        off_t m_frac_off{-1};
+        int m_frac_width{0};
+        frac_func m_frac_func{nullptr};
+        struct exttm m_tm;
+        time_t m_tv_sec{0};
+
+        /** The format that the fractional seconds analysis was done for. */
+        const char *m_analyzed_fmt{nullptr};
+        std::shared_ptr<const ptime_compiled_fmt> m_frac_head;
+        frac_func m_analyzed_func{nullptr};
+        int m_analyzed_width{0};
+    } dts_memo;
+
+    /** Set to false to always fully parse timestamps. */
+    bool dts_use_memo{true};
 
     static const int EXPIRE_TIME = 15 * 60;
 
@@ -101,6 +157,23 @@ struct date_time_scanner {
 
     size_t ftime(char *dst, size_t len, const struct exttm &tm) const;
 
+    const ptime_compiled_fmt &compiled_fmt(const char * const time_fmt[],
+                                           int index);
+
+    bool memo_lookup(const char *time_src,
+                     size_t time_len,
+                     const char * const time_fmt[],
+                     bool convert_local,
+                     struct exttm *tm_out,
+                     struct timeval &tv_out);
+
+    void memo_store(const char *time_src,
+                    size_t time_len,
+                    const char * const time_fmt[],
+                    bool convert_local,
+                    const struct exttm &tm,
+                    const struct timeval &tv);
+
     bool convert_to_timeval(const char *time_src,
                             ssize_t time_len,
                             const char * const time_fmt[],
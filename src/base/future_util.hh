@@ -31,6 +31,7 @@
 #define lnav_future_util_hh
 
 #include <deque>
+#include <functional>
 #include <future>
 
 namespace lnav {
@@ -62,9 +63,12 @@ class future_queue {
 public:
     /**
      * @param processor The function to execute with the result of a future.
+     * @param max_queue_size The number of futures that can be in flight,
+     *   defaults to MAX_QUEUE_SIZE.
      */
-    explicit future_queue(std::function<void(const T&)> processor)
-        : fq_processor(processor) {};
+    explicit future_queue(std::function<void(const T&)> processor,
+                          size_t max_queue_size = MAX_QUEUE_SIZE)
+        : fq_processor(processor), fq_max_queue_size(max_queue_size) {};
 
     ~future_queue() {
         this->pop_to();
@@ -72,14 +76,14 @@ public:
 
     /**
      * Add a future to the queue.  If the size of the queue is greater than the
-     * MAX_QUEUE_SIZE, this call will block waiting for the first queued
+     * maximum queue size, this call will block waiting for the first queued
      * future to return a result.
      *
      * @param f The future to add to the queue.
      */
     void push_back(std::future<T>&& f) {
         this->fq_deque.emplace_back(std::move(f));
-        this->pop_to(MAX_QUEUE_SIZE);
+        this->pop_to(this->fq_max_queue_size);
     }
 
     /**
@@ -96,6 +100,7 @@ public:
     }
 
     std::function<void(const T&)> fq_processor;
+    size_t fq_max_queue_size;
     std::deque<std::future<T>> fq_deque;
 };
 
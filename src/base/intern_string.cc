@@ -33,10 +33,17 @@
 
 #include <string.h>
 
+#include <mutex>
+
 #include "intern_string.hh"
 
 const static int TABLE_SIZE = 4095;
 static intern_string *TABLE[TABLE_SIZE];
+/**
+ * Guards TABLE since formats can be scanning lines on worker threads.  The
+ * constructor is constexpr, so this is safe to use during static init.
+ */
+static std::mutex TABLE_MUTEX;
 
 unsigned long
 hash_str(const char *str, size_t len)
@@ -61,6 +68,8 @@ const intern_string *intern_string::lookup(const char *str, ssize_t len) noexcep
     }
     h = hash_str(str, len) % TABLE_SIZE;
 
+    std::lock_guard<std::mutex> lg(TABLE_MUTEX);
+
     curr = TABLE[h];
     while (curr != nullptr) {
         if (curr->is_len == len && strncmp(curr->is_str, str, len) == 0) {
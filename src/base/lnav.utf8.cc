@@ -0,0 +1,402 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file lnav.utf8.cc
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "lnav.utf8.hh"
+
+namespace lnav {
+namespace utf8 {
+
+/**
+ * @return The length of the well-formed UTF-8 sequence at the start of str
+ *   or zero if the sequence is not well-formed.  See table 3-7 in the
+ *   Unicode standard for the byte ranges.
+ */
+static size_t sequence_length(const unsigned char *str, size_t avail)
+{
+    unsigned char lo = 0x80, hi = 0xbf;
+    size_t retval;
+
+    if (str[0] < 0x80) {
+        return 1;
+    }
+    if (str[0] >= 0xc2 && str[0] <= 0xdf) {
+        retval = 2;
+    } else if (str[0] >= 0xe0 && str[0] <= 0xef) {
+        retval = 3;
+        if (str[0] == 0xe0) {
+            lo = 0xa0;
+        } else if (str[0] == 0xed) {
+            hi = 0x9f;
+        }
+    } else if (str[0] >= 0xf0 && str[0] <= 0xf4) {
+        retval = 4;
+        if (str[0] == 0xf0) {
+            lo = 0x90;
+        } else if (str[0] == 0xf4) {
+            hi = 0x8f;
+        }
+    } else {
+        return 0;
+    }
+
+    if (avail < retval || str[1] < lo || str[1] > hi) {
+        return 0;
+    }
+    for (size_t lpc = 2; lpc < retval; lpc++) {
+        if (str[lpc] < 0x80 || str[lpc] > 0xbf) {
+            return 0;
+        }
+    }
+
+    return retval;
+}
+
+/**
+ * Check the multi-byte sequences that start before the given end.  A
+ * newline can never be part of a sequence, so the caller does not need to
+ * look for one.
+ *
+ * @return The offset after the last sequence, which can be past the end.
+ */
+static size_t check_sequences(const unsigned char *str,
+                              size_t off,
+                              size_t end,
+                              size_t len,
+                              bool &valid)
+{
+    while (off < end) {
+        if (str[off] < 0x80) {
+            off += 1;
+            continue;
+        }
+
+        auto seq_len = sequence_length(&str[off], len - off);
+
+        if (seq_len == 0) {
+            valid = false;
+            seq_len = 1;
+        }
+        off += seq_len;
+    }
+
+    return off;
+}
+
+static line_scan_result scan_line_scalar(const unsigned char *str,
+                                         size_t off,
+                                         size_t len,
+                                         bool valid)
+{
+    line_scan_result retval;
+
+    while (off < len) {
+        if (str[off] == '\n') {
+            retval.lsr_end = off;
+            break;
+        }
+        off = check_sequences(str, off, off + 1, len, valid);
+    }
+    retval.lsr_valid = valid;
+
+    return retval;
+}
+
+#if defined(__x86_64__) && defined(__SSE2__)
+static line_scan_result scan_line_sse2(const unsigned char *str, size_t len)
+{
+    const auto lf_chars = _mm_set1_epi8('\n');
+    auto valid = true;
+    size_t off = 0;
+
+    while (off + 16 <= len) {
+        auto chunk = _mm_loadu_si128((const __m128i *) &str[off]);
+        unsigned int lf_mask = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(chunk, lf_chars));
+        unsigned int high_mask = _mm_movemask_epi8(chunk);
+
+        if (lf_mask) {
+            auto lf_off = __builtin_ctz(lf_mask);
+
+            high_mask &= (1U << lf_off) - 1;
+            if (high_mask) {
+                check_sequences(str,
+                                off + __builtin_ctz(high_mask),
+                                off + lf_off,
+                                off + lf_off,
+                                valid);
+            }
+            return {(ssize_t) (off + lf_off), valid};
+        }
+        if (high_mask) {
+            off = check_sequences(
+                str, off + __builtin_ctz(high_mask), off + 16, len, valid);
+        } else {
+            off += 16;
+        }
+    }
+
+    return scan_line_scalar(str, off, len, valid);
+}
+
+/*
+ * The AVX2 kernel checks whole chunks at once using the lookup tables from
+ * "Validating UTF-8 In Less Than One Instruction Per Byte" by John Keiser
+ * and Daniel Lemire.  Each byte is classified by the high nibble of the
+ * previous byte, the low nibble of the previous byte and its own high
+ * nibble.  An error is found when all three lookups share a bit.
+ */
+static const uint8_t TOO_SHORT = 1 << 0;
+static const uint8_t TOO_LONG = 1 << 1;
+static const uint8_t OVERLONG_3 = 1 << 2;
+static const uint8_t TOO_LARGE = 1 << 3;
+static const uint8_t SURROGATE = 1 << 4;
+static const uint8_t OVERLONG_2 = 1 << 5;
+static const uint8_t TOO_LARGE_1000 = 1 << 6;
+static const uint8_t OVERLONG_4 = 1 << 6;
+static const uint8_t TWO_CONTS = 1 << 7;
+static const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+__attribute__((target("avx2")))
+static inline __m256i lookup16(__m256i nibbles, const uint8_t (&table)[16])
+{
+    auto table128 = _mm_loadu_si128((const __m128i *) table);
+
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(table128),
+                               nibbles);
+}
+
+/**
+ * @return The chunk shifted so that each byte lines up with the byte that
+ *   is N bytes before it, taking the bytes from the end of prev as needed.
+ */
+template<int N>
+__attribute__((target("avx2")))
+static inline __m256i prev_bytes(__m256i chunk, __m256i prev)
+{
+    return _mm256_alignr_epi8(
+        chunk, _mm256_permute2x128_si256(prev, chunk, 0x21), 16 - N);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i high_nibbles(__m256i chunk)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(chunk, 4),
+                            _mm256_set1_epi8(0x0f));
+}
+
+/**
+ * @return A vector with a non-zero byte for every error in the chunk.
+ */
+__attribute__((target("avx2")))
+static inline __m256i check_utf8_avx2(__m256i chunk, __m256i prev)
+{
+    static const uint8_t BYTE_1_HIGH[16] = {
+        // 0_______ ________ <ASCII in byte 1>
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        // 10______ ________ <continuation in byte 1>
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        // 1100____ ________ <two byte lead in byte 1>
+        TOO_SHORT | OVERLONG_2,
+        // 1101____ ________ <two byte lead in byte 1>
+        TOO_SHORT,
+        // 1110____ ________ <three byte lead in byte 1>
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        // 1111____ ________ <four+ byte lead in byte 1>
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+    };
+    static const uint8_t BYTE_1_LOW[16] = {
+        // ____0000 ________
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        // ____0001 ________
+        CARRY | OVERLONG_2,
+        // ____001_ ________
+        CARRY,
+        CARRY,
+        // ____0100 ________
+        CARRY | TOO_LARGE,
+        // ____0101 ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____011_ ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____1___ ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____1101 ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+    };
+    static const uint8_t BYTE_2_HIGH[16] = {
+        // ________ 0_______ <ASCII in byte 2>
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        // ________ 1000____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000
+            | OVERLONG_4,
+        // ________ 1001____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        // ________ 101_____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        // ________ 11______
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    };
+
+    auto prev1 = prev_bytes<1>(chunk, prev);
+    auto special_cases = _mm256_and_si256(
+        _mm256_and_si256(
+            lookup16(high_nibbles(prev1), BYTE_1_HIGH),
+            lookup16(_mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)),
+                     BYTE_1_LOW)),
+        lookup16(high_nibbles(chunk), BYTE_2_HIGH));
+
+    // The third and fourth bytes of a sequence are only covered by the
+    // lookups as continuations, so check that they are expected here.
+    auto is_third_byte = _mm256_subs_epu8(prev_bytes<2>(chunk, prev),
+                                          _mm256_set1_epi8(0xe0 - 0x80));
+    auto is_fourth_byte = _mm256_subs_epu8(prev_bytes<3>(chunk, prev),
+                                           _mm256_set1_epi8(0xf0 - 0x80));
+    auto must_be_cont = _mm256_and_si256(
+        _mm256_or_si256(is_third_byte, is_fourth_byte),
+        _mm256_set1_epi8((char) 0x80));
+
+    return _mm256_xor_si256(must_be_cont, special_cases);
+}
+
+/**
+ * @return A vector with a non-zero byte if a sequence at the end of the
+ *   chunk continues into the next one.
+ */
+__attribute__((target("avx2")))
+static inline __m256i is_incomplete_avx2(__m256i chunk)
+{
+    const auto max_value = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char) (0xf0 - 1), (char) (0xe0 - 1), (char) (0xc0 - 1));
+
+    return _mm256_subs_epu8(chunk, max_value);
+}
+
+__attribute__((target("avx2")))
+static line_scan_result scan_line_avx2(const unsigned char *str, size_t len)
+{
+    const auto lf_chars = _mm256_set1_epi8('\n');
+    const auto indexes = _mm256_setr_epi8(
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    auto prev = _mm256_setzero_si256();
+    auto prev_incomplete = _mm256_setzero_si256();
+    auto error = _mm256_setzero_si256();
+    size_t off = 0;
+
+    while (off + 32 <= len) {
+        auto chunk = _mm256_loadu_si256((const __m256i *) &str[off]);
+        unsigned int lf_mask = _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(chunk, lf_chars));
+        unsigned int high_mask = _mm256_movemask_epi8(chunk);
+
+        if (lf_mask) {
+            auto lf_off = __builtin_ctz(lf_mask);
+
+            high_mask &= (1U << lf_off) - 1;
+            if (high_mask) {
+                // The bytes after the newline belong to the next line, so
+                // replace them with NULs before checking the chunk.  The
+                // newline itself ends any sequence that is still open.
+                chunk = _mm256_andnot_si256(
+                    _mm256_cmpgt_epi8(indexes, _mm256_set1_epi8(lf_off)),
+                    chunk);
+                error = _mm256_or_si256(error, check_utf8_avx2(chunk, prev));
+            } else {
+                error = _mm256_or_si256(error, prev_incomplete);
+            }
+            return {(ssize_t) (off + lf_off), (bool) _mm256_testz_si256(
+                error, error)};
+        }
+        if (high_mask) {
+            error = _mm256_or_si256(error, check_utf8_avx2(chunk, prev));
+            prev_incomplete = is_incomplete_avx2(chunk);
+        } else {
+            error = _mm256_or_si256(error, prev_incomplete);
+            prev_incomplete = _mm256_setzero_si256();
+        }
+        prev = chunk;
+        off += 32;
+    }
+
+    if (!_mm256_testz_si256(prev_incomplete, prev_incomplete)) {
+        // Go back to the start of the sequence that was cut off by the end
+        // of the last chunk so the scalar loop can finish checking it.
+        for (size_t back = 1; back <= 3; back++) {
+            if (str[off - back] >= 0xc0) {
+                off -= back;
+                break;
+            }
+        }
+    }
+
+    return scan_line_scalar(
+        str, off, len, (bool) _mm256_testz_si256(error, error));
+}
+#endif
+
+line_scan_result scan_line(const char *str, size_t len)
+{
+    auto ustr = (const unsigned char *) str;
+
+#if defined(__x86_64__) && defined(__SSE2__)
+    static const bool HAS_AVX2 = __builtin_cpu_supports("avx2");
+
+    if (HAS_AVX2) {
+        return scan_line_avx2(ustr, len);
+    }
+    return scan_line_sse2(ustr, len);
+#else
+    return scan_line_scalar(ustr, 0, len, true);
+#endif
+}
+
+}
+}
@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file lnav.utf8.hh
+ */
+
+#ifndef lnav_utf8_hh
+#define lnav_utf8_hh
+
+#include <sys/types.h>
+
+namespace lnav {
+namespace utf8 {
+
+struct line_scan_result {
+    /** The offset of the first newline or -1 if there is none. */
+    ssize_t lsr_end{-1};
+    /** True if the bytes before the newline are valid UTF-8. */
+    bool lsr_valid{true};
+};
+
+/**
+ * Find the end of the line at the start of a buffer and check that the line
+ * is valid UTF-8 in a single pass over the data.  The buffer is processed
+ * in 32 or 16 byte chunks using AVX2 or SSE2 when the CPU supports them.
+ * Chunks that are entirely ASCII are skipped after checking for a newline.
+ * The AVX2 kernel checks the other chunks as a whole, while the SSE2 and
+ * scalar code check the bytes in multi-byte sequences one at a time.
+ *
+ * @param str The buffer to scan.
+ * @param len The amount of data in the buffer.
+ * @return The offset of the newline and whether the line is valid.  If no
+ *   newline is found, the whole buffer is checked.
+ */
+line_scan_result scan_line(const char *str, size_t len);
+
+}
+}
+
+#endif
@@ -0,0 +1,199 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <string>
+
+#include "doctest.hh"
+
+#include "base/is_utf8.hh"
+#include "base/lnav.utf8.hh"
+
+static lnav::utf8::line_scan_result scan(const std::string &str)
+{
+    return lnav::utf8::scan_line(str.data(), str.size());
+}
+
+TEST_CASE("lnav::utf8::scan_line") {
+    {
+        auto res = scan("");
+
+        CHECK(res.lsr_end == -1);
+        CHECK(res.lsr_valid);
+    }
+
+    {
+        auto res = scan("short\nline");
+
+        CHECK(res.lsr_end == 5);
+        CHECK(res.lsr_valid);
+    }
+
+    {
+        std::string line(100, 'a');
+
+        line += "\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5\n";
+        auto res = scan(line);
+
+        CHECK(res.lsr_end == 111);
+        CHECK(res.lsr_valid);
+    }
+
+    {
+        // An invalid byte after the newline belongs to the next line.
+        std::string line = "abc\n\xff";
+
+        line += std::string(64, 'b');
+        auto res = scan(line);
+
+        CHECK(res.lsr_end == 3);
+        CHECK(res.lsr_valid);
+    }
+
+    {
+        // A sequence that is cut short by the newline.
+        std::string line(30, 'a');
+
+        line += "\xe1\xbd\n";
+        line += std::string(64, 'b');
+        auto res = scan(line);
+
+        CHECK(res.lsr_end == 32);
+        CHECK_FALSE(res.lsr_valid);
+    }
+
+    {
+        // A sequence that crosses the boundary between chunks.
+        for (size_t prefix = 10; prefix < 40; prefix++) {
+            std::string line(prefix, 'a');
+
+            line += "\xf0\x9f\x98\x80";
+            line += std::string(40, 'b');
+            line += "\n";
+            auto res = scan(line);
+
+            CHECK(res.lsr_end == (ssize_t) line.size() - 1);
+            CHECK(res.lsr_valid);
+        }
+    }
+
+    {
+        // Overlong encodings and surrogates.
+        const char *bad[] = {
+            "\xc0\xaf",
+            "\xe0\x80\xaf",
+            "\xed\xa0\x80",
+            "\xf4\x90\x80\x80",
+            "\x80",
+        };
+
+        for (const auto *seq : bad) {
+            std::string line(20, 'a');
+
+            line += seq;
+            line += std::string(20, 'b');
+            auto res = scan(line);
+
+            CHECK(res.lsr_end == -1);
+            CHECK_FALSE(res.lsr_valid);
+        }
+    }
+}
+
+TEST_CASE("lnav::utf8::scan_line matches is_utf8") {
+    std::string data;
+    unsigned int seed = 1;
+
+    for (size_t lpc = 0; lpc < 4096; lpc++) {
+        seed = seed * 1103515245 + 12345;
+        auto byte = (seed >> 16) & 0xff;
+
+        // Mostly ASCII with the occasional high byte and newline.
+        if (byte < 0xe0) {
+            byte = 'a' + (byte % 26);
+        } else if (byte < 0xe4) {
+            byte = '\n';
+        }
+        data.push_back((char) byte);
+    }
+
+    for (size_t off = 0; off < data.size(); off++) {
+        auto res = lnav::utf8::scan_line(&data[off], data.size() - off);
+        const char *msg;
+        int faulty_bytes;
+        auto end = is_utf8((unsigned char *) &data[off],
+                           res.lsr_end == -1 ? data.size() - off : res.lsr_end,
+                           &msg,
+                           &faulty_bytes);
+
+        CHECK(res.lsr_valid == (msg == nullptr));
+        if (msg == nullptr && res.lsr_end != -1) {
+            CHECK(end == -1);
+        }
+    }
+}
+
+TEST_CASE("lnav::utf8::scan_line matches is_utf8 for multi-byte text") {
+    const char *seqs[] = {
+        "a", " ", "\xc3\xa9", "\xce\xba", "\xe6\x97\xa5", "\xef\xbf\xbd",
+        "\xf0\x9f\x98\x80", "\xf4\x8f\xbf\xbf", "\n",
+        // Invalid sequences, which are picked less often.
+        "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80",
+        "\xf5\x80\x80\x80", "\x80", "\xe6\x97", "\xff",
+    };
+    std::string data;
+    unsigned int seed = 1;
+
+    while (data.size() < 8192) {
+        seed = seed * 1103515245 + 12345;
+        auto pick = (seed >> 16) % 1024;
+
+        if (pick < 1000) {
+            data += seqs[pick % 9];
+        } else {
+            data += seqs[9 + pick % 8];
+        }
+    }
+
+    for (size_t off = 0; off < data.size(); off++) {
+        auto res = lnav::utf8::scan_line(&data[off], data.size() - off);
+        auto lf = data.find('\n', off);
+        const char *msg;
+        int faulty_bytes;
+
+        is_utf8((unsigned char *) &data[off],
+                (lf == std::string::npos ? data.size() : lf) - off,
+                &msg,
+                &faulty_bytes);
+
+        CHECK(res.lsr_end == (lf == std::string::npos ? -1 : (ssize_t) (lf - off)));
+        CHECK(res.lsr_valid == (msg == nullptr));
+    }
+}
@@ -105,6 +105,27 @@ void sql_progress_finished()
 
 Result<string, string> execute_from_file(exec_context &ec, const ghc::filesystem::path &path, int line_number, char mode, const string &cmdline);
 
+/**
+ * Make text_filters_changed() filter all of the lines before returning so
+ * that each command in a script sees the view with the filters from the
+ * earlier commands applied.  Any filtering that is still being done in the
+ * background is finished first.
+ *
+ * @return The previous time slice, which should be restored afterward.
+ */
+static chrono::milliseconds filter_synchronously()
+{
+    auto& lss = lnav_data.ld_log_source;
+    auto retval = lss.get_filter_time_slice();
+
+    lss.set_filter_time_slice(chrono::milliseconds::zero());
+    if (lss.is_filtering()) {
+        rebuild_indexes();
+    }
+
+    return retval;
+}
+
 Result<string, string> execute_command(exec_context &ec, const string &cmdline)
 {
     vector<string> args;
@@ -498,6 +519,11 @@ Result<string, string> execute_file(exec_context &ec, const string &path_and_arg
 
     log_info("Executing file: %s", path_and_args.c_str());
 
+    auto old_slice = filter_synchronously();
+    auto _restore_slice = finally([old_slice] {
+        lnav_data.ld_log_source.set_filter_time_slice(old_slice);
+    });
+
     if (!lexer.split(split_args, ec.ec_local_vars.top())) {
         return ec.make_error("unable to parse path");
     }
@@ -663,6 +689,11 @@ void execute_init_commands(exec_context &ec, vector<pair<Result<string, string>,
     db_label_source &dls = lnav_data.ld_db_row_source;
     int option_index = 1;
 
+    auto old_slice = filter_synchronously();
+    auto _restore_slice = finally([old_slice] {
+        lnav_data.ld_log_source.set_filter_time_slice(old_slice);
+    });
+
     log_info("Executing initial commands");
     for (auto &cmd : lnav_data.ld_commands) {
         string alt_msg;
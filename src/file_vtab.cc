@@ -40,6 +40,7 @@
 #include "session_data.hh"
 #include "vtab_module.hh"
 #include "log_format.hh"
+#include "log_format_ext.hh"
 #include "file_vtab.cfg.hh"
 
 using namespace std;
@@ -224,5 +225,135 @@ struct injectable_lnav_file : vtab_module<lnav_file> {
     using injectable = injectable_lnav_file(file_collection&);
 };
 
+struct lnav_file_pattern_stats
+    : public tvt_iterator_cursor<lnav_file_pattern_stats> {
+    struct iterator {
+        using difference_type = int;
+        using value_type = logfile;
+        using pointer = logfile *;
+        using reference = logfile &;
+        using iterator_category = forward_iterator_tag;
+
+        const file_collection *i_collection;
+        size_t i_file_index;
+        int i_pattern_index;
+
+        iterator(const file_collection *fc = nullptr,
+                 size_t file_index = 0,
+                 int pattern_index = -1)
+            : i_collection(fc), i_file_index(file_index),
+              i_pattern_index(pattern_index) {
+        }
+
+        iterator &operator++() {
+            const auto &files = this->i_collection->fc_files;
+
+            while (this->i_file_index < files.size()) {
+                auto format = files[this->i_file_index]->get_format();
+
+                this->i_pattern_index += 1;
+                if (format != nullptr &&
+                    this->i_pattern_index <
+                    (int) format->lf_pattern_hits.size()) {
+                    break;
+                }
+                this->i_file_index += 1;
+                this->i_pattern_index = -1;
+            }
+
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return this->i_file_index == other.i_file_index &&
+                   this->i_pattern_index == other.i_pattern_index;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+    static constexpr const char *NAME = "lnav_file_pattern_stats";
+    static constexpr const char *CREATE_STMT = R"(
+-- Access statistics for the patterns of a log format through this table.
+CREATE TABLE lnav_file_pattern_stats (
+    filepath text,  -- The path to the file.
+    format text,    -- The log file format for the file.
+    pattern text,   -- The name of the pattern.
+    hits integer    -- The number of lines that matched this pattern.
+);
+)";
+
+    explicit lnav_file_pattern_stats(file_collection& fc)
+        : lfps_collection(fc) {
+    }
+
+    iterator begin() {
+        iterator retval(&this->lfps_collection);
+
+        return ++retval;
+    }
+
+    iterator end() {
+        return {&this->lfps_collection,
+                this->lfps_collection.fc_files.size(),
+                -1};
+    }
+
+    sqlite_int64 get_rowid(iterator iter) {
+        sqlite_int64 retval = iter.i_file_index;
+
+        retval = retval << 32;
+        retval = retval | iter.i_pattern_index;
+
+        return retval;
+    }
+
+    int get_column(const cursor &vc, sqlite3_context *ctx, int col) {
+        auto lf = this->lfps_collection.fc_files[vc.iter.i_file_index];
+        auto format = lf->get_format();
+        auto pat_index = vc.iter.i_pattern_index;
+
+        switch (col) {
+            case 0:
+                to_sqlite(ctx, lf->get_filename());
+                break;
+            case 1:
+                to_sqlite(ctx, format->get_name().get());
+                break;
+            case 2: {
+                auto elf = dynamic_pointer_cast<external_log_format>(format);
+
+                if (elf != nullptr) {
+                    to_sqlite(ctx,
+                              elf->elf_pattern_order[pat_index]->p_config_path);
+                } else {
+                    sqlite3_result_null(ctx);
+                }
+                break;
+            }
+            case 3:
+                to_sqlite(ctx, (int64_t) format->lf_pattern_hits[pat_index]);
+                break;
+            default:
+                ensure(0);
+                break;
+        }
+
+        return SQLITE_OK;
+    }
+
+    file_collection &lfps_collection;
+};
+
+struct injectable_lnav_file_pattern_stats
+    : vtab_module<tvt_no_update<lnav_file_pattern_stats>> {
+    using vtab_module<tvt_no_update<lnav_file_pattern_stats>>::vtab_module;
+    using injectable =
+        injectable_lnav_file_pattern_stats(file_collection&);
+};
+
 static auto file_binder = injector::bind_multiple<vtab_module_base>()
-     .add<injectable_lnav_file>();
+     .add<injectable_lnav_file>()
+     .add<injectable_lnav_file_pattern_stats>();
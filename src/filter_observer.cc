@@ -47,18 +47,42 @@ void line_filter_observer::logline_new_lines(const logfile &lf,
         return;
     }
 
+    uint32_t wanted_mask = 0;
+
+    for (auto &filter : this->lfo_filter_stack) {
+        if (filter->lf_deleted) {
+            continue;
+        }
+        auto index = filter->get_index();
+        auto count = this->lfo_filter_state.tfs_filter_count[index];
+
+        // Only feed a filter the lines that directly follow the ones it has
+        // already seen, a filter that is behind is caught up separately.
+        if (offset >= count &&
+            offset <= count + this->lfo_filter_state.tfs_lines_for_message[index]) {
+            wanted_mask |= 1UL << index;
+        }
+    }
+    if (wanted_mask == 0) {
+        return;
+    }
+
+    this->lfo_filter_stack.update_prefilter();
     for (; ll_begin != ll_end; ++ll_begin) {
         if (lf.get_format() != nullptr) {
             lf.get_format()->get_subline(*ll_begin, sbr);
         }
+
+        auto hits = this->lfo_filter_stack.match_line(
+            wanted_mask, lf, ll_begin, sbr);
+
         for (auto &filter : this->lfo_filter_stack) {
-            if (filter->lf_deleted) {
+            uint32_t bit = 1UL << filter->get_index();
+
+            if (filter->lf_deleted || !(wanted_mask & bit)) {
                 continue;
             }
-            if (offset >=
-                this->lfo_filter_state.tfs_filter_count[filter->get_index()]) {
-                filter->add_line(this->lfo_filter_state, ll_begin, sbr);
-            }
+            filter->add_line(this->lfo_filter_state, ll_begin, hits & bit);
         }
     }
 }
@@ -72,3 +96,92 @@ void line_filter_observer::logline_eof(const logfile &lf)
         iter->end_of_message(this->lfo_filter_state);
     }
 }
+
+bool line_filter_observer::catch_up(logfile &lf,
+                                    size_t end,
+                                    nonstd::optional<ui_clock::time_point> deadline)
+{
+    static const size_t BATCH_SIZE = 16 * 1024;
+
+    end = std::min(end, lf.size());
+    while (this->get_min_count(lf.size()) < end) {
+        if (deadline && ui_clock::now() >= deadline.value()) {
+            return false;
+        }
+
+        auto start = this->skip_unmatchable(lf, this->get_min_next(lf.size()));
+        auto batch_end = std::min(lf.size(), std::max(start, end) + BATCH_SIZE);
+
+        lf.reobserve_range(lf.begin() + start, lf.begin() + batch_end);
+        if (this->get_min_next(lf.size()) == start &&
+            this->get_min_count(lf.size()) < end) {
+            log_warning("%s: unable to catch up filters at line %zu",
+                        lf.get_filename().c_str(),
+                        start);
+            break;
+        }
+    }
+
+    return true;
+}
+
+size_t line_filter_observer::skip_unmatchable(const logfile &lf, size_t start)
+{
+    const auto &ti = lf.get_trigram_index();
+    std::vector<std::pair<text_filter *, const trigram_index::query *>> waiting;
+    size_t limit = lf.size();
+
+    if (start >= ti.get_line_count()) {
+        return start;
+    }
+
+    for (auto &filter : this->lfo_filter_stack) {
+        if (filter->lf_deleted) {
+            continue;
+        }
+
+        auto index = filter->get_index();
+        auto count = this->lfo_filter_state.tfs_filter_count[index];
+
+        if (count + this->lfo_filter_state.tfs_lines_for_message[index] !=
+            start) {
+            // Lines that another filter has not seen yet cannot be skipped.
+            limit = std::min(limit, count);
+            continue;
+        }
+
+        auto tq = filter->get_trigram_query();
+
+        if (tq == nullptr) {
+            return start;
+        }
+        waiting.emplace_back(filter.get(), tq);
+    }
+
+    if (waiting.empty()) {
+        return start;
+    }
+
+    this->lfo_filter_state.resize(lf.size());
+
+    auto line = start;
+
+    while (line < limit) {
+        auto next = limit;
+
+        for (const auto &pair : waiting) {
+            next = std::min(next, pair.second->next_candidate(ti, line));
+        }
+        if (next == line) {
+            break;
+        }
+        for (; line < next; line++) {
+            for (const auto &pair : waiting) {
+                pair.first->add_line(
+                    this->lfo_filter_state, lf.begin() + line, false);
+            }
+        }
+    }
+
+    return line;
+}
@@ -77,6 +77,52 @@ public:
         return retval;
     };
 
+    /**
+     * @return The lowest line number that one of the filters still needs to
+     *   look at, including the lines of a message that is in progress.
+     */
+    size_t get_min_next(size_t max) const {
+        size_t retval = max;
+
+        for (auto &filter : this->lfo_filter_stack) {
+            if (filter->lf_deleted) {
+                continue;
+            }
+
+            auto index = filter->get_index();
+
+            retval = std::min(
+                retval,
+                this->lfo_filter_state.tfs_filter_count[index] +
+                this->lfo_filter_state.tfs_lines_for_message[index]);
+        }
+
+        return retval;
+    };
+
+    /**
+     * Run the filters that have fallen behind, like a newly added one, over
+     * the file until all of them have a result for the lines before "end".
+     * The lines are read in batches, so some results past "end" will also
+     * be filled in.
+     *
+     * @param deadline The time to stop at, checked between batches.
+     * @return False if the deadline was reached before catching up.
+     */
+    bool catch_up(logfile &lf,
+                  size_t end,
+                  nonstd::optional<ui_clock::time_point> deadline =
+                      nonstd::nullopt);
+
+    /**
+     * Use the file's trigram index to move the filters that are waiting for
+     * the given line past the lines that none of them can match, without
+     * reading those lines.
+     *
+     * @return The line where the filters need to start reading.
+     */
+    size_t skip_unmatchable(const logfile &lf, size_t start);
+
     void clear_deleted_filter_state() {
         uint32_t used_mask = 0;
 
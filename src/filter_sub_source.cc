@@ -398,20 +398,15 @@ void filter_sub_source::rl_change(readline_curses *rc)
         case filter_lang_t::NONE:
             break;
         case filter_lang_t::REGEX: {
-            auto_mem<pcre> code;
-            const char *errptr;
-            int eoff;
-
-            if ((code = pcre_compile(new_value.c_str(),
-                                     PCRE_CASELESS,
-                                     &errptr,
-                                     &eoff,
-                                     nullptr)) == nullptr) {
+            auto compile_res = pcre_registry::singleton().compile(
+                new_value, PCRE_CASELESS);
+
+            if (compile_res.isErr()) {
                 lnav_data.ld_filter_help_status_source.fss_error
-                    .set_value("error: %s", errptr);
+                    .set_value("error: %s", compile_res.unwrapErr().ce_msg);
             } else {
                 auto &hm = top_view->get_highlights();
-                highlighter hl(code.release());
+                highlighter hl(compile_res.unwrap());
                 int color;
 
                 if (tf->get_type() == text_filter::EXCLUDE) {
@@ -481,15 +476,10 @@ void filter_sub_source::rl_perform(readline_curses *rc)
         switch (tf->get_lang()) {
             case filter_lang_t::NONE:
             case filter_lang_t::REGEX: {
-                auto_mem<pcre> code;
-                const char *errptr;
-                int eoff;
-
-                if ((code = pcre_compile(new_value.c_str(),
-                                         PCRE_CASELESS,
-                                         &errptr,
-                                         &eoff,
-                                         nullptr)) == nullptr) {
+                auto compile_res = pcre_registry::singleton().compile(
+                    new_value, PCRE_CASELESS);
+
+                if (compile_res.isErr()) {
                     this->rl_abort(rc);
                 } else {
                     tf->lf_deleted = true;
@@ -497,7 +487,7 @@ void filter_sub_source::rl_perform(readline_curses *rc)
 
                     auto pf = make_shared<pcre_filter>(tf->get_type(),
                                                        new_value, tf->get_index(),
-                                                       code.release());
+                                                       pcrepp(compile_res.unwrap()));
 
                     *iter = pf;
                     tss->text_filters_changed();
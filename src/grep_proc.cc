@@ -36,8 +36,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <signal.h>
-#include <sys/wait.h>
+
+#include <chrono>
+#include <thread>
 
 #include "base/lnav_log.hh"
 #include "base/string_util.hh"
@@ -48,8 +49,8 @@
 using namespace std;
 
 template<typename LineType>
-grep_proc<LineType>::grep_proc(pcre *code, grep_proc_source<LineType> &gps)
-    : gp_pcre(code),
+grep_proc<LineType>::grep_proc(pcrepp code, grep_proc_source<LineType> &gps)
+    : gp_pcre(std::move(code)),
       gp_source(gps)
 {
     require(this->invariant());
@@ -63,201 +64,212 @@ grep_proc<LineType>::~grep_proc()
     this->invalidate();
 }
 
-template<typename LineType>
-void grep_proc<LineType>::handle_match(int line,
-                                       string &line_value,
-                                       int off,
-                                       int *matches,
-                                       int count)
-{
-    int lpc;
-
-    if (off == 0) {
-        fprintf(stdout, "%d\n", line);
-    }
-    fprintf(stdout, "[%d:%d]\n", matches[0], matches[1]);
-    for (lpc = 1; lpc < count; lpc++) {
-        fprintf(stdout,
-                "(%d:%d)",
-                matches[lpc * 2],
-                matches[lpc * 2 + 1]);
-        fwrite(&(line_value.c_str()[matches[lpc * 2]]),
-               1,
-               matches[lpc * 2 + 1] -
-               matches[lpc * 2],
-               stdout);
-        fputc('\n', stdout);
-    }
-}
-
 template<typename LineType>
 void grep_proc<LineType>::start()
 {
     require(this->invariant());
 
-    if (this->gp_child_started || this->gp_queue.empty()) {
+    if (this->gp_started || this->gp_queue.empty()) {
         return;
     }
 
-    auto_pipe in_pipe(STDIN_FILENO);
-    auto_pipe out_pipe(STDOUT_FILENO);
-    auto_pipe err_pipe(STDERR_FILENO);
-
-    /* Get ahold of some pipes for stdout and stderr. */
-    if (out_pipe.open() < 0) {
+    if (this->gp_notify_pipe.open() < 0) {
         throw error(errno);
     }
 
-    if (err_pipe.open() < 0) {
-        throw error(errno);
+    for (auto fd : {this->gp_notify_pipe.read_end().get(),
+                    this->gp_notify_pipe.write_end().get()}) {
+        log_perror(fcntl(fd, F_SETFL, O_NONBLOCK));
+        log_perror(fcntl(fd, F_SETFD, 1));
     }
 
-    if ((this->gp_child = fork()) < 0) {
-        throw error(errno);
+    this->gp_started = true;
+    this->gp_request_count = this->gp_queue.size();
+    this->gp_active_queue = std::move(this->gp_queue);
+    this->gp_queue.clear();
+    this->gp_read_line = nonstd::nullopt;
+
+    // Nothing has been read yet, so wake up the main loop to get going.
+    this->notify();
+}
+
+template<typename LineType>
+void grep_proc<LineType>::notify()
+{
+    if (write(this->gp_notify_pipe.write_end(), "", 1) == -1 &&
+        errno != EAGAIN) {
+        log_error("unable to notify grep_proc -- %s", strerror(errno));
     }
+}
+
+template<typename LineType>
+unique_ptr<typename grep_proc<LineType>::grep_chunk>
+grep_proc<LineType>::read_chunk()
+{
+    static const size_t MAX_CHUNK_LINES = 4 * 1024;
+    static const size_t MAX_CHUNK_BYTES = 1024 * 1024;
+
+    auto retval = make_unique<grep_chunk>();
+    size_t byte_count = 0;
 
-    in_pipe.after_fork(this->gp_child);
-    out_pipe.after_fork(this->gp_child);
-    err_pipe.after_fork(this->gp_child);
+    while (!this->gp_active_queue.empty() &&
+           retval->gc_lines.size() < MAX_CHUNK_LINES &&
+           byte_count < MAX_CHUNK_BYTES) {
+        LineType start_line = this->gp_active_queue.front().first;
+        LineType stop_line  = this->gp_active_queue.front().second;
 
-    if (this->gp_child != 0) {
-        log_perror(fcntl(out_pipe.read_end(), F_SETFL, O_NONBLOCK));
-        log_perror(fcntl(out_pipe.read_end(), F_SETFD, 1));
-        this->gp_line_buffer.set_fd(out_pipe.read_end());
+        if (!this->gp_read_line) {
+            this->gp_read_line = this->gp_source.grep_initial_line(
+                start_line, this->gp_highest_line);
+        }
 
-        log_perror(fcntl(err_pipe.read_end(), F_SETFL, O_NONBLOCK));
-        log_perror(fcntl(err_pipe.read_end(), F_SETFD, 1));
-        require(this->gp_err_pipe.get() == -1);
-        this->gp_err_pipe = std::move(err_pipe.read_end());
-        this->gp_child_started = true;
-        this->gp_child_queue_size = this->gp_queue.size();
+        LineType line = this->gp_read_line.value();
+        bool done = (line == -1 || (stop_line != -1 && line >= stop_line));
 
-        this->gp_queue.clear();
-        return;
-    }
+        if (!done) {
+            retval->gc_values.emplace_back();
 
-    /* In the child... */
+            auto &line_value = retval->gc_values.back();
 
-    /*
-     * Restore the default signal handlers so we don't hang around
-     * forever if there is a problem.
-     */
-    signal(SIGINT, SIG_DFL);
-    signal(SIGTERM, SIG_DFL);
+            if (this->gp_source.grep_value_for_line(line, line_value)) {
+                byte_count += line_value.size();
+                retval->gc_lines.push_back(line);
+            } else {
+                retval->gc_values.pop_back();
+                done = true;
+            }
+            this->gp_source.grep_next_line(line);
+            this->gp_read_line = line;
+        }
 
-    this->child_init();
+        if (done) {
+            if (stop_line == -1) {
+                // When scanning to the end of the source, we need to keep
+                // the highest line that was seen so that the next request
+                // that continues from the end works properly.
+                this->gp_highest_line = line - LineType(1);
+            }
+            this->gp_active_queue.pop_front();
+            this->gp_read_line = nonstd::nullopt;
+        }
+    }
 
-    this->child_loop();
+    if (retval->gc_lines.empty()) {
+        return nullptr;
+    }
 
-    _exit(0);
+    return retval;
 }
 
 template<typename LineType>
-void grep_proc<LineType>::child_loop()
+void grep_proc<LineType>::match_chunk(grep_chunk &chunk) const
 {
-    char   outbuf[BUFSIZ * 2];
-    string line_value;
-
-    /* Make sure buffering is on, not sure of the state in the parent. */
-    if (setvbuf(stdout, outbuf, _IOFBF, BUFSIZ * 2) < 0) {
-        perror("setvbuf");
-    }
-    lnav_log_file = fopen("/tmp/lnav.grep.err", "a");
-    line_value.reserve(BUFSIZ * 2);
-    while (!this->gp_queue.empty()) {
-        LineType start_line = this->gp_queue.front().first;
-        LineType stop_line  = this->gp_queue.front().second;
-        bool        done       = false;
-        LineType line;
-
-        this->gp_queue.pop_front();
-        for (line = this->gp_source.grep_initial_line(start_line, this->gp_highest_line);
-             line != -1 && (stop_line == -1 || line < stop_line) && !done;
-             this->gp_source.grep_next_line(line)) {
-            line_value.clear();
-            done = !this->gp_source.grep_value_for_line(line, line_value);
-            if (!done) {
-                pcre_context_static<128> pc;
-                pcre_input pi(line_value);
-
-                while (this->gp_pcre.match(pc, pi)) {
-                    pcre_context::iterator   pc_iter;
-                    pcre_context::capture_t *m;
-
-                    if (pi.pi_offset == 0) {
-                        fprintf(stdout, "%d\n", (int) line);
-                    }
-                    m = pc.all();
-                    fprintf(stdout, "[%d:%d]\n", m->c_begin, m->c_end);
-                    for (pc_iter = pc.begin(); pc_iter != pc.end();
-                         pc_iter++) {
-                        if (!pc_iter->is_valid()) {
-                            continue;
-                        }
-                        fprintf(stdout,
-                                "(%d:%d)",
-                                pc_iter->c_begin,
-                                pc_iter->c_end);
-
-                        /* If the capture was conditional, pcre will return a -1
-                         * here.
-                         */
-                        if (pc_iter->c_begin >= 0) {
-                            fwrite(pi.get_substr_start(pc_iter),
-                                   1,
-                                   pc_iter->length(),
-                                   stdout);
-                        }
-                        fputc('\n', stdout);
-                    }
-                    fprintf(stdout, "/\n");
+    for (uint32_t lpc = 0; lpc < chunk.gc_values.size(); lpc++) {
+        pcre_context_static<128> pc;
+        pcre_input pi(chunk.gc_values[lpc]);
+
+        while (this->gp_pcre.match(pc, pi)) {
+            auto m = pc.all();
+
+            chunk.gc_results.push_back({
+                result_kind::MATCH, lpc, m->c_begin, m->c_end,
+            });
+            for (auto pc_iter = pc.begin(); pc_iter != pc.end(); pc_iter++) {
+                if (!pc_iter->is_valid()) {
+                    continue;
                 }
+                chunk.gc_results.push_back({
+                    result_kind::CAPTURE, lpc, pc_iter->c_begin, pc_iter->c_end,
+                });
             }
+            chunk.gc_results.push_back({
+                result_kind::MATCH_END, lpc, 0, 0,
+            });
+        }
+    }
+}
+
+template<typename LineType>
+void grep_proc<LineType>::dispatch_chunk(const grep_chunk &chunk)
+{
+    auto res_iter = chunk.gc_results.cbegin();
+
+    for (uint32_t lpc = 0; lpc < chunk.gc_lines.size(); lpc++) {
+        LineType line = chunk.gc_lines[lpc];
+        bool stale = chunk.is_requeued(line);
+        bool matched = false;
+
+        for (; res_iter != chunk.gc_results.cend() &&
+               res_iter->gr_value_index == lpc;
+             ++res_iter) {
+            const auto &res = *res_iter;
 
-            if (((line + 1) % 10000) == 0) {
-                /* Periodically flush the buffer so the parent sees progress */
-                this->child_batch();
+            if (stale) {
+                continue;
+            }
+
+            switch (res.gr_kind) {
+                case result_kind::MATCH:
+                    require(res.gr_start >= 0);
+                    require(res.gr_end >= 0);
+
+                    matched = true;
+                    this->gp_sink->grep_match(*this, line, res.gr_start, res.gr_end);
+                    break;
+                case result_kind::CAPTURE: {
+                    /* If the capture was conditional, pcre will return a -1
+                     * here.
+                     */
+                    if (res.gr_start < 0) {
+                        this->gp_sink->grep_capture(*this,
+                                                    line,
+                                                    res.gr_start,
+                                                    res.gr_end,
+                                                    nullptr);
+                        break;
+                    }
+
+                    auto capture = chunk.gc_values[lpc].substr(
+                        res.gr_start, res.gr_end - res.gr_start);
+
+                    this->gp_sink->grep_capture(*this,
+                                                line,
+                                                res.gr_start,
+                                                res.gr_end,
+                                                &capture[0]);
+                    break;
+                }
+                case result_kind::MATCH_END:
+                    this->gp_sink->grep_match_end(*this, line);
+                    break;
             }
         }
 
-        if (stop_line == -1) {
-            // When scanning to the end of the source, we need to return the
-            // highest line that was seen so that the next request that
-            // continues from the end works properly.
-            fprintf(stdout, "h%d\n", line - 1);
+        if (!stale) {
+            this->gp_sink->grep_line_searched(*this, line, matched);
         }
-        this->child_term();
     }
 }
 
 template<typename LineType>
 void grep_proc<LineType>::cleanup()
 {
-    if (this->gp_child != -1 && this->gp_child != 0) {
-        int status = 0;
+    // The futures wait for their workers to finish when they are destroyed.
+    this->gp_chunks.clear();
 
-        kill(this->gp_child, SIGTERM);
-        while (waitpid(this->gp_child, &status, 0) < 0 && (errno == EINTR)) {
-            ;
-        }
-        require(!WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT);
-        this->gp_child         = -1;
-        this->gp_child_started = false;
+    if (this->gp_started) {
+        this->gp_started = false;
+        this->gp_active_queue.clear();
+        this->gp_read_line = nonstd::nullopt;
+        this->gp_notify_pipe.close();
 
         if (this->gp_sink) {
-            for (size_t lpc = 0; lpc < this->gp_child_queue_size; lpc++) {
+            for (size_t lpc = 0; lpc < this->gp_request_count; lpc++) {
                 this->gp_sink->grep_end(*this);
             }
         }
     }
 
-    if (this->gp_err_pipe != -1) {
-        this->gp_err_pipe.reset();
-    }
-
-    this->gp_pipe_range.clear();
-    this->gp_line_buffer.reset();
-
     ensure(this->invariant());
 
     if (!this->gp_queue.empty()) {
@@ -266,128 +278,72 @@ void grep_proc<LineType>::cleanup()
 }
 
 template<typename LineType>
-void grep_proc<LineType>::dispatch_line(char *line)
+void grep_proc<LineType>::check_poll_set(const std::vector<struct pollfd> &pollfds)
 {
-    int start, end, capture_start;
+    static const auto TIME_SLICE = std::chrono::milliseconds(10);
 
-    require(line != nullptr);
+    require(this->invariant());
 
-    if (sscanf(line, "h%d", this->gp_highest_line.out()) == 1) {
-    } else if (sscanf(line, "%d", this->gp_last_line.out()) == 1) {
-        /* Starting a new line with matches. */
-        ensure(this->gp_last_line >= 0);
+    if (!this->gp_started ||
+        !pollfd_ready(pollfds, this->gp_notify_pipe.read_end())) {
+        return;
     }
-    else if (sscanf(line, "[%d:%d]", &start, &end) == 2) {
-        require(start >= 0);
-        require(end >= 0);
 
-        /* Pass the match offsets to the sink delegate. */
-        if (this->gp_sink != nullptr) {
-            this->gp_sink->grep_match(*this, this->gp_last_line, start, end);
-        }
-    }
-    else if (sscanf(line, "(%d:%d)%n", &start, &end, &capture_start) == 2) {
-        require(start == -1 || start >= 0);
-        require(end >= 0);
+    char buffer[1024];
 
-        /* Pass the captured strings to the sink delegate. */
-        if (this->gp_sink != nullptr) {
-            this->gp_sink->grep_capture(*this,
-                                        this->gp_last_line,
-                                        start,
-                                        end,
-                                        start < 0 ?
-                                        nullptr : &line[capture_start]);
-        }
-    }
-    else if (line[0] == '/') {
-        if (this->gp_sink != nullptr) {
-            this->gp_sink->grep_match_end(*this, this->gp_last_line);
-        }
+    while (read(this->gp_notify_pipe.read_end(), buffer, sizeof(buffer)) > 0) {
     }
-    else {
-        log_error("bad line from child -- %s", line);
-    }
-}
 
-template<typename LineType>
-void grep_proc<LineType>::check_poll_set(const std::vector<struct pollfd> &pollfds)
-{
-    require(this->invariant());
+    bool dispatched = false;
 
-    if (this->gp_err_pipe != -1 && pollfd_ready(pollfds, this->gp_err_pipe)) {
-        char buffer[1024 + 1];
-        ssize_t rc;
+    // Pass on the results of the chunks that are done, in order.
+    while (!this->gp_chunks.empty() &&
+           this->gp_chunks.front().first->gc_matched) {
+        auto &front = this->gp_chunks.front();
 
-        rc = read(this->gp_err_pipe, buffer, sizeof(buffer) - 1);
-        if (rc > 0) {
-            static const char *PREFIX = ": ";
-
-            buffer[rc] = '\0';
-            if (strncmp(buffer, PREFIX, strlen(PREFIX)) == 0) {
-                char *lf;
-
-                if ((lf = strchr(buffer, '\n')) != nullptr) {
-                    *lf = '\0';
-                }
-                if (this->gp_control != nullptr) {
-                    this->gp_control->grep_error(&buffer[strlen(PREFIX)]);
-                }
-            }
-        }
-        else if (rc == 0) {
-            this->gp_err_pipe.reset();
+        front.second.wait();
+        if (this->gp_sink != nullptr) {
+            this->dispatch_chunk(*front.first);
         }
+        this->gp_chunks.pop_front();
+        dispatched = true;
     }
 
-    if (this->gp_line_buffer.get_fd() != -1 &&
-        pollfd_ready(pollfds, this->gp_line_buffer.get_fd())) {
-        try {
-            static const int MAX_LOOPS = 100;
-
-            int loop_count = 0;
-            bool drained = false;
-
-            while (loop_count < MAX_LOOPS) {
-                auto load_result = this->gp_line_buffer
-                    .load_next_line(this->gp_pipe_range);
-
-                if (load_result.isErr()) {
-                    break;
-                }
-
-                auto li = load_result.unwrap();
+    // Keep the workers busy with more lines, the source can only be read
+    // from this thread, so limit the time spent to keep the UI responsive.
+    size_t max_chunks = std::max(1U, std::thread::hardware_concurrency());
+    auto deadline = std::chrono::steady_clock::now() + TIME_SLICE;
 
-                if (li.li_file_range.empty()) {
-                    drained = true;
-                    break;
-                }
+    while (!this->gp_active_queue.empty() &&
+           this->gp_chunks.size() < max_chunks &&
+           std::chrono::steady_clock::now() < deadline) {
+        auto chunk = this->read_chunk();
 
-                this->gp_pipe_range = li.li_file_range;
-                this->gp_line_buffer.read_range(li.li_file_range).then([this](auto sbr) {
-                    auto_mem<char> buf;
+        if (chunk == nullptr) {
+            break;
+        }
 
-                    buf = (char *) malloc(sbr.length() + 1);
-                    sbr.rtrim(is_line_ending);
-                    memcpy(buf, sbr.get_data(), sbr.length());
-                    buf[sbr.length()] = '\0';
-                    this->dispatch_line(buf);
-                });
+        auto *chunk_ptr = chunk.get();
 
-                loop_count += 1;
-            }
+        this->gp_chunks.emplace_back(
+            std::move(chunk),
+            std::async(std::launch::async, [this, chunk_ptr]() {
+                this->match_chunk(*chunk_ptr);
+                chunk_ptr->gc_matched = true;
+                this->notify();
+            }));
+    }
 
-            if (this->gp_sink != nullptr) {
-                this->gp_sink->grep_end_batch(*this);
-            }
+    if (dispatched && this->gp_sink != nullptr) {
+        this->gp_sink->grep_end_batch(*this);
+    }
 
-            if (drained && this->gp_line_buffer.is_pipe_closed()) {
-                this->cleanup();
-            }
-        }
-        catch (line_buffer::error & e) {
-            this->cleanup();
-        }
+    if (this->gp_active_queue.empty() && this->gp_chunks.empty()) {
+        this->cleanup();
+    } else if (!this->gp_active_queue.empty() &&
+               this->gp_chunks.size() < max_chunks) {
+        // There is still room for more work, so come back around.
+        this->notify();
     }
 
     ensure(this->invariant());
@@ -45,17 +45,20 @@
 #include <pcre/pcre.h>
 #endif
 
+#include <atomic>
 #include <deque>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 #include <exception>
 
+#include "optional.hpp"
 #include "pcrepp/pcrepp.hh"
 #include "auto_fd.hh"
 #include "auto_mem.hh"
 #include "base/lnav_log.hh"
 #include "strong_int.hh"
-#include "line_buffer.hh"
 
 template<typename LineType>
 class grep_proc;
@@ -152,14 +155,26 @@ public:
                               char *capture) { };
 
     virtual void grep_match_end(grep_proc<LineType> &gp, LineType line) { };
+
+    /**
+     * Called after the matches for a line have been passed on.  Lines that
+     * were queued again while they were being searched are not reported
+     * until they have been searched again.
+     *
+     * @param line The line that was searched.
+     * @param matched True if there was at least one match in the line.
+     */
+    virtual void grep_line_searched(grep_proc<LineType> &gp,
+                                    LineType line,
+                                    bool matched) { };
 };
 
 /**
- * "Grep" that runs in a separate process so it doesn't stall user-interaction.
- * This class manages the child process and any interactions between the parent
- * and child.  The source data to be matched comes from the grep_proc_source
- * delegate and the results are sent to the grep_proc_sink delegate in the
- * parent process.
+ * "Grep" that runs in the background so it doesn't stall user-interaction.
+ * The lines to be matched are read from the grep_proc_source delegate on
+ * the main thread in chunks that are handed off to worker threads.  The
+ * results of each chunk are then passed, in order, to the grep_proc_sink
+ * delegate on the main thread.
  *
  * Note: The "grep" executable is not actually used, instead we use the pcre(3)
  * library directly.
@@ -178,12 +193,12 @@ public:
 
     /**
      * Construct a grep_proc object.  You must call the start() method
-     * to fork off the child process and begin processing.
+     * to begin processing.
      *
-     * @param code The pcre code to run over the lines of input.
+     * @param code The pattern to run over the lines of input.
      * @param gps The source of the data to match.
      */
-    grep_proc(pcre *code, grep_proc_source<LineType> &gps);
+    grep_proc(pcrepp code, grep_proc_source<LineType> &gps);
 
     virtual ~grep_proc();
 
@@ -218,6 +233,13 @@ public:
         require(stop == -1 || start < stop);
 
         this->gp_queue.emplace_back(start, stop);
+        if (start != -1) {
+            // The lines might have changed since they were read, so the
+            // results for them in the chunks that are out are stale.
+            for (auto &chunk : this->gp_chunks) {
+                chunk.first->gc_requeued.emplace_back(start, stop);
+            }
+        }
         if (this->gp_sink) {
             this->gp_sink->grep_begin(*this, start, stop);
         }
@@ -232,16 +254,9 @@ public:
 
     void update_poll_set(std::vector<struct pollfd> &pollfds)
     {
-        if (this->gp_line_buffer.get_fd() != -1) {
+        if (this->gp_notify_pipe.read_end() != -1) {
             pollfds.push_back((struct pollfd) {
-                    this->gp_line_buffer.get_fd(),
-                    POLLIN,
-                    0
-            });
-        }
-        if (this->gp_err_pipe != -1) {
-            pollfds.push_back((struct pollfd) {
-                    this->gp_err_pipe,
+                    this->gp_notify_pipe.read_end(),
                     POLLIN,
                     0
             });
@@ -258,70 +273,113 @@ public:
     /** Check the invariants for this object. */
     bool invariant()
     {
-        if (this->gp_child_started) {
-            require(this->gp_child > 0);
-            require(this->gp_line_buffer.get_fd() != -1);
+        if (this->gp_started) {
+            require(this->gp_notify_pipe.read_end() != -1);
         }
         else {
-            /* require(this->gp_child == -1); XXX doesnt work with static destr */
-            require(this->gp_line_buffer.get_fd() == -1);
+            require(this->gp_notify_pipe.read_end() == -1);
+            require(this->gp_chunks.empty());
         }
 
         return true;
     };
 
 protected:
+    /** The kinds of results produced by the workers. */
+    enum class result_kind : uint8_t {
+        MATCH,
+        CAPTURE,
+        MATCH_END,
+    };
 
     /**
-     * Dispatch a line received from the child.
+     * A match, capture, or end-of-matches for a line in a chunk.  The
+     * offsets are relative to the start of the line's value.
      */
-    void dispatch_line(char *line);
+    struct grep_result {
+        result_kind gr_kind;
+        uint32_t gr_value_index;
+        int gr_start;
+        int gr_end;
+    };
+
+    /** A batch of lines to be matched by a worker. */
+    struct grep_chunk {
+        std::vector<LineType> gc_lines;
+        std::vector<std::string> gc_values;
+        std::vector<grep_result> gc_results;
+        /** Set by the worker once gc_results is filled in. */
+        std::atomic<bool> gc_matched{false};
+        /**
+         * The ranges of lines that were queued again after this chunk was
+         * read, only touched by the main thread.
+         */
+        std::vector<std::pair<LineType, LineType>> gc_requeued;
+
+        bool is_requeued(LineType line) const {
+            for (const auto &range : this->gc_requeued) {
+                if (range.first <= line &&
+                    (range.second == -1 || line < range.second)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+    };
 
     /**
-     * Free any resources used by the object and make sure the child has been
-     * terminated.
+     * Read the next chunk of lines from the source.
+     *
+     * @return The chunk or nullptr if there are no more lines to read.
      */
-    void cleanup();
+    std::unique_ptr<grep_chunk> read_chunk();
 
-    void child_loop();
+    /** Match the lines in a chunk, called from a worker thread. */
+    void match_chunk(grep_chunk &chunk) const;
 
-    virtual void child_init() { };
+    /** Pass the results of a chunk on to the sink. */
+    void dispatch_chunk(const grep_chunk &chunk);
 
-    virtual void child_batch() { fflush(stdout); };
+    /** Wake up the poll() in the main loop. */
+    void notify();
 
-    virtual void child_term() { fflush(stdout); };
-
-    virtual void handle_match(int line,
-                              std::string &line_value,
-                              int off,
-                              int *matches,
-                              int count);
+    /**
+     * Free any resources used by the object and wait for any workers to
+     * finish.
+     */
+    void cleanup();
 
     pcrepp             gp_pcre;
     grep_proc_source<LineType> &gp_source;        /*< The data source delegate. */
 
-    auto_fd     gp_err_pipe;             /*< Standard error from the child. */
-    line_buffer gp_line_buffer;          /*< Standard out from the child. */
-    file_range  gp_pipe_range;
+    auto_pipe gp_notify_pipe;            /*<
+                                          * Written to by the workers when
+                                          * a chunk is finished.
+                                          */
 
-    pid_t gp_child{-1};                     /*<
-                                         * The child's pid or zero in the
-                                         * child.
-                                         */
-    bool     gp_child_started{false};          /*< True if the child was start()'d. */
-    size_t gp_child_queue_size{0};
+    bool     gp_started{false};          /*< True if the search was start()'d. */
+    size_t gp_request_count{0};         /*< The number of requests started. */
+
+    /** The requests that are currently being worked on. */
+    std::deque<std::pair<LineType, LineType> > gp_active_queue;
+    nonstd::optional<LineType> gp_read_line; /*<
+                                              * The next line to read for the
+                                              * front of the active queue.
+                                              */
+    /**
+     * The chunks being matched by workers, in line order.  The future is
+     * for the worker and the pair is ordered so that it is waited on before
+     * the chunk is freed.
+     */
+    std::deque<std::pair<std::unique_ptr<grep_chunk>, std::future<void>>>
+        gp_chunks;
 
     /** The queue of search requests. */
     std::deque<std::pair<LineType, LineType> > gp_queue;
-    LineType gp_last_line{0};           /*<
-                                         * The last line number received from
-                                         * the child.  For multiple matches,
-                                         * the line number is only sent once.
-                                         */
     LineType gp_highest_line;        /*< The highest numbered line processed
-                                         * by the grep child process.  This
-                                         * value is used when the start line
-                                         * for a queued request is -1.
+                                         * by the search.  This value is used
+                                         * when the start line for a queued
+                                         * request is -1.
                                          */
     grep_proc_sink<LineType> *gp_sink{nullptr};         /*< The sink delegate. */
     grep_proc_control *gp_control{nullptr};      /*< The control delegate. */
@@ -31,66 +31,6 @@
 
 #include "highlighter.hh"
 
-highlighter::highlighter(const highlighter &other)
-{
-    this->h_pattern = other.h_pattern;
-    this->h_fg = other.h_fg;
-    this->h_bg = other.h_bg;
-    this->h_role = other.h_role;
-    this->h_code = other.h_code;
-    pcre_refcount(this->h_code, 1);
-    this->study();
-    this->h_attrs = other.h_attrs;
-    this->h_text_formats = other.h_text_formats;
-    this->h_format_name = other.h_format_name;
-    this->h_nestable = other.h_nestable;
-}
-
-highlighter &highlighter::operator=(const highlighter &other)
-{
-    if (this == &other) {
-        return *this;
-    }
-
-    if (this->h_code != nullptr && pcre_refcount(this->h_code, -1) == 0) {
-        free(this->h_code);
-        this->h_code = nullptr;
-    }
-    free(this->h_code_extra);
-
-    this->h_pattern = other.h_pattern;
-    this->h_fg = other.h_fg;
-    this->h_bg = other.h_bg;
-    this->h_role = other.h_role;
-    this->h_code = other.h_code;
-    pcre_refcount(this->h_code, 1);
-    this->study();
-    this->h_format_name = other.h_format_name;
-    this->h_attrs = other.h_attrs;
-    this->h_text_formats = other.h_text_formats;
-    this->h_nestable = other.h_nestable;
-
-    return *this;
-}
-
-void highlighter::study()
-{
-    const char *errptr;
-
-    this->h_code_extra = pcre_study(this->h_code, 0, &errptr);
-    if (!this->h_code_extra && errptr) {
-        log_error("pcre_study error: %s", errptr);
-    }
-    if (this->h_code_extra != nullptr) {
-        pcre_extra *extra = this->h_code_extra;
-
-        extra->flags |= (PCRE_EXTRA_MATCH_LIMIT |
-                         PCRE_EXTRA_MATCH_LIMIT_RECURSION);
-        extra->match_limit           = 10000;
-        extra->match_limit_recursion = 500;
-    }
-}
-
 void highlighter::annotate(attr_line_t &al, int start) const
 {
     auto &vc = view_colors::singleton();
@@ -107,14 +47,28 @@ void highlighter::annotate(attr_line_t &al, int start) const
         re_end = str.length() - start;
     for (int off = 0; off < (int)str.size() - start; ) {
         int rc, matches[60];
-        rc = pcre_exec(this->h_code,
-                       this->h_code_extra,
-                       line_start,
-                       re_end,
-                       off,
-                       0,
-                       matches,
-                       60);
+
+        if (this->h_compiled != nullptr && this->h_compiled->is_literal()) {
+            auto lit_start = this->h_compiled->find_literal(
+                line_start, re_end, off);
+
+            if (lit_start == -1) {
+                rc = PCRE_ERROR_NOMATCH;
+            } else {
+                rc = 1;
+                matches[0] = lit_start;
+                matches[1] = lit_start + this->h_compiled->pc_literal.size();
+            }
+        } else {
+            rc = pcre_exec(this->h_code,
+                           this->h_code_extra,
+                           line_start,
+                           re_end,
+                           off,
+                           0,
+                           matches,
+                           60);
+        }
         if (rc > 0) {
             struct line_range lr;
 
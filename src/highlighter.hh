@@ -40,30 +40,22 @@
 #include "view_curses.hh"
 
 struct highlighter {
-    highlighter()
-        : h_code(nullptr),
-          h_code_extra(nullptr) { };
+    highlighter() = default;
 
     explicit highlighter(pcre *code)
-        : h_code(code)
-    {
-        pcre_refcount(this->h_code, 1);
-        this->study();
-    };
+        : h_compiled(pcre_compiled::wrap(code)),
+          h_code(h_compiled->pc_code),
+          h_code_extra(h_compiled->pc_extra) { };
 
-    highlighter(const highlighter &other);
+    explicit highlighter(std::shared_ptr<const pcre_compiled> compiled)
+        : h_compiled(std::move(compiled)),
+          h_code(h_compiled->pc_code),
+          h_code_extra(h_compiled->pc_extra) { };
 
-    highlighter &operator=(const highlighter &other);
-
-    virtual ~highlighter() {
-        if (this->h_code != nullptr && pcre_refcount(this->h_code, -1) == 0) {
-            free(this->h_code);
-            this->h_code = nullptr;
-        }
-        free(this->h_code_extra);
-    };
+    explicit highlighter(const pcrepp &re)
+        : highlighter(re.p_compiled) { };
 
-    void study();
+    virtual ~highlighter() = default;
 
     highlighter &with_pattern(const std::string &pattern) {
         this->h_pattern = pattern;
@@ -120,8 +112,9 @@ struct highlighter {
     view_colors::role_t h_role{view_colors::VCR_NONE};
     styling::color_unit h_fg{styling::color_unit::make_empty()};
     styling::color_unit h_bg{styling::color_unit::make_empty()};
-    pcre *h_code;
-    pcre_extra *h_code_extra;
+    std::shared_ptr<const pcre_compiled> h_compiled;
+    pcre *h_code{nullptr};
+    const pcre_extra *h_code_extra{nullptr};
     int h_attrs{-1};
     std::set<text_format_t> h_text_formats;
     intern_string_t h_format_name;
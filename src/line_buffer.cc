@@ -36,19 +36,25 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #ifdef HAVE_BZLIB_H
 #include <bzlib.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <mutex>
 #include <set>
-
-#ifdef HAVE_X86INTRIN_H
-#include "simdutf8check.h"
-#endif
+#include <thread>
 
 #include "base/math_util.hh"
-#include "base/is_utf8.hh"
+#include "base/lnav.utf8.hh"
+#include "auto_mem.hh"
 #include "line_buffer.hh"
 #include "fmtlib/fmt/format.h"
 
@@ -57,65 +63,6 @@ using namespace std;
 static const ssize_t DEFAULT_INCREMENT          = 128 * 1024;
 static const ssize_t MAX_COMPRESSED_BUFFER_SIZE = 32 * 1024 * 1024;
 
-/*
- * XXX REMOVE ME
- *
- * The stock bzipped file code does not use pread, so we need to use a lock to
- * get exclusive access to the file.  In the future, we should just rewrite
- * the bzipped file code to use pread.
- */
-class lock_hack {
-public:
-    class guard {
-public:
-
-        guard() : g_lock(lock_hack::singleton())
-        {
-            this->g_lock.lock();
-        };
-
-        ~guard()
-        {
-            this->g_lock.unlock();
-        };
-
-private:
-        lock_hack &g_lock;
-    };
-
-    static lock_hack &singleton()
-    {
-        static lock_hack retval;
-
-        return retval;
-    };
-
-    void lock()
-    {
-        lockf(this->lh_fd, F_LOCK, 0);
-    };
-
-    void unlock()
-    {
-        lockf(this->lh_fd, F_ULOCK, 0);
-    };
-
-private:
-
-    lock_hack()
-    {
-        char lockname[64];
-
-        snprintf(lockname, sizeof(lockname), "/tmp/lnav.%d.lck", getpid());
-        this->lh_fd = open(lockname, O_CREAT | O_RDWR, 0600);
-        log_perror(fcntl(this->lh_fd, F_SETFD, FD_CLOEXEC));
-        unlink(lockname);
-    };
-
-    auto_fd lh_fd;
-};
-/* XXX END */
-
 static int32_t read_le32(const unsigned char *data)
 {
     return (
@@ -141,6 +88,11 @@ void line_buffer::gz_indexed::close()
         inflateEnd(&this->strm);
         ::close(this->gz_fd);
         this->syncpoints.clear();
+        this->gz_members.clear();
+        this->gz_decoded.clear();
+        this->gz_member_mode = false;
+        this->gz_bgzf = false;
+        this->gz_members_eof = false;
         this->gz_fd = -1;
     }
 }
@@ -186,6 +138,7 @@ void line_buffer::gz_indexed::open(int fd)
     this->close();
     this->init_stream();
     this->gz_fd = fd;
+    this->detect_members();
 }
 
 int line_buffer::gz_indexed::stream_data(void * buf, size_t size)
@@ -281,6 +234,20 @@ void line_buffer::gz_indexed::seek(off_t offset)
 
 int line_buffer::gz_indexed::read(void * buf, size_t offset, size_t size)
 {
+    if (this->gz_member_mode) {
+        auto rc = this->read_members(buf, offset, size);
+
+        if (rc != -1) {
+            return rc;
+        }
+
+        // The stream decoder handles anything the member reader cannot.
+        log_info("falling back to inflating gzip file serially");
+        this->gz_member_mode = false;
+        this->gz_members.clear();
+        this->gz_decoded.clear();
+    }
+
     if (offset != this->strm.total_out) {
         this->seek(offset);
     }
@@ -290,9 +257,828 @@ int line_buffer::gz_indexed::read(void * buf, size_t offset, size_t size)
     return bytes;
 }
 
+namespace {
+
+const char SYNCPOINTS_MAGIC[8] = "lnavgzs";
+const uint32_t SYNCPOINTS_VERSION = 1;
+
+struct syncpoints_header {
+    char sh_magic[8]{};
+    uint32_t sh_version{SYNCPOINTS_VERSION};
+    uint32_t sh_dict_size{sizeof(line_buffer::gz_indexed::indexDict)};
+    file_size_t sh_file_size{0};
+    uint64_t sh_count{0};
+};
+
+}
+
+Result<void, std::string>
+line_buffer::gz_indexed::save_syncpoints(const std::string &path,
+                                         file_size_t file_size) const
+{
+    auto_mem<gzFile_s> gz(gzclose);
+    syncpoints_header sh;
+
+    memcpy(sh.sh_magic, SYNCPOINTS_MAGIC, sizeof(sh.sh_magic));
+    sh.sh_file_size = file_size;
+    sh.sh_count = this->syncpoints.size();
+
+    if ((gz = gzopen(path.c_str(), "wb")) == nullptr) {
+        return Err(fmt::format("unable to open syncpoints file: {} -- {}",
+                               path, strerror(errno)));
+    }
+
+    auto ok = gzwrite(gz, &sh, sizeof(sh)) == sizeof(sh);
+    for (const auto &dict : this->syncpoints) {
+        if (!ok) {
+            break;
+        }
+        ok = gzwrite(gz, &dict, sizeof(dict)) == sizeof(dict);
+    }
+    if (gzclose(gz.release()) != Z_OK || !ok) {
+        return Err(fmt::format("unable to write syncpoints file: {}", path));
+    }
+
+    return Ok();
+}
+
+Result<void, std::string>
+line_buffer::gz_indexed::load_syncpoints(const std::string &path,
+                                         file_size_t file_size)
+{
+    auto_mem<gzFile_s> gz(gzclose);
+    syncpoints_header sh;
+
+    if ((gz = gzopen(path.c_str(), "rb")) == nullptr) {
+        return Err(fmt::format("unable to open syncpoints file: {} -- {}",
+                               path, strerror(errno)));
+    }
+
+    if (gzread(gz, &sh, sizeof(sh)) != sizeof(sh) ||
+        memcmp(sh.sh_magic, SYNCPOINTS_MAGIC, sizeof(sh.sh_magic)) != 0 ||
+        sh.sh_version != SYNCPOINTS_VERSION ||
+        sh.sh_dict_size != sizeof(indexDict)) {
+        return Err(fmt::format("incompatible syncpoints file: {}", path));
+    }
+    // Syncpoints are at least SYNCPOINT_SIZE bytes apart in the input.
+    if (sh.sh_file_size != file_size ||
+        sh.sh_count > (uint64_t) file_size / SYNCPOINT_SIZE + 1) {
+        return Err(fmt::format("syncpoints are for a different file: {}",
+                               path));
+    }
+
+    std::vector<indexDict> dicts(sh.sh_count);
+    for (auto &dict : dicts) {
+        if (gzread(gz, &dict, sizeof(dict)) != sizeof(dict)) {
+            return Err(fmt::format("truncated syncpoints file: {}", path));
+        }
+    }
+
+    if (dicts.size() > this->syncpoints.size()) {
+        this->syncpoints = std::move(dicts);
+    }
+
+    return Ok();
+}
+
+/**
+ * @param max_threads The limit set by line_buffer::set_decode_threads() or
+ *   zero for no limit.
+ * @return The number of members or blocks to decode at a time, one per
+ *   thread.
+ */
+static size_t decode_batch_size(size_t max_threads = 0)
+{
+    // hardware_concurrency() can return zero if the count is not known.
+    size_t retval = std::max(2U, std::thread::hardware_concurrency());
+
+    if (max_threads > 0) {
+        retval = std::min(retval, max_threads);
+    }
+
+    return retval;
+}
+
+/** The size of the fixed part of a gzip member header. */
+static const size_t GZ_MEMBER_HEADER_SIZE = 10;
+/** The smallest possible member: a header, an empty block, and a trailer. */
+static const file_size_t GZ_MEMBER_MIN_SIZE = GZ_MEMBER_HEADER_SIZE + 2 + 8;
+/** Members larger than this are left to the stream decoder. */
+static const file_size_t GZ_MEMBER_MAX_SIZE = 4 * 1024 * 1024;
+static const size_t GZ_MEMBER_MAX_OUTPUT = 64 * 1024 * 1024;
+
+static bool is_member_header(const unsigned char *data)
+{
+    // The magic number, the deflate method, no reserved flags, and one of
+    // the defined values for the extra flags.
+    return data[0] == 0x1f && data[1] == 0x8b && data[2] == Z_DEFLATED &&
+           (data[3] & 0xe0) == 0 &&
+           (data[8] == 0 || data[8] == 2 || data[8] == 4);
+}
+
+static Result<std::vector<char>, std::string>
+inflate_member(int fd, file_off_t in, file_size_t in_size)
+{
+    std::vector<unsigned char> inbuf(in_size);
+    std::vector<char> retval;
+    z_stream strm;
+
+    if (pread(fd, inbuf.data(), in_size, in) != (ssize_t) in_size) {
+        return Err(fmt::format("unable to read gzip member at {} -- {}",
+                               in, strerror(errno)));
+    }
+
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, GZ_HEADER_MODE) != Z_OK) {
+        return Err(std::string("unable to initialize inflate"));
+    }
+
+    strm.next_in = inbuf.data();
+    strm.avail_in = in_size;
+
+    size_t used = 0;
+    auto rc = Z_OK;
+    while (rc == Z_OK) {
+        if (used == retval.size()) {
+            if (retval.size() >= GZ_MEMBER_MAX_OUTPUT) {
+                break;
+            }
+            retval.resize(std::max(retval.size() * 2,
+                                   (size_t) std::max((file_size_t) Z_BUFSIZE,
+                                                     in_size * 4)));
+        }
+        strm.next_out = (Bytef *) &retval[used];
+        strm.avail_out = retval.size() - used;
+        rc = inflate(&strm, Z_NO_FLUSH);
+        used = retval.size() - strm.avail_out;
+    }
+    auto leftover = strm.avail_in;
+    inflateEnd(&strm);
+
+    if (rc != Z_STREAM_END) {
+        return Err(fmt::format("unable to decompress gzip member at {} -- {}",
+                               in, rc));
+    }
+    if (leftover != 0) {
+        return Err(fmt::format("gzip member at {} has {} trailing bytes",
+                               in, leftover));
+    }
+
+    retval.resize(used);
+
+    return Ok(std::move(retval));
+}
+
+void line_buffer::gz_indexed::detect_members()
+{
+    struct stat st;
+
+    if (fstat(this->gz_fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+    this->gz_file_size = st.st_size;
+
+    if (this->bgzf_member_size(0)) {
+        log_info("gzip file is in BGZF format, decompressing blocks in "
+                 "parallel");
+        this->gz_member_mode = true;
+        this->gz_bgzf = true;
+        return;
+    }
+
+    auto next = this->find_member_start(GZ_MEMBER_MIN_SIZE,
+                                        GZ_MEMBER_MAX_SIZE);
+    if (next && (file_size_t) *next < this->gz_file_size) {
+        log_info("gzip file has multiple members, decompressing them in "
+                 "parallel");
+        this->gz_member_mode = true;
+    }
+}
+
+nonstd::optional<file_off_t>
+line_buffer::gz_indexed::find_member_start(file_off_t from,
+                                           file_off_t limit) const
+{
+    unsigned char buffer[Z_BUFSIZE];
+    auto off = from;
+
+    limit = std::min(limit, (file_off_t) this->gz_file_size);
+    while (off < limit) {
+        auto rc = pread(this->gz_fd, buffer, sizeof(buffer), off);
+
+        if (rc < (ssize_t) GZ_MEMBER_HEADER_SIZE) {
+            break;
+        }
+
+        auto end = std::min(rc - (ssize_t) GZ_MEMBER_HEADER_SIZE + 1,
+                            (ssize_t) (limit - off));
+        auto *curr = buffer;
+        while ((curr = (unsigned char *) memchr(
+            curr, 0x1f, end - (curr - buffer))) != nullptr) {
+            if (is_member_header(curr)) {
+                return off + (curr - buffer);
+            }
+            curr += 1;
+        }
+        off += end;
+    }
+
+    if (limit == (file_off_t) this->gz_file_size) {
+        return limit;
+    }
+
+    return nonstd::nullopt;
+}
+
+nonstd::optional<file_size_t>
+line_buffer::gz_indexed::bgzf_member_size(file_off_t off) const
+{
+    unsigned char header[GZ_MEMBER_HEADER_SIZE + 2];
+
+    if (pread(this->gz_fd, header, sizeof(header), off) != sizeof(header) ||
+        !is_member_header(header) ||
+        !(header[3] & 0x04)) {
+        return nonstd::nullopt;
+    }
+
+    size_t xlen = header[10] | (header[11] << 8);
+    std::vector<unsigned char> extra(xlen);
+
+    if (pread(this->gz_fd, extra.data(), xlen, off + sizeof(header)) !=
+        (ssize_t) xlen) {
+        return nonstd::nullopt;
+    }
+
+    for (size_t lpc = 0; lpc + 4 <= xlen; ) {
+        size_t slen = extra[lpc + 2] | (extra[lpc + 3] << 8);
+
+        if (extra[lpc] == 'B' && extra[lpc + 1] == 'C' && slen == 2 &&
+            lpc + 6 <= xlen) {
+            return (file_size_t) (extra[lpc + 4] | (extra[lpc + 5] << 8)) + 1;
+        }
+        lpc += 4 + slen;
+    }
+
+    return nonstd::nullopt;
+}
+
+Result<bool, std::string> line_buffer::gz_indexed::index_more_members()
+{
+    const auto batch_size = decode_batch_size(this->gz_max_threads);
+    std::vector<member_info> batch;
+    file_off_t next = this->get_source_offset();
+
+    while (batch.size() < batch_size &&
+           (file_size_t) next < this->gz_file_size) {
+        nonstd::optional<file_off_t> end;
+
+        if (this->gz_bgzf) {
+            auto bsize = this->bgzf_member_size(next);
+
+            if (bsize) {
+                end = next + *bsize;
+            }
+        } else {
+            end = this->find_member_start(next + GZ_MEMBER_MIN_SIZE,
+                                          next + GZ_MEMBER_MAX_SIZE);
+        }
+        if (!end) {
+            if (batch.empty()) {
+                return Err(fmt::format("unable to find the end of the gzip "
+                                       "member at {}", next));
+            }
+            break;
+        }
+
+        member_info mi;
+
+        mi.mi_in = next;
+        mi.mi_in_size = *end - next;
+        batch.emplace_back(mi);
+        next = *end;
+    }
+
+    if (batch.empty()) {
+        this->gz_members_eof = true;
+        return Ok(false);
+    }
+
+    // A single member is inflated on this thread when it is called for.
+    const auto policy = batch.size() > 1 ? std::launch::async
+                                         : std::launch::deferred;
+    std::vector<std::future<Result<std::vector<char>, std::string>>> futures;
+    for (const auto &mi : batch) {
+        futures.emplace_back(std::async(policy, [this, mi]() {
+            return inflate_member(this->gz_fd, mi.mi_in, mi.mi_in_size);
+        }));
+    }
+
+    // Compressed data can contain bytes that look like a member header, so
+    // a failure might just mean the member was split in the wrong place.
+    // Try again with the following candidate boundaries included.
+    auto merge_member = [this](member_info &mi, const std::string &err)
+        -> Result<std::vector<char>, std::string> {
+        while (true) {
+            auto end = this->find_member_start(
+                mi.mi_in + mi.mi_in_size + 1,
+                mi.mi_in + GZ_MEMBER_MAX_SIZE);
+
+            if (!end || (file_size_t) *end <= mi.mi_in + mi.mi_in_size) {
+                return Err(err);
+            }
+            mi.mi_in_size = *end - mi.mi_in;
+
+            auto decode_res = inflate_member(
+                this->gz_fd, mi.mi_in, mi.mi_in_size);
+            if (decode_res.isOk()) {
+                return decode_res;
+            }
+        }
+    };
+
+    for (size_t lpc = 0; lpc < batch.size(); lpc++) {
+        auto &mi = batch[lpc];
+        auto first_res = futures[lpc].get();
+        auto merged = first_res.isErr() && !this->gz_bgzf;
+        auto decode_res = merged ?
+                          merge_member(mi, first_res.unwrapErr()) :
+                          std::move(first_res);
+
+        if (decode_res.isErr()) {
+            if (lpc == 0) {
+                return Err(decode_res.unwrapErr());
+            }
+            break;
+        }
+
+        auto data = decode_res.unwrap();
+
+        if (!this->gz_members.empty()) {
+            const auto &last = this->gz_members.back();
+
+            mi.mi_out = last.mi_out + last.mi_out_size;
+        }
+        mi.mi_out_size = data.size();
+        this->gz_members.emplace_back(mi);
+        this->gz_decoded.emplace_back(
+            decoded_member{this->gz_members.size() - 1, std::move(data)});
+        if (merged) {
+            // The rest of the batch overlaps the merged member.
+            break;
+        }
+    }
+
+    while (this->gz_decoded.size() > 2 * decode_batch_size()) {
+        this->gz_decoded.pop_front();
+    }
+
+    return Ok(true);
+}
+
+const std::vector<char> *line_buffer::gz_indexed::get_member_data(size_t index)
+{
+    for (const auto &dm : this->gz_decoded) {
+        if (dm.dm_index == index) {
+            return &dm.dm_data;
+        }
+    }
+
+    const auto &mi = this->gz_members[index];
+    auto decode_res = inflate_member(this->gz_fd, mi.mi_in, mi.mi_in_size);
+    if (decode_res.isErr()) {
+        log_error("%s", decode_res.unwrapErr().c_str());
+        return nullptr;
+    }
+
+    this->gz_decoded.emplace_back(
+        decoded_member{index, decode_res.unwrap()});
+    if (this->gz_decoded.size() > 2 * decode_batch_size()) {
+        this->gz_decoded.pop_front();
+    }
+
+    return &this->gz_decoded.back().dm_data;
+}
+
+int line_buffer::gz_indexed::read_members(void *buf, size_t offset, size_t size)
+{
+    size_t copied = 0;
+
+    while (copied < size) {
+        auto pos = offset + copied;
+
+        while (!this->gz_members_eof &&
+               (this->gz_members.empty() ||
+                (size_t) (this->gz_members.back().mi_out +
+                          this->gz_members.back().mi_out_size) <= pos)) {
+            auto index_res = this->index_more_members();
+
+            if (index_res.isErr()) {
+                log_error("%s", index_res.unwrapErr().c_str());
+                return copied > 0 ? copied : -1;
+            }
+        }
+        if (this->gz_members.empty() ||
+            (size_t) (this->gz_members.back().mi_out +
+                      this->gz_members.back().mi_out_size) <= pos) {
+            break;
+        }
+
+        auto iter = std::upper_bound(
+            this->gz_members.begin(), this->gz_members.end(), pos,
+            [](size_t lhs, const member_info &rhs) {
+                return lhs < (size_t) rhs.mi_out;
+            });
+        --iter;
+
+        auto index = std::distance(this->gz_members.begin(), iter);
+        auto data = this->get_member_data(index);
+        if (data == nullptr) {
+            return copied > 0 ? copied : -1;
+        }
+
+        auto data_off = pos - iter->mi_out;
+        auto to_copy = std::min(size - copied, data->size() - data_off);
+
+        memcpy((char *) buf + copied, data->data() + data_off, to_copy);
+        copied += to_copy;
+    }
+
+    return copied;
+}
+
+static const uint64_t BZ_BLOCK_MAGIC = 0x314159265359ULL;
+static const uint64_t BZ_EOS_MAGIC = 0x177245385090ULL;
+static const uint64_t BZ_MAGIC_MASK = 0xffffffffffffULL;
+static const size_t BZ_SCAN_SIZE = 64 * 1024;
+
+/**
+ * @return An upper bound on the compressed size of a block, in bits, for
+ *   the given block size level.  bzip2 only ever expands incompressible
+ *   data by a small amount.
+ */
+static uint64_t bz_block_max_bits(char level)
+{
+    return (uint64_t) (level - '0') * 100000 * 8 * 5 / 4 + 64 * 1024;
+}
+
+void line_buffer::bz_indexed::close()
+{
+    this->bz_fd.reset();
+    this->bz_blocks.clear();
+    this->bz_decoded.clear();
+    this->bz_next_bit = 0;
+    this->bz_level = '9';
+    this->bz_eof = false;
+    this->bz_error = nonstd::nullopt;
+}
+
+void line_buffer::bz_indexed::open(auto_fd fd)
+{
+    char header[4];
+
+    this->close();
+    this->bz_fd = std::move(fd);
+    if (pread(this->bz_fd, header, sizeof(header), 0) != sizeof(header) ||
+        header[3] < '1' || header[3] > '9') {
+        this->bz_eof = true;
+        return;
+    }
+    this->bz_level = header[3];
+    this->bz_next_bit = sizeof(header) * 8;
+}
+
+nonstd::optional<std::pair<uint64_t, bool>>
+line_buffer::bz_indexed::find_magic(uint64_t from_bit) const
+{
+    unsigned char buffer[BZ_SCAN_SIZE];
+    file_off_t off = from_bit / 8;
+    uint64_t bits = 0;
+
+    while (true) {
+        auto rc = pread(this->bz_fd, buffer, sizeof(buffer), off);
+
+        if (rc <= 0) {
+            return nonstd::nullopt;
+        }
+
+        for (ssize_t lpc = 0; lpc < rc; lpc++) {
+            bits = (bits << 8) | buffer[lpc];
+
+            // Check the windows that end in this byte from the earliest one.
+            uint64_t byte_end_bit = (off + lpc + 1) * 8;
+            for (int shift = 7; shift >= 0; shift--) {
+                auto window = (bits >> shift) & BZ_MAGIC_MASK;
+                if (byte_end_bit < 48U + (uint64_t) shift) {
+                    continue;
+                }
+
+                auto start_bit = byte_end_bit - shift - 48;
+                if (start_bit < from_bit) {
+                    continue;
+                }
+                if (window == BZ_BLOCK_MAGIC) {
+                    return std::make_pair(start_bit, true);
+                }
+                if (window == BZ_EOS_MAGIC) {
+                    return std::make_pair(start_bit, false);
+                }
+            }
+        }
+        off += rc;
+    }
+}
+
+namespace {
+
+/**
+ * Builds a bzip2 stream with a single block copied out of another stream.
+ */
+class bz_bit_writer {
+public:
+    void put_bits(uint64_t value, int count)
+    {
+        for (int lpc = count - 1; lpc >= 0; lpc--) {
+            this->put_bit((value >> lpc) & 1);
+        }
+    }
+
+    void put_bit(int bit)
+    {
+        if (this->bw_bit_count % 8 == 0) {
+            this->bw_data.push_back(0);
+        }
+        if (bit) {
+            this->bw_data.back() |= 0x80 >> (this->bw_bit_count % 8);
+        }
+        this->bw_bit_count += 1;
+    }
+
+    std::vector<char> bw_data;
+    uint64_t bw_bit_count{0};
+};
+
+}
+
+Result<std::vector<char>, std::string>
+line_buffer::bz_indexed::decode_block(const block_info &bi) const
+{
+#ifdef HAVE_BZLIB_H
+    auto start_byte = bi.bi_start_bit / 8;
+    auto end_byte = (bi.bi_end_bit + 7) / 8;
+    std::vector<unsigned char> in(end_byte - start_byte);
+
+    if (pread(this->bz_fd, in.data(), in.size(), start_byte) !=
+        (ssize_t) in.size()) {
+        return Err(fmt::format("unable to read block at bit {} -- {}",
+                               bi.bi_start_bit, strerror(errno)));
+    }
+
+    // Wrap the block in a stream header and trailer.  The combined CRC of a
+    // stream with a single block is the same as the block's CRC.
+    bz_bit_writer bw;
+    uint32_t block_crc = 0;
+
+    bw.put_bits('B', 8);
+    bw.put_bits('Z', 8);
+    bw.put_bits('h', 8);
+    bw.put_bits(bi.bi_level, 8);
+    for (auto bit = bi.bi_start_bit; bit < bi.bi_end_bit; bit++) {
+        auto byte_off = bit / 8 - start_byte;
+        auto value = (in[byte_off] >> (7 - bit % 8)) & 1;
+
+        if (bit >= bi.bi_start_bit + 48 && bit < bi.bi_start_bit + 80) {
+            block_crc = (block_crc << 1) | value;
+        }
+        bw.put_bit(value);
+    }
+    bw.put_bits(BZ_EOS_MAGIC, 48);
+    bw.put_bits(block_crc, 32);
+
+    bz_stream strm;
+    std::vector<char> retval;
+    int rc;
+
+    memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+        return Err(std::string("unable to initialize bzip2 decompressor"));
+    }
+    strm.next_in = bw.bw_data.data();
+    strm.avail_in = bw.bw_data.size();
+    do {
+        auto used = retval.size();
+
+        retval.resize(used + DEFAULT_INCREMENT);
+        strm.next_out = &retval[used];
+        strm.avail_out = DEFAULT_INCREMENT;
+        rc = BZ2_bzDecompress(&strm);
+        retval.resize(used + DEFAULT_INCREMENT - strm.avail_out);
+    } while (rc == BZ_OK && (strm.avail_in > 0 || strm.avail_out == 0));
+    BZ2_bzDecompressEnd(&strm);
+
+    if (rc != BZ_STREAM_END) {
+        return Err(fmt::format("unable to decompress block at bit {} -- {}",
+                               bi.bi_start_bit, rc));
+    }
+
+    return Ok(std::move(retval));
+#else
+    return Err(std::string("not compiled with bzip2 support"));
+#endif
+}
+
+bool line_buffer::bz_indexed::index_more_blocks()
+{
+    const auto batch_size = decode_batch_size(this->bz_max_threads);
+    std::vector<block_info> batch;
+
+    while (!this->bz_eof && batch.size() < batch_size) {
+        auto magic = this->find_magic(this->bz_next_bit);
+
+        if (!magic) {
+            this->bz_eof = true;
+            break;
+        }
+
+        if (!magic->second) {
+            // Skip the stream CRC and padding, another stream could follow.
+            file_off_t next_header = (magic->first + 48 + 32 + 7) / 8;
+            char header[4];
+
+            if (pread(this->bz_fd, header, sizeof(header), next_header) !=
+                sizeof(header) ||
+                strncmp(header, "BZh", 3) != 0 ||
+                header[3] < '1' || header[3] > '9') {
+                this->bz_eof = true;
+                break;
+            }
+            this->bz_level = header[3];
+            this->bz_next_bit = (next_header + sizeof(header)) * 8;
+            continue;
+        }
+
+        auto end_magic = this->find_magic(magic->first + 48);
+        if (!end_magic) {
+            log_error("bzip2 block at bit %" PRIu64 " is truncated",
+                      magic->first);
+            this->bz_eof = true;
+            break;
+        }
+
+        block_info bi;
+
+        bi.bi_start_bit = magic->first;
+        bi.bi_end_bit = end_magic->first;
+        bi.bi_level = this->bz_level;
+        batch.emplace_back(bi);
+        this->bz_next_bit = end_magic->first;
+    }
+
+    const auto policy = batch.size() > 1 ? std::launch::async
+                                         : std::launch::deferred;
+    std::vector<std::future<Result<std::vector<char>, std::string>>> futures;
+    for (const auto &bi : batch) {
+        futures.emplace_back(std::async(policy, [this, bi]() {
+            return this->decode_block(bi);
+        }));
+    }
+
+    // The compressed bits can contain a sequence that looks like a magic
+    // number, so a failure might just mean the block was split in the wrong
+    // place.  The block starts where the last good one ended, so keep
+    // decoding from there across the following candidates.
+    auto merge_block = [this](block_info &bi, const std::string &err)
+        -> Result<std::vector<char>, std::string> {
+        auto max_end = bi.bi_start_bit + bz_block_max_bits(bi.bi_level);
+
+        while (true) {
+            auto magic = this->find_magic(bi.bi_end_bit + 1);
+
+            if (!magic || magic->first > max_end) {
+                return Err(err);
+            }
+            bi.bi_end_bit = magic->first;
+
+            auto decode_res = this->decode_block(bi);
+            if (decode_res.isOk()) {
+                return decode_res;
+            }
+        }
+    };
+
+    auto retval = false;
+    for (size_t lpc = 0; lpc < batch.size(); lpc++) {
+        auto &bi = batch[lpc];
+        auto first_res = futures[lpc].get();
+        auto merged = first_res.isErr();
+        auto decode_res = merged ?
+                          merge_block(bi, first_res.unwrapErr()) :
+                          std::move(first_res);
+
+        if (decode_res.isErr()) {
+            log_error("%s", decode_res.unwrapErr().c_str());
+            // Any blocks after a bad one cannot be placed in the stream.
+            this->bz_error = decode_res.unwrapErr();
+            this->bz_eof = true;
+            break;
+        }
+
+        auto data = decode_res.unwrap();
+
+        if (!this->bz_blocks.empty()) {
+            const auto &last = this->bz_blocks.back();
+
+            bi.bi_out = last.bi_out + last.bi_out_size;
+        }
+        bi.bi_out_size = data.size();
+        this->bz_blocks.emplace_back(bi);
+        this->bz_decoded.emplace_back(
+            decoded_block{this->bz_blocks.size() - 1, std::move(data)});
+        retval = true;
+        if (merged) {
+            // The rest of the batch overlaps the merged block, so scan
+            // again from its real end.
+            this->bz_next_bit = bi.bi_end_bit;
+            this->bz_level = bi.bi_level;
+            this->bz_eof = false;
+            break;
+        }
+    }
+
+    while (this->bz_decoded.size() > 2 * decode_batch_size()) {
+        this->bz_decoded.pop_front();
+    }
+
+    return retval;
+}
+
+const std::vector<char> *line_buffer::bz_indexed::get_block_data(size_t index)
+{
+    for (const auto &db : this->bz_decoded) {
+        if (db.db_index == index) {
+            return &db.db_data;
+        }
+    }
+
+    auto decode_res = this->decode_block(this->bz_blocks[index]);
+    if (decode_res.isErr()) {
+        log_error("%s", decode_res.unwrapErr().c_str());
+        return nullptr;
+    }
+
+    this->bz_decoded.emplace_back(
+        decoded_block{index, decode_res.unwrap()});
+    if (this->bz_decoded.size() > 2 * decode_batch_size()) {
+        this->bz_decoded.pop_front();
+    }
+
+    return &this->bz_decoded.back().db_data;
+}
+
+int line_buffer::bz_indexed::read(void *buf, size_t offset, size_t size)
+{
+    size_t copied = 0;
+
+    while (copied < size) {
+        auto pos = offset + copied;
+
+        while (this->bz_blocks.empty() ||
+               (size_t) (this->bz_blocks.back().bi_out +
+                         this->bz_blocks.back().bi_out_size) <= pos) {
+            if (!this->index_more_blocks()) {
+                break;
+            }
+        }
+        if (this->bz_blocks.empty() ||
+            (size_t) (this->bz_blocks.back().bi_out +
+                      this->bz_blocks.back().bi_out_size) <= pos) {
+            break;
+        }
+
+        auto iter = std::upper_bound(
+            this->bz_blocks.begin(), this->bz_blocks.end(), pos,
+            [](size_t lhs, const block_info &rhs) {
+                return lhs < (size_t) rhs.bi_out;
+            });
+        --iter;
+
+        auto index = std::distance(this->bz_blocks.begin(), iter);
+        auto data = this->get_block_data(index);
+        if (data == nullptr) {
+            return copied > 0 ? copied : -1;
+        }
+
+        auto block_off = pos - iter->bi_out;
+        auto len = std::min(size - copied, data->size() - block_off);
+
+        memcpy((char *) buf + copied, data->data() + block_off, len);
+        copied += len;
+    }
+
+    return copied;
+}
+
 line_buffer::line_buffer()
-    : lb_bz_file(false),
-      lb_compressed_offset(0),
+    : lb_compressed_offset(0),
       lb_file_size(-1),
       lb_file_offset(0),
       lb_file_time(0),
@@ -321,12 +1107,16 @@ void line_buffer::set_fd(auto_fd &fd)
 {
     file_off_t newoff = 0;
 
+    this->cancel_read_ahead();
+    this->unmap();
+    this->lb_short_read = false;
+
     if (this->lb_gz_file) {
         this->lb_gz_file.close();
     }
 
     if (this->lb_bz_file) {
-        this->lb_bz_file = false;
+        this->lb_bz_file.close();
     }
 
     if (fd != -1) {
@@ -366,7 +1156,11 @@ void line_buffer::set_fd(auto_fd &fd)
                     if (lseek(fd, 0, SEEK_SET) < 0) {
                         throw error(errno);
                     }
-                    this->lb_bz_file = true;
+
+                    auto bzfd = auto_fd::dup_of(fd);
+
+                    log_perror(fcntl(bzfd, F_SETFD, FD_CLOEXEC));
+                    this->lb_bz_file.open(std::move(bzfd));
 
                     /*
                      * Loading data from a bzip2 file is pretty slow, so we try
@@ -415,6 +1209,10 @@ void line_buffer::ensure_available(file_off_t start, ssize_t max_length)
 {
     ssize_t prefill, available;
 
+    if (this->lb_map_addr != nullptr) {
+        return;
+    }
+
     require(max_length <= MAX_LINE_BUFFER_SIZE);
 
     if (this->lb_file_size != -1) {
@@ -489,6 +1287,26 @@ bool line_buffer::fill_range(file_off_t start, ssize_t max_length)
 
     require(start >= 0);
 
+    if (this->lb_map_addr != nullptr) {
+        if (this->is_map_faulted()) {
+            log_warning("mapped file was truncated, falling back to reading");
+            this->unmap();
+        } else if (this->in_range(start) &&
+                   this->in_range(start + max_length - 1)) {
+            return true;
+        } else {
+            struct stat st;
+
+            if ((size_t) start <= this->lb_map_size &&
+                fstat(this->lb_fd, &st) == 0 &&
+                st.st_size == (off_t) this->lb_map_size) {
+                return this->in_range(start);
+            }
+            log_info("mapped file changed size, falling back to reading");
+            this->unmap();
+        }
+    }
+
     if (this->in_range(start) && this->in_range(start + max_length - 1)) {
         /* Cache already has the data, nothing to do. */
         retval = true;
@@ -500,7 +1318,15 @@ bool line_buffer::fill_range(file_off_t start, ssize_t max_length)
         this->ensure_available(start, max_length);
 
         /* ... read in the new data. */
-        if (this->lb_gz_file) {
+        auto space = this->lb_buffer_max - this->lb_buffer_size;
+        auto ra_rc = this->take_read_ahead(
+            this->lb_file_offset + this->lb_buffer_size,
+            &this->lb_buffer[this->lb_buffer_size],
+            space);
+        if (ra_rc) {
+            rc = ra_rc.value();
+        }
+        else if (this->lb_gz_file) {
             if (this->lb_file_size != (ssize_t)-1 &&
                 this->in_range(start) &&
                 this->in_range(this->lb_file_size - 1)) {
@@ -527,46 +1353,10 @@ bool line_buffer::fill_range(file_off_t start, ssize_t max_length)
                 rc = 0;
             }
             else {
-                lock_hack::guard guard;
-                char             scratch[32 * 1024];
-                BZFILE *         bz_file;
-                file_off_t       seek_to;
-                int              bzfd;
-
-                /*
-                 * Unfortunately, there is no bzseek, so we need to reopen the
-                 * file every time we want to do a read.
-                 */
-                bzfd = dup(this->lb_fd);
-                if (lseek(this->lb_fd, 0, SEEK_SET) < 0) {
-                    close(bzfd);
-                    throw error(errno);
-                }
-                if ((bz_file = BZ2_bzdopen(bzfd, "r")) == NULL) {
-                    close(bzfd);
-                    if (errno == 0) {
-                        throw bad_alloc();
-                    }
-                    else{
-                        throw error(errno);
-                    }
-                }
-
-                seek_to = this->lb_file_offset + this->lb_buffer_size;
-                while (seek_to > 0) {
-                    int count;
-
-                    count = BZ2_bzread(bz_file,
-                                       scratch,
-                                       std::min((size_t)seek_to,
-                                                sizeof(scratch)));
-                    seek_to -= count;
-                }
-                rc = BZ2_bzread(bz_file,
-                                &this->lb_buffer[this->lb_buffer_size],
-                                this->lb_buffer_max - this->lb_buffer_size);
-                this->lb_compressed_offset = lseek(bzfd, 0, SEEK_SET);
-                BZ2_bzclose(bz_file);
+                rc = this->lb_bz_file.read(&this->lb_buffer[this->lb_buffer_size],
+                                           this->lb_file_offset + this->lb_buffer_size,
+                                           this->lb_buffer_max - this->lb_buffer_size);
+                this->lb_compressed_offset = this->lb_bz_file.get_source_offset();
 
                 if (rc != -1 && (
                     rc < (this->lb_buffer_max - this->lb_buffer_size))) {
@@ -597,6 +1387,7 @@ bool line_buffer::fill_range(file_off_t start, ssize_t max_length)
             errno = EAGAIN;
 #endif
         }
+        this->lb_short_read = (rc >= 0 && rc < space);
         switch (rc) {
         case 0:
             if (!this->lb_seekable) {
@@ -643,6 +1434,269 @@ bool line_buffer::fill_range(file_off_t start, ssize_t max_length)
     return retval;
 }
 
+namespace {
+
+/**
+ * The regions of memory that are mapped by line_buffers.  The SIGBUS handler
+ * checks the faulting address against these to decide if the fault can be
+ * recovered from.  A start of one marks a region that is being set up.
+ */
+struct mmap_region {
+    std::atomic<uintptr_t> mr_start{0};
+    std::atomic<size_t> mr_size{0};
+    std::atomic<bool> mr_faulted{false};
+};
+
+const size_t MAX_MMAP_REGIONS = 256;
+mmap_region MMAP_REGIONS[MAX_MMAP_REGIONS];
+uintptr_t MMAP_PAGE_SIZE;
+struct sigaction PREV_SIGBUS_ACTION;
+
+void sigbus_handler(int sig, siginfo_t *info, void *context)
+{
+    auto addr = (uintptr_t) info->si_addr;
+
+    for (auto &mr : MMAP_REGIONS) {
+        auto start = mr.mr_start.load();
+
+        if (start <= 1 || addr < start || addr >= start + mr.mr_size.load()) {
+            continue;
+        }
+
+        // Put a page of zeroes where the file data used to be so that the
+        // access can complete.
+        auto page = (void *) (addr & ~(MMAP_PAGE_SIZE - 1));
+        if (mmap(page,
+                 MMAP_PAGE_SIZE,
+                 PROT_READ,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+                 -1,
+                 0) != MAP_FAILED) {
+            mr.mr_faulted = true;
+            return;
+        }
+        break;
+    }
+
+    // Not ours, the access will fault again and go to the previous handler.
+    sigaction(SIGBUS, &PREV_SIGBUS_ACTION, nullptr);
+}
+
+void install_sigbus_handler()
+{
+    static std::once_flag INSTALLED;
+
+    std::call_once(INSTALLED, []() {
+        struct sigaction sa;
+
+        MMAP_PAGE_SIZE = sysconf(_SC_PAGESIZE);
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_sigaction = sigbus_handler;
+        sigaction(SIGBUS, &sa, &PREV_SIGBUS_ACTION);
+    });
+}
+
+}
+
+bool line_buffer::set_mmap(bool enabled)
+{
+    struct stat st;
+
+    if (!enabled) {
+        this->unmap();
+        return false;
+    }
+
+    if (this->lb_map_addr != nullptr) {
+        return true;
+    }
+
+    if (this->lb_fd == -1 ||
+        !this->lb_seekable ||
+        this->is_compressed() ||
+        fstat(this->lb_fd, &st) == -1 ||
+        !S_ISREG(st.st_mode) ||
+        st.st_size == 0) {
+        return false;
+    }
+
+    int region = -1;
+    for (size_t lpc = 0; lpc < MAX_MMAP_REGIONS; lpc++) {
+        uintptr_t expected = 0;
+
+        if (MMAP_REGIONS[lpc].mr_start.compare_exchange_strong(expected, 1)) {
+            region = lpc;
+            break;
+        }
+    }
+    if (region == -1) {
+        log_warning("too many mapped files, reading normally");
+        return false;
+    }
+
+    install_sigbus_handler();
+
+    auto addr = mmap(
+        nullptr, st.st_size, PROT_READ, MAP_PRIVATE, this->lb_fd, 0);
+    if (addr == MAP_FAILED) {
+        log_warning("unable to map file -- %s", strerror(errno));
+        MMAP_REGIONS[region].mr_start = 0;
+        return false;
+    }
+
+    this->cancel_read_ahead();
+    this->lb_share_manager.invalidate_refs();
+
+    auto &mr = MMAP_REGIONS[region];
+    mr.mr_size = st.st_size;
+    mr.mr_faulted = false;
+    mr.mr_start = (uintptr_t) addr;
+
+    this->lb_map_addr = (char *) addr;
+    this->lb_map_size = st.st_size;
+    this->lb_map_region = region;
+    this->lb_file_offset = 0;
+    this->lb_buffer_size = st.st_size;
+
+    return true;
+}
+
+void line_buffer::unmap()
+{
+    if (this->lb_map_addr == nullptr) {
+        return;
+    }
+
+    // Any refs into the mapping need to copy the data before it goes away.
+    this->lb_share_manager.invalidate_refs();
+    MMAP_REGIONS[this->lb_map_region].mr_start = 0;
+    munmap(this->lb_map_addr, this->lb_map_size);
+
+    this->lb_map_addr = nullptr;
+    this->lb_map_size = 0;
+    this->lb_map_region = -1;
+    this->lb_file_offset = 0;
+    this->lb_buffer_size = 0;
+}
+
+bool line_buffer::is_map_faulted() const
+{
+    return this->lb_map_region != -1 &&
+           MMAP_REGIONS[this->lb_map_region].mr_faulted.load();
+}
+
+void line_buffer::set_read_ahead(bool enabled)
+{
+    if (!enabled) {
+        this->cancel_read_ahead();
+    }
+    this->lb_read_ahead = enabled;
+}
+
+void line_buffer::set_decode_threads(size_t count)
+{
+    this->wait_for_read_ahead();
+    this->lb_gz_file.set_max_threads(count);
+    this->lb_bz_file.set_max_threads(count);
+}
+
+ssize_t line_buffer::read_at(char *buf, file_off_t off, size_t size)
+{
+    if (this->lb_gz_file) {
+        return this->lb_gz_file.read(buf, off, size);
+    }
+#ifdef HAVE_BZLIB_H
+    if (this->lb_bz_file) {
+        return this->lb_bz_file.read(buf, off, size);
+    }
+#endif
+    return pread(this->lb_fd, buf, size, off);
+}
+
+void line_buffer::start_read_ahead()
+{
+    if (this->lb_ra_future.valid() ||
+        this->lb_ra_size > 0 ||
+        this->lb_map_addr != nullptr ||
+        this->lb_short_read ||
+        this->lb_fd == -1 ||
+        !this->lb_seekable) {
+        return;
+    }
+
+    auto off = this->lb_file_offset + this->lb_buffer_size;
+    if (this->lb_file_size != -1 && off >= this->lb_file_size) {
+        return;
+    }
+
+    size_t size = this->lb_buffer_max;
+
+    this->lb_ra_buffer.resize(size);
+    this->lb_ra_offset = off;
+    this->lb_ra_start = 0;
+    this->lb_ra_eof = false;
+    this->lb_ra_future = std::async(std::launch::async, [this, off, size]() {
+        auto rc = this->read_at(this->lb_ra_buffer.data(), off, size);
+
+        if (this->lb_gz_file) {
+            this->lb_ra_compressed_offset =
+                this->lb_gz_file.get_source_offset();
+        }
+        else if (this->lb_bz_file) {
+            this->lb_ra_compressed_offset =
+                this->lb_bz_file.get_source_offset();
+        }
+        this->lb_ra_eof = (rc >= 0 && (size_t) rc < size);
+
+        return rc;
+    });
+}
+
+void line_buffer::wait_for_read_ahead()
+{
+    if (this->lb_ra_future.valid()) {
+        this->lb_ra_size = this->lb_ra_future.get();
+    }
+}
+
+void line_buffer::cancel_read_ahead()
+{
+    this->wait_for_read_ahead();
+    this->lb_ra_size = 0;
+}
+
+nonstd::optional<ssize_t> line_buffer::take_read_ahead(file_off_t off,
+                                                       char *dst,
+                                                       size_t size)
+{
+    this->wait_for_read_ahead();
+    if (this->lb_ra_size <= 0 ||
+        off != this->lb_ra_offset + (file_off_t) this->lb_ra_start) {
+        this->lb_ra_size = 0;
+        return nonstd::nullopt;
+    }
+
+    auto to_copy = std::min((size_t) this->lb_ra_size - this->lb_ra_start,
+                            size);
+
+    memcpy(dst, &this->lb_ra_buffer[this->lb_ra_start], to_copy);
+    this->lb_ra_start += to_copy;
+    if (this->is_compressed()) {
+        this->lb_compressed_offset = this->lb_ra_compressed_offset;
+    }
+    if (this->lb_ra_start == (size_t) this->lb_ra_size) {
+        if (this->lb_ra_eof && this->is_compressed()) {
+            // Unlike regular files, the end of a compressed file is final.
+            this->lb_file_size = off + to_copy;
+        }
+        this->lb_ra_size = 0;
+    }
+
+    return to_copy;
+}
+
 Result<line_info, string> line_buffer::load_next_line(file_range prev_line)
 {
     ssize_t request_size = DEFAULT_INCREMENT;
@@ -653,6 +1707,13 @@ Result<line_info, string> line_buffer::load_next_line(file_range prev_line)
 
     auto offset = prev_line.next_offset();
     retval.li_file_range.fr_offset = offset;
+    if (this->lb_map_addr != nullptr &&
+        (size_t) offset < this->lb_map_size) {
+        // The whole file is already available, so there is no need to grow
+        // the request a little at a time.
+        request_size = std::min((ssize_t) MAX_LINE_BUFFER_SIZE,
+                                (ssize_t) (this->lb_map_size - offset));
+    }
     while (!done) {
         char *line_start, *lf;
 
@@ -660,28 +1721,19 @@ Result<line_info, string> line_buffer::load_next_line(file_range prev_line)
 
         /* Find the data in the cache and */
         line_start = this->get_range(offset, retval.li_file_range.fr_size);
-        /* ... look for the end-of-line or end-of-file. */
-        ssize_t utf8_end = -1;
-
-#ifdef HAVE_X86INTRIN_H
-        if (!validate_utf8_fast(line_start, retval.li_file_range.fr_size, &utf8_end)) {
-            retval.li_valid_utf = false;
+        if (this->lb_map_addr != nullptr &&
+            retval.li_file_range.fr_size > request_size) {
+            retval.li_file_range.fr_size = request_size;
         }
-#else
-        {
-            const char *msg;
-            int faulty_bytes;
-
-            utf8_end = is_utf8((unsigned char *) line_start, retval.li_file_range.fr_size, &msg, &faulty_bytes);
-            if (msg != nullptr) {
-                lf = (char *) memchr(line_start, '\n', retval.li_file_range.fr_size);
-                utf8_end = lf - line_start;
-                retval.li_valid_utf = false;
-            }
-        }
-#endif
-        if (utf8_end >= 0) {
-            lf = line_start + utf8_end;
+        /* ... look for the end-of-line or end-of-file. */
+        auto scan_res = lnav::utf8::scan_line(
+            line_start, retval.li_file_range.fr_size);
+
+        // Each pass rescans the whole line, so a multi-byte sequence that
+        // was cut off at the end of the last pass is not held against it.
+        retval.li_valid_utf = scan_res.lsr_valid;
+        if (scan_res.lsr_end >= 0) {
+            lf = line_start + scan_res.lsr_end;
         } else {
             lf = nullptr;
         }
@@ -753,6 +1805,17 @@ Result<line_info, string> line_buffer::load_next_line(file_range prev_line)
         }
     }
 
+    if (this->lb_map_addr != nullptr && this->is_map_faulted()) {
+        // The line might have been read from the zeroed pages, try again
+        // now that the file will be read normally.
+        this->unmap();
+        return this->load_next_line(prev_line);
+    }
+
+    if (this->lb_read_ahead) {
+        this->start_read_ahead();
+    }
+
     ensure(retval.li_file_range.fr_size <= this->lb_buffer_size);
     ensure(this->invariant());
 
@@ -790,5 +1853,11 @@ Result<shared_buffer_ref, std::string> line_buffer::read_range(const file_range
 
 file_range line_buffer::get_available()
 {
+    if (this->lb_map_addr != nullptr) {
+        // Only report what would have been read into a regular buffer.
+        return {0, std::min(this->lb_buffer_size,
+                             (ssize_t) DEFAULT_LINE_BUFFER_SIZE)};
+    }
+
     return {this->lb_file_offset, this->lb_buffer_size};
 }
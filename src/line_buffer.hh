@@ -37,7 +37,11 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#include <deque>
 #include <exception>
+#include <future>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "base/lnav_log.hh"
@@ -46,6 +50,7 @@
 #include "auto_fd.hh"
 #include "auto_mem.hh"
 #include "shared_buffer.hh"
+#include "optional.hpp"
 
 struct line_info {
     file_range li_file_range;
@@ -84,7 +89,11 @@ public:
 
     /**
      * A memoized gzip file reader that can do random file access faster than
-     * gzseek/gzread alone.
+     * gzseek/gzread alone.  Files that are made up of many small members,
+     * like the ones written by log shippers or BGZF, are split at the member
+     * boundaries and the members are decompressed in batches on a pool of
+     * threads.  Otherwise, the data is inflated serially and syncpoints are
+     * recorded along the way.
      */
     class gz_indexed {
         public:
@@ -99,9 +108,34 @@ public:
         }
 
         uLong get_source_offset() {
+            if (this->gz_member_mode) {
+                return this->gz_members.empty() ? 0 :
+                       this->gz_members.back().mi_in +
+                       this->gz_members.back().mi_in_size;
+            }
             return !!*this ? this->strm.total_in + this->strm.avail_in : 0;
         }
 
+        /**
+         * @return True if the members of the file are being decompressed
+         *   independently.
+         */
+        bool is_member_mode() const {
+            return this->gz_member_mode;
+        }
+
+        size_t get_member_count() const {
+            return this->gz_members.size();
+        }
+
+        /**
+         * @param count The number of threads that can inflate members at
+         *   the same time or zero for one per CPU.
+         */
+        void set_max_threads(size_t count) {
+            this->gz_max_threads = count;
+        }
+
         void close();
         void init_stream();
         void continue_stream();
@@ -115,12 +149,37 @@ public:
          */
         int read(void * buf, size_t offset, size_t size);
 
+        size_t get_syncpoint_count() const {
+            return this->syncpoints.size();
+        }
+
+        /**
+         * Write the syncpoints found so far to a compressed file so that
+         * they can be reused by load_syncpoints() when the file is reopened.
+         *
+         * @param path The path of the file to write.
+         * @param file_size The size of the gzipped file, which is checked
+         *   when the syncpoints are loaded.
+         */
+        Result<void, std::string> save_syncpoints(const std::string &path,
+                                                  file_size_t file_size) const;
+
+        /**
+         * Replace the syncpoints with the ones saved by save_syncpoints().
+         *
+         * @param path The path of the file to read.
+         * @param file_size The current size of the gzipped file.
+         */
+        Result<void, std::string> load_syncpoints(const std::string &path,
+                                                  file_size_t file_size);
+
         struct indexDict {
             off_t in = 0;
             off_t out = 0;
             unsigned char bits = 0;
             unsigned char in_bits = 0;
             Bytef index[GZ_WINSIZE];
+            indexDict() = default;
             indexDict(z_stream const & s, const file_size_t size) {
                 assert((s.data_type & GZ_END_OF_BLOCK_MASK));
                 assert(!(s.data_type & GZ_END_OF_FILE_MASK));
@@ -154,10 +213,167 @@ public:
             }
         };
     private:
+        struct member_info {
+            /** The offset of the member's header in the gzip file. */
+            file_off_t mi_in{0};
+            file_size_t mi_in_size{0};
+            /** The offset of the member in the decompressed stream. */
+            file_off_t mi_out{0};
+            size_t mi_out_size{0};
+        };
+
+        struct decoded_member {
+            size_t dm_index;
+            std::vector<char> dm_data;
+        };
+
+        /**
+         * Check if the file is made up of multiple members that can be
+         * decompressed on their own and switch to member mode if it is.
+         */
+        void detect_members();
+
+        /**
+         * Find the first offset that looks like the start of a gzip member.
+         *
+         * @param from The offset to start searching at.
+         * @param limit The offset where the search should stop.
+         * @return The offset of the member header, the size of the file if
+         *   the end of the file was reached, or nullopt if no header was
+         *   found before the limit.
+         */
+        nonstd::optional<file_off_t> find_member_start(file_off_t from,
+                                                       file_off_t limit) const;
+
+        /**
+         * @return The size of the BGZF block at the given offset, taken from
+         *   the "BC" extra field in the member header.
+         */
+        nonstd::optional<file_size_t> bgzf_member_size(file_off_t off) const;
+
+        /**
+         * Find the next batch of members and decompress them.
+         *
+         * @return True if members were added, false at the end of the file,
+         *   or an error if the file cannot be split into members.
+         */
+        Result<bool, std::string> index_more_members();
+
+        const std::vector<char> *get_member_data(size_t index);
+
+        int read_members(void *buf, size_t offset, size_t size);
+
         z_stream                strm;               /*< gzip streams structure */
         std::vector<indexDict>  syncpoints;         /*< indexed dictionaries as discovered */
         auto_mem<Bytef>         inbuf;              /*< Compressed data buffer */
         int gz_fd = -1;                             /*< The file to read data from. */
+        file_size_t gz_file_size{0};
+        bool gz_member_mode{false};
+        bool gz_bgzf{false};
+        bool gz_members_eof{false};
+        size_t gz_max_threads{0};
+        std::vector<member_info> gz_members;
+        std::deque<decoded_member> gz_decoded;
+    };
+
+    /**
+     * A bzip2 file reader that supports random access.  The blocks in a
+     * bzip2 stream start at bit-aligned magic numbers and can be decoded on
+     * their own, so the compressed data is scanned for the block boundaries
+     * and only the block containing the requested offset is decompressed.
+     * New blocks are decoded in batches on a pool of threads.
+     */
+    class bz_indexed {
+        public:
+        bz_indexed() = default;
+        bz_indexed(bz_indexed &&other) = default;
+
+        inline operator bool() const {
+            return this->bz_fd != -1;
+        }
+
+        /** @return The offset of the end of the last block found so far. */
+        file_off_t get_source_offset() const {
+            return this->bz_blocks.empty() ? 0 :
+                   this->bz_blocks.back().bi_end_bit / 8;
+        }
+
+        size_t get_block_count() const {
+            return this->bz_blocks.size();
+        }
+
+        /**
+         * @param count The number of threads that can decode blocks at the
+         *   same time or zero for one per CPU.
+         */
+        void set_max_threads(size_t count) {
+            this->bz_max_threads = count;
+        }
+
+        /**
+         * @return The reason the blocks after the last good one could not
+         *   be read, if any.
+         */
+        const nonstd::optional<std::string> &get_error() const {
+            return this->bz_error;
+        }
+
+        void close();
+
+        /** @param fd The file to read from, this object takes ownership. */
+        void open(auto_fd fd);
+
+        /**
+         * Decompress bytes from the bz2 file returning at most `size` bytes.
+         * offset is the byte-offset in the decompressed data stream.
+         */
+        int read(void *buf, size_t offset, size_t size);
+
+        private:
+        struct block_info {
+            /** The bit offset of the block's magic number. */
+            uint64_t bi_start_bit{0};
+            /** The bit offset of the magic number following the block. */
+            uint64_t bi_end_bit{0};
+            /** The offset of the block in the decompressed stream. */
+            file_off_t bi_out{0};
+            size_t bi_out_size{0};
+            /** The block size level from the stream header, '1'-'9'. */
+            char bi_level{'9'};
+        };
+
+        struct decoded_block {
+            size_t db_index;
+            std::vector<char> db_data;
+        };
+
+        /**
+         * Find the first block or end-of-stream magic number at or after the
+         * given bit offset.
+         *
+         * @return The bit offset of the magic number and true if it is the
+         *   start of a block.
+         */
+        nonstd::optional<std::pair<uint64_t, bool>> find_magic(
+            uint64_t from_bit) const;
+
+        /** Find the next batch of blocks and decompress them. */
+        bool index_more_blocks();
+
+        Result<std::vector<char>, std::string> decode_block(
+            const block_info &bi) const;
+
+        const std::vector<char> *get_block_data(size_t index);
+
+        auto_fd bz_fd;
+        std::vector<block_info> bz_blocks;
+        std::deque<decoded_block> bz_decoded;
+        /** The bit offset where the search for the next block begins. */
+        uint64_t bz_next_bit{0};
+        char bz_level{'9'};
+        bool bz_eof{false};
+        size_t bz_max_threads{0};
+        nonstd::optional<std::string> bz_error;
     };
 
     /** Construct an empty line_buffer. */
@@ -192,6 +408,69 @@ public:
         return this->lb_gz_file || this->lb_bz_file;
     };
 
+    bool is_gzipped() const {
+        return this->lb_gz_file;
+    };
+
+    /**
+     * @return The reason the end of a compressed file could not be read, if
+     *   the data stopped decompressing part way through.
+     */
+    nonstd::optional<std::string> get_decompress_error() {
+        this->wait_for_read_ahead();
+        return this->lb_bz_file.get_error();
+    };
+
+    /** @return The reader for a gzipped file. */
+    gz_indexed &get_gz_file() {
+        // The reader is not safe to use while a read-ahead is in progress.
+        this->wait_for_read_ahead();
+        return this->lb_gz_file;
+    };
+
+    /**
+     * Enable or disable reading ahead.  When enabled, load_next_line()
+     * starts reading and decompressing the data that follows the buffer on
+     * a background thread so that it is ready by the time the caller
+     * reaches it.  This is only useful when the file is being scanned
+     * sequentially, random reads will discard the data read ahead.
+     *
+     * Note that the object must not be moved while a read-ahead is in
+     * progress.
+     */
+    void set_read_ahead(bool enabled);
+
+    bool is_read_ahead() const {
+        return this->lb_read_ahead;
+    };
+
+    /**
+     * Limit the number of threads used to decompress the file so that it
+     * can share a budget with other work.  Any read-ahead in progress is
+     * finished first.
+     *
+     * @param count The number of threads or zero for one per CPU.
+     */
+    void set_decode_threads(size_t count);
+
+    /**
+     * Map the file into memory instead of copying it into the buffer.  The
+     * shared_buffer_refs returned by read_range() will then point directly
+     * into the mapping.  This is only meant for files that are not expected
+     * to change.  If the file grows, the mapping is dropped and the data is
+     * read normally.  If it is truncated, the SIGBUS raised when accessing
+     * the missing pages is caught, the pages are replaced with zeroes, and
+     * the mapping is dropped on the next read.
+     *
+     * @param enabled True to map the file, false to go back to reading it.
+     * @return True if the file is mapped.
+     */
+    bool set_mmap(bool enabled);
+
+    bool is_mmapped() const {
+        return this->lb_map_addr != nullptr;
+    };
+
     file_off_t get_read_offset(file_off_t off) const
     {
         if (this->is_compressed()) {
@@ -222,14 +501,32 @@ public:
 
     file_range get_available();
 
+    /**
+     * Record that the lines before the given offset were loaded by some
+     * other line_buffer so that read_range() will return them.
+     *
+     * @param off The offset of the start of the next line to load.
+     */
+    void mark_lines_loaded(file_off_t off)
+    {
+        if (off > this->lb_last_line_offset) {
+            this->lb_last_line_offset = off;
+        }
+    };
+
     void clear()
     {
-        this->lb_buffer_size  = 0;
+        // A mapping does not go stale, so there is nothing to clear.
+        if (this->lb_map_addr == nullptr) {
+            this->lb_buffer_size = 0;
+        }
     };
 
     /** Release any resources held by this object. */
     void reset()
     {
+        this->cancel_read_ahead();
+        this->unmap();
         this->lb_fd.reset();
 
         this->lb_file_offset      = 0;
@@ -242,7 +539,8 @@ public:
     bool invariant()
     {
         require(this->lb_buffer != nullptr);
-        require(this->lb_buffer_size <= this->lb_buffer_max);
+        require(this->lb_map_addr != nullptr ||
+                this->lb_buffer_size <= this->lb_buffer_max);
 
         return true;
     };
@@ -303,17 +601,55 @@ private:
         require(buffer_offset >= 0);
         require(this->lb_buffer_size >= buffer_offset);
 
-        retval    = &this->lb_buffer[buffer_offset];
+        if (this->lb_map_addr != nullptr) {
+            retval = &this->lb_map_addr[buffer_offset];
+        } else {
+            retval = &this->lb_buffer[buffer_offset];
+        }
         avail_out = this->lb_buffer_size - buffer_offset;
 
         return retval;
     };
 
+    /** Drop the mapping of the file, if there is one. */
+    void unmap();
+
+    /** @return True if a SIGBUS was raised for a page in the mapping. */
+    bool is_map_faulted() const;
+
+    /** Read a range of data from the file or decompressed stream. */
+    ssize_t read_at(char *buf, file_off_t off, size_t size);
+
+    /**
+     * Start reading the data after the end of the buffer on a background
+     * thread, if it is not already being read.
+     */
+    void start_read_ahead();
+
+    /** Wait for any read-ahead in progress to finish. */
+    void wait_for_read_ahead();
+
+    /** Wait for any read-ahead in progress and throw away the data. */
+    void cancel_read_ahead();
+
+    /**
+     * Copy data that was read ahead into the buffer.
+     *
+     * @param off The file offset of the data to copy.
+     * @param dst The location in the buffer to copy the data to.
+     * @param size The amount of space available at dst.
+     * @return The amount of data copied or nullopt if the data read ahead
+     *   is not for the given offset.
+     */
+    nonstd::optional<ssize_t> take_read_ahead(file_off_t off,
+                                              char *dst,
+                                              size_t size);
+
     shared_buffer lb_share_manager;
 
     auto_fd lb_fd;              /*< The file to read data from. */
     gz_indexed  lb_gz_file;     /*< File reader for gzipped files. */
-    bool    lb_bz_file;         /*< Flag set for bzip2 compressed files. */
+    bz_indexed  lb_bz_file;     /*< File reader for bzip2 files. */
     file_off_t   lb_compressed_offset; /*< The offset into the compressed file. */
 
     auto_mem<char> lb_buffer;   /*< The internal buffer where data is cached */
@@ -333,5 +669,23 @@ private:
                                  *  buffer. */
     bool   lb_seekable;         /*< Flag set for seekable file descriptors. */
     file_off_t  lb_last_line_offset; /*< */
+
+    char *lb_map_addr{nullptr}; /*< The mapping of the file, if any. */
+    size_t lb_map_size{0};      /*< The size of the mapping. */
+    int lb_map_region{-1};      /*< The index of the region for SIGBUS. */
+
+    bool lb_read_ahead{false};  /*< Flag set when reading ahead is enabled. */
+    bool lb_short_read{false};  /*< Set when the last read reached the end. */
+    std::vector<char> lb_ra_buffer; /*< The data that was read ahead. */
+    file_off_t lb_ra_offset{0}; /*< The file offset of lb_ra_buffer[0]. */
+    size_t lb_ra_start{0};      /*< The amount of lb_ra_buffer consumed. */
+    ssize_t lb_ra_size{0};      /*< The amount of data in lb_ra_buffer. */
+    bool lb_ra_eof{false};      /*< Set if the read-ahead reached the end. */
+    file_off_t lb_ra_compressed_offset{0};
+    /**
+     * The read-ahead in progress.  This member is last so that it is
+     * destroyed, and waited on, before the file readers.
+     */
+    std::future<ssize_t> lb_ra_future;
 };
 #endif
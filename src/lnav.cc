@@ -453,7 +453,7 @@ private:
         for (auto &sc : lnav_data.ld_status) {
             sc.do_update();
         }
-        if (lnav_data.ld_mode == LNM_FILES && !initial_build) {
+        if (lnav_data.ld_mode == LNM_FILES && !initial_build && lf != nullptr) {
             auto &fc = lnav_data.ld_active_files;
             auto iter = std::find(fc.fc_files.begin(),
                                   fc.fc_files.end(), lf);
@@ -1525,6 +1525,10 @@ static void looper()
         auto next_status_update_time = next_rebuild_time;
         auto next_rescan_time = next_rebuild_time;
 
+        // Keep the UI responsive while a new filter is run over the logs,
+        // the rest of the lines are filtered by rebuild_indexes().
+        lnav_data.ld_log_source.set_filter_time_slice(50ms);
+
         while (lnav_data.ld_looping) {
             auto loop_deadline = ui_clock::now() +
                 (session_stage == 0 ? 3s : 50ms);
@@ -1605,7 +1609,8 @@ static void looper()
 
             auto ui_now = ui_clock::now();
             if (initial_rescan_completed) {
-                if (ui_now >= next_rebuild_time) {
+                if (ui_now >= next_rebuild_time ||
+                    lnav_data.ld_log_source.is_filtering()) {
                     rebuild_indexes(loop_deadline);
                     if (ui_clock::now() < loop_deadline) {
                         next_rebuild_time = ui_clock::now() + 333ms;
@@ -1862,6 +1867,7 @@ static void looper()
                     if (!ran_cleanup) {
                         archive_manager::cleanup_cache();
                         tailer::cleanup_cache();
+                        logfile::cleanup_index_cache();
                         ran_cleanup = true;
                     }
                 }
@@ -2874,6 +2880,7 @@ SELECT tbl_name FROM sqlite_master WHERE sql LIKE 'CREATE VIRTUAL TABLE%'
                 execute_init_commands(lnav_data.ld_exec_context, cmd_results);
                 archive_manager::cleanup_cache();
                 tailer::cleanup_cache();
+                logfile::cleanup_index_cache();
                 wait_for_pipers();
                 isc::to<curl_looper&, services::curl_streamer_t>()
                     .send_and_wait([](auto& clooper) {
@@ -2989,6 +2996,10 @@ SELECT tbl_name FROM sqlite_master WHERE sql LIKE 'CREATE VIRTUAL TABLE%'
             fprintf(stderr, "error: %s\n", strerror(e.e_err));
         }
 
+        for (auto &lf : lnav_data.ld_active_files.fc_files) {
+            lf->save_index_cache();
+        }
+
         // When reading from stdin, tell the user where the capture file is
         // stored so they can look at it later.
         if (stdin_out_fd != -1 &&
@@ -1479,24 +1479,21 @@ static Result<string, string> com_highlight(exec_context &ec, string cmdline, ve
     else if (args.size() > 1) {
         textview_curses *tc = *lnav_data.ld_view_stack.top();
         auto &hm = tc->get_highlights();
-        const char *errptr;
-        auto_mem<pcre> code;
-        int         eoff;
 
         args[1] = remaining_args(cmdline, args);
         if (hm.find({highlight_source_t::INTERACTIVE, args[1]}) != hm.end()) {
             return ec.make_error("highlight already exists -- {}",
                 args[1]);
         }
-        else if ((code = pcre_compile(args[1].c_str(),
-                                      PCRE_CASELESS,
-                                      &errptr,
-                                      &eoff,
-                                      nullptr)) == nullptr) {
-            return ec.make_error("{}", errptr);
+
+        auto compile_res = pcre_registry::singleton().compile(args[1],
+                                                              PCRE_CASELESS);
+
+        if (compile_res.isErr()) {
+            return ec.make_error("{}", compile_res.unwrapErr().ce_msg);
         }
         else {
-            highlighter hl(code.release());
+            highlighter hl(compile_res.unwrap());
             attr_t hl_attrs = view_colors::singleton().attrs_for_ident(args[1]);
 
             if (ec.ec_dry_run) {
@@ -1602,9 +1599,6 @@ static Result<string, string> com_filter(exec_context &ec, string cmdline, vecto
     else if (args.size() > 1) {
         text_sub_source *tss = tc->get_sub_source();
         filter_stack &fs = tss->get_filters();
-        const char *errptr;
-        auto_mem<pcre> code;
-        int         eoff;
 
         args[1] = remaining_args(cmdline, args);
         if (fs.get_filter(args[1]) != NULL) {
@@ -1614,21 +1608,24 @@ static Result<string, string> com_filter(exec_context &ec, string cmdline, vecto
             return ec.make_error("filter limit reached, try combining "
                                  "filters with a pipe symbol (e.g. foo|bar)");
         }
-        else if ((code = pcre_compile(args[1].c_str(),
-                                      PCRE_CASELESS,
-                                      &errptr,
-                                      &eoff,
-                                      nullptr)) == NULL) {
-            return ec.make_error("{}", errptr);
+
+        auto compile_res = pcre_registry::singleton().compile(args[1],
+                                                              PCRE_CASELESS);
+
+        if (compile_res.isErr()) {
+            return ec.make_error("{}", compile_res.unwrapErr().ce_msg);
         }
-        else if (ec.ec_dry_run) {
+
+        auto code = compile_res.unwrap();
+
+        if (ec.ec_dry_run) {
             if (args[0] == "filter-in" && !fs.empty()) {
                 lnav_data.ld_preview_status_source.get_description()
                     .set_value("Match preview for :filter-in only works if there are no other filters");
                 retval = "";
             } else {
                 auto &hm = tc->get_highlights();
-                highlighter hl(code.release());
+                highlighter hl(code);
                 int color;
 
                 if (args[0] == "filter-out") {
@@ -1658,7 +1655,7 @@ static Result<string, string> com_filter(exec_context &ec, string cmdline, vecto
             if (!filter_index) {
                 return ec.make_error("too many filters");
             }
-            auto pf = make_shared<pcre_filter>(lt, args[1], *filter_index, code.release());
+            auto pf = make_shared<pcre_filter>(lt, args[1], *filter_index, pcrepp(code));
 
             log_debug("%s [%d] %s", args[0].c_str(), pf->get_index(), args[1].c_str());
             fs.add_filter(pf);
@@ -2026,7 +2023,7 @@ static Result<string, string> com_create_search_table(exec_context &ec, string c
         if (ec.ec_dry_run) {
             textview_curses *tc = &lnav_data.ld_views[LNV_LOG];
             auto &hm = tc->get_highlights();
-            highlighter hl(re.p_code);
+            highlighter hl(re);
 
             hl.with_attrs(view_colors::ansi_color_pair(COLOR_BLACK, COLOR_CYAN) | A_BLINK);
 
@@ -905,6 +905,63 @@ static struct json_path_container logfile_handlers = {
         .with_min_value(1)
         .for_field(&_lnav_config::lc_logfile,
                    &lnav::logfile::config::lc_max_unrecognized_lines),
+    yajlpp::property_handler("parallel-index-chunk-size")
+        .with_synopsis("<bytes>")
+        .with_description(
+            "The size of the chunks a large file is split into when it is "
+            "indexed on multiple threads.  A value of zero disables "
+            "parallel indexing.")
+        .with_min_value(0)
+        .for_field(&_lnav_config::lc_logfile,
+                   &lnav::logfile::config::lc_parallel_index_chunk_size),
+    yajlpp::property_handler("index-cache-min-size")
+        .with_synopsis("<bytes>")
+        .with_description(
+            "The minimum size of a file before its index is saved so that it "
+            "does not need to be rebuilt when the file is reopened.  A value "
+            "of zero disables the index cache.")
+        .with_min_value(0)
+        .for_field(&_lnav_config::lc_logfile,
+                   &lnav::logfile::config::lc_index_cache_min_size),
+    yajlpp::property_handler("index-cache-ttl")
+        .with_synopsis("<duration>")
+        .with_description(
+            "The time-to-live for saved file indexes, expressed as a duration "
+            "(e.g. '3d' for three days)")
+        .with_example("3d")
+        .with_example("12h")
+        .for_field(&_lnav_config::lc_logfile,
+                   &lnav::logfile::config::lc_index_cache_ttl),
+    yajlpp::property_handler("trigram-index-min-size")
+        .with_synopsis("<bytes>")
+        .with_description(
+            "The minimum size of a file before an index of the "
+            "three-character sequences in its lines is built and saved "
+            "alongside the index cache.  Searches and filters with a literal "
+            "string only look at the parts of the file that could contain "
+            "it.  A value of zero disables the index.")
+        .with_min_value(0)
+        .for_field(&_lnav_config::lc_logfile,
+                   &lnav::logfile::config::lc_trigram_index_min_size),
+    yajlpp::property_handler("use-mmap")
+        .with_synopsis("bool")
+        .with_description(
+            "Map files that are not expected to change into memory instead "
+            "of reading them.  Files extracted from archives, read-only "
+            "files, and files that have not been modified for the "
+            "'mmap-min-age' duration are considered unchanging.")
+        .for_field(&_lnav_config::lc_logfile,
+                   &lnav::logfile::config::lc_use_mmap),
+    yajlpp::property_handler("mmap-min-age")
+        .with_synopsis("<duration>")
+        .with_description(
+            "The time since a file was last modified before it is mapped "
+            "into memory, expressed as a duration (e.g. '10m' for ten "
+            "minutes)")
+        .with_example("10m")
+        .with_example("1h")
+        .for_field(&_lnav_config::lc_logfile,
+                   &lnav::logfile::config::lc_mmap_min_age),
 };
 
 static struct json_path_container ssh_config_handlers = {
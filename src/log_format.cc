@@ -223,12 +223,18 @@ std::string logline_value::to_string() const
 }
 
 vector<std::shared_ptr<log_format>> log_format::lf_root_formats;
+log_format_prefilter log_format::lf_root_prefilter;
 
 vector<std::shared_ptr<log_format>> &log_format::get_root_formats()
 {
     return lf_root_formats;
 }
 
+log_format_prefilter &log_format::get_root_prefilter()
+{
+    return lf_root_prefilter;
+}
+
 static bool next_format(const std::vector<std::shared_ptr<external_log_format::pattern>> &patterns,
                         int &index,
                         int &locked_index)
@@ -251,6 +257,45 @@ static bool next_format(const std::vector<std::shared_ptr<external_log_format::p
     return retval;
 }
 
+/**
+ * Step through the patterns for a scan.  The locked pattern is tried first
+ * and, if that does not match, the rest are tried in the given order.
+ *
+ * @param scan_order The indexes of the patterns in the order to try them.
+ * @param index The index of the current pattern, -1 to start.
+ * @param locked_index The index of the locked pattern or -1 if the locked
+ *   pattern has already been tried.
+ * @param scan_pos The position in scan_order of the next pattern to try.
+ * @param orig_lock The index of the pattern that was originally locked,
+ *   which does not need to be tried again.
+ */
+static bool next_format(const std::vector<int> &scan_order,
+                        int &index,
+                        int &locked_index,
+                        size_t &scan_pos,
+                        int orig_lock)
+{
+    if (locked_index != -1) {
+        if (index == locked_index) {
+            return false;
+        }
+        index = locked_index;
+        return true;
+    }
+
+    while (scan_pos < scan_order.size()) {
+        auto next_index = scan_order[scan_pos];
+
+        scan_pos += 1;
+        if (next_index != orig_lock) {
+            index = next_index;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 bool log_format::next_format(pcre_format *fmt, int &index, int &locked_index)
 {
     bool retval = true;
@@ -331,7 +376,7 @@ const char *log_format::log_scanf(uint32_t line_number,
     return retval;
 }
 
-void log_format::check_for_new_year(std::vector<logline> &dst, exttm etm,
+void log_format::check_for_new_year(logline_index &dst, exttm etm,
                                     struct timeval log_tv)
 {
     if (dst.empty()) {
@@ -623,7 +668,7 @@ bool external_log_format::scan_for_partial(shared_buffer_ref &sbr, size_t &len_o
 }
 
 log_format::scan_result_t external_log_format::scan(logfile &lf,
-                                                    std::vector<logline> &dst,
+                                                    logline_index &dst,
                                                     const line_info &li,
                                                     shared_buffer_ref &sbr)
 {
@@ -706,8 +751,13 @@ log_format::scan_result_t external_log_format::scan(logfile &lf,
     pcre_context_static<128> pc;
     int curr_fmt = -1, orig_lock = this->last_pattern_index();
     int pat_index = orig_lock;
+    size_t scan_pos = 0;
 
-    while (::next_format(this->elf_pattern_order, curr_fmt, pat_index)) {
+    while (::next_format(this->elf_pattern_scan_order,
+                         curr_fmt,
+                         pat_index,
+                         scan_pos,
+                         orig_lock)) {
         auto fpat = this->elf_pattern_order[curr_fmt];
         auto& pat = fpat->p_pcre;
 
@@ -717,8 +767,10 @@ log_format::scan_result_t external_log_format::scan(logfile &lf,
 
         if (!pat->match(pc, pi, PCRE_NO_UTF8_CHECK)) {
             if (!this->lf_pattern_locks.empty() && pat_index != -1) {
-                curr_fmt = -1;
                 pat_index = -1;
+                if (this->lf_specialized) {
+                    this->sort_pattern_scan_order();
+                }
             }
             continue;
         }
@@ -841,6 +893,7 @@ log_format::scan_result_t external_log_format::scan(logfile &lf,
 
         dst.emplace_back(li.li_file_range.fr_offset, log_tv, level, mod_index, opid);
 
+        this->lf_pattern_hits[curr_fmt] += 1;
         if (orig_lock != curr_fmt) {
             uint32_t lock_line;
 
@@ -1648,6 +1701,12 @@ void external_log_format::build(std::vector<std::string> &errors) {
         this->elf_pattern_order.push_back(iter->second);
     }
 
+    this->elf_pattern_scan_order.clear();
+    for (size_t lpc = 0; lpc < this->elf_pattern_order.size(); lpc++) {
+        this->elf_pattern_scan_order.push_back(lpc);
+    }
+    this->lf_pattern_hits.assign(this->elf_pattern_order.size(), 0);
+
     if (this->elf_type != ELF_TYPE_TEXT) {
         if (!this->elf_patterns.empty()) {
             errors.push_back("error:" +
@@ -1928,10 +1987,9 @@ void external_log_format::build(std::vector<std::string> &errors) {
     for (auto &hd_pair : this->elf_highlighter_patterns) {
         external_log_format::highlighter_def &hd = hd_pair.second;
         const std::string &pattern = hd.hd_pattern;
-        const char *errptr;
         auto fg = styling::color_unit::make_empty();
         auto bg = styling::color_unit::make_empty();
-        int eoff, attrs = 0;
+        int attrs = 0;
 
         if (!hd.hd_color.empty()) {
             fg = styling::color_unit::from_str(hd.hd_color)
@@ -1966,19 +2024,18 @@ void external_log_format::build(std::vector<std::string> &errors) {
             attrs |= A_BLINK;
         }
 
-        pcre *code = pcre_compile(pattern.c_str(),
-                                  PCRE_CASELESS,
-                                  &errptr,
-                                  &eoff,
-                                  nullptr);
+        auto compile_res = pcre_registry::singleton().compile(pattern,
+                                                              PCRE_CASELESS);
+
+        if (compile_res.isErr()) {
+            auto ce = compile_res.unwrapErr();
 
-        if (code == nullptr) {
             errors.push_back("error:"
                              + this->elf_name.to_string()
                              + ":highlighters/"
                              + hd_pair.first.to_string()
                              + ":"
-                             + string(errptr));
+                             + string(ce.ce_msg));
             errors.push_back("error:"
                              + this->elf_name.to_string()
                              + ":highlighters/"
@@ -1990,10 +2047,10 @@ void external_log_format::build(std::vector<std::string> &errors) {
                              + ":highlighters/"
                              + hd_pair.first.to_string()
                              + ":"
-                             + string(eoff, ' ')
+                             + string(ce.ce_offset, ' ')
                              + "^");
         } else {
-            this->lf_highlighters.emplace_back(code);
+            this->lf_highlighters.emplace_back(compile_res.unwrap());
             this->lf_highlighters.back()
                 .with_pattern(pattern)
                 .with_format_name(this->elf_name)
@@ -2089,6 +2146,30 @@ public:
         }
     };
 
+    int get_opid_column() const override {
+        const auto &elf = this->elt_format;
+
+        // The JSON scanner only hashes opids that are strings, numbers are
+        // left with a zero hash.
+        if (elf.elf_opid_field.empty() ||
+            elf.elf_type == external_log_format::ELF_TYPE_JSON) {
+            return -1;
+        }
+
+        auto iter = elf.elf_value_defs.find(elf.elf_opid_field);
+
+        // The hash in the logline is of the captured text, so it can only
+        // be compared against values that are not transformed.
+        if (iter == elf.elf_value_defs.end() ||
+            iter->second->vd_meta.lvm_column == -1 ||
+            iter->second->vd_meta.lvm_kind != value_kind_t::VALUE_TEXT ||
+            !iter->second->vd_collate.empty()) {
+            return -1;
+        }
+
+        return VT_COL_MAX + iter->second->vd_meta.lvm_column;
+    };
+
     void get_foreign_keys(std::vector<std::string> &keys_inout) const
     {
         log_vtab_impl::get_foreign_keys(keys_inout);
@@ -2203,6 +2284,7 @@ std::shared_ptr<log_format> external_log_format::specialized(int fmt_lock)
 
     retval->lf_specialized = true;
     this->lf_pattern_locks.clear();
+    std::fill(this->lf_pattern_hits.begin(), this->lf_pattern_hits.end(), 0);
     if (fmt_lock != -1) {
         retval->lf_pattern_locks.emplace_back(0, fmt_lock);
     }
@@ -2224,6 +2306,41 @@ std::shared_ptr<log_format> external_log_format::specialized(int fmt_lock)
     return retval;
 }
 
+bool external_log_format::supports_parallel_scan() const
+{
+    if (this->elf_type != ELF_TYPE_TEXT) {
+        return false;
+    }
+
+    // Module lookups update the global MODULE_FORMATS table.
+    for (const auto &pat : this->elf_pattern_order) {
+        if (pat->p_module_field_index != -1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void external_log_format::sort_pattern_scan_order()
+{
+    auto &order = this->elf_pattern_scan_order;
+    const auto &hits = this->lf_pattern_hits;
+
+    // The order changes slowly, so an insertion sort is usually a single
+    // pass over the few patterns in a format.
+    for (size_t lpc = 1; lpc < order.size(); lpc++) {
+        auto pat_index = order[lpc];
+        auto pos = lpc;
+
+        while (pos > 0 && hits[order[pos - 1]] < hits[pat_index]) {
+            order[pos] = order[pos - 1];
+            pos -= 1;
+        }
+        order[pos] = pat_index;
+    }
+}
+
 bool external_log_format::match_name(const string &filename)
 {
     if (this->elf_file_pattern.empty()) {
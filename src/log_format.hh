@@ -60,6 +60,8 @@
 #include "log_level.hh"
 #include "line_buffer.hh"
 #include "log_format_fwd.hh"
+#include "log_format_prefilter.hh"
+#include "logline_index.hh"
 
 struct sqlite3;
 class logfile;
@@ -306,6 +308,12 @@ public:
      */
     static std::vector<std::shared_ptr<log_format>> &get_root_formats();
 
+    /**
+     * @return The prefilter used to pick out the root formats that could
+     * match a line.  The entries are indexes into get_root_formats().
+     */
+    static log_format_prefilter &get_root_prefilter();
+
     /**
      * Template used to register log formats during initialization.
      */
@@ -346,6 +354,9 @@ public:
     virtual void clear()
     {
         this->lf_pattern_locks.clear();
+        std::fill(this->lf_pattern_hits.begin(),
+                  this->lf_pattern_hits.end(),
+                  0);
         this->lf_date_time.clear();
     };
 
@@ -374,7 +385,7 @@ public:
      * @param len The length of the prefix string.
      */
     virtual scan_result_t scan(logfile &lf,
-                               std::vector<logline> &dst,
+                               logline_index &dst,
                                const line_info &li,
                                shared_buffer_ref &sbr) = 0;
 
@@ -410,6 +421,14 @@ public:
 
     virtual std::shared_ptr<log_format> specialized(int fmt_lock = -1) = 0;
 
+    /**
+     * @return True if specialized copies of this format can scan lines on
+     *   threads other than the main one.
+     */
+    virtual bool supports_parallel_scan() const {
+        return false;
+    };
+
     virtual std::shared_ptr<log_vtab_impl> get_vtab_impl() const {
         return nullptr;
     };
@@ -441,7 +460,7 @@ public:
         return &this->lf_timestamp_format[0];
     };
 
-    void check_for_new_year(std::vector<logline> &dst, exttm log_tv,
+    void check_for_new_year(logline_index &dst, exttm log_tv,
                             timeval timeval1);
 
     virtual std::string get_pattern_name(uint64_t line_number) const;
@@ -470,6 +489,12 @@ public:
     uint8_t lf_mod_index{0};
     date_time_scanner lf_date_time;
     std::vector<pattern_for_lines> lf_pattern_locks;
+    /**
+     * The number of lines that were matched by each pattern, indexed in the
+     * same way as the pattern indexes in lf_pattern_locks.  Formats that do
+     * not keep track of this leave it empty.
+     */
+    std::vector<uint64_t> lf_pattern_hits;
     intern_string_t lf_timestamp_field{intern_string::lookup("timestamp", -1)};
     std::vector<const char *> lf_timestamp_format;
     unsigned int lf_timestamp_flags{0};
@@ -481,6 +506,7 @@ public:
     bool lf_specialized{false};
 protected:
     static std::vector<std::shared_ptr<log_format>> lf_root_formats;
+    static log_format_prefilter lf_root_prefilter;
 
     struct pcre_format {
         pcre_format(const char *regex) : name(regex), pcre(regex) {
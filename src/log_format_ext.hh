@@ -135,7 +135,7 @@ public:
     bool match_name(const std::string &filename);
 
     scan_result_t scan(logfile &lf,
-                       std::vector<logline> &dst,
+                       logline_index &dst,
                        const line_info &offset,
                        shared_buffer_ref &sbr);
 
@@ -169,6 +169,14 @@ public:
 
     std::shared_ptr<log_format> specialized(int fmt_lock);
 
+    bool supports_parallel_scan() const;
+
+    /**
+     * Sort elf_pattern_scan_order by the number of hits for each pattern.
+     * Patterns with the same number of hits keep their relative order.
+     */
+    void sort_pattern_scan_order();
+
     const logline_value_stats *stats_for_value(const intern_string_t &name) const {
         const logline_value_stats *retval = nullptr;
 
@@ -352,6 +360,12 @@ public:
     std::shared_ptr<pcrepp> elf_filename_pcre;
     std::map<std::string, std::shared_ptr<pattern>> elf_patterns;
     std::vector<std::shared_ptr<pattern>> elf_pattern_order;
+    /**
+     * The indexes into elf_pattern_order in the order they are tried when
+     * the locked pattern does not match.  Specialized formats keep this
+     * sorted by the number of hits so the most common patterns go first.
+     */
+    std::vector<int> elf_pattern_scan_order;
     std::vector<sample> elf_samples;
     std::unordered_map<const intern_string_t, std::shared_ptr<value_def>>
         elf_value_defs;
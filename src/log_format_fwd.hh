@@ -291,6 +291,8 @@ public:
                  (this->ll_millis <= (rhs.tv_usec / 1000))));
     };
 private:
+    friend class logline_index;
+
     file_off_t ll_offset;
     time_t ll_time;
     unsigned int ll_millis : 10;
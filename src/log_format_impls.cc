@@ -143,7 +143,7 @@ class generic_log_format : public log_format {
     };
 
     scan_result_t scan(logfile &lf,
-                       vector<logline> &dst,
+                       logline_index &dst,
                        const line_info &li,
                        shared_buffer_ref &sbr)
     {
@@ -400,7 +400,7 @@ public:
         this->blf_field_defs.clear();
     };
 
-    scan_result_t scan_int(std::vector<logline> &dst,
+    scan_result_t scan_int(logline_index &dst,
                            const line_info &li,
                            shared_buffer_ref &sbr) {
         static const intern_string_t STATUS_CODE = intern_string::lookup("bro_status_code");
@@ -478,7 +478,7 @@ public:
     }
 
     scan_result_t scan(logfile &lf,
-                       std::vector<logline> &dst,
+                       logline_index &dst,
                        const line_info &li,
                        shared_buffer_ref &sbr) {
         static pcrepp SEP_RE(R"(^#separator\s+(.+))");
@@ -918,7 +918,7 @@ public:
         this->wlf_field_defs.clear();
     };
 
-    scan_result_t scan_int(std::vector<logline> &dst,
+    scan_result_t scan_int(logline_index &dst,
                            const line_info &li,
                            shared_buffer_ref &sbr) {
         static const intern_string_t F_DATE = intern_string::lookup("date");
@@ -1033,7 +1033,7 @@ public:
     }
 
     scan_result_t scan(logfile &lf,
-                       std::vector<logline> &dst,
+                       logline_index &dst,
                        const line_info &li,
                        shared_buffer_ref &sbr) override {
         static auto W3C_LOG_NAME = intern_string::lookup("w3c_log");
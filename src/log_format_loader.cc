@@ -1051,6 +1051,60 @@ void load_formats(const std::vector<ghc::filesystem::path> &extra_paths,
         return elem->get_name() == "generic_log";
     });
     roots.insert(iter, graph_ordered_formats.begin(), graph_ordered_formats.end());
+
+    auto &prefilter = log_format::get_root_prefilter();
+
+    prefilter.clear();
+    for (size_t lpc = 0; lpc < roots.size(); lpc++) {
+        auto *elf = dynamic_cast<external_log_format *>(roots[lpc].get());
+
+        if (elf == nullptr) {
+            prefilter.add_unconditional(lpc);
+            continue;
+        }
+        if (elf->elf_type == external_log_format::ELF_TYPE_JSON) {
+            // Every JSON log message is an object.
+            prefilter.add_literal(lpc, "{");
+            continue;
+        }
+        bool has_pattern = false;
+        for (const auto &pat : elf->elf_pattern_order) {
+            if (pat->p_module_format) {
+                continue;
+            }
+            has_pattern = true;
+            prefilter.add_literal(
+                lpc, log_format_prefilter::required_literal(pat->p_string));
+        }
+        // Formats that only have module patterns never match a line on their
+        // own, but it's up to scan() to decide that.
+        if (!has_pattern) {
+            prefilter.add_unconditional(lpc);
+        }
+    }
+    prefilter.build();
+    log_info("Format prefilter has %d literals", prefilter.literal_count());
+
+    // Double-check the literal extraction against the samples.
+    std::vector<bool> candidates;
+    for (size_t lpc = 0; lpc < roots.size(); lpc++) {
+        auto *elf = dynamic_cast<external_log_format *>(roots[lpc].get());
+
+        if (elf == nullptr) {
+            continue;
+        }
+        for (const auto &sample : elf->elf_samples) {
+            prefilter.match(sample.s_line.c_str(), sample.s_line.size(),
+                            candidates);
+            if (!candidates[lpc]) {
+                log_warning("format prefilter rejected sample for %s: %s",
+                            elf->get_name().get(),
+                            sample.s_line.c_str());
+                prefilter.add_unconditional(lpc);
+                break;
+            }
+        }
+    }
 }
 
 static void exec_sql_in_path(sqlite3 *db, const ghc::filesystem::path &path, std::vector<string> &errors)
@@ -0,0 +1,634 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file log_format_prefilter.cc
+ */
+
+#include "config.h"
+
+#include <ctype.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+
+#include "log_format_prefilter.hh"
+
+namespace {
+
+/**
+ * A simple scanner for PCRE patterns that collects the runs of literal
+ * characters that are required for the pattern to match.  Any construct that
+ * is not understood causes the scan to fail, in which case the pattern is
+ * treated as not having any required literals.
+ */
+class literal_scanner {
+public:
+    explicit literal_scanner(const std::string &regex) : ls_regex(regex) {};
+
+    bool scan(std::vector<std::string> &lits_out)
+    {
+        bool no_alt = this->scan_sequence(lits_out);
+
+        return !this->ls_failed && no_alt && this->at_end();
+    };
+
+private:
+    enum class quant_t {
+        NONE,
+        OPTIONAL,
+        REPEAT,
+    };
+
+    bool at_end() const
+    {
+        return this->ls_pos >= this->ls_regex.size();
+    };
+
+    char peek(size_t off = 0) const
+    {
+        if (this->ls_pos + off >= this->ls_regex.size()) {
+            return '\0';
+        }
+        return this->ls_regex[this->ls_pos + off];
+    };
+
+    quant_t skip_quantifier()
+    {
+        quant_t retval;
+
+        switch (this->peek()) {
+            case '?':
+            case '*':
+                this->ls_pos += 1;
+                retval = quant_t::OPTIONAL;
+                break;
+            case '+':
+                this->ls_pos += 1;
+                retval = quant_t::REPEAT;
+                break;
+            case '{': {
+                size_t off = 1;
+                bool has_min = false, min_is_zero = true;
+
+                while (isdigit(this->peek(off))) {
+                    has_min = true;
+                    if (this->peek(off) != '0') {
+                        min_is_zero = false;
+                    }
+                    off += 1;
+                }
+                if (!has_min) {
+                    // PCRE treats a brace that does not start a valid
+                    // quantifier as a literal.
+                    return quant_t::NONE;
+                }
+                if (this->peek(off) == ',') {
+                    off += 1;
+                    while (isdigit(this->peek(off))) {
+                        off += 1;
+                    }
+                }
+                if (this->peek(off) != '}') {
+                    return quant_t::NONE;
+                }
+                this->ls_pos += off + 1;
+                retval = min_is_zero ? quant_t::OPTIONAL : quant_t::REPEAT;
+                break;
+            }
+            default:
+                return quant_t::NONE;
+        }
+
+        // Lazy and possessive suffixes
+        if (this->peek() == '?' || this->peek() == '+') {
+            this->ls_pos += 1;
+        }
+
+        return retval;
+    };
+
+    void skip_until(char term)
+    {
+        while (!this->at_end() && this->peek() != term) {
+            this->ls_pos += 1;
+        }
+        if (this->at_end()) {
+            this->ls_failed = true;
+        } else {
+            this->ls_pos += 1;
+        }
+    };
+
+    void skip_class()
+    {
+        // Skip the opening bracket and any negation.
+        this->ls_pos += 1;
+        if (this->peek() == '^') {
+            this->ls_pos += 1;
+        }
+        // A closing bracket at the start is part of the class.
+        if (this->peek() == ']') {
+            this->ls_pos += 1;
+        }
+        while (!this->at_end()) {
+            switch (this->peek()) {
+                case '\\':
+                    this->ls_pos += 2;
+                    break;
+                case '[':
+                    if (this->peek(1) == ':') {
+                        this->ls_pos += 2;
+                        this->skip_until(']');
+                    } else {
+                        this->ls_pos += 1;
+                    }
+                    break;
+                case ']':
+                    this->ls_pos += 1;
+                    return;
+                default:
+                    this->ls_pos += 1;
+                    break;
+            }
+        }
+        this->ls_failed = true;
+    };
+
+    /**
+     * Skip an escape sequence that does not stand for a literal character,
+     * like a character type or a back-reference.
+     */
+    void skip_escape()
+    {
+        char ch = this->peek(1);
+
+        this->ls_pos += 2;
+        switch (ch) {
+            case 'Q':
+            case 'E':
+                this->ls_failed = true;
+                break;
+            case 'c':
+                this->ls_pos += 1;
+                break;
+            case 'x':
+                if (this->peek() == '{') {
+                    this->skip_until('}');
+                } else {
+                    for (int lpc = 0; lpc < 2 && isxdigit(this->peek());
+                         lpc++) {
+                        this->ls_pos += 1;
+                    }
+                }
+                break;
+            case 'g':
+            case 'k':
+            case 'p':
+            case 'P':
+                switch (this->peek()) {
+                    case '{':
+                        this->skip_until('}');
+                        break;
+                    case '<':
+                        this->skip_until('>');
+                        break;
+                    case '\'':
+                        this->ls_pos += 1;
+                        this->skip_until('\'');
+                        break;
+                    default:
+                        this->ls_pos += 1;
+                        break;
+                }
+                break;
+            default:
+                while (isdigit(ch) && isdigit(this->peek())) {
+                    this->ls_pos += 1;
+                }
+                break;
+        }
+    };
+
+    /**
+     * Scan the group that starts at the current position.  The literals in
+     * the group are only added if the group is always part of a match.
+     */
+    void scan_group(std::vector<std::string> &lits_out)
+    {
+        bool lookaround = false;
+
+        this->ls_pos += 1;
+        if (this->peek() == '?') {
+            switch (this->peek(1)) {
+                case ':':
+                case '>':
+                    this->ls_pos += 2;
+                    break;
+                case '=':
+                case '!':
+                    lookaround = true;
+                    this->ls_pos += 2;
+                    break;
+                case '<':
+                    if (this->peek(2) == '=' || this->peek(2) == '!') {
+                        lookaround = true;
+                        this->ls_pos += 3;
+                    } else {
+                        this->skip_until('>');
+                    }
+                    break;
+                case 'P':
+                    if (this->peek(2) != '<') {
+                        this->ls_failed = true;
+                        return;
+                    }
+                    this->skip_until('>');
+                    break;
+                case '\'':
+                    this->ls_pos += 2;
+                    this->skip_until('\'');
+                    break;
+                default:
+                    // Option settings, comments, conditionals, and so on.
+                    this->ls_failed = true;
+                    return;
+            }
+        } else if (this->peek() == '*') {
+            this->ls_failed = true;
+            return;
+        }
+
+        std::vector<std::string> inner;
+        bool no_alt = this->scan_sequence(inner);
+
+        if (this->ls_failed) {
+            return;
+        }
+        if (this->peek() != ')') {
+            this->ls_failed = true;
+            return;
+        }
+        this->ls_pos += 1;
+
+        auto quant = this->skip_quantifier();
+
+        if (!lookaround && no_alt && quant != quant_t::OPTIONAL) {
+            lits_out.insert(lits_out.end(), inner.begin(), inner.end());
+        }
+    };
+
+    /**
+     * Scan a sequence of atoms up to the end of the pattern or the closing
+     * parenthesis of the current group.
+     *
+     * @return False if the sequence contained an alternation.
+     */
+    bool scan_sequence(std::vector<std::string> &lits_out)
+    {
+        std::string run;
+        bool has_alt = false;
+        auto flush = [&run, &lits_out]() {
+            if (!run.empty()) {
+                lits_out.push_back(run);
+                run.clear();
+            }
+        };
+
+        while (!this->at_end() && !this->ls_failed) {
+            char ch = this->peek();
+            bool is_literal = false;
+
+            switch (ch) {
+                case ')':
+                    flush();
+                    return !has_alt;
+                case '|':
+                    has_alt = true;
+                    this->ls_pos += 1;
+                    flush();
+                    continue;
+                case '\\':
+                    if (this->ls_pos + 1 >= this->ls_regex.size()) {
+                        this->ls_failed = true;
+                        continue;
+                    }
+                    ch = this->peek(1);
+                    if (isalnum(ch)) {
+                        this->skip_escape();
+                    } else {
+                        is_literal = true;
+                        this->ls_pos += 2;
+                    }
+                    break;
+                case '[':
+                    this->skip_class();
+                    break;
+                case '(':
+                    flush();
+                    this->scan_group(lits_out);
+                    continue;
+                case '.':
+                case '^':
+                case '$':
+                case '*':
+                case '+':
+                case '?':
+                    this->ls_pos += 1;
+                    break;
+                default:
+                    is_literal = true;
+                    this->ls_pos += 1;
+                    break;
+            }
+
+            auto quant = this->skip_quantifier();
+
+            if (!is_literal) {
+                flush();
+                continue;
+            }
+
+            run.push_back(ch);
+            switch (quant) {
+                case quant_t::NONE:
+                    break;
+                case quant_t::OPTIONAL: {
+                    // The quantifier applies to the whole UTF-8 character,
+                    // so drop any continuation bytes along with the lead.
+                    unsigned char last;
+
+                    do {
+                        last = run.back();
+                        run.pop_back();
+                    } while ((last & 0xc0) == 0x80 && !run.empty());
+                    flush();
+                    break;
+                }
+                case quant_t::REPEAT:
+                    flush();
+                    break;
+            }
+        }
+
+        flush();
+        return !has_alt;
+    };
+
+    const std::string &ls_regex;
+    size_t ls_pos{0};
+    bool ls_failed{false};
+};
+
+}
+
+std::string log_format_prefilter::required_literal(const std::string &regex)
+{
+    std::vector<std::string> lits;
+    literal_scanner scanner(regex);
+    std::string retval;
+
+    if (!scanner.scan(lits)) {
+        return retval;
+    }
+
+    for (const auto &lit : lits) {
+        if (lit.size() > retval.size()) {
+            retval = lit;
+        }
+    }
+
+    return retval;
+}
+
+void log_format_prefilter::ensure_index(size_t index)
+{
+    if (index >= this->lp_unconditional.size()) {
+        this->lp_unconditional.resize(index + 1);
+    }
+}
+
+void log_format_prefilter::add_unconditional(size_t index)
+{
+    this->ensure_index(index);
+    this->lp_unconditional[index] = true;
+}
+
+void log_format_prefilter::add_literal(size_t index,
+                                       const std::string &literal,
+                                       bool caseless)
+{
+    if (!caseless) {
+        if (literal.empty()) {
+            this->add_unconditional(index);
+            return;
+        }
+
+        this->ensure_index(index);
+        this->lp_literals.emplace_back(literal, index);
+        return;
+    }
+
+    // Only ASCII letters are folded by the automaton.  In UTF-8 mode, PCRE
+    // also matches "k" and "s" against the Kelvin sign and the long s, so
+    // the longest run of the literal without those is used instead.
+    size_t best_start = 0, best_len = 0, start = 0;
+
+    for (size_t lpc = 0; lpc <= literal.size(); lpc++) {
+        auto ch = lpc < literal.size() ? (unsigned char) literal[lpc] : 0;
+
+        if (ch == 0 || ch >= 0x80 || tolower(ch) == 'k' ||
+            tolower(ch) == 's') {
+            if (lpc - start > best_len) {
+                best_start = start;
+                best_len = lpc - start;
+            }
+            start = lpc + 1;
+        }
+    }
+
+    if (best_len == 0) {
+        this->add_unconditional(index);
+        return;
+    }
+
+    std::string folded = literal.substr(best_start, best_len);
+
+    std::transform(folded.begin(), folded.end(), folded.begin(), ::tolower);
+    this->ensure_index(index);
+    this->lp_literals.emplace_back(folded, index);
+    this->lp_caseless = true;
+}
+
+void log_format_prefilter::clear()
+{
+    this->lp_unconditional.clear();
+    this->lp_literals.clear();
+    this->lp_literal_count = 0;
+    this->lp_caseless = false;
+    std::fill(std::begin(this->lp_byte_class),
+              std::end(this->lp_byte_class),
+              0);
+    this->lp_class_count = 1;
+    this->lp_transitions.clear();
+    this->lp_output_start.clear();
+    this->lp_outputs.clear();
+}
+
+void log_format_prefilter::build()
+{
+    struct trie_node {
+        std::map<uint8_t, uint32_t> tn_children;
+        std::vector<uint32_t> tn_outputs;
+        uint32_t tn_fail{0};
+    };
+
+    std::vector<trie_node> trie(1);
+
+    this->lp_transitions.clear();
+    this->lp_output_start.clear();
+    this->lp_outputs.clear();
+    std::fill(std::begin(this->lp_byte_class),
+              std::end(this->lp_byte_class),
+              0);
+    this->lp_class_count = 1;
+
+    for (const auto &lit_pair : this->lp_literals) {
+        uint32_t state = 0;
+
+        for (auto ch : lit_pair.first) {
+            auto uch = (uint8_t) ch;
+
+            if (this->lp_caseless) {
+                uch = tolower(uch);
+            }
+
+            if (this->lp_byte_class[uch] == 0) {
+                this->lp_byte_class[uch] = this->lp_class_count;
+                this->lp_class_count += 1;
+            }
+
+            auto iter = trie[state].tn_children.find(uch);
+            if (iter == trie[state].tn_children.end()) {
+                uint32_t next = trie.size();
+
+                trie[state].tn_children[uch] = next;
+                trie.emplace_back();
+                state = next;
+            } else {
+                state = iter->second;
+            }
+        }
+        trie[state].tn_outputs.push_back(lit_pair.second);
+    }
+
+    if (this->lp_caseless) {
+        for (int ch = 'A'; ch <= 'Z'; ch++) {
+            this->lp_byte_class[ch] = this->lp_byte_class[tolower(ch)];
+        }
+    }
+
+    this->lp_literal_count = std::count_if(
+        trie.begin(), trie.end(), [](const trie_node &tn) {
+            return !tn.tn_outputs.empty();
+        });
+
+    if (this->lp_literals.empty()) {
+        return;
+    }
+
+    // Turn the trie into a DFA by filling in the missing transitions with
+    // the transitions of the failure state, visiting the states in
+    // breadth-first order so the failure states are done first.
+    auto class_count = this->lp_class_count;
+    std::deque<uint32_t> queue;
+
+    this->lp_transitions.resize(trie.size() * class_count);
+    queue.push_back(0);
+    while (!queue.empty()) {
+        auto state = queue.front();
+        auto &node = trie[state];
+        auto fail = node.tn_fail;
+
+        queue.pop_front();
+        if (state != 0) {
+            auto &fail_outputs = trie[fail].tn_outputs;
+
+            node.tn_outputs.insert(node.tn_outputs.end(),
+                                   fail_outputs.begin(),
+                                   fail_outputs.end());
+            std::sort(node.tn_outputs.begin(), node.tn_outputs.end());
+            node.tn_outputs.erase(
+                std::unique(node.tn_outputs.begin(), node.tn_outputs.end()),
+                node.tn_outputs.end());
+            for (size_t cl = 0; cl < class_count; cl++) {
+                this->lp_transitions[state * class_count + cl] =
+                    this->lp_transitions[fail * class_count + cl];
+            }
+        }
+        for (const auto &child : node.tn_children) {
+            auto cl = this->lp_byte_class[child.first];
+
+            trie[child.second].tn_fail =
+                state == 0 ? 0 : this->lp_transitions[fail * class_count + cl];
+            this->lp_transitions[state * class_count + cl] = child.second;
+            queue.push_back(child.second);
+        }
+    }
+
+    this->lp_output_start.reserve(trie.size() + 1);
+    for (const auto &node : trie) {
+        this->lp_output_start.push_back(this->lp_outputs.size());
+        this->lp_outputs.insert(this->lp_outputs.end(),
+                                node.tn_outputs.begin(),
+                                node.tn_outputs.end());
+    }
+    this->lp_output_start.push_back(this->lp_outputs.size());
+}
+
+void log_format_prefilter::match(const char *str, size_t len,
+                                 std::vector<bool> &candidates_out) const
+{
+    candidates_out = this->lp_unconditional;
+    if (this->lp_transitions.empty()) {
+        return;
+    }
+
+    const auto *trans = this->lp_transitions.data();
+    const auto *out_start = this->lp_output_start.data();
+    auto class_count = this->lp_class_count;
+    uint32_t state = 0;
+
+    for (size_t lpc = 0; lpc < len; lpc++) {
+        state = trans[state * class_count +
+                      this->lp_byte_class[(uint8_t) str[lpc]]];
+        for (auto out = out_start[state]; out < out_start[state + 1]; out++) {
+            candidates_out[this->lp_outputs[out]] = true;
+        }
+    }
+}
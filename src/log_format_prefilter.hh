@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file log_format_prefilter.hh
+ */
+
+#ifndef lnav_log_format_prefilter_hh
+#define lnav_log_format_prefilter_hh
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Narrows down the set of formats that need to be tried when detecting the
+ * format of a file.  Each format registers the literal strings that one of
+ * its patterns requires to be in a line, then all of the literals are
+ * compiled into a single Aho-Corasick automaton.  A line is scanned once by
+ * the automaton and only the formats whose literals were found, or that had
+ * no usable literals, are candidates for the more expensive regex match.
+ */
+class log_format_prefilter {
+public:
+    /**
+     * Find the longest literal string that must appear in any subject that
+     * is matched by the given regular expression.
+     *
+     * @param regex The PCRE pattern to examine.
+     * @return The literal or an empty string if one could not be determined.
+     */
+    static std::string required_literal(const std::string &regex);
+
+    /**
+     * Mark the entry with the given index as a candidate for every line.
+     */
+    void add_unconditional(size_t index);
+
+    /**
+     * Mark the entry with the given index as a candidate for lines that
+     * contain the given literal.
+     *
+     * @param caseless True if the literal should be matched without regard
+     *   to case, as with PCRE_CASELESS.  Once a caseless literal is added,
+     *   all of the literals are matched without regard to case, which only
+     *   produces extra candidates.
+     */
+    void add_literal(size_t index,
+                     const std::string &literal,
+                     bool caseless = false);
+
+    /**
+     * Compile the literals that have been added so far into the automaton.
+     */
+    void build();
+
+    /**
+     * Remove all of the entries and literals.
+     */
+    void clear();
+
+    /** @return The number of entries known to the prefilter. */
+    size_t size() const { return this->lp_unconditional.size(); };
+
+    /** @return The number of distinct literals in the automaton. */
+    size_t literal_count() const { return this->lp_literal_count; };
+
+    /**
+     * Scan a line and determine which entries could possibly match it.
+     *
+     * @param str The line to scan.
+     * @param len The length of the line.
+     * @param candidates_out On return, holds a flag for each entry that is
+     *   true if the entry is a candidate for the line.
+     */
+    void match(const char *str, size_t len,
+               std::vector<bool> &candidates_out) const;
+
+private:
+    void ensure_index(size_t index);
+
+    std::vector<bool> lp_unconditional;
+    std::vector<std::pair<std::string, size_t>> lp_literals;
+    size_t lp_literal_count{0};
+    bool lp_caseless{false};
+
+    /** Maps each byte to its column in the transition table. */
+    uint16_t lp_byte_class[256]{};
+    size_t lp_class_count{1};
+    /** The DFA transitions, lp_class_count entries per state. */
+    std::vector<uint32_t> lp_transitions;
+    /**
+     * For each state, the offset into lp_outputs of the entries that are
+     * matched when the state is reached.  The entries for state N are in
+     * the range [lp_output_start[N], lp_output_start[N + 1]).
+     */
+    std::vector<uint32_t> lp_output_start;
+    std::vector<uint32_t> lp_outputs;
+};
+
+#endif
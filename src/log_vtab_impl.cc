@@ -31,6 +31,7 @@
 
 #include "base/lnav_log.hh"
 #include "base/string_util.hh"
+#include "base/strnatcmp.h"
 #include "sql_util.hh"
 #include "log_vtab_impl.hh"
 #include "yajlpp/yajlpp_def.hh"
@@ -176,6 +177,92 @@ struct vtab_cursor {
     struct log_cursor          log_cursor;
     shared_buffer_ref          log_msg;
     std::vector<logline_value> line_values;
+
+    /*
+     * The constraints that are checked against the metadata in the logline
+     * and the file, so the rows that cannot match are skipped without
+     * reading the message.  SQLite still checks the remaining rows.
+     */
+
+    /** True if any of the constraints below are set. */
+    bool has_metadata_constraints{false};
+    /** Bitmask of the levels a message can have. */
+    uint32_t level_mask{~0U};
+    /** The files, by index in the source, that a message can be from. */
+    std::vector<bool> file_mask;
+    /** Bitmask of the opid hashes a message can have. */
+    uint64_t opid_mask{~0ULL};
+    /** The files that the opid hash is checked for. */
+    std::vector<bool> opid_files;
+
+    void clear_metadata_constraints() {
+        this->has_metadata_constraints = false;
+        this->level_mask = ~0U;
+        this->file_mask.clear();
+        this->opid_mask = ~0ULL;
+        this->opid_files.clear();
+    };
+
+    /**
+     * Narrow the files that a message can be from to the ones that pass
+     * the given predicate.
+     */
+    template<typename F>
+    void restrict_files(logfile_sub_source &lss, F pred) {
+        std::vector<bool> mask;
+
+        for (const auto &ld : lss) {
+            auto lf = ld->get_file_ptr();
+
+            mask.push_back(lf != nullptr && pred(*lf));
+        }
+        if (!this->file_mask.empty()) {
+            for (size_t lpc = 0; lpc < mask.size(); lpc++) {
+                mask[lpc] = mask[lpc] && this->file_mask[lpc];
+            }
+        }
+        this->file_mask = std::move(mask);
+        this->has_metadata_constraints = true;
+    };
+
+    /**
+     * @return True if the message at the given line passes the constraints
+     *   on its metadata.
+     */
+    bool metadata_matches(logfile_sub_source &lss, vis_line_t vl) const {
+        if (!this->has_metadata_constraints ||
+            vl >= this->log_cursor.lc_end_line) {
+            return true;
+        }
+
+        auto cl = lss.at(vl);
+        uint64_t line_number;
+        auto ld = lss.find_data(cl, line_number);
+        size_t file_index = cl / logfile_sub_source::MAX_LINES_PER_FILE;
+        auto lf = (*ld)->get_file_ptr();
+
+        if (lf == nullptr) {
+            return true;
+        }
+        if (!this->file_mask.empty() &&
+            (file_index >= this->file_mask.size() ||
+             !this->file_mask[file_index])) {
+            return false;
+        }
+
+        auto ll = lf->begin() + line_number;
+
+        if (!(this->level_mask & (1U << ll->get_msg_level()))) {
+            return false;
+        }
+        if (file_index < this->opid_files.size() &&
+            this->opid_files[file_index] &&
+            !(this->opid_mask & (1ULL << ll->get_opid()))) {
+            return false;
+        }
+
+        return true;
+    };
 };
 
 static int vt_destructor(sqlite3_vtab *p_svt);
@@ -289,6 +376,12 @@ static int vt_next(sqlite3_vtab_cursor *cur)
              log_vtab_data.lvd_progress(log_cursor_latest))) {
             break;
         }
+        if (!vc->metadata_matches(*vt->lss,
+                                  vc->log_cursor.lc_curr_line + 1_vl)) {
+            vc->log_cursor.lc_curr_line += 1_vl;
+            vc->log_cursor.lc_sub_index = 0;
+            continue;
+        }
         done = vt->vi->next(vc->log_cursor, *vt->lss);
     } while (!done);
 
@@ -761,6 +854,51 @@ void log_cursor::update(unsigned char op, vis_line_t vl, bool exact)
     }
 }
 
+/**
+ * The operator stored in the index info passed to vt_filter() for an IN
+ * constraint that is handled all at once.  SQLite reports these as EQ.
+ */
+static const unsigned char VT_INDEX_CONSTRAINT_IN = 0xff;
+
+/**
+ * Collect the text values that a metadata constraint is compared against.
+ *
+ * @return False if any of the values are not text, in which case the
+ *   constraint should not be used to skip rows.
+ */
+static bool collect_text_values(unsigned char op,
+                                sqlite3_value *arg,
+                                std::vector<std::string> &values_out)
+{
+#if SQLITE_VERSION_NUMBER >= 3038000
+    if (op == VT_INDEX_CONSTRAINT_IN) {
+        sqlite3_value *val;
+        int rc;
+
+        for (rc = sqlite3_vtab_in_first(arg, &val);
+             rc == SQLITE_OK && val != nullptr;
+             rc = sqlite3_vtab_in_next(arg, &val)) {
+            if (sqlite3_value_type(val) != SQLITE3_TEXT) {
+                return false;
+            }
+            values_out.emplace_back(
+                (const char *) sqlite3_value_text(val),
+                sqlite3_value_bytes(val));
+        }
+
+        return rc == SQLITE_DONE;
+    }
+#endif
+
+    if (sqlite3_value_type(arg) != SQLITE3_TEXT) {
+        return false;
+    }
+    values_out.emplace_back((const char *) sqlite3_value_text(arg),
+                            sqlite3_value_bytes(arg));
+
+    return true;
+}
+
 static int vt_filter(sqlite3_vtab_cursor *p_vtc,
                      int idxNum, const char *idxStr,
                      int argc, sqlite3_value **argv)
@@ -771,6 +909,74 @@ static int vt_filter(sqlite3_vtab_cursor *p_vtc,
         sqlite3_index_info::sqlite3_index_constraint *)idxStr;
 
     log_info("(%p) filter called: %d", vt, idxNum);
+    p_cur->clear_metadata_constraints();
+    for (int lpc = 0; lpc < idxNum; lpc++) {
+        if (index[lpc].op != SQLITE_INDEX_CONSTRAINT_EQ &&
+            index[lpc].op != VT_INDEX_CONSTRAINT_IN) {
+            continue;
+        }
+
+        std::vector<std::string> values;
+
+        if (!collect_text_values(index[lpc].op, argv[lpc], values)) {
+            continue;
+        }
+
+        auto col = index[lpc].iColumn;
+
+        if (col == VT_COL_LEVEL) {
+            uint32_t mask = 0;
+
+            for (const auto &val : values) {
+                for (int level = 0; level < LEVEL__MAX; level++) {
+                    if (levelcmp(val.c_str(), val.length(),
+                                 level_names[level], -1) == 0) {
+                        mask |= 1U << level;
+                    }
+                }
+            }
+            p_cur->level_mask &= mask;
+            p_cur->has_metadata_constraints = true;
+        } else if (col == VT_COL_MAX + vt->vi->vi_column_count + 1) {
+            // log_path uses the "naturalnocase" collation.
+            p_cur->restrict_files(*vt->lss, [&values](auto &lf) {
+                const auto &fn = lf.get_filename();
+
+                return std::any_of(
+                    values.begin(), values.end(), [&fn](const auto &val) {
+                        return strnatcasecmp(val.length(), val.c_str(),
+                                             fn.length(), fn.c_str()) == 0;
+                    });
+            });
+        } else if (col == vt->vi->get_format_column()) {
+            p_cur->restrict_files(*vt->lss, [&values](auto &lf) {
+                auto name = lf.get_format()->get_name();
+
+                return std::any_of(
+                    values.begin(), values.end(), [&name](const auto &val) {
+                        return strcasecmp(name.get(), val.c_str()) == 0;
+                    });
+            });
+        } else if (col == vt->vi->get_opid_column()) {
+            uint64_t mask = 0;
+
+            if (p_cur->opid_files.empty()) {
+                for (const auto &ld : *vt->lss) {
+                    auto lf = ld->get_file_ptr();
+
+                    p_cur->opid_files.push_back(
+                        lf != nullptr &&
+                        lf->get_format_name() == vt->vi->get_name());
+                }
+            }
+            for (const auto &val : values) {
+                mask |= 1ULL << (hash_str(val.c_str(), val.length()) & 0x3fU);
+            }
+            p_cur->opid_mask &= mask;
+            p_cur->has_metadata_constraints = true;
+        }
+    }
+
     p_cur->log_cursor.lc_curr_line = -1_vl;
     p_cur->log_cursor.lc_end_line = vis_line_t(vt->lss->text_line_count());
     vt_next(p_vtc);
@@ -807,7 +1013,10 @@ static int vt_filter(sqlite3_vtab_cursor *p_vtc,
         }
     }
 
-    while (!p_cur->log_cursor.is_eof() && !vt->vi->is_valid(p_cur->log_cursor, *vt->lss)) {
+    while (!p_cur->log_cursor.is_eof() &&
+           (!p_cur->metadata_matches(*vt->lss,
+                                     p_cur->log_cursor.lc_curr_line) ||
+            !vt->vi->is_valid(p_cur->log_cursor, *vt->lss))) {
         p_cur->log_cursor.lc_curr_line += 1_vl;
     }
 
@@ -856,6 +1065,48 @@ static int vt_best_index(sqlite3_vtab *tab, sqlite3_index_info *p_info)
         }
     }
 
+    // The constraints on the metadata are used to skip rows, but SQLite
+    // still needs to check them since the opid is only a hash and the
+    // level and path are compared using a collation.  The rows have to
+    // come back in log order, so an IN list has to be handled in a single
+    // scan instead of one scan per value, which needs sqlite3_vtab_in().
+    bool has_range = argvInUse > 0;
+
+#if SQLITE_VERSION_NUMBER >= 3038000
+    int path_col = VT_COL_MAX + vt->vi->vi_column_count + 1;
+
+    for (int lpc = 0; lpc < p_info->nConstraint; lpc++) {
+        auto cons = p_info->aConstraint[lpc];
+
+        if (!cons.usable || cons.op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            continue;
+        }
+
+        bool is_opid = (cons.iColumn != -1 &&
+                        cons.iColumn == vt->vi->get_opid_column());
+
+        // The hash of the opid only works for exact comparisons.
+        if (is_opid &&
+            strcmp(sqlite3_vtab_collation(p_info, lpc), "BINARY") != 0) {
+            continue;
+        }
+
+        if (is_opid ||
+            cons.iColumn == VT_COL_LEVEL ||
+            cons.iColumn == path_col ||
+            (cons.iColumn != -1 &&
+             cons.iColumn == vt->vi->get_format_column())) {
+            if (sqlite3_vtab_in(p_info, lpc, -1)) {
+                sqlite3_vtab_in(p_info, lpc, 1);
+                cons.op = VT_INDEX_CONSTRAINT_IN;
+            }
+            argvInUse += 1;
+            indexes.push_back(cons);
+            p_info->aConstraintUsage[lpc].argvIndex = argvInUse;
+        }
+    }
+#endif
+
     if (argvInUse) {
         sqlite3_index_info::sqlite3_index_constraint *index_copy;
         size_t len = indexes.size() * sizeof(*index_copy);
@@ -871,7 +1122,7 @@ static int vt_best_index(sqlite3_vtab *tab, sqlite3_index_info *p_info)
         p_info->idxNum = argvInUse;
         p_info->idxStr = (char *) index_copy;
         p_info->needToFreeIdxStr = 1;
-        p_info->estimatedCost = 10.0;
+        p_info->estimatedCost = has_range ? 10.0 : 100.0;
     }
 
     return SQLITE_OK;
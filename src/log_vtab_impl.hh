@@ -135,6 +135,24 @@ public:
 
     virtual void get_columns(std::vector<vtab_column> &cols) const { };
 
+    /**
+     * @return The number of the column with the operation ID of a message,
+     *   or -1 if there is no such column.  The ID is only checked against
+     *   the hash kept in the logline for messages from files in this
+     *   table's format.
+     */
+    virtual int get_opid_column() const {
+        return -1;
+    };
+
+    /**
+     * @return The number of the column with the name of a message's format,
+     *   or -1 if there is no such column.
+     */
+    virtual int get_format_column() const {
+        return -1;
+    };
+
     virtual void get_foreign_keys(std::vector<std::string> &keys_inout) const
     {
         keys_inout.emplace_back("log_line");
@@ -42,10 +42,16 @@
 
 #include <time.h>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <utility>
 
+#include "base/future_util.hh"
 #include "base/string_util.hh"
 #include "base/injector.hh"
+#include "base/paths.hh"
+#include "auto_fd.hh"
 #include "logfile.hh"
 #include "logfile.cfg.hh"
 #include "log_format.hh"
@@ -55,6 +61,56 @@ using namespace std;
 
 static const size_t INDEX_RESERVE_INCREMENT = 1024;
 
+/**
+ * Stands in for the real observers while the file is being indexed on a
+ * worker thread and records what needs to be passed on to them afterward.
+ */
+class logfile::async_observer
+    : public logfile_observer, public logline_observer {
+public:
+    indexing_result logfile_indexing(const std::shared_ptr<logfile> &lf,
+                                     file_off_t off,
+                                     file_size_t total) override
+    {
+        this->ao_offset = off;
+        this->ao_total = total;
+        this->ao_has_progress = true;
+
+        return this->ao_cancelled ? indexing_result::BREAK :
+               indexing_result::CONTINUE;
+    };
+
+    void logline_restart(const logfile &lf, file_size_t rollback_size) override
+    {
+        this->ao_restarted = true;
+        this->ao_rollback_size = rollback_size;
+        this->ao_first_new_line = lf.size();
+    };
+
+    void logline_new_lines(const logfile &lf,
+                           logfile::const_iterator ll_begin,
+                           logfile::const_iterator ll_end,
+                           shared_buffer_ref &sbr) override
+    {
+    };
+
+    void logline_eof(const logfile &lf) override
+    {
+        this->ao_eof = true;
+    };
+
+    logfile_observer *ao_logfile_observer{nullptr};
+    logline_observer *ao_logline_observer{nullptr};
+    std::atomic<file_off_t> ao_offset{0};
+    std::atomic<file_size_t> ao_total{0};
+    std::atomic<bool> ao_has_progress{false};
+    std::atomic<bool> ao_cancelled{false};
+    bool ao_restarted{false};
+    file_size_t ao_rollback_size{0};
+    size_t ao_first_new_line{0};
+    bool ao_eof{false};
+};
+
 Result<std::shared_ptr<logfile>, std::string> logfile::open(
     std::string filename, logfile_open_options &loo)
 {
@@ -111,6 +167,12 @@ Result<std::shared_ptr<logfile>, std::string> logfile::open(
 
     lf->lf_content_id = hasher().update(lf->lf_filename).to_string();
     lf->lf_line_buffer.set_fd(lf->lf_options.loo_fd);
+    // Overlap reading the file with scanning it while indexing.
+    lf->lf_line_buffer.set_read_ahead(!lf->lf_line_buffer.is_pipe());
+    if (lf->is_immutable() && lf->lf_line_buffer.set_mmap(true)) {
+        log_info("%s: file is not expected to change, mapping it",
+                 lf->lf_filename.c_str());
+    }
     lf->lf_index.reserve(INDEX_RESERVE_INCREMENT);
 
     lf->lf_indexing = lf->lf_options.loo_is_visible;
@@ -170,12 +232,108 @@ void logfile::set_format_base_time(log_format *lf)
     lf->lf_date_time.set_base_time(file_time);
 }
 
+/**
+ * Fix up the index after a line has been scanned.
+ *
+ * @param index The index that the format appended to.
+ * @param format The format that did the scan or nullptr if a format has not
+ *   been detected yet.
+ * @param found The result of the scan.
+ * @param li The line that was scanned.
+ * @param prescan_size The size of the index before the scan.
+ * @param prescan_time The time of the last line before the scan.
+ * @param default_time The time to use for an unrecognized line at the start
+ *   of the index.
+ * @param out_of_time_order_count Incremented when a line is found to be
+ *   earlier than the previous one.
+ * @return True if the index needs to be sorted.
+ */
+static bool update_index_after_scan(logline_index &index,
+                                    const log_format *format,
+                                    log_format::scan_result_t found,
+                                    const line_info &li,
+                                    size_t prescan_size,
+                                    time_t prescan_time,
+                                    time_t default_time,
+                                    uint32_t &out_of_time_order_count)
+{
+    bool retval = false;
+
+    switch (found) {
+        case log_format::SCAN_MATCH:
+            if (!index.empty()) {
+                index.back().set_valid_utf(li.li_valid_utf);
+            }
+            if (prescan_size > 0 &&
+                index.size() >= prescan_size &&
+                prescan_time != index[prescan_size - 1].get_time()) {
+                retval = true;
+            }
+            if (prescan_size > 0 && prescan_size < index.size()) {
+                logline &second_to_last = index[prescan_size - 1];
+                logline &latest = index[prescan_size];
+
+                if (latest < second_to_last) {
+                    if (format->lf_time_ordered) {
+                        out_of_time_order_count += 1;
+                        for (size_t lpc = prescan_size;
+                             lpc < index.size(); lpc++) {
+                            logline &line_to_update = index[lpc];
+
+                            line_to_update.set_time_skew(true);
+                            line_to_update.set_time(second_to_last.get_time());
+                            line_to_update.set_millis(
+                                second_to_last.get_millis());
+                        }
+                    } else {
+                        retval = true;
+                    }
+                }
+            }
+            break;
+        case log_format::SCAN_NO_MATCH: {
+            log_level_t last_level = LEVEL_UNKNOWN;
+            time_t last_time = default_time;
+            short last_millis = 0;
+            uint8_t last_mod = 0, last_opid = 0;
+
+            if (!index.empty()) {
+                logline &ll = index.back();
+
+                /*
+                 * Assume this line is part of the previous one(s) and copy the
+                 * metadata over.
+                 */
+                last_time = ll.get_time();
+                last_millis = ll.get_millis();
+                if (format != nullptr) {
+                    last_level = (log_level_t)(ll.get_level_and_flags() |
+                        LEVEL_CONTINUED);
+                }
+                last_mod = ll.get_module_id();
+                last_opid = ll.get_opid();
+            }
+            index.emplace_back(li.li_file_range.fr_offset,
+                               last_time,
+                               last_millis,
+                               last_level,
+                               last_mod,
+                               last_opid);
+            index.back().set_valid_utf(li.li_valid_utf);
+            break;
+        }
+        case log_format::SCAN_INCOMPLETE:
+            break;
+    }
+
+    return retval;
+}
+
 bool logfile::process_prefix(shared_buffer_ref &sbr, const line_info &li)
 {
     log_format::scan_result_t found = log_format::SCAN_NO_MATCH;
     size_t prescan_size = this->lf_index.size();
     time_t prescan_time = 0;
-    bool retval = false;
 
     if (this->lf_format.get() != nullptr) {
         if (!this->lf_index.empty()) {
@@ -188,7 +346,14 @@ bool logfile::process_prefix(shared_buffer_ref &sbr, const line_info &li)
              this->lf_index.size() <
              injector::get<const lnav::logfile::config &>().lc_max_unrecognized_lines) {
         auto &root_formats = log_format::get_root_formats();
+        auto &prefilter = log_format::get_root_prefilter();
         vector<std::shared_ptr<log_format>>::iterator iter;
+        bool use_prefilter = prefilter.size() == root_formats.size();
+
+        if (use_prefilter) {
+            prefilter.match(sbr.get_data(), sbr.length(),
+                            this->lf_format_candidates);
+        }
 
         /*
          * Try each scanner until we get a match.  Fortunately, all the formats
@@ -197,6 +362,10 @@ bool logfile::process_prefix(shared_buffer_ref &sbr, const line_info &li)
         for (iter = root_formats.begin();
              iter != root_formats.end() && (found != log_format::SCAN_MATCH);
              ++iter) {
+            if (use_prefilter &&
+                !this->lf_format_candidates[iter - root_formats.begin()]) {
+                continue;
+            }
             if (!(*iter)->match_name(this->lf_filename)) {
                 continue;
             }
@@ -227,83 +396,394 @@ bool logfile::process_prefix(shared_buffer_ref &sbr, const line_info &li)
                  * written out at the same time as the last one, so we need to
                  * go back and update everything.
                  */
-                logline &last_line = this->lf_index[this->lf_index.size() - 1];
+                auto last_tv = this->lf_index.back().get_timeval();
 
                 for (size_t lpc = 0; lpc < this->lf_index.size() - 1; lpc++) {
-                    this->lf_index[lpc].set_time(last_line.get_time());
-                    this->lf_index[lpc].set_millis(last_line.get_millis());
+                    this->lf_index[lpc].set_time(last_tv);
                 }
                 break;
             }
         }
     }
 
-    switch (found) {
-        case log_format::SCAN_MATCH:
-            if (!this->lf_index.empty()) {
-                this->lf_index.back().set_valid_utf(li.li_valid_utf);
+    return update_index_after_scan(this->lf_index,
+                                   this->lf_format.get(),
+                                   found,
+                                   li,
+                                   prescan_size,
+                                   prescan_time,
+                                   this->lf_index_time,
+                                   this->lf_out_of_time_order_count);
+}
+
+namespace {
+
+/**
+ * The lines from a chunk of a file that were indexed on a worker thread.
+ */
+struct index_chunk {
+    /** The offset of the first line in the chunk. */
+    file_off_t ic_start{0};
+    /** The offset just past the last line in the chunk. */
+    file_off_t ic_end{0};
+    /**
+     * The lines in the chunk.  The first entry is a placeholder so that the
+     * format always has a previous line to work from.
+     */
+    logline_index ic_index;
+    /**
+     * The number of lines at the start of the chunk that inherited their
+     * metadata from the placeholder and need to be fixed up.
+     */
+    size_t ic_leading_lines{0};
+    std::vector<log_format::pattern_for_lines> ic_pattern_locks;
+    std::vector<logline_value_stats> ic_value_stats;
+    std::vector<uint64_t> ic_pattern_hits;
+    size_t ic_longest_line{0};
+    uint32_t ic_out_of_time_order_count{0};
+    bool ic_sort_needed{false};
+    nonstd::optional<std::string> ic_error;
+};
+
+}
+
+/**
+ * Index the lines that start in the given range of the file.  This is run on
+ * a worker thread, so only the given format and line buffer are touched.
+ *
+ * @param lf The file being indexed, only passed through to the format.
+ * @param format A specialized format that is only used by this worker.
+ * @param fd A descriptor for the file that is owned by this worker.
+ * @param start The offset where the chunk begins.
+ * @param end The offset where the next chunk begins.
+ * @param align_start True if the start could be in the middle of a line.
+ * @param cancelled Set when the rest of the work is being thrown away.
+ */
+static index_chunk index_file_chunk(logfile &lf,
+                                    std::shared_ptr<log_format> format,
+                                    auto_fd fd,
+                                    file_off_t start,
+                                    file_off_t end,
+                                    bool align_start,
+                                    const std::atomic<bool> &cancelled)
+{
+    index_chunk retval;
+    line_buffer lb;
+    auto prev_range = file_range{start};
+
+    lb.set_fd(fd);
+    if (align_start) {
+        // Skip the tail of the line that started in the previous chunk.
+        auto load_result = lb.load_next_line(file_range{start - 1});
+
+        if (load_result.isErr()) {
+            retval.ic_error = load_result.unwrapErr();
+            return retval;
+        }
+        prev_range = load_result.unwrap().li_file_range;
+    }
+
+    retval.ic_start = prev_range.next_offset();
+    retval.ic_index.reserve(INDEX_RESERVE_INCREMENT);
+    retval.ic_index.emplace_back(retval.ic_start, 0, 0, LEVEL_UNKNOWN);
+    while (true) {
+        if (cancelled) {
+            retval.ic_error = "cancelled";
+            return retval;
+        }
+
+        auto load_result = lb.load_next_line(prev_range);
+
+        if (load_result.isErr()) {
+            retval.ic_error = load_result.unwrapErr();
+            return retval;
+        }
+
+        auto li = load_result.unwrap();
+
+        if (li.li_file_range.fr_offset >= end) {
+            break;
+        }
+        if (li.li_file_range.empty() || li.li_partial) {
+            retval.ic_error = "unexpected end of file";
+            return retval;
+        }
+        prev_range = li.li_file_range;
+
+        auto read_result = lb.read_range(li.li_file_range);
+        if (read_result.isErr()) {
+            retval.ic_error = read_result.unwrapErr();
+            return retval;
+        }
+
+        auto sbr = read_result.unwrap().rtrim(is_line_ending);
+        size_t prescan_size = retval.ic_index.size();
+        time_t prescan_time = retval.ic_index.back().get_time();
+
+        retval.ic_longest_line = std::max(retval.ic_longest_line,
+                                          sbr.length());
+        auto found = format->scan(lf, retval.ic_index, li, sbr);
+        if (update_index_after_scan(retval.ic_index,
+                                    format.get(),
+                                    found,
+                                    li,
+                                    prescan_size,
+                                    prescan_time,
+                                    0,
+                                    retval.ic_out_of_time_order_count)) {
+            retval.ic_sort_needed = true;
+        }
+    }
+    retval.ic_end = prev_range.next_offset();
+
+    // Real timestamps are never zero, so anything that still has the
+    // placeholder's time was a continuation of the previous chunk.
+    while (retval.ic_leading_lines + 1 < retval.ic_index.size() &&
+           retval.ic_index[retval.ic_leading_lines + 1].get_time() == 0) {
+        retval.ic_leading_lines += 1;
+    }
+    retval.ic_pattern_locks = format->lf_pattern_locks;
+    retval.ic_value_stats = format->lf_value_stats;
+    retval.ic_pattern_hits = format->lf_pattern_hits;
+
+    return retval;
+}
+
+static std::mutex ROOT_FORMAT_MUTEX;
+
+file_off_t logfile::index_in_parallel(file_off_t start,
+                                      const struct stat &st,
+                                      nonstd::optional<ui_clock::time_point> deadline,
+                                      bool &sort_needed,
+                                      bool &interrupted)
+{
+    static const auto FULL_DATE = ETF_DAY_SET|ETF_MONTH_SET|ETF_YEAR_SET;
+
+    const auto chunk_size = injector::get<const lnav::logfile::config &>()
+        .lc_parallel_index_chunk_size;
+    // hardware_concurrency() can return zero if the count is not known.
+    size_t thread_count = std::max(2U, std::thread::hardware_concurrency());
+
+    if (this->lf_index_threads > 0) {
+        thread_count = std::min(thread_count, this->lf_index_threads);
+    }
+    if (thread_count < 2 ||
+        chunk_size <= 0 ||
+        this->lf_format == nullptr ||
+        !this->lf_format->supports_parallel_scan() ||
+        (this->lf_format->lf_timestamp_flags & FULL_DATE) != FULL_DATE ||
+        this->lf_line_buffer.is_compressed() ||
+        this->lf_line_buffer.is_pipe() ||
+        !this->lf_options.loo_non_utf_is_visible ||
+        st.st_size - start < 2 * chunk_size) {
+        return start;
+    }
+
+    auto root_format = log_format::find_root_format(
+        this->lf_format->get_name().get());
+    if (root_format == nullptr) {
+        return start;
+    }
+
+    log_info("%s: indexing %" PRId64 " bytes in parallel",
+             this->lf_filename.c_str(),
+             (int64_t) (st.st_size - start));
+
+    std::atomic<bool> cancelled{false};
+    bool stitching = true;
+    auto retval = start;
+    lnav::futures::future_queue<index_chunk> fq([&](const index_chunk &ic) {
+        if (!stitching) {
+            return;
+        }
+        if (ic.ic_error || ic.ic_start != retval) {
+            log_warning("%s: unable to use chunk at %" PRId64 " -- %s",
+                        this->lf_filename.c_str(),
+                        (int64_t) ic.ic_start,
+                        ic.ic_error.value_or("misaligned").c_str());
+            stitching = false;
+            cancelled = true;
+            return;
+        }
+
+        auto base_size = this->lf_index.size();
+
+        this->lf_index.insert(this->lf_index.end(),
+                              ic.ic_index.begin() + 1,
+                              ic.ic_index.end());
+        for (size_t lpc = base_size;
+             lpc < base_size + ic.ic_leading_lines; lpc++) {
+            auto &ll = this->lf_index[lpc];
+
+            if (lpc == 0) {
+                ll.set_time(this->lf_index_time);
+                ll.set_millis(0);
+                if (ll.is_continued()) {
+                    ll.set_level(LEVEL_UNKNOWN);
+                }
+                continue;
             }
-            if (prescan_size > 0 &&
-                this->lf_index.size() >= prescan_size &&
-                prescan_time != this->lf_index[prescan_size - 1].get_time()) {
-                retval = true;
+
+            const auto &prev_ll = this->lf_index[lpc - 1];
+
+            ll.set_time(prev_ll.get_time());
+            ll.set_millis(prev_ll.get_millis());
+            if (ll.is_continued()) {
+                ll.set_level((log_level_t) (prev_ll.get_level_and_flags() |
+                                            LEVEL_CONTINUED));
+                ll.set_opid(prev_ll.get_opid());
             }
-            if (prescan_size > 0 && prescan_size < this->lf_index.size()) {
-                logline &second_to_last = this->lf_index[prescan_size - 1];
-                logline &latest = this->lf_index[prescan_size];
+        }
 
-                if (latest < second_to_last) {
-                    if (this->lf_format->lf_time_ordered) {
-                        this->lf_out_of_time_order_count += 1;
-                        for (size_t lpc = prescan_size;
-                             lpc < this->lf_index.size(); lpc++) {
-                            logline &line_to_update = this->lf_index[lpc];
+        auto first_line = base_size + ic.ic_leading_lines;
+        if (first_line > 0 &&
+            first_line < this->lf_index.size() &&
+            this->lf_index[first_line] < this->lf_index[first_line - 1]) {
+            if (this->lf_format->lf_time_ordered) {
+                const auto max_line = this->lf_index[first_line - 1];
+
+                this->lf_out_of_time_order_count += 1;
+                for (auto lpc = first_line;
+                     lpc < this->lf_index.size() &&
+                     this->lf_index[lpc] < max_line;
+                     lpc++) {
+                    auto &line_to_update = this->lf_index[lpc];
+
+                    line_to_update.set_time_skew(true);
+                    line_to_update.set_time(max_line.get_time());
+                    line_to_update.set_millis(max_line.get_millis());
+                }
+            } else {
+                sort_needed = true;
+            }
+        }
 
-                            line_to_update.set_time_skew(true);
-                            line_to_update.set_time(second_to_last.get_time());
-                            line_to_update.set_millis(
-                                second_to_last.get_millis());
-                        }
-                    } else {
-                        retval = true;
-                    }
+        if (base_size < this->lf_index.size()) {
+            auto &locks = this->lf_format->lf_pattern_locks;
+
+            for (const auto &pfl : ic.ic_pattern_locks) {
+                uint32_t line = base_size;
+
+                if (pfl.pfl_line > 0) {
+                    line += pfl.pfl_line - 1;
+                }
+                if (pfl.pfl_pat_index == this->lf_format->last_pattern_index()) {
+                    continue;
+                }
+                if (!locks.empty() && locks.back().pfl_line == line) {
+                    locks.back().pfl_pat_index = pfl.pfl_pat_index;
+                } else {
+                    locks.emplace_back(line, pfl.pfl_pat_index);
                 }
             }
-            break;
-        case log_format::SCAN_NO_MATCH: {
-            log_level_t last_level = LEVEL_UNKNOWN;
-            time_t last_time = this->lf_index_time;
-            short last_millis = 0;
-            uint8_t last_mod = 0, last_opid = 0;
+        }
+        auto &value_stats = this->lf_format->lf_value_stats;
+        for (size_t lpc = 0;
+             lpc < ic.ic_value_stats.size() && lpc < value_stats.size();
+             lpc++) {
+            value_stats[lpc].merge(ic.ic_value_stats[lpc]);
+        }
+        auto &pattern_hits = this->lf_format->lf_pattern_hits;
+        for (size_t lpc = 0;
+             lpc < ic.ic_pattern_hits.size() && lpc < pattern_hits.size();
+             lpc++) {
+            pattern_hits[lpc] += ic.ic_pattern_hits[lpc];
+        }
+        this->lf_longest_line = std::max(this->lf_longest_line,
+                                         ic.ic_longest_line);
+        this->lf_out_of_time_order_count += ic.ic_out_of_time_order_count;
+        if (ic.ic_sort_needed) {
+            sort_needed = true;
+        }
 
-            if (!this->lf_index.empty()) {
-                logline &ll = this->lf_index.back();
+        this->lf_line_buffer.mark_lines_loaded(ic.ic_end);
+        this->lf_index_size = ic.ic_end;
+        this->lf_partial_line = false;
+        retval = ic.ic_end;
 
-                /*
-                 * Assume this line is part of the previous one(s) and copy the
-                 * metadata over.
-                 */
-                last_time = ll.get_time();
-                last_millis = ll.get_millis();
-                if (this->lf_format.get() != nullptr) {
-                    last_level = (log_level_t)(ll.get_level_and_flags() |
-                        LEVEL_CONTINUED);
+        if (this->lf_logline_observer != nullptr) {
+            auto iter = this->begin() + base_size;
+
+            while (iter != this->end()) {
+                auto next_iter = iter + 1;
+
+                while (next_iter != this->end() &&
+                       next_iter->get_offset() == iter->get_offset()) {
+                    ++next_iter;
                 }
-                last_mod = ll.get_module_id();
-                last_opid = ll.get_opid();
+
+                auto next_offset = next_iter == this->end() ?
+                    ic.ic_end : next_iter->get_offset();
+                auto read_result = this->lf_line_buffer.read_range({
+                    iter->get_offset(), next_offset - iter->get_offset()
+                });
+
+                if (read_result.isErr()) {
+                    log_error("%s:read failure -- %s",
+                              this->lf_filename.c_str(),
+                              read_result.unwrapErr().c_str());
+                } else {
+                    auto sbr = read_result.unwrap().rtrim(is_line_ending);
+
+                    this->lf_logline_observer->logline_new_lines(
+                        *this, iter, next_iter, sbr);
+                }
+                iter = next_iter;
             }
-            this->lf_index.emplace_back(li.li_file_range.fr_offset,
-                                        last_time,
-                                        last_millis,
-                                        last_level,
-                                        last_mod,
-                                        last_opid);
-            this->lf_index.back().set_valid_utf(li.li_valid_utf);
-            break;
         }
-        case log_format::SCAN_INCOMPLETE:
+
+        if (this->lf_logfile_observer != nullptr) {
+            auto indexing_res = this->lf_logfile_observer->logfile_indexing(
+                this->shared_from_this(), ic.ic_end, st.st_size);
+
+            if (indexing_res == logfile_observer::indexing_result::BREAK) {
+                interrupted = true;
+                stitching = false;
+                cancelled = true;
+            }
+        }
+    }, thread_count);
+
+    size_t chunk_count = 0;
+    for (auto chunk_start = start;
+         stitching && chunk_start + 2 * chunk_size <= st.st_size;
+         chunk_start += chunk_size) {
+        // Keep every thread busy for at least one round, after that, leave
+        // the rest of the file for the next call.
+        if (chunk_count >= thread_count && deadline &&
+            ui_clock::now() > deadline.value()) {
             break;
+        }
+
+        std::shared_ptr<log_format> chunk_format;
+        {
+            // Other files could be indexed on worker threads at the same time
+            // and specialized() updates the root format.
+            std::lock_guard<std::mutex> lg(ROOT_FORMAT_MUTEX);
+
+            chunk_format = root_format->specialized(
+                this->lf_format->last_pattern_index());
+        }
+
+        for (auto &stats : chunk_format->lf_value_stats) {
+            stats.clear();
+        }
+        std::fill(chunk_format->lf_pattern_hits.begin(),
+                  chunk_format->lf_pattern_hits.end(),
+                  0);
+        this->set_format_base_time(chunk_format.get());
+        fq.push_back(std::async(std::launch::async,
+                                index_file_chunk,
+                                std::ref(*this),
+                                chunk_format,
+                                auto_fd::dup_of(this->lf_line_buffer.get_fd()),
+                                chunk_start,
+                                chunk_start + chunk_size,
+                                chunk_start != start,
+                                std::cref(cancelled)));
+        chunk_count += 1;
     }
+    fq.pop_to();
 
     return retval;
 }
@@ -379,6 +859,21 @@ logfile::rebuild_result_t logfile::rebuild_index(nonstd::optional<ui_clock::time
                 this->lf_index.pop_back();
                 rollback_size += 1;
             }
+            if (has_format && !this->lf_format->lf_pattern_locks.empty()) {
+                const auto &last_line = this->lf_index.back();
+                auto &hits = this->lf_format->lf_pattern_hits;
+                auto pat_index = this->lf_format->pattern_index_for_line(
+                    this->lf_index.size() - 1);
+
+                // The line is going to be scanned again, so don't count it
+                // twice.
+                if (!last_line.is_continued() &&
+                    last_line.get_msg_level() != LEVEL_INVALID &&
+                    pat_index >= 0 && pat_index < (int) hits.size() &&
+                    hits[pat_index] > 0) {
+                    hits[pat_index] -= 1;
+                }
+            }
             this->lf_index.pop_back();
             rollback_size += 1;
 
@@ -431,6 +926,18 @@ logfile::rebuild_result_t logfile::rebuild_index(nonstd::optional<ui_clock::time
                       begin_size);
         }
         auto prev_range = file_range{off};
+        if (has_format) {
+            bool interrupted = false;
+            auto next_off = this->index_in_parallel(
+                off, st, deadline, sort_needed, interrupted);
+
+            if (next_off != off) {
+                prev_range = file_range{next_off};
+            }
+            if (interrupted) {
+                limit = 0;
+            }
+        }
         while (limit > 0) {
             auto load_result = this->lf_line_buffer.load_next_line(prev_range);
 
@@ -499,7 +1006,14 @@ logfile::rebuild_result_t logfile::rebuild_index(nonstd::optional<ui_clock::time
             // Update this early so that line_length() works
             this->lf_index_size = li.li_file_range.next_offset();
 
-            if (this->lf_logline_observer != nullptr) {
+            if (!has_format && this->lf_format != nullptr &&
+                this->load_index_cache(st)) {
+                prev_range = file_range{this->lf_index_size};
+                if (this->lf_logline_observer != nullptr) {
+                    this->observe_new_lines(this->begin() + old_size);
+                }
+            }
+            else if (this->lf_logline_observer != nullptr) {
                 this->lf_logline_observer->logline_new_lines(
                     *this, this->begin() + old_size, this->end(), sbr);
             }
@@ -507,7 +1021,7 @@ logfile::rebuild_result_t logfile::rebuild_index(nonstd::optional<ui_clock::time
             if (this->lf_logfile_observer != nullptr) {
                 auto indexing_res = this->lf_logfile_observer->logfile_indexing(
                     this->shared_from_this(),
-                    this->lf_line_buffer.get_read_offset(li.li_file_range.next_offset()),
+                    this->lf_line_buffer.get_read_offset(this->lf_index_size),
                     st.st_size);
 
                 if (indexing_res == logfile_observer::indexing_result::BREAK) {
@@ -526,6 +1040,12 @@ logfile::rebuild_result_t logfile::rebuild_index(nonstd::optional<ui_clock::time
             limit -= 1;
         }
 
+        auto decompress_err = this->lf_line_buffer.get_decompress_error();
+        if (decompress_err) {
+            this->lf_notes.writeAccess()->emplace(
+                note_type::decompress_error,
+                fmt::format("file is cut short, {}", decompress_err.value()));
+        }
         if (this->lf_format == nullptr &&
             this->lf_options.loo_visible_size_limit > 0 &&
             prev_range.fr_offset > 256 * 1024 &&
@@ -589,6 +1109,10 @@ logfile::rebuild_result_t logfile::rebuild_index(nonstd::optional<ui_clock::time
         this->lf_out_of_time_order_count = 0;
     }
 
+    if (retval == rebuild_result_t::NO_NEW_LINES) {
+        this->update_trigram_index(deadline);
+    }
+
     return retval;
 }
 
@@ -645,9 +1169,98 @@ void logfile::set_logline_observer(logline_observer *llo)
     }
 }
 
+std::future<logfile::rebuild_result_t>
+logfile::start_async_index(nonstd::optional<ui_clock::time_point> deadline,
+                           size_t max_threads)
+{
+    require(this->lf_async_observer == nullptr);
+
+    this->lf_index_threads = max_threads;
+    this->lf_line_buffer.set_decode_threads(max_threads);
+    this->lf_async_observer = std::make_unique<async_observer>();
+    this->lf_async_observer->ao_logfile_observer = this->lf_logfile_observer;
+    this->lf_async_observer->ao_logline_observer = this->lf_logline_observer;
+    this->lf_logfile_observer = this->lf_async_observer.get();
+    this->lf_logline_observer = this->lf_async_observer.get();
+
+    auto lf = this->shared_from_this();
+    return std::async(std::launch::async, [lf, deadline]() {
+        return lf->rebuild_index(deadline);
+    });
+}
+
+void logfile::report_async_progress()
+{
+    require(this->lf_async_observer != nullptr);
+
+    auto &ao = *this->lf_async_observer;
+
+    if (ao.ao_logfile_observer == nullptr || !ao.ao_has_progress) {
+        return;
+    }
+
+    // The worker is still changing the index, so only the offsets can be
+    // passed on, not the file itself.
+    auto indexing_res = ao.ao_logfile_observer->logfile_indexing(
+        nullptr, ao.ao_offset, ao.ao_total);
+    if (indexing_res == logfile_observer::indexing_result::BREAK) {
+        ao.ao_cancelled = true;
+    }
+}
+
+logfile::rebuild_result_t
+logfile::finish_async_index(std::future<rebuild_result_t> &fut)
+{
+    require(this->lf_async_observer != nullptr);
+
+    auto retval = fut.get();
+    auto ao = std::move(this->lf_async_observer);
+
+    this->lf_index_threads = 0;
+    this->lf_line_buffer.set_decode_threads(0);
+    this->lf_logfile_observer = ao->ao_logfile_observer;
+    this->lf_logline_observer = ao->ao_logline_observer;
+
+    if (this->lf_logline_observer != nullptr && ao->ao_restarted) {
+        this->lf_logline_observer->logline_restart(*this,
+                                                   ao->ao_rollback_size);
+        this->observe_new_lines(this->begin() + ao->ao_first_new_line);
+        if (ao->ao_eof) {
+            this->lf_logline_observer->logline_eof(*this);
+        }
+    }
+    if (this->lf_logfile_observer != nullptr && ao->ao_has_progress) {
+        this->lf_logfile_observer->logfile_indexing(
+            this->shared_from_this(), ao->ao_offset, ao->ao_total);
+    }
+
+    return retval;
+}
+
+void logfile::observe_new_lines(iterator iter)
+{
+    while (iter != this->end()) {
+        auto iter_end = iter + 1;
+
+        while (iter_end != this->end() && iter_end->get_sub_offset() != 0) {
+            ++iter_end;
+        }
+        this->read_line(iter).then([this, iter, iter_end](auto sbr) {
+            this->lf_logline_observer->logline_new_lines(
+                *this, iter, iter_end, sbr);
+        });
+        iter = iter_end;
+    }
+}
+
 void logfile::reobserve_from(iterator iter)
 {
-    for (; iter != this->end(); ++iter) {
+    this->reobserve_range(iter, this->end());
+}
+
+void logfile::reobserve_range(iterator iter, iterator end)
+{
+    for (; iter != end; ++iter) {
         off_t offset = std::distance(this->begin(), iter);
 
         if (iter->get_sub_offset() > 0) {
@@ -672,6 +1285,9 @@ void logfile::reobserve_from(iterator iter)
                 *this, iter, iter_end, sbr);
         });
     }
+    if (end != this->end()) {
+        return;
+    }
     if (this->lf_logfile_observer != nullptr) {
         this->lf_logfile_observer->logfile_indexing(
             this->shared_from_this(), this->size(), this->size());
@@ -741,9 +1357,7 @@ intern_string_t logfile::get_format_name() const
 nonstd::optional<logfile::const_iterator>
 logfile::find_from_time(const timeval &tv) const
 {
-    auto retval = std::lower_bound(this->lf_index.begin(),
-                                   this->lf_index.end(),
-                                   tv);
+    auto retval = this->lf_index.lower_bound(tv);
     if (retval == this->lf_index.end()) {
         return nonstd::nullopt;
     }
@@ -759,3 +1373,584 @@ void logfile::mark_as_duplicate(const string &name)
         note_type::duplicate,
         fmt::format("hiding duplicate of {}", name));
 }
+
+namespace {
+
+const char INDEX_CACHE_MAGIC[8] = "lnavidx";
+const uint32_t INDEX_CACHE_VERSION = 2;
+const file_ssize_t INDEX_CACHE_TAIL_SIZE = 4096;
+
+/**
+ * The header of a saved index.  It is followed by the loglines, the pattern
+ * locks and the value stats for the format.
+ */
+struct index_cache_header {
+    char ich_magic[8]{};
+    uint32_t ich_version{INDEX_CACHE_VERSION};
+    uint32_t ich_logline_size{sizeof(logline)};
+    /** The offset just past the last line in the index. */
+    int64_t ich_index_size{0};
+    /** The size of the file on disk when the index was saved. */
+    int64_t ich_file_size{0};
+    /** The modification time of the file when the index was saved. */
+    int64_t ich_mtime{0};
+    uint64_t ich_line_count{0};
+    uint64_t ich_pattern_lock_count{0};
+    uint64_t ich_value_stats_count{0};
+    uint64_t ich_longest_line{0};
+    uint32_t ich_out_of_time_order_count{0};
+    char ich_format_name[128]{};
+    /**
+     * The hash of the data just before ich_index_size, used to check that
+     * the file has only been appended to since the index was saved.  This
+     * is empty for gzipped files, which need to be unchanged instead.
+     */
+    char ich_tail_hash[64]{};
+};
+
+const char TRIGRAM_CACHE_MAGIC[8] = "lnavtri";
+const uint32_t TRIGRAM_CACHE_VERSION = 1;
+
+/**
+ * The header of a saved trigram index, which is followed by the index
+ * itself.  The index is only valid for a file whose data before
+ * tch_end_offset has not changed.
+ */
+struct trigram_cache_header {
+    char tch_magic[8]{};
+    uint32_t tch_version{TRIGRAM_CACHE_VERSION};
+    uint32_t tch_block_lines{trigram_index::BLOCK_LINES};
+    uint64_t tch_line_count{0};
+    /** The offset just past the last line in the index. */
+    int64_t tch_end_offset{0};
+    char tch_tail_hash[64]{};
+};
+
+struct cached_pattern_lock {
+    uint32_t cpl_line;
+    int32_t cpl_pat_index;
+};
+
+}
+
+static ghc::filesystem::path index_cache_path()
+{
+    return lnav::paths::workdir() / "index";
+}
+
+static ghc::filesystem::path syncpoints_cache_path(const std::string &content_id)
+{
+    return index_cache_path() / fmt::format("gz-{}", content_id);
+}
+
+static nonstd::optional<std::string> hash_file_tail(int fd, file_off_t end)
+{
+    auto len = std::min(end, (file_off_t) INDEX_CACHE_TAIL_SIZE);
+    char buffer[INDEX_CACHE_TAIL_SIZE];
+
+    if (pread(fd, buffer, len, end - len) != len) {
+        return nonstd::nullopt;
+    }
+
+    return hasher().update(buffer, len).to_string();
+}
+
+bool logfile::is_immutable() const
+{
+    auto &cfg = injector::get<const lnav::logfile::config &>();
+
+    if (!cfg.lc_use_mmap ||
+        !S_ISREG(this->lf_stat.st_mode) ||
+        this->lf_line_buffer.is_compressed() ||
+        this->lf_line_buffer.is_pipe()) {
+        return false;
+    }
+
+    if (this->lf_options.loo_source == logfile_name_source::ARCHIVE) {
+        return true;
+    }
+    if ((this->lf_stat.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) == 0) {
+        return true;
+    }
+
+    auto age = std::chrono::seconds(time(nullptr) - this->lf_stat.st_mtime);
+
+    return age >= cfg.lc_mmap_min_age;
+}
+
+bool logfile::is_index_cacheable() const
+{
+    static const auto FULL_DATE = ETF_DAY_SET|ETF_MONTH_SET|ETF_YEAR_SET;
+
+    // Adjusted times are written into the index, so those files are skipped
+    // along with ones whose timestamps depend on the file's mtime.
+    return this->lf_named_file &&
+           this->lf_format != nullptr &&
+           this->lf_format->supports_parallel_scan() &&
+           (this->lf_format->lf_timestamp_flags & FULL_DATE) == FULL_DATE &&
+           (!this->lf_line_buffer.is_compressed() ||
+            this->lf_line_buffer.is_gzipped()) &&
+           !this->lf_line_buffer.is_pipe() &&
+           this->lf_time_offset.tv_sec == 0 &&
+           this->lf_time_offset.tv_usec == 0;
+}
+
+bool logfile::load_index_cache(const struct stat &st)
+{
+    auto &cfg = injector::get<const lnav::logfile::config &>();
+
+    if (cfg.lc_index_cache_min_size <= 0 ||
+        st.st_size < cfg.lc_index_cache_min_size ||
+        !this->is_index_cacheable()) {
+        return false;
+    }
+
+    auto cache_path = index_cache_path() /
+                      fmt::format("idx-{}", this->lf_content_id);
+    auto_mem<FILE> file(fclose);
+    index_cache_header ich;
+
+    if ((file = fopen(cache_path.c_str(), "r")) == nullptr) {
+        return false;
+    }
+
+    if (fread(&ich, sizeof(ich), 1, file) != 1 ||
+        memcmp(ich.ich_magic, INDEX_CACHE_MAGIC, sizeof(ich.ich_magic)) != 0 ||
+        ich.ich_version != INDEX_CACHE_VERSION ||
+        ich.ich_logline_size != sizeof(logline) ||
+        ich.ich_line_count < this->lf_index.size() ||
+        ich.ich_value_stats_count != this->lf_format->lf_value_stats.size()) {
+        log_warning("%s: ignoring incompatible index cache -- %s",
+                    this->lf_filename.c_str(),
+                    cache_path.c_str());
+        return false;
+    }
+    ich.ich_format_name[sizeof(ich.ich_format_name) - 1] = '\0';
+    ich.ich_tail_hash[sizeof(ich.ich_tail_hash) - 1] = '\0';
+
+    if (this->lf_format->get_name() != ich.ich_format_name) {
+        log_info("%s: index cache is for a different format -- %s",
+                 this->lf_filename.c_str(),
+                 ich.ich_format_name);
+        return false;
+    }
+    if (this->lf_line_buffer.is_compressed()) {
+        if (ich.ich_file_size != st.st_size || ich.ich_mtime != st.st_mtime) {
+            log_info("%s: file changed since the index was cached",
+                     this->lf_filename.c_str());
+            return false;
+        }
+    } else {
+        if (ich.ich_index_size > st.st_size ||
+            (ich.ich_file_size == st.st_size && ich.ich_mtime != st.st_mtime)) {
+            log_info("%s: file was overwritten since the index was cached",
+                     this->lf_filename.c_str());
+            return false;
+        }
+
+        auto tail_hash = hash_file_tail(this->lf_line_buffer.get_fd(),
+                                        ich.ich_index_size);
+        if (!tail_hash || tail_hash.value() != ich.ich_tail_hash) {
+            log_info("%s: file contents changed since the index was cached",
+                     this->lf_filename.c_str());
+            return false;
+        }
+    }
+
+    std::vector<logline> index(ich.ich_line_count,
+                               logline(0, 0, 0, LEVEL_UNKNOWN));
+    std::vector<cached_pattern_lock> locks(ich.ich_pattern_lock_count);
+    std::vector<logline_value_stats> stats(ich.ich_value_stats_count);
+
+    if (fread(index.data(), sizeof(logline), index.size(), file) !=
+        index.size() ||
+        fread(locks.data(), sizeof(cached_pattern_lock), locks.size(), file) !=
+        locks.size() ||
+        fread(stats.data(), sizeof(logline_value_stats), stats.size(), file) !=
+        stats.size()) {
+        log_warning("%s: index cache is truncated -- %s",
+                    this->lf_filename.c_str(),
+                    cache_path.c_str());
+        return false;
+    }
+
+    for (size_t lpc = 0; lpc < this->lf_index.size(); lpc++) {
+        if (index[lpc].get_offset() != this->lf_index[lpc].get_offset()) {
+            log_info("%s: index cache does not match the start of the file",
+                     this->lf_filename.c_str());
+            return false;
+        }
+    }
+
+    for (auto &ll : index) {
+        ll.set_mark(false);
+        ll.set_expr_mark(false);
+    }
+
+    if (this->lf_line_buffer.is_gzipped()) {
+        // The index is still usable without the syncpoints, reading lines
+        // will just be slower.
+        auto load_res = this->lf_line_buffer.get_gz_file().load_syncpoints(
+            syncpoints_cache_path(this->lf_content_id), st.st_size);
+
+        if (load_res.isErr()) {
+            log_warning("%s: unable to load gzip syncpoints -- %s",
+                        this->lf_filename.c_str(),
+                        load_res.unwrapErr().c_str());
+        }
+    }
+
+    this->lf_format->lf_pattern_locks.clear();
+    for (const auto &cpl : locks) {
+        this->lf_format->lf_pattern_locks.emplace_back(cpl.cpl_line,
+                                                       cpl.cpl_pat_index);
+    }
+    this->lf_format->lf_value_stats = std::move(stats);
+    this->lf_index.clear();
+    this->lf_index.reserve(index.size());
+    this->lf_index.insert(this->lf_index.cend(), index.begin(), index.end());
+    this->lf_trigram_index.clear();
+    this->lf_trigram_index_loaded = false;
+    this->lf_index_size = ich.ich_index_size;
+    this->lf_index_cache_size = ich.ich_index_size;
+    this->lf_longest_line = std::max(this->lf_longest_line,
+                                     (size_t) ich.ich_longest_line);
+    this->lf_out_of_time_order_count = ich.ich_out_of_time_order_count;
+    this->lf_partial_line = false;
+    this->lf_line_buffer.mark_lines_loaded(this->lf_index_size);
+
+    // Keep the entry from being cleaned up while it is still in use.
+    std::error_code ec;
+    ghc::filesystem::last_write_time(
+        cache_path, ghc::filesystem::file_time_type::clock::now(), ec);
+
+    log_info("%s: loaded %zu lines from the index cache",
+             this->lf_filename.c_str(),
+             this->lf_index.size());
+
+    return true;
+}
+
+void logfile::save_index_cache()
+{
+    auto &cfg = injector::get<const lnav::logfile::config &>();
+
+    this->save_trigram_index();
+
+    if (cfg.lc_index_cache_min_size <= 0 ||
+        this->lf_is_closed ||
+        this->lf_index.empty() ||
+        this->lf_index_size < cfg.lc_index_cache_min_size ||
+        this->lf_index_size == this->lf_index_cache_size ||
+        !this->is_index_cacheable()) {
+        return;
+    }
+
+    index_cache_header ich;
+    auto format_name = this->lf_format->get_name();
+    auto tail_hash = this->lf_line_buffer.is_compressed() ?
+                     nonstd::make_optional(std::string()) :
+                     hash_file_tail(this->lf_line_buffer.get_fd(),
+                                    this->lf_index_size);
+
+    if (!tail_hash ||
+        format_name.size() >= sizeof(ich.ich_format_name) ||
+        tail_hash->size() >= sizeof(ich.ich_tail_hash)) {
+        return;
+    }
+
+    memcpy(ich.ich_magic, INDEX_CACHE_MAGIC, sizeof(ich.ich_magic));
+    ich.ich_index_size = this->lf_index_size;
+    ich.ich_file_size = this->lf_stat.st_size;
+    ich.ich_mtime = this->lf_stat.st_mtime;
+    ich.ich_line_count = this->lf_index.size();
+    ich.ich_pattern_lock_count = this->lf_format->lf_pattern_locks.size();
+    ich.ich_value_stats_count = this->lf_format->lf_value_stats.size();
+    ich.ich_longest_line = this->lf_longest_line;
+    ich.ich_out_of_time_order_count = this->lf_out_of_time_order_count;
+    strcpy(ich.ich_format_name, format_name.get());
+    strcpy(ich.ich_tail_hash, tail_hash->c_str());
+
+    std::vector<cached_pattern_lock> locks;
+    for (const auto &pfl : this->lf_format->lf_pattern_locks) {
+        locks.emplace_back(cached_pattern_lock{
+            pfl.pfl_line, pfl.pfl_pat_index
+        });
+    }
+
+    auto cache_dir = index_cache_path();
+    auto cache_path = cache_dir / fmt::format("idx-{}", this->lf_content_id);
+    auto tmp_path = cache_path.string() + fmt::format(".{}.tmp", getpid());
+    auto_mem<FILE> file(fclose);
+    std::error_code ec;
+
+    ghc::filesystem::create_directories(cache_dir, ec);
+    if ((file = fopen(tmp_path.c_str(), "w")) == nullptr) {
+        log_error("%s: unable to open index cache -- %s",
+                  tmp_path.c_str(),
+                  strerror(errno));
+        return;
+    }
+
+    auto write_lines = [this, &file]() {
+        for (const auto &ll : this->lf_index) {
+            if (fwrite(&ll, sizeof(ll), 1, file) != 1) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto& lf_value_stats = this->lf_format->lf_value_stats;
+    if (fwrite(&ich, sizeof(ich), 1, file) != 1 ||
+        !write_lines() ||
+        fwrite(locks.data(), sizeof(cached_pattern_lock), locks.size(),
+               file) != locks.size() ||
+        fwrite(lf_value_stats.data(), sizeof(logline_value_stats),
+               lf_value_stats.size(), file) != lf_value_stats.size() ||
+        fclose(file.release()) != 0) {
+        log_error("%s: unable to write index cache -- %s",
+                  tmp_path.c_str(),
+                  strerror(errno));
+        ghc::filesystem::remove(tmp_path, ec);
+        return;
+    }
+
+    ghc::filesystem::rename(tmp_path, cache_path, ec);
+    if (ec) {
+        log_error("%s: unable to save index cache -- %s",
+                  cache_path.c_str(),
+                  ec.message().c_str());
+        ghc::filesystem::remove(tmp_path, ec);
+        return;
+    }
+
+    if (this->lf_line_buffer.is_gzipped()) {
+        auto save_res = this->lf_line_buffer.get_gz_file().save_syncpoints(
+            syncpoints_cache_path(this->lf_content_id), this->lf_stat.st_size);
+
+        if (save_res.isErr()) {
+            log_error("%s: unable to save gzip syncpoints -- %s",
+                      this->lf_filename.c_str(),
+                      save_res.unwrapErr().c_str());
+        }
+    }
+
+    this->lf_index_cache_size = this->lf_index_size;
+    log_info("%s: saved %zu lines to the index cache -- %s",
+             this->lf_filename.c_str(),
+             this->lf_index.size(),
+             cache_path.c_str());
+}
+
+bool logfile::is_trigram_indexable() const
+{
+    auto &cfg = injector::get<const lnav::logfile::config &>();
+
+    return cfg.lc_trigram_index_min_size > 0 &&
+           this->lf_index_size >= cfg.lc_trigram_index_min_size &&
+           !this->lf_is_closed &&
+           !this->lf_line_buffer.is_compressed() &&
+           this->is_index_cacheable();
+}
+
+void logfile::update_trigram_index(
+    nonstd::optional<ui_clock::time_point> deadline)
+{
+    static const size_t LINES_PER_DEADLINE_CHECK = 1024;
+
+    if (!this->is_trigram_indexable()) {
+        return;
+    }
+
+    if (!this->lf_trigram_index_loaded) {
+        this->lf_trigram_index_loaded = true;
+        this->load_trigram_index();
+    }
+
+    // The last line is read again if it was not finished, so leave it out.
+    auto end = this->lf_index.size();
+    if (this->lf_partial_line && end > 0) {
+        end -= 1;
+    }
+
+    auto line = this->lf_trigram_index.get_line_count();
+    if (line >= end) {
+        return;
+    }
+
+    for (size_t count = 0; line < end; line++, count++) {
+        if (deadline && (count % LINES_PER_DEADLINE_CHECK) == 0 &&
+            ui_clock::now() > deadline.value()) {
+            break;
+        }
+
+        auto read_result = this->read_line(this->begin() + line);
+
+        if (read_result.isErr()) {
+            log_error("%s:%zu: unable to read line for trigram index -- %s",
+                      this->lf_filename.c_str(),
+                      line,
+                      read_result.unwrapErr().c_str());
+            break;
+        }
+
+        auto sbr = read_result.unwrap();
+
+        this->lf_trigram_index.add_line(sbr.get_data(), sbr.length());
+    }
+    this->lf_trigram_index.flush();
+}
+
+bool logfile::load_trigram_index()
+{
+    auto cache_path = index_cache_path() /
+                      fmt::format("tri-{}", this->lf_content_id);
+    auto_mem<FILE> file(fclose);
+    trigram_cache_header tch;
+
+    if ((file = fopen(cache_path.c_str(), "r")) == nullptr) {
+        return false;
+    }
+
+    if (fread(&tch, sizeof(tch), 1, file) != 1 ||
+        memcmp(tch.tch_magic, TRIGRAM_CACHE_MAGIC, sizeof(tch.tch_magic)) != 0 ||
+        tch.tch_version != TRIGRAM_CACHE_VERSION ||
+        tch.tch_block_lines != trigram_index::BLOCK_LINES ||
+        tch.tch_line_count > this->lf_index.size()) {
+        log_info("%s: ignoring incompatible trigram index -- %s",
+                 this->lf_filename.c_str(),
+                 cache_path.c_str());
+        return false;
+    }
+    tch.tch_tail_hash[sizeof(tch.tch_tail_hash) - 1] = '\0';
+
+    auto end_offset = tch.tch_line_count < this->lf_index.size() ?
+                      this->lf_index[tch.tch_line_count].get_offset() :
+                      this->lf_index_size;
+    if (end_offset != tch.tch_end_offset) {
+        log_info("%s: trigram index does not match the lines in the file",
+                 this->lf_filename.c_str());
+        return false;
+    }
+
+    auto tail_hash = hash_file_tail(this->lf_line_buffer.get_fd(),
+                                    end_offset);
+    if (!tail_hash || tail_hash.value() != tch.tch_tail_hash) {
+        log_info("%s: file contents changed since the trigram index was "
+                 "saved",
+                 this->lf_filename.c_str());
+        return false;
+    }
+
+    if (!this->lf_trigram_index.load(file, tch.tch_line_count)) {
+        log_warning("%s: trigram index is truncated -- %s",
+                    this->lf_filename.c_str(),
+                    cache_path.c_str());
+        return false;
+    }
+    this->lf_trigram_index_saved = tch.tch_line_count;
+
+    std::error_code ec;
+    ghc::filesystem::last_write_time(
+        cache_path, ghc::filesystem::file_time_type::clock::now(), ec);
+
+    log_info("%s: loaded %zu lines from the trigram index",
+             this->lf_filename.c_str(),
+             this->lf_trigram_index.get_line_count());
+
+    return true;
+}
+
+void logfile::save_trigram_index()
+{
+    auto line_count = this->lf_trigram_index.get_line_count();
+
+    if (line_count == 0 ||
+        line_count == this->lf_trigram_index_saved ||
+        line_count > this->lf_index.size() ||
+        !this->is_trigram_indexable()) {
+        return;
+    }
+
+    trigram_cache_header tch;
+    auto end_offset = line_count < this->lf_index.size() ?
+                      this->lf_index[line_count].get_offset() :
+                      this->lf_index_size;
+    auto tail_hash = hash_file_tail(this->lf_line_buffer.get_fd(),
+                                    end_offset);
+
+    if (!tail_hash || tail_hash->size() >= sizeof(tch.tch_tail_hash)) {
+        return;
+    }
+
+    memcpy(tch.tch_magic, TRIGRAM_CACHE_MAGIC, sizeof(tch.tch_magic));
+    tch.tch_line_count = line_count;
+    tch.tch_end_offset = end_offset;
+    strcpy(tch.tch_tail_hash, tail_hash->c_str());
+
+    auto cache_dir = index_cache_path();
+    auto cache_path = cache_dir / fmt::format("tri-{}", this->lf_content_id);
+    auto tmp_path = cache_path.string() + fmt::format(".{}.tmp", getpid());
+    auto_mem<FILE> file(fclose);
+    std::error_code ec;
+
+    ghc::filesystem::create_directories(cache_dir, ec);
+    if ((file = fopen(tmp_path.c_str(), "w")) == nullptr) {
+        log_error("%s: unable to open trigram index -- %s",
+                  tmp_path.c_str(),
+                  strerror(errno));
+        return;
+    }
+
+    if (fwrite(&tch, sizeof(tch), 1, file) != 1 ||
+        !this->lf_trigram_index.save(file) ||
+        fclose(file.release()) != 0) {
+        log_error("%s: unable to write trigram index -- %s",
+                  tmp_path.c_str(),
+                  strerror(errno));
+        ghc::filesystem::remove(tmp_path, ec);
+        return;
+    }
+
+    ghc::filesystem::rename(tmp_path, cache_path, ec);
+    if (ec) {
+        log_error("%s: unable to save trigram index -- %s",
+                  cache_path.c_str(),
+                  ec.message().c_str());
+        ghc::filesystem::remove(tmp_path, ec);
+        return;
+    }
+
+    this->lf_trigram_index_saved = line_count;
+    log_info("%s: saved %zu lines to the trigram index -- %s",
+             this->lf_filename.c_str(),
+             line_count,
+             cache_path.c_str());
+}
+
+void logfile::cleanup_index_cache()
+{
+    (void) std::async(std::launch::async, []() {
+        auto now = ghc::filesystem::file_time_type::clock::now();
+        auto cache_path = index_cache_path();
+        auto& cfg = injector::get<const lnav::logfile::config&>();
+        std::vector<ghc::filesystem::path> to_remove;
+        std::error_code ec;
+
+        for (const auto& entry :
+             ghc::filesystem::directory_iterator(cache_path, ec)) {
+            auto mtime = ghc::filesystem::last_write_time(entry.path());
+            auto exp_time = mtime + cfg.lc_index_cache_ttl;
+            if (now < exp_time) {
+                continue;
+            }
+
+            to_remove.emplace_back(entry.path());
+        }
+
+        for (auto& entry : to_remove) {
+            log_debug("removing cached index: %s", entry.c_str());
+            ghc::filesystem::remove(entry, ec);
+        }
+    });
+}
@@ -32,11 +32,19 @@
 #ifndef lnav_logfile_cfg_hh
 #define lnav_logfile_cfg_hh
 
+#include <chrono>
+
 namespace lnav {
 namespace logfile {
 
 struct config {
     int64_t lc_max_unrecognized_lines{15000};
+    int64_t lc_parallel_index_chunk_size{16 * 1024 * 1024};
+    int64_t lc_index_cache_min_size{64 * 1024 * 1024};
+    std::chrono::seconds lc_index_cache_ttl{std::chrono::hours(48)};
+    int64_t lc_trigram_index_min_size{0};
+    bool lc_use_mmap{false};
+    std::chrono::seconds lc_mmap_min_age{std::chrono::minutes(10)};
 };
 
 }
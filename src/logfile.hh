@@ -38,6 +38,8 @@
 #include <sys/types.h>
 #include <sys/resource.h>
 
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 #include <utility>
@@ -52,7 +54,9 @@
 #include "ghc/filesystem.hpp"
 #include "logfile_fwd.hh"
 #include "log_format_fwd.hh"
+#include "logline_index.hh"
 #include "safe/safe.h"
+#include "trigram_index.hh"
 
 /**
  * Observer interface for logfile indexing progress.
@@ -69,7 +73,8 @@ public:
     };
 
     /**
-     * @param lf The logfile object that is doing the indexing.
+     * @param lf The logfile object that is doing the indexing or nullptr if
+     *   the file is being indexed on a worker thread and cannot be touched.
      * @param off The current offset in the file being processed.
      * @param total The total size of the file.
      * @return false
@@ -92,8 +97,8 @@ class logfile :
     public unique_path_source,
     public std::enable_shared_from_this<logfile> {
 public:
-    typedef std::vector<logline>::iterator       iterator;
-    typedef std::vector<logline>::const_iterator const_iterator;
+    typedef logline_index::iterator       iterator;
+    typedef logline_index::const_iterator const_iterator;
 
     /**
      * Construct a logfile with the given arguments.
@@ -240,6 +245,9 @@ public:
 
     nonstd::optional<const_iterator> find_from_time(const struct timeval& tv) const;
 
+    /** @return True if the lines in the index are in time order. */
+    bool is_sorted() const { return this->lf_index.is_sorted(); }
+
     logline &operator[](int index) { return this->lf_index[index]; };
 
     logline &front() {
@@ -323,8 +331,70 @@ public:
      */
     rebuild_result_t rebuild_index(nonstd::optional<ui_clock::time_point> deadline = nonstd::nullopt);
 
+    /**
+     * Start indexing any new data in the file on a worker thread.  The
+     * observers are not called from the worker, instead, the changes are
+     * passed on to them when finish_async_index() is called.  Nothing else
+     * should touch this object until then.
+     *
+     * @param deadline Passed on to rebuild_index().
+     * @param max_threads The number of threads that can be used to index
+     *   chunks of the file in parallel or to decompress it, zero for no
+     *   limit.  Chunking is turned off if this is one.
+     * @return The future for the result of the rebuild_index() call.
+     */
+    std::future<rebuild_result_t> start_async_index(
+        nonstd::optional<ui_clock::time_point> deadline = nonstd::nullopt,
+        size_t max_threads = 0);
+
+    /**
+     * Pass the progress made by the worker started by start_async_index()
+     * on to the logfile_observer.  The observer is given a null logfile
+     * since the worker is still running.  Must be called from the main
+     * thread.
+     */
+    void report_async_progress();
+
+    /**
+     * Wait for the worker started by start_async_index() to finish and then
+     * bring the observers up-to-date.  Must be called from the main thread.
+     *
+     * @param fut The future returned by start_async_index().
+     * @return The result of the rebuild_index() call.
+     */
+    rebuild_result_t finish_async_index(std::future<rebuild_result_t> &fut);
+
     void reobserve_from(iterator iter);
 
+    /**
+     * Pass the messages that start in the given range to the logline
+     * observer again.  The end-of-file notification is only sent if the
+     * range extends to the end of the file.
+     */
+    void reobserve_range(iterator iter, iterator end);
+
+    /**
+     * Save the index for this file to the cache in the work directory so
+     * that only new data needs to be scanned the next time the file is
+     * opened.  Small files and indexes that have not changed since they
+     * were loaded from the cache are skipped.  The trigram index, if there
+     * is one, is saved next to it.
+     */
+    void save_index_cache();
+
+    /** Remove saved indexes that have outlived the configured TTL. */
+    static void cleanup_index_cache();
+
+    /**
+     * @return The index of the trigrams in the lines of this file.  It is
+     *   only filled in for large files when the trigram index is enabled
+     *   and covers the lines that were indexed before the file stopped
+     *   growing.
+     */
+    const trigram_index &get_trigram_index() const {
+        return this->lf_trigram_index;
+    };
+
     void set_logfile_observer(logfile_observer *lo) {
         this->lf_logfile_observer = lo;
     };
@@ -370,6 +440,7 @@ public:
         indexing_disabled,
         duplicate,
         not_utf,
+        decompress_error,
     };
 
     using note_map = std::map<note_type, std::string>;
@@ -389,11 +460,74 @@ protected:
      */
     bool process_prefix(shared_buffer_ref &sbr, const line_info &li);
 
+    /**
+     * Split the rest of the file into chunks that are indexed by a pool of
+     * worker threads and then stitch the results onto the end of the index.
+     * This is only done for large files using a format that can be scanned
+     * in parallel.
+     *
+     * @param start The offset of the first line to index.
+     * @param st The current stat() of the file.
+     * @param deadline The time after which no more chunks should be started.
+     * @param sort_needed Set to true if the new lines need to be sorted.
+     * @param interrupted Set to true if the logfile_observer asked for
+     *   indexing to stop.
+     * @return The offset of the next line that still needs to be indexed.
+     */
+    file_off_t index_in_parallel(file_off_t start,
+                                 const struct stat &st,
+                                 nonstd::optional<ui_clock::time_point> deadline,
+                                 bool &sort_needed,
+                                 bool &interrupted);
+
     void set_format_base_time(log_format *lf);
 
+    /**
+     * @return True if the file is not expected to change, so it can be read
+     * through a memory mapping instead of with pread().
+     */
+    bool is_immutable() const;
+
+    /** @return True if the index for this file can be saved to the cache. */
+    bool is_index_cacheable() const;
+
+    /**
+     * Replace the index with the one saved in the cache for this file's
+     * content ID, if there is one and it is still valid for the file.
+     *
+     * @param st The current stat() of the file.
+     * @return True if the index was loaded from the cache.
+     */
+    bool load_index_cache(const struct stat &st);
+
+    /**
+     * Pass the messages starting at the given line on to the
+     * logline_observer.
+     */
+    void observe_new_lines(iterator iter);
+
 private:
+    class async_observer;
+
     logfile(std::string filename, logfile_open_options &loo);
 
+    /** @return True if a trigram index should be kept for this file. */
+    bool is_trigram_indexable() const;
+
+    /**
+     * Add the lines that are not in the trigram index yet, stopping early
+     * if the deadline passes.
+     */
+    void update_trigram_index(nonstd::optional<ui_clock::time_point> deadline);
+
+    /**
+     * Replace the trigram index with the one saved in the cache for this
+     * file's content ID, if it still matches the start of the file.
+     */
+    bool load_trigram_index();
+
+    void save_trigram_index();
+
     std::string lf_filename;
     logfile_open_options lf_options;
     logfile_activity lf_activity;
@@ -404,7 +538,8 @@ private:
     std::string lf_content_id;
     struct stat lf_stat{};
     std::shared_ptr<log_format> lf_format;
-    std::vector<logline>      lf_index;
+    std::vector<bool> lf_format_candidates;
+    logline_index             lf_index;
     time_t      lf_index_time{0};
     file_off_t  lf_index_size{0};
     bool lf_sort_needed{false};
@@ -422,6 +557,14 @@ private:
     safe_notes lf_notes;
 
     nonstd::optional<std::pair<file_off_t, size_t>> lf_next_line_cache;
+    std::unique_ptr<async_observer> lf_async_observer;
+    /** The limit on threads for index_in_parallel(), zero for no limit. */
+    size_t lf_index_threads{0};
+    file_off_t lf_index_cache_size{0};
+    trigram_index lf_trigram_index;
+    bool lf_trigram_index_loaded{false};
+    /** The number of lines in the trigram index when it was last saved. */
+    size_t lf_trigram_index_saved{0};
 };
 
 class logline_observer {
@@ -29,8 +29,11 @@
 
 #include "config.h"
 
+#include <deque>
 #include <future>
+#include <thread>
 #include <algorithm>
+#include <numeric>
 #include <sqlite3.h>
 
 #include "base/humanize.time.hh"
@@ -599,6 +602,119 @@ void logfile_sub_source::text_attrs_for_line(textview_curses &lv,
     }
 }
 
+std::map<const logfile *, logfile::rebuild_result_t>
+logfile_sub_source::rebuild_file_indexes(
+    nonstd::optional<ui_clock::time_point> deadline)
+{
+    std::map<const logfile *, logfile::rebuild_result_t> retval;
+    std::vector<std::shared_ptr<logfile>> candidates;
+
+    if (this->tss_view->is_paused()) {
+        return retval;
+    }
+
+    for (auto &ld : this->lss_files) {
+        auto lf = ld->get_file();
+
+        if (lf == nullptr || !lf->is_indexing() || !lf->get_format() ||
+            !lf->get_format()->supports_parallel_scan() ||
+            lf->is_compressed() ||
+            lf->get_index_size() >= lf->get_stat().st_size) {
+            continue;
+        }
+        candidates.emplace_back(lf);
+    }
+
+    if (candidates.size() < 2) {
+        return retval;
+    }
+
+    // Large files are also split into chunks that are indexed on their own
+    // threads, so share one budget between the files instead of letting
+    // each of them start a full set of threads.
+    const size_t thread_budget = std::max(
+        2U, std::thread::hardware_concurrency());
+    const size_t max_running = std::min(thread_budget, candidates.size());
+    const size_t threads_per_file = thread_budget / max_running;
+    std::deque<std::pair<std::shared_ptr<logfile>,
+                         std::future<logfile::rebuild_result_t>>> running;
+    auto cand_iter = candidates.begin();
+
+    while (cand_iter != candidates.end() || !running.empty()) {
+        while (cand_iter != candidates.end() &&
+               running.size() < max_running) {
+            auto &lf = *cand_iter;
+
+            running.emplace_back(
+                lf, lf->start_async_index(deadline, threads_per_file));
+            ++cand_iter;
+        }
+
+        auto &front = running.front();
+
+        if (front.second.wait_for(std::chrono::milliseconds(100)) ==
+            std::future_status::timeout) {
+            // The observers can only be called from this thread, so pass
+            // on the progress of all the files while we wait.
+            for (auto &pair : running) {
+                pair.first->report_async_progress();
+            }
+            continue;
+        }
+
+        retval[front.first.get()] =
+            front.first->finish_async_index(front.second);
+        running.pop_front();
+    }
+
+    return retval;
+}
+
+/**
+ * Iterates over a run of lines in a file in time order.  Most files are
+ * already in order, so the lines are visited directly.  Otherwise, the
+ * line numbers are visited in the order given by a separate, sorted list.
+ */
+class file_run_iterator {
+public:
+    file_run_iterator() = default;
+
+    file_run_iterator(logfile *lf,
+                      const std::vector<uint32_t> *order,
+                      size_t pos)
+        : fri_file(lf), fri_order(order), fri_pos(pos) {
+    };
+
+    size_t line_number() const {
+        if (this->fri_order != nullptr) {
+            return (*this->fri_order)[this->fri_pos];
+        }
+        return this->fri_pos;
+    };
+
+    logline &operator*() const {
+        return (*this->fri_file)[this->line_number()];
+    };
+
+    file_run_iterator &operator++() {
+        this->fri_pos += 1;
+        return *this;
+    };
+
+    bool operator==(const file_run_iterator &rhs) const {
+        return this->fri_pos == rhs.fri_pos;
+    };
+
+    bool operator!=(const file_run_iterator &rhs) const {
+        return this->fri_pos != rhs.fri_pos;
+    };
+
+private:
+    logfile *fri_file{nullptr};
+    const std::vector<uint32_t> *fri_order{nullptr};
+    size_t fri_pos{0};
+};
+
 logfile_sub_source::rebuild_result logfile_sub_source::rebuild_index(nonstd::optional<ui_clock::time_point> deadline)
 {
     iterator iter;
@@ -616,6 +732,8 @@ logfile_sub_source::rebuild_result logfile_sub_source::rebuild_index(nonstd::opt
         retval = rebuild_result::rr_full_rebuild;
     }
 
+    auto file_results = this->rebuild_file_indexes(deadline);
+
     for (iter = this->lss_files.begin();
          iter != this->lss_files.end();
          iter++) {
@@ -632,7 +750,12 @@ logfile_sub_source::rebuild_result logfile_sub_source::rebuild_index(nonstd::opt
         }
         else {
             if (!this->tss_view->is_paused()) {
-                switch (lf->rebuild_index(deadline)) {
+                auto res_iter = file_results.find(lf);
+                auto rebuild_res = res_iter != file_results.end() ?
+                                   res_iter->second :
+                                   lf->rebuild_index(deadline);
+
+                switch (rebuild_res) {
                     case logfile::rebuild_result_t::NO_NEW_LINES:
                         // No changes
                         break;
@@ -702,7 +825,9 @@ logfile_sub_source::rebuild_result logfile_sub_source::rebuild_index(nonstd::opt
         }
 
         this->lss_index.clear();
+        this->truncate_row_levels(0);
         this->lss_filtered_index.clear();
+        this->lss_filtered_through = 0;
         this->lss_longest_line = 0;
         this->lss_basename_width = 0;
         this->lss_filename_width = 0;
@@ -742,6 +867,7 @@ logfile_sub_source::rebuild_result logfile_sub_source::rebuild_index(nonstd::opt
                                     logline_cmp(*this));
         this->lss_index.shrink_to(std::distance(
             this->lss_index.begin(), row_iter));
+        this->truncate_row_levels(this->lss_index.size());
         log_debug("new index size %ld/%ld; remain %ld",
                   this->lss_index.ba_size,
                   this->lss_index.ba_capacity,
@@ -752,6 +878,8 @@ logfile_sub_source::rebuild_result logfile_sub_source::rebuild_index(nonstd::opt
                                     filtered_logline_cmp(*this));
         this->lss_filtered_index.resize(std::distance(
             this->lss_filtered_index.begin(), filt_row_iter));
+        this->lss_filtered_through = std::min(this->lss_filtered_through,
+                                              this->lss_index.size());
         search_start = vis_line_t(this->lss_filtered_index.size());
 
         auto bm_range = vis_bm[&textview_curses::BM_USER_EXPR].equal_range(
@@ -777,7 +905,6 @@ logfile_sub_source::rebuild_result logfile_sub_source::rebuild_index(nonstd::opt
 
     if (retval != rebuild_result::rr_no_change || force) {
         size_t index_size = 0, start_size = this->lss_index.size();
-        logline_cmp line_cmper(*this);
 
         for (auto& ld : this->lss_files) {
             auto lf = ld->get_file_ptr();
@@ -793,65 +920,68 @@ logfile_sub_source::rebuild_result logfile_sub_source::rebuild_index(nonstd::opt
                 this->lss_filename_width, lf->get_filename().size());
         }
 
-        if (full_sort) {
-            for (auto& ld : this->lss_files) {
-                auto lf = ld->get_file_ptr();
+        // The lines in a file are usually in time order, so the rows are
+        // built by merging the runs of new lines from each file.  The runs
+        // from files that are out of order (e.g. those that had a NEW_ORDER
+        // result) are sorted on their own first.
+        kmerge_tree_c<logline, logfile_data, file_run_iterator> merge(
+            file_count);
+        std::vector<std::vector<uint32_t>> sorted_runs;
 
-                if (lf == nullptr) {
-                    continue;
-                }
-
-                for (size_t line_index = 0; line_index < lf->size(); line_index++) {
-                    content_line_t con_line(ld->ld_file_index * MAX_LINES_PER_FILE +
-                                            line_index);
+        sorted_runs.reserve(file_count);
+        for (auto& ld : this->lss_files) {
+            auto lf = ld->get_file_ptr();
 
-                    this->lss_index.push_back(con_line);
-                }
+            if (lf == nullptr) {
+                continue;
             }
 
-            // XXX get rid of this full sort on the initial run, it's not
-            // needed unless the file is not in time-order
-            sort(this->lss_index.begin(), this->lss_index.end(), line_cmper);
-        } else {
-            kmerge_tree_c<logline, logfile_data, logfile::iterator> merge(
-                file_count);
-
-            for (iter = this->lss_files.begin();
-                 iter != this->lss_files.end();
-                 iter++) {
-                logfile_data *ld = iter->get();
-                auto lf = ld->get_file_ptr();
-                if (lf == nullptr) {
-                    continue;
-                }
-
-                merge.add(ld,
-                          lf->begin() + ld->ld_lines_indexed,
-                          lf->end());
-                index_size += lf->size();
+            const std::vector<uint32_t> *order = nullptr;
+            size_t run_start = ld->ld_lines_indexed;
+            size_t run_end = lf->size();
+
+            if (full_sort && !lf->is_sorted()) {
+                log_debug("%s: lines are out of order, sorting",
+                          lf->get_filename().c_str());
+                sorted_runs.emplace_back(lf->size());
+
+                auto& run = sorted_runs.back();
+                // Only a few blocks of the index are kept decoded, so copy
+                // the lines out in order instead of jumping around in it.
+                std::vector<logline> lines(lf->cbegin(), lf->cend());
+
+                std::iota(run.begin(), run.end(), 0);
+                std::sort(run.begin(), run.end(),
+                          [&lines](const auto lhs, const auto rhs) {
+                              return lines[lhs] < lines[rhs];
+                          });
+                order = &run;
             }
+            merge.add(ld.get(),
+                      file_run_iterator(lf, order, run_start),
+                      file_run_iterator(lf, order, run_end));
+            index_size += lf->size();
+        }
 
-            merge.execute();
-            for (;;) {
-                logfile::iterator lf_iter;
-                logfile_data *ld;
-
-                if (!merge.get_top(ld, lf_iter)) {
-                    break;
-                }
+        merge.execute();
+        for (;;) {
+            file_run_iterator run_iter;
+            logfile_data *ld;
 
-                int file_index = ld->ld_file_index;
-                int line_index = lf_iter - ld->get_file_ptr()->begin();
+            if (!merge.get_top(ld, run_iter)) {
+                break;
+            }
 
-                content_line_t con_line(file_index * MAX_LINES_PER_FILE +
-                                        line_index);
+            content_line_t con_line(ld->ld_file_index * MAX_LINES_PER_FILE +
+                                    run_iter.line_number());
 
-                this->lss_index.push_back(con_line);
+            this->lss_index.push_back(con_line);
 
-                merge.next();
-            }
+            merge.next();
         }
 
+        this->index_row_levels(start_size);
+
         for (iter = this->lss_files.begin();
              iter != this->lss_files.end();
              iter++) {
@@ -864,64 +994,21 @@ logfile_sub_source::rebuild_result logfile_sub_source::rebuild_index(nonstd::opt
             (*iter)->ld_lines_indexed = lf->size();
         }
 
-        this->lss_filtered_index.reserve(this->lss_index.size());
-
-        uint32_t filter_in_mask, filter_out_mask;
-        this->get_filters().get_enabled_mask(filter_in_mask, filter_out_mask);
-
         if (start_size == 0 && this->lss_index_delegate != nullptr) {
             this->lss_index_delegate->index_start(*this);
         }
 
-        for (size_t index_index = start_size;
-             index_index < this->lss_index.size();
-             index_index++) {
-            content_line_t cl = (content_line_t) this->lss_index[index_index];
-            uint64_t line_number;
-            auto ld = this->find_data(cl, line_number);
-
-            if (!(*ld)->is_visible()) {
-                continue;
-            }
-
-            auto lf = (*ld)->get_file_ptr();
-            auto line_iter = lf->begin() + line_number;
-
-            if (line_iter->is_ignored()) {
-                continue;
-            }
-
-            if (!this->tss_apply_filters ||
-                (!(*ld)->ld_filter_state.excluded(filter_in_mask, filter_out_mask,
-                                                  line_number) &&
-                 this->check_extra_filters(ld, line_iter))) {
-                auto eval_res = this->eval_sql_filter(this->lss_marker_stmt.in(),
-                                                      ld, line_iter);
-                if (eval_res.isErr()) {
-                    line_iter->set_expr_mark(false);
-                } else {
-                    auto matched = eval_res.unwrap();
-
-                    if (matched) {
-                        line_iter->set_expr_mark(true);
-                        vis_bm[&textview_curses::BM_USER_EXPR]
-                            .insert_once(vis_line_t(this->lss_filtered_index.size()));
-                    }
-                    else {
-                        line_iter->set_expr_mark(false);
-                    }
-                }
-                this->lss_filtered_index.push_back(index_index);
-                if (this->lss_index_delegate != nullptr) {
-                    this->lss_index_delegate->index_line(
-                            *this, lf, lf->begin() + line_number);
-                }
-            }
+        if (this->filter_rows(deadline) &&
+            this->lss_index_delegate != nullptr) {
+            this->lss_index_delegate->index_complete(*this);
         }
-
-        if (this->lss_index_delegate != nullptr) {
+    } else if (this->is_filtering()) {
+        // Keep going with the rows left over from text_filters_changed().
+        if (this->filter_rows(deadline) &&
+            this->lss_index_delegate != nullptr) {
             this->lss_index_delegate->index_complete(*this);
         }
+        retval = rebuild_result::rr_appended_lines;
     }
 
     switch (retval) {
@@ -1033,22 +1120,83 @@ void logfile_sub_source::text_filters_changed()
 
         if (lf != nullptr) {
             ld->ld_filter_state.clear_deleted_filter_state();
-            lf->reobserve_from(lf->begin() + ld->ld_filter_state.get_min_count(lf->size()));
         }
     }
 
     auto& vis_bm = this->tss_view->get_bookmarks();
-    uint32_t filtered_in_mask, filtered_out_mask;
-
-    this->get_filters().get_enabled_mask(filtered_in_mask, filtered_out_mask);
 
     if (this->lss_index_delegate != nullptr) {
         this->lss_index_delegate->index_start(*this);
     }
     vis_bm[&textview_curses::BM_USER_EXPR].clear();
 
+    // The filters that already have results for every line are not run
+    // again, the rows are just checked against their cached bits.  Any new
+    // filters are run on the lines as the rows are visited.
     this->lss_filtered_index.clear();
-    for (size_t index_index = 0; index_index < this->lss_index.size(); index_index++) {
+    this->lss_filtered_through = 0;
+
+    nonstd::optional<ui_clock::time_point> deadline;
+
+    if (this->lss_filter_time_slice.count() > 0) {
+        deadline = ui_clock::now() + this->lss_filter_time_slice;
+    }
+    if (this->filter_rows(deadline)) {
+        if (this->lss_index_delegate != nullptr) {
+            this->lss_index_delegate->index_complete(*this);
+        }
+    } else {
+        log_debug("filtered %zu of %zu rows, continuing in the background",
+                  this->lss_filtered_through,
+                  this->lss_index.size());
+    }
+
+    if (this->tss_view != nullptr) {
+        this->tss_view->reload_data();
+        this->tss_view->redo_search();
+    }
+}
+
+bool logfile_sub_source::filter_rows(
+    nonstd::optional<ui_clock::time_point> deadline)
+{
+    static const size_t DEADLINE_CHECK_INTERVAL = 1024;
+
+    auto& vis_bm = this->tss_view->get_bookmarks();
+    uint32_t filter_in_mask, filter_out_mask;
+    size_t rows_since_check = 0;
+
+    this->get_filters().get_enabled_mask(filter_in_mask, filter_out_mask);
+    this->lss_filtered_index.reserve(this->lss_index.size());
+
+    // The rows outside of the time range and below the minimum level are
+    // skipped without looking at their lines.
+    auto row_range = std::make_pair((size_t) 0, this->lss_index.size());
+
+    if (this->tss_apply_filters) {
+        row_range = this->get_time_range_rows();
+        this->lss_filtered_through = std::max(this->lss_filtered_through,
+                                              row_range.first);
+    }
+    for (; this->lss_filtered_through < row_range.second;
+         this->lss_filtered_through++) {
+        if (deadline && ++rows_since_check >= DEADLINE_CHECK_INTERVAL) {
+            rows_since_check = 0;
+            if (ui_clock::now() >= deadline.value()) {
+                return false;
+            }
+        }
+
+        if (this->tss_apply_filters &&
+            this->lss_min_log_level > LEVEL_UNKNOWN) {
+            this->lss_filtered_through = this->next_row_at_min_level(
+                this->lss_filtered_through, row_range.second);
+            if (this->lss_filtered_through >= row_range.second) {
+                break;
+            }
+        }
+
+        auto index_index = this->lss_filtered_through;
         content_line_t cl = (content_line_t) this->lss_index[index_index];
         uint64_t line_number;
         auto ld = this->find_data(cl, line_number);
@@ -1060,9 +1208,14 @@ void logfile_sub_source::text_filters_changed()
         auto lf = (*ld)->get_file_ptr();
         auto line_iter = lf->begin() + line_number;
 
+        if (line_iter->is_ignored()) {
+            continue;
+        }
+
+        (*ld)->ld_filter_state.catch_up(*lf, line_number + 1);
         if (!this->tss_apply_filters ||
-            (!(*ld)->ld_filter_state.excluded(filtered_in_mask, filtered_out_mask,
-                                           line_number) &&
+            (!(*ld)->ld_filter_state.excluded(filter_in_mask, filter_out_mask,
+                                              line_number) &&
              this->check_extra_filters(ld, line_iter))) {
             auto eval_res = this->eval_sql_filter(this->lss_marker_stmt.in(),
                                                   ld, line_iter);
@@ -1087,14 +1240,94 @@ void logfile_sub_source::text_filters_changed()
         }
     }
 
-    if (this->lss_index_delegate != nullptr) {
-        this->lss_index_delegate->index_complete(*this);
+    this->lss_filtered_through = this->lss_index.size();
+
+    // Bring the filter results for the rest of the lines, like those in
+    // hidden files, up-to-date so the hit counts are complete.  This can
+    // also take a while, so pick it up again on the next call if the
+    // deadline is reached.
+    this->lss_filters_behind = true;
+    for (auto& ld : *this) {
+        auto lf = ld->get_file_ptr();
+
+        if (lf != nullptr &&
+            !ld->ld_filter_state.catch_up(*lf, lf->size(), deadline)) {
+            return false;
+        }
     }
+    this->lss_filters_behind = false;
 
-    if (this->tss_view != nullptr) {
-        this->tss_view->reload_data();
-        this->tss_view->redo_search();
+    return true;
+}
+
+void logfile_sub_source::index_row_levels(size_t start_row)
+{
+    size_t word_count = (this->lss_index.size() + 63) / 64;
+
+    for (auto& level_rows : this->lss_level_rows) {
+        level_rows.resize(word_count, 0);
+    }
+    for (size_t row = start_row; row < this->lss_index.size(); row++) {
+        auto ll = this->find_line((content_line_t) this->lss_index[row]);
+
+        this->lss_level_rows[ll->get_msg_level()][row / 64] |=
+            1ULL << (row % 64);
+    }
+}
+
+void logfile_sub_source::truncate_row_levels(size_t size)
+{
+    size_t word_count = (size + 63) / 64;
+
+    for (auto& level_rows : this->lss_level_rows) {
+        level_rows.resize(word_count);
+        if (size % 64) {
+            level_rows.back() &= (1ULL << (size % 64)) - 1;
+        }
+    }
+}
+
+size_t logfile_sub_source::next_row_at_min_level(size_t row, size_t end) const
+{
+    while (row < end) {
+        size_t word = row / 64;
+        uint64_t bits = 0;
+
+        for (int level = this->lss_min_log_level; level < LEVEL__MAX; level++) {
+            const auto& level_rows = this->lss_level_rows[level];
+
+            if (word < level_rows.size()) {
+                bits |= level_rows[word];
+            }
+        }
+        bits &= ~0ULL << (row % 64);
+        if (bits != 0) {
+            return std::min(end, word * 64 + __builtin_ctzll(bits));
+        }
+        row = (word + 1) * 64;
     }
+
+    return end;
+}
+
+std::pair<size_t, size_t> logfile_sub_source::get_time_range_rows()
+{
+    auto lower = this->lss_index.begin();
+    auto upper = this->lss_index.end();
+    struct timeval tv;
+
+    if (this->get_min_log_time(tv)) {
+        lower = std::lower_bound(lower, upper, tv, logline_cmp(*this));
+    }
+    if (this->get_max_log_time(tv)) {
+        upper = std::partition_point(lower, upper, [this, &tv](const auto& ic) {
+            return *this->find_line((content_line_t) ic) <= tv;
+        });
+    }
+
+    return std::make_pair(
+        (size_t) std::distance(this->lss_index.begin(), lower),
+        (size_t) std::distance(this->lss_index.begin(), upper));
 }
 
 bool logfile_sub_source::list_input_handle_key(listview_curses &lv, int ch)
@@ -1132,6 +1365,118 @@ logfile_sub_source::get_grepper()
     );
 }
 
+vis_line_t logfile_sub_source::text_next_candidate(
+    vis_line_t line, const trigram_index::query &tq)
+{
+    for (; line < (int) this->lss_filtered_index.size(); ++line) {
+        uint64_t line_number;
+        auto ld = this->find_data(this->at(line), line_number);
+        auto lf = (*ld)->get_file_ptr();
+
+        if (lf == nullptr ||
+            tq.next_candidate(lf->get_trigram_index(), line_number) ==
+            line_number) {
+            break;
+        }
+    }
+
+    return line;
+}
+
+void logfile_sub_source::text_search_changed(const std::string &pattern)
+{
+    this->lss_search_pattern = pattern;
+    this->lss_search_tail_reads.clear();
+    for (auto &ld : this->lss_files) {
+        ld->select_search(pattern);
+    }
+}
+
+/**
+ * @return True if the given line is part of the last line in the file, which
+ *   is read again when more data is appended.
+ */
+static bool is_last_file_line(const logfile &lf, size_t line_number)
+{
+    auto iter = lf.end();
+
+    while (iter != lf.begin()) {
+        --iter;
+        if (iter->get_sub_offset() == 0) {
+            break;
+        }
+    }
+
+    return line_number >= (size_t) std::distance(lf.begin(), iter);
+}
+
+vis_line_t logfile_sub_source::text_next_unsearched(
+    vis_line_t line, std::vector<vis_line_t> &hits_out)
+{
+    if (this->lss_search_pattern.empty()) {
+        return line;
+    }
+
+    for (; line < (int) this->lss_filtered_index.size(); ++line) {
+        auto cl = this->at(line);
+        uint64_t line_number;
+        auto ld = this->find_data(cl, line_number);
+        auto lf = (*ld)->get_file_ptr();
+
+        if (lf == nullptr || (*ld)->ld_search_results.empty()) {
+            break;
+        }
+
+        const auto &sr = (*ld)->ld_search_results.front();
+
+        if (line_number >= sr.sr_searched.size() ||
+            !sr.sr_searched[line_number]) {
+            if (is_last_file_line(*lf, line_number)) {
+                this->lss_search_tail_reads.insert(cl);
+            }
+            break;
+        }
+        if (sr.sr_matched[line_number]) {
+            hits_out.push_back(line);
+        }
+    }
+
+    return line;
+}
+
+void logfile_sub_source::text_search_result(vis_line_t line, bool matched)
+{
+    if (this->lss_search_pattern.empty() ||
+        line >= (int) this->lss_filtered_index.size()) {
+        return;
+    }
+
+    auto cl = this->at(line);
+
+    if (this->lss_search_tail_reads.erase(cl) > 0) {
+        return;
+    }
+
+    uint64_t line_number;
+    auto ld = this->find_data(cl, line_number);
+    auto lf = (*ld)->get_file_ptr();
+
+    if (lf == nullptr || (*ld)->ld_search_results.empty()) {
+        return;
+    }
+
+    auto &sr = (*ld)->ld_search_results.front();
+
+    if (line_number >= sr.sr_searched.size()) {
+        auto new_size = std::max((size_t) line_number + 1, lf->size());
+
+        sr.sr_searched.resize(new_size);
+        sr.sr_matched.resize(new_size);
+    }
+    sr.sr_searched[line_number] = true;
+    sr.sr_matched[line_number] = matched;
+}
+
 bool logfile_sub_source::insert_file(const shared_ptr<logfile> &lf)
 {
     iterator existing;
@@ -1149,10 +1494,12 @@ bool logfile_sub_source::insert_file(const shared_ptr<logfile> &lf)
         auto ld = std::make_unique<logfile_data>(
             this->lss_files.size(), this->get_filters(), lf);
         ld->set_visibility(lf->get_open_options().loo_is_visible);
+        ld->select_search(this->lss_search_pattern);
         this->lss_files.push_back(std::move(ld));
     }
     else {
         (*existing)->set_file(lf);
+        (*existing)->select_search(this->lss_search_pattern);
     }
     this->lss_force_rebuild = true;
 
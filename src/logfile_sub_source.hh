@@ -36,6 +36,7 @@
 
 #include <map>
 #include <list>
+#include <set>
 #include <array>
 #include <sstream>
 #include <utility>
@@ -81,9 +82,14 @@ public:
 class pcre_filter
     : public text_filter {
 public:
-    pcre_filter(type_t type, const std::string& id, size_t index, pcre *code)
+    pcre_filter(type_t type, const std::string& id, size_t index, pcrepp code)
         : text_filter(type, filter_lang_t::REGEX, id, index),
-          pf_pcre(code) { };
+          pf_pcre(std::move(code)),
+          pf_trigram_query(
+              (this->pf_pcre.p_options & PCRE_EXTENDED) ? "" :
+              log_format_prefilter::required_literal(
+                  this->pf_pcre.get_pattern()),
+              this->pf_pcre.p_options & PCRE_CASELESS) { };
 
     ~pcre_filter() override = default;
 
@@ -94,6 +100,26 @@ public:
         return this->pf_pcre.match(pc, pi);
     };
 
+    void add_to_prefilter(log_format_prefilter &lp) const override {
+        // The literal scanner does not know about extended mode whitespace.
+        if (this->pf_pcre.p_options & PCRE_EXTENDED) {
+            lp.add_unconditional(this->lf_index);
+            return;
+        }
+
+        lp.add_literal(
+            this->lf_index,
+            log_format_prefilter::required_literal(this->pf_pcre.get_pattern()),
+            this->pf_pcre.p_options & PCRE_CASELESS);
+    };
+
+    const trigram_index::query *get_trigram_query() const override {
+        if (this->pf_trigram_query.empty()) {
+            return nullptr;
+        }
+        return &this->pf_trigram_query;
+    };
+
     std::string to_command() override {
         return (this->lf_type == text_filter::INCLUDE ?
                 "filter-in " : "filter-out ") +
@@ -102,6 +128,7 @@ public:
 
 protected:
     pcrepp pf_pcre;
+    trigram_index::query pf_trigram_query;
 };
 
 class sql_filter : public text_filter {
@@ -462,7 +489,27 @@ public:
     };
 
     int get_filtered_count() const {
-        return this->lss_index.size() - this->lss_filtered_index.size();
+        return this->lss_filtered_through - this->lss_filtered_index.size();
+    };
+
+    /**
+     * Limit the time text_filters_changed() spends filtering before it
+     * returns.  The remaining lines are filtered by later rebuild_index()
+     * calls and show up in the view as they are done.  A zero duration,
+     * the default, filters all of the lines before returning.
+     */
+    void set_filter_time_slice(std::chrono::milliseconds slice) {
+        this->lss_filter_time_slice = slice;
+    };
+
+    std::chrono::milliseconds get_filter_time_slice() const {
+        return this->lss_filter_time_slice;
+    };
+
+    /** @return True if some lines still need to be filtered. */
+    bool is_filtering() const {
+        return this->lss_filtered_through < this->lss_index.size() ||
+               this->lss_filters_behind;
     };
 
     int get_filtered_count_for(size_t filter_index) const {
@@ -545,8 +592,8 @@ public:
         std::shared_ptr<logfile> lf = this->find(line);
 
         if (lf != nullptr) {
-            auto ll_iter = lf->begin() + line;
-            auto &ll = *ll_iter;
+            // Copy the line since the search can compact its block.
+            auto ll = *(lf->cbegin() + line);
             auto vis_start_opt = this->find_from_time(ll.get_timeval());
 
             if (!vis_start_opt) {
@@ -600,6 +647,19 @@ public:
 
     log_accel::direction_t get_line_accel_direction(vis_line_t vl);
 
+    /**
+     * The lines of a file that a search pattern was run over and the ones
+     * that matched.
+     */
+    struct search_results {
+        std::string sr_pattern;
+        std::vector<bool> sr_searched;
+        std::vector<bool> sr_matched;
+    };
+
+    /** The number of search patterns to keep results for. */
+    static const size_t MAX_CACHED_SEARCHES = 4;
+
     /**
      * Container for logfile references that keeps of how many lines in the
      * logfile have been indexed.
@@ -620,6 +680,37 @@ public:
         void set_file(const std::shared_ptr<logfile> &lf) {
             this->ld_filter_state.lfo_filter_state.tfs_logfile = lf;
             lf->set_logline_observer(&this->ld_filter_state);
+            this->ld_search_results.clear();
+        };
+
+        /**
+         * Move the results for the given pattern to the front of the list,
+         * dropping the least recently used ones to make room if needed.
+         */
+        void select_search(const std::string &pattern) {
+            if (pattern.empty()) {
+                return;
+            }
+
+            auto iter = std::find_if(this->ld_search_results.begin(),
+                                     this->ld_search_results.end(),
+                                     [&pattern](const auto &sr) {
+                                         return sr.sr_pattern == pattern;
+                                     });
+
+            if (iter != this->ld_search_results.end()) {
+                this->ld_search_results.splice(
+                    this->ld_search_results.begin(),
+                    this->ld_search_results,
+                    iter);
+                return;
+            }
+
+            this->ld_search_results.emplace_front();
+            this->ld_search_results.front().sr_pattern = pattern;
+            if (this->ld_search_results.size() > MAX_CACHED_SEARCHES) {
+                this->ld_search_results.pop_back();
+            }
         };
 
         std::shared_ptr<logfile> get_file() const {
@@ -642,6 +733,8 @@ public:
         line_filter_observer ld_filter_state;
         size_t ld_lines_indexed{0};
         bool ld_visible;
+        /** The cached search results, the current pattern is first. */
+        std::list<search_results> ld_search_results;
     };
 
     typedef std::vector<std::unique_ptr<logfile_data>>::iterator iterator;
@@ -770,6 +863,7 @@ public:
             vis_bookmarks &bm = this->lmg_source.tss_view->get_bookmarks();
             bookmark_vector<vis_line_t> &bv = bm[&textview_curses::BM_META];
 
+            this->lmg_done = false;
             if (bv.empty()) {
                 return -1_vl;
             }
@@ -808,6 +902,16 @@ public:
     nonstd::optional<std::pair<grep_proc_source<vis_line_t> *, grep_proc_sink<vis_line_t> *>>
     get_grepper();
 
+    vis_line_t text_next_candidate(vis_line_t line,
+                                   const trigram_index::query &tq) override;
+
+    void text_search_changed(const std::string &pattern) override;
+
+    vis_line_t text_next_unsearched(vis_line_t line,
+                                    std::vector<vis_line_t> &hits_out) override;
+
+    void text_search_result(vis_line_t line, bool matched) override;
+
     nonstd::optional<location_history *> get_location_history() {
         return &this->lss_location_history;
     };
@@ -823,6 +927,17 @@ public:
 private:
     static const size_t LINE_SIZE_CACHE_SIZE = 512;
 
+    /**
+     * Index the files with a large backlog of data concurrently on worker
+     * threads.
+     *
+     * @param deadline The time by which indexing should stop.
+     * @return The results of the rebuild_index() calls for the files that
+     *   were indexed.
+     */
+    std::map<const logfile *, logfile::rebuild_result_t> rebuild_file_indexes(
+        nonstd::optional<ui_clock::time_point> deadline);
+
     enum {
         B_SCRUB,
         B_TIME_OFFSET,
@@ -963,6 +1078,40 @@ private:
 
     bool check_extra_filters(iterator ld, logfile::iterator ll);
 
+    /**
+     * Add the rows of lss_index past lss_filtered_through that pass the
+     * filters to lss_filtered_index.  Filters that have not looked at a
+     * row's line yet are run first.
+     *
+     * @param deadline The time to stop at, even if rows are left.
+     * @return True if all of the rows were filtered and the filters have
+     *   caught up with the rest of the lines.
+     */
+    bool filter_rows(nonstd::optional<ui_clock::time_point> deadline);
+
+    /**
+     * Record the levels of the rows in lss_index starting at the given row
+     * in the per-level bitmaps.
+     */
+    void index_row_levels(size_t start_row);
+
+    /**
+     * Drop the level bits for the rows at and after the given row.
+     */
+    void truncate_row_levels(size_t size);
+
+    /**
+     * @return The first row in the range [row, end) with a level that is
+     *   at or above the minimum, or end if there are none.
+     */
+    size_t next_row_at_min_level(size_t row, size_t end) const;
+
+    /**
+     * @return The range of rows in lss_index that fall within the minimum
+     *   and maximum log times.
+     */
+    std::pair<size_t, size_t> get_time_range_rows();
+
     size_t                    lss_basename_width = 0;
     size_t                    lss_filename_width = 0;
     unsigned long             lss_flags{0};
@@ -971,6 +1120,20 @@ private:
 
     big_array<indexed_content> lss_index;
     std::vector<uint32_t> lss_filtered_index;
+    /** The number of rows in lss_index that have been filtered. */
+    size_t lss_filtered_through{0};
+    /**
+     * True if the filters still need to be run over lines that are not in
+     * the rows, like those in hidden files, to complete the hit counts.
+     */
+    bool lss_filters_behind{false};
+    /**
+     * Bitmaps, one for each log level, of the rows in lss_index that have
+     * that level.  The bits for all of the levels at or above the minimum
+     * are OR'd together to find the rows that can be shown.
+     */
+    std::array<std::vector<uint64_t>, LEVEL__MAX> lss_level_rows;
+    std::chrono::milliseconds lss_filter_time_slice{0};
     auto_mem<sqlite3_stmt> lss_preview_filter_stmt{sqlite3_finalize};
 
     bookmarks<content_line_t>::type lss_user_marks;
@@ -997,6 +1160,13 @@ private:
     size_t            lss_longest_line{0};
     meta_grepper lss_meta_grepper;
     log_location_history lss_location_history;
+    std::string lss_search_pattern;
+    /**
+     * The lines that were at the end of their file when the search read
+     * them.  The line might have been incomplete and read again by the
+     * file since then, so the result is not cached.
+     */
+    std::set<content_line_t> lss_search_tail_reads;
 
     bool lss_in_value_for_line{false};
 };
@@ -0,0 +1,503 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file logline_index.cc
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "logline_index.hh"
+
+namespace {
+
+enum column_t {
+    COL_OFFSET,
+    COL_TIME,
+    COL_MILLIS,
+    COL_LEVEL,
+    COL_FLAGS,
+    COL_SUB_OFFSET,
+    COL_SCHEMA,
+
+    COL__MAX
+};
+
+/**
+ * Lines are usually appended in time order with offsets that increase by
+ * the length of each line, so the offset and time columns store the
+ * difference from the previous line.  The difference is zig-zag encoded to
+ * keep small negative values small.
+ */
+uint64_t zigzag_encode(int64_t value)
+{
+    return ((uint64_t) value << 1U) ^ (uint64_t) (value >> 63);
+}
+
+int64_t zigzag_decode(uint64_t value)
+{
+    return (int64_t) (value >> 1U) ^ -(int64_t) (value & 1U);
+}
+
+uint8_t width_for(uint64_t max_value)
+{
+    if (max_value == 0) {
+        return 0;
+    }
+    if (max_value <= 0xffU) {
+        return 1;
+    }
+    if (max_value <= 0xffffU) {
+        return 2;
+    }
+    if (max_value <= 0xffffffffU) {
+        return 4;
+    }
+    return 8;
+}
+
+const size_t BLOCK_SIZE = logline_index::BLOCK_SIZE;
+
+template<typename T>
+void store_column(uint8_t *dst, const uint64_t *values, uint64_t base)
+{
+    for (size_t lpc = 0; lpc < BLOCK_SIZE; lpc++) {
+        auto narrow = (T) (values[lpc] - base);
+
+        memcpy(&dst[lpc * sizeof(T)], &narrow, sizeof(T));
+    }
+}
+
+void store_column(uint8_t *dst,
+                  uint8_t width,
+                  const uint64_t *values,
+                  uint64_t base)
+{
+    switch (width) {
+        case 0:
+            break;
+        case 1:
+            store_column<uint8_t>(dst, values, base);
+            break;
+        case 2:
+            store_column<uint16_t>(dst, values, base);
+            break;
+        case 4:
+            store_column<uint32_t>(dst, values, base);
+            break;
+        default:
+            store_column<uint64_t>(dst, values, base);
+            break;
+    }
+}
+
+template<typename T, typename F>
+void for_each_value(const uint8_t *src, F func)
+{
+    for (size_t lpc = 0; lpc < BLOCK_SIZE; lpc++) {
+        T narrow;
+
+        memcpy(&narrow, &src[lpc * sizeof(T)], sizeof(T));
+        func(lpc, (uint64_t) narrow);
+    }
+}
+
+/**
+ * Call func with the index and value of each entry in a column.  Nothing is
+ * called for a zero-width column since all of its values are the base.
+ */
+template<typename F>
+void for_each_value(const uint8_t *src, uint8_t width, F func)
+{
+    switch (width) {
+        case 0:
+            break;
+        case 1:
+            for_each_value<uint8_t>(src, func);
+            break;
+        case 2:
+            for_each_value<uint16_t>(src, func);
+            break;
+        case 4:
+            for_each_value<uint32_t>(src, func);
+            break;
+        default:
+            for_each_value<uint64_t>(src, func);
+            break;
+    }
+}
+
+int64_t time_in_millis(const logline &ll)
+{
+    return (int64_t) ll.get_time() * 1000 + ll.get_millis();
+}
+
+}
+
+struct logline_index::packed_lines {
+    /**
+     * The first value in the offset and time columns and the minimum value
+     * in the others.
+     */
+    int64_t pl_base[COL__MAX];
+    /** The number of bytes used for each value in a column, zero or 1-8. */
+    uint8_t pl_width[COL__MAX];
+    /**
+     * Copies of the first and last lines in the block, used for searching
+     * and checking the order without decoding the block.
+     */
+    logline pl_first{0, 0, 0, LEVEL_UNKNOWN};
+    logline pl_last{0, 0, 0, LEVEL_UNKNOWN};
+    /** True if the lines in the block are in time order. */
+    bool pl_sorted;
+    size_t pl_data_size;
+    std::unique_ptr<uint8_t[]> pl_data;
+};
+
+logline_index::block::block()
+{
+    this->b_lines.reserve(BLOCK_SIZE);
+}
+
+logline_index::block::~block() = default;
+
+logline_index::block &logline_index::tail_block()
+{
+    if (this->li_size % BLOCK_SIZE == 0) {
+        // The block that was just filled is now limited like any other.
+        if (!this->li_blocks.empty() && this->li_blocks.back()->b_decoded) {
+            this->li_blocks.back()->b_last_used = ++this->li_clock;
+            this->track_decoded(this->li_blocks.size() - 1);
+        }
+        this->li_blocks.emplace_back(std::make_unique<block>());
+    }
+
+    return *this->li_blocks.back();
+}
+
+void logline_index::pop_back()
+{
+    require(!this->empty());
+
+    auto block_index = this->li_blocks.size() - 1;
+    auto &blk = *this->li_blocks.back();
+
+    if (!blk.b_decoded) {
+        decode(blk);
+    }
+    blk.b_lines.pop_back();
+    this->li_size -= 1;
+
+    // The block is the tail again, which is not counted against the limit.
+    auto iter = std::find(
+        this->li_decoded.begin(), this->li_decoded.end(), block_index);
+    if (iter != this->li_decoded.end()) {
+        *iter = this->li_decoded.back();
+        this->li_decoded.pop_back();
+    }
+    if (blk.b_lines.empty()) {
+        this->li_blocks.pop_back();
+        this->li_generation += 1;
+    }
+}
+
+void logline_index::track_decoded(size_t block_index) const
+{
+    this->li_decoded.push_back(block_index);
+    if (this->li_decoded.size() <= MAX_DECODED_BLOCKS) {
+        return;
+    }
+
+    auto lru = std::min_element(
+        this->li_decoded.begin(),
+        this->li_decoded.end(),
+        [this](size_t lhs, size_t rhs) {
+            return this->li_blocks[lhs]->b_last_used <
+                   this->li_blocks[rhs]->b_last_used;
+        });
+
+    encode(*this->li_blocks[*lru]);
+    *lru = this->li_decoded.back();
+    this->li_decoded.pop_back();
+    this->li_generation += 1;
+}
+
+logline_index::const_iterator
+logline_index::lower_bound(const struct timeval &tv) const
+{
+    auto target = (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    auto block_iter = std::partition_point(
+        this->li_blocks.begin(),
+        this->li_blocks.end(),
+        [target](const std::unique_ptr<block> &blk) {
+            if (blk->b_decoded) {
+                return time_in_millis(blk->b_lines.back()) < target;
+            }
+            return time_in_millis(blk->b_packed->pl_last) < target;
+        });
+
+    if (block_iter == this->li_blocks.end()) {
+        return this->cend();
+    }
+
+    auto block_start = (size_t) (block_iter - this->li_blocks.begin()) *
+                       BLOCK_SIZE;
+    auto block_end = std::min(this->li_size, block_start + BLOCK_SIZE);
+
+    return std::lower_bound(const_iterator{this, block_start},
+                            const_iterator{this, block_end},
+                            tv);
+}
+
+size_t logline_index::compact(size_t max_blocks)
+{
+    size_t retval = 0;
+    auto full_blocks = this->li_size / BLOCK_SIZE;
+
+    for (size_t lpc = 0; lpc < full_blocks && retval < max_blocks; lpc++) {
+        auto &blk = *this->li_blocks[lpc];
+
+        if (!blk.b_decoded) {
+            continue;
+        }
+
+        encode(blk);
+        retval += 1;
+    }
+    if (retval > 0) {
+        this->li_decoded.erase(
+            std::remove_if(this->li_decoded.begin(),
+                           this->li_decoded.end(),
+                           [this](size_t block_index) {
+                               return !this->li_blocks[block_index]->b_decoded;
+                           }),
+            this->li_decoded.end());
+        this->li_generation += 1;
+    }
+
+    return retval;
+}
+
+bool logline_index::is_sorted() const
+{
+    const logline *prev_last = nullptr;
+
+    for (const auto &blk : this->li_blocks) {
+        const logline *first, *last;
+
+        if (blk->b_decoded) {
+            if (!std::is_sorted(blk->b_lines.begin(), blk->b_lines.end())) {
+                return false;
+            }
+            first = &blk->b_lines.front();
+            last = &blk->b_lines.back();
+        } else {
+            if (!blk->b_packed->pl_sorted) {
+                return false;
+            }
+            first = &blk->b_packed->pl_first;
+            last = &blk->b_packed->pl_last;
+        }
+        if (prev_last != nullptr && *first < *prev_last) {
+            return false;
+        }
+        prev_last = last;
+    }
+
+    return true;
+}
+
+size_t logline_index::memory_usage() const
+{
+    auto retval = this->li_blocks.capacity() * sizeof(std::unique_ptr<block>);
+
+    for (const auto &blk : this->li_blocks) {
+        retval += sizeof(block);
+        retval += blk->b_lines.capacity() * sizeof(logline);
+        if (blk->b_packed) {
+            retval += sizeof(packed_lines) + blk->b_packed->pl_data_size;
+        }
+    }
+
+    return retval;
+}
+
+uint64_t logline_index::get_flags(const logline &ll)
+{
+    return (uint64_t) ll.ll_valid_utf |
+           (uint64_t) ll.ll_expr_mark << 1U |
+           (uint64_t) ll.ll_opid << 2U |
+           (uint64_t) ll.ll_module_id << 8U;
+}
+
+void logline_index::set_flags(logline &ll, uint64_t flags)
+{
+    ll.ll_valid_utf = flags & 1U;
+    ll.ll_expr_mark = (flags >> 1U) & 1U;
+    ll.ll_opid = (flags >> 2U) & 0x3fU;
+    ll.ll_module_id = (flags >> 8U) & 0x7fU;
+}
+
+void logline_index::encode(block &blk)
+{
+    require(blk.b_lines.size() == BLOCK_SIZE);
+
+    thread_local uint64_t values[COL__MAX][BLOCK_SIZE];
+    uint64_t mins[COL__MAX];
+    uint64_t maxes[COL__MAX];
+    auto pl = std::make_unique<packed_lines>();
+    const auto *lines = blk.b_lines.data();
+    int64_t prev_offset = lines[0].ll_offset;
+    int64_t prev_time = lines[0].ll_time;
+
+    pl->pl_sorted = true;
+    for (size_t lpc = 0; lpc < BLOCK_SIZE; lpc++) {
+        const auto &ll = lines[lpc];
+
+        if (lpc > 0 && ll < lines[lpc - 1]) {
+            pl->pl_sorted = false;
+        }
+
+        values[COL_OFFSET][lpc] = zigzag_encode(ll.ll_offset - prev_offset);
+        values[COL_TIME][lpc] = zigzag_encode(ll.ll_time - prev_time);
+        values[COL_MILLIS][lpc] = ll.ll_millis;
+        values[COL_LEVEL][lpc] = ll.ll_level;
+        values[COL_FLAGS][lpc] = get_flags(ll);
+        values[COL_SUB_OFFSET][lpc] = ll.ll_sub_offset;
+        values[COL_SCHEMA][lpc] = (uint64_t) (uint8_t) ll.ll_schema[0] |
+                                  (uint64_t) (uint8_t) ll.ll_schema[1] << 8U;
+        prev_offset = ll.ll_offset;
+        prev_time = ll.ll_time;
+    }
+
+    pl->pl_data_size = 0;
+    for (size_t col = 0; col < COL__MAX; col++) {
+        auto minmax = std::minmax_element(values[col],
+                                          values[col] + BLOCK_SIZE);
+
+        mins[col] = *minmax.first;
+        maxes[col] = *minmax.second;
+    }
+    pl->pl_base[COL_OFFSET] = lines[0].ll_offset;
+    pl->pl_width[COL_OFFSET] = width_for(maxes[COL_OFFSET]);
+    pl->pl_base[COL_TIME] = lines[0].ll_time;
+    pl->pl_width[COL_TIME] = width_for(maxes[COL_TIME]);
+    for (size_t col = COL_MILLIS; col < COL__MAX; col++) {
+        pl->pl_base[col] = mins[col];
+        pl->pl_width[col] = width_for(maxes[col] - mins[col]);
+    }
+    for (size_t col = 0; col < COL__MAX; col++) {
+        pl->pl_data_size += pl->pl_width[col] * BLOCK_SIZE;
+    }
+    pl->pl_first = lines[0];
+    pl->pl_last = lines[BLOCK_SIZE - 1];
+    pl->pl_data = std::make_unique<uint8_t[]>(pl->pl_data_size);
+
+    auto *dst = pl->pl_data.get();
+    for (size_t col = 0; col < COL__MAX; col++) {
+        auto base = col < COL_MILLIS ? 0 : pl->pl_base[col];
+
+        store_column(dst, pl->pl_width[col], values[col], base);
+        dst += pl->pl_width[col] * BLOCK_SIZE;
+    }
+
+    blk.b_packed = std::move(pl);
+    blk.b_decoded = false;
+    std::vector<logline>().swap(blk.b_lines);
+}
+
+void logline_index::decode(block &blk)
+{
+    const auto &pl = *blk.b_packed;
+    const uint8_t *columns[COL__MAX];
+    const auto *src = pl.pl_data.get();
+
+    for (size_t col = 0; col < COL__MAX; col++) {
+        columns[col] = src;
+        src += pl.pl_width[col] * BLOCK_SIZE;
+    }
+
+    // Start with every line set to the base values and then fill in the
+    // columns that vary, one column at a time.
+    logline proto(pl.pl_base[COL_OFFSET], 0, 0,
+                  (log_level_t) pl.pl_base[COL_LEVEL]);
+    auto schema = pl.pl_base[COL_SCHEMA];
+
+    proto.ll_time = pl.pl_base[COL_TIME];
+    proto.ll_millis = pl.pl_base[COL_MILLIS];
+    set_flags(proto, pl.pl_base[COL_FLAGS]);
+    proto.ll_sub_offset = pl.pl_base[COL_SUB_OFFSET];
+    proto.ll_schema[0] = (char) (schema & 0xffU);
+    proto.ll_schema[1] = (char) ((schema >> 8U) & 0xffU);
+    blk.b_lines.assign(BLOCK_SIZE, proto);
+
+    auto *lines = blk.b_lines.data();
+    for_each_value(columns[COL_OFFSET], pl.pl_width[COL_OFFSET],
+        [lines, curr = pl.pl_base[COL_OFFSET]](size_t lpc,
+                                               uint64_t value) mutable {
+            curr += zigzag_decode(value);
+            lines[lpc].ll_offset = curr;
+        });
+    for_each_value(columns[COL_TIME], pl.pl_width[COL_TIME],
+        [lines, curr = pl.pl_base[COL_TIME]](size_t lpc,
+                                             uint64_t value) mutable {
+            curr += zigzag_decode(value);
+            lines[lpc].ll_time = curr;
+        });
+    for_each_value(columns[COL_MILLIS], pl.pl_width[COL_MILLIS],
+        [lines, base = pl.pl_base[COL_MILLIS]](size_t lpc, uint64_t value) {
+            lines[lpc].ll_millis = base + value;
+        });
+    for_each_value(columns[COL_LEVEL], pl.pl_width[COL_LEVEL],
+        [lines, base = pl.pl_base[COL_LEVEL]](size_t lpc, uint64_t value) {
+            lines[lpc].ll_level = base + value;
+        });
+    for_each_value(columns[COL_FLAGS], pl.pl_width[COL_FLAGS],
+        [lines, base = pl.pl_base[COL_FLAGS]](size_t lpc, uint64_t value) {
+            set_flags(lines[lpc], base + value);
+        });
+    for_each_value(columns[COL_SUB_OFFSET], pl.pl_width[COL_SUB_OFFSET],
+        [lines, base = pl.pl_base[COL_SUB_OFFSET]](size_t lpc,
+                                                   uint64_t value) {
+            lines[lpc].ll_sub_offset = base + value;
+        });
+    for_each_value(columns[COL_SCHEMA], pl.pl_width[COL_SCHEMA],
+        [lines, base = pl.pl_base[COL_SCHEMA]](size_t lpc, uint64_t value) {
+            auto schema = base + value;
+
+            lines[lpc].ll_schema[0] = (char) (schema & 0xffU);
+            lines[lpc].ll_schema[1] = (char) ((schema >> 8U) & 0xffU);
+        });
+
+    blk.b_packed.reset();
+    blk.b_decoded = true;
+}
@@ -0,0 +1,401 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file logline_index.hh
+ */
+
+#ifndef lnav_logline_index_hh
+#define lnav_logline_index_hh
+
+#include <sys/time.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "base/file_range.hh"
+#include "base/lnav_log.hh"
+#include "log_format_fwd.hh"
+
+/**
+ * The index of lines in a log file.  The lines are stored in fixed-size
+ * blocks so that growing the index never needs to copy the lines that are
+ * already in it.  Full blocks are compacted into a delta-encoded form that
+ * takes a fraction of the memory of the plain logline objects.  Only the
+ * MAX_DECODED_BLOCKS full blocks that were used most recently are kept
+ * decoded, so a pass over the whole index does not leave all of it decoded.
+ * When another block is filled or decoded, the least recently used block is
+ * compacted again, keeping any changes made to its lines.
+ *
+ * Pointers and references to a line stay valid until MAX_DECODED_BLOCKS
+ * other blocks have been used after it or compact() is called.  Iterators
+ * stay valid since they look their block up again when it is compacted.
+ * The index is not thread-safe, only one thread should use it at a time.
+ */
+class logline_index {
+private:
+    struct block;
+
+public:
+    static const size_t BLOCK_SHIFT = 10;
+    static const size_t BLOCK_SIZE = 1UL << BLOCK_SHIFT;
+    static const size_t MAX_DECODED_BLOCKS = 64;
+
+    template<typename IndexT, typename ValueT>
+    class basic_iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = logline;
+        using difference_type = std::ptrdiff_t;
+        using pointer = ValueT *;
+        using reference = ValueT &;
+
+        basic_iterator() = default;
+
+        basic_iterator(IndexT *index, size_t pos)
+            : i_index(index), i_pos(pos) {};
+
+        template<typename OtherIndexT, typename OtherValueT,
+                 typename = typename std::enable_if<
+                     std::is_convertible<OtherValueT *, ValueT *>::value>::type>
+        basic_iterator(const basic_iterator<OtherIndexT, OtherValueT> &other)
+            : i_index(other.i_index), i_pos(other.i_pos),
+              i_lines(other.i_lines), i_block(other.i_block),
+              i_block_ptr(other.i_block_ptr),
+              i_generation(other.i_generation) {};
+
+        reference operator*() const {
+            return *this->lookup(this->i_pos);
+        };
+
+        pointer operator->() const {
+            return this->lookup(this->i_pos);
+        };
+
+        reference operator[](difference_type n) const {
+            return *this->lookup(this->i_pos + n);
+        };
+
+        basic_iterator &operator++() {
+            this->i_pos += 1;
+            return *this;
+        };
+
+        basic_iterator operator++(int) {
+            auto retval = *this;
+
+            this->i_pos += 1;
+            return retval;
+        };
+
+        basic_iterator &operator--() {
+            this->i_pos -= 1;
+            return *this;
+        };
+
+        basic_iterator operator--(int) {
+            auto retval = *this;
+
+            this->i_pos -= 1;
+            return retval;
+        };
+
+        basic_iterator &operator+=(difference_type n) {
+            this->i_pos += n;
+            return *this;
+        };
+
+        basic_iterator &operator-=(difference_type n) {
+            this->i_pos -= n;
+            return *this;
+        };
+
+        basic_iterator operator+(difference_type n) const {
+            return {this->i_index, this->i_pos + n};
+        };
+
+        friend basic_iterator operator+(difference_type n,
+                                        const basic_iterator &iter) {
+            return iter + n;
+        };
+
+        basic_iterator operator-(difference_type n) const {
+            return {this->i_index, this->i_pos - n};
+        };
+
+        friend difference_type operator-(const basic_iterator &lhs,
+                                         const basic_iterator &rhs) {
+            return (difference_type) lhs.i_pos - (difference_type) rhs.i_pos;
+        };
+
+        friend bool operator==(const basic_iterator &lhs,
+                               const basic_iterator &rhs) {
+            return lhs.i_pos == rhs.i_pos;
+        };
+
+        friend bool operator!=(const basic_iterator &lhs,
+                               const basic_iterator &rhs) {
+            return lhs.i_pos != rhs.i_pos;
+        };
+
+        friend bool operator<(const basic_iterator &lhs,
+                              const basic_iterator &rhs) {
+            return lhs.i_pos < rhs.i_pos;
+        };
+
+        friend bool operator>(const basic_iterator &lhs,
+                              const basic_iterator &rhs) {
+            return lhs.i_pos > rhs.i_pos;
+        };
+
+        friend bool operator<=(const basic_iterator &lhs,
+                               const basic_iterator &rhs) {
+            return lhs.i_pos <= rhs.i_pos;
+        };
+
+        friend bool operator>=(const basic_iterator &lhs,
+                               const basic_iterator &rhs) {
+            return lhs.i_pos >= rhs.i_pos;
+        };
+
+    private:
+        template<typename, typename>
+        friend class basic_iterator;
+
+        /**
+         * Find the line at the given position.  The lines for the last
+         * block that was looked at are cached so that walking through a
+         * block only needs to check the index once.  The block is still
+         * marked as used so that it is not the next one to be compacted.
+         */
+        pointer lookup(size_t pos) const {
+            auto block_index = pos >> BLOCK_SHIFT;
+
+            if (block_index != this->i_block ||
+                this->i_generation != this->i_index->li_generation) {
+                this->i_lines = this->i_index->block_lines(block_index);
+                this->i_block = block_index;
+                this->i_block_ptr =
+                    this->i_index->li_blocks[block_index].get();
+                this->i_generation = this->i_index->li_generation;
+            } else {
+                this->i_block_ptr->b_last_used = ++this->i_index->li_clock;
+            }
+
+            return &this->i_lines[pos & (BLOCK_SIZE - 1)];
+        };
+
+        IndexT *i_index{nullptr};
+        size_t i_pos{0};
+        mutable logline *i_lines{nullptr};
+        mutable size_t i_block{SIZE_MAX};
+        mutable block *i_block_ptr{nullptr};
+        mutable size_t i_generation{0};
+    };
+
+    using value_type = logline;
+    using size_type = size_t;
+    using reference = logline &;
+    using const_reference = const logline &;
+    using iterator = basic_iterator<const logline_index, logline>;
+    using const_iterator = basic_iterator<const logline_index, const logline>;
+
+    logline_index() = default;
+
+    logline_index(logline_index &&other) = default;
+
+    logline_index &operator=(logline_index &&other) = default;
+
+    size_t size() const { return this->li_size; };
+
+    bool empty() const { return this->li_size == 0; };
+
+    void reserve(size_t size) {
+        this->li_blocks.reserve((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    };
+
+    void clear() {
+        this->li_blocks.clear();
+        this->li_decoded.clear();
+        this->li_size = 0;
+        this->li_generation += 1;
+    };
+
+    logline &operator[](size_t index) { return *this->line_ptr(index); };
+
+    const logline &operator[](size_t index) const {
+        return *this->line_ptr(index);
+    };
+
+    logline &front() { return (*this)[0]; };
+
+    const logline &front() const { return (*this)[0]; };
+
+    logline &back() { return (*this)[this->li_size - 1]; };
+
+    const logline &back() const { return (*this)[this->li_size - 1]; };
+
+    iterator begin() { return {this, 0}; };
+
+    iterator end() { return {this, this->li_size}; };
+
+    const_iterator begin() const { return {this, 0}; };
+
+    const_iterator end() const { return {this, this->li_size}; };
+
+    const_iterator cbegin() const { return {this, 0}; };
+
+    const_iterator cend() const { return {this, this->li_size}; };
+
+    void push_back(const logline &ll) {
+        this->tail_block().b_lines.push_back(ll);
+        this->li_size += 1;
+    };
+
+    template<typename... Args>
+    void emplace_back(Args&&... args) {
+        this->tail_block().b_lines.emplace_back(std::forward<Args>(args)...);
+        this->li_size += 1;
+    };
+
+    void pop_back();
+
+    /**
+     * Append a range of lines to the index.  Lines can only be inserted at
+     * the end.
+     */
+    template<typename InputIt>
+    void insert(const_iterator pos, InputIt first, InputIt last) {
+        require(pos == this->cend());
+
+        for (; first != last; ++first) {
+            this->push_back(*first);
+        }
+    };
+
+    /**
+     * Find the first line that is not earlier than the given time.  Only the
+     * block containing that line needs to be decoded.
+     *
+     * @param tv The time to search for.
+     * @return An iterator to the line or end() if all of the lines are
+     *   earlier.
+     */
+    const_iterator lower_bound(const struct timeval &tv) const;
+
+    /**
+     * Check if the lines are in time order.  Compacted blocks record if their
+     * lines were in order, so they do not need to be decoded.
+     *
+     * @return True if no line is earlier than the one before it.
+     */
+    bool is_sorted() const;
+
+    /** @return The number of bytes used by the lines in the index. */
+    size_t memory_usage() const;
+
+protected:
+    /**
+     * Compact the full blocks that are currently decoded.  Any references or
+     * pointers to lines in those blocks are invalidated, iterators are not.
+     *
+     * @param max_blocks The maximum number of blocks to compact.
+     * @return The number of blocks that were compacted.
+     */
+    size_t compact(size_t max_blocks = SIZE_MAX);
+
+private:
+    template<typename, typename>
+    friend class basic_iterator;
+
+    /** The delta-encoded form of a full block of lines. */
+    struct packed_lines;
+
+    struct block {
+        block();
+
+        ~block();
+
+        /** The decoded lines, empty while the block is packed. */
+        std::vector<logline> b_lines;
+        std::unique_ptr<packed_lines> b_packed;
+        bool b_decoded{true};
+        /** The value of li_clock when the block was last used. */
+        size_t b_last_used{0};
+    };
+
+    logline *block_lines(size_t block_index) const {
+        auto &blk = *this->li_blocks[block_index];
+
+        blk.b_last_used = ++this->li_clock;
+        if (!blk.b_decoded) {
+            decode(blk);
+            this->track_decoded(block_index);
+        }
+
+        return blk.b_lines.data();
+    };
+
+    logline *line_ptr(size_t index) const {
+        return &this->block_lines(
+            index >> BLOCK_SHIFT)[index & (BLOCK_SIZE - 1)];
+    };
+
+    block &tail_block();
+
+    /**
+     * Add a full, decoded block to the ones that are kept decoded and
+     * compact the least recently used one if there are too many.
+     */
+    void track_decoded(size_t block_index) const;
+
+    static uint64_t get_flags(const logline &ll);
+
+    static void set_flags(logline &ll, uint64_t flags);
+
+    static void decode(block &blk);
+
+    static void encode(block &blk);
+
+    std::vector<std::unique_ptr<block>> li_blocks;
+    size_t li_size{0};
+    /**
+     * Incremented when the decoded lines of a block are freed so that
+     * iterators know to look the block up again.
+     */
+    mutable size_t li_generation{0};
+    /** Incremented each time a block is used, to find the least recent. */
+    mutable size_t li_clock{0};
+    /** The indexes of the full blocks that are decoded. */
+    mutable std::vector<size_t> li_decoded;
+};
+
+#endif
@@ -31,6 +31,10 @@
 
 #include "config.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "pcrepp.hh"
 
 using namespace std;
@@ -71,19 +75,30 @@ std::string pcrepp::quote(const char *unquoted)
 
 Result<pcrepp, pcrepp::compile_error> pcrepp::from_str(std::string pattern, int options)
 {
-    const char *errptr;
-    int eoff;
-    auto code = pcre_compile(pattern.c_str(),
-                             options | PCRE_UTF8,
-                             &errptr,
-                             &eoff,
-                             nullptr);
+    auto compile_res = pcre_registry::singleton().compile(pattern,
+                                                          options | PCRE_UTF8);
 
-    if (!code) {
-        return Err(compile_error{errptr, eoff});
+    if (compile_res.isErr()) {
+        return Err(compile_res.unwrapErr());
     }
 
-    return Ok(pcrepp(std::move(pattern), code));
+    return Ok(pcrepp(compile_res.unwrap()));
+}
+
+void pcrepp::compile(int options)
+{
+    auto compile_res = pcre_registry::singleton().compile(this->p_pattern,
+                                                          options);
+
+    if (compile_res.isErr()) {
+        auto ce = compile_res.unwrapErr();
+
+        throw error(ce.ce_msg, ce.ce_offset);
+    }
+
+    this->p_compiled = compile_res.unwrap();
+    this->load_info();
+    this->find_captures(this->p_pattern.c_str());
 }
 
 void pcrepp::find_captures(const char *pattern)
@@ -179,6 +194,22 @@ bool pcrepp::match(pcre_context &pc, pcre_input &pi, int options) const
     pi.pi_offset = pi.pi_next_offset;
 
     str = pi.get_string();
+    if (options == 0 && this->p_compiled->is_literal()) {
+        auto start = this->p_compiled->find_literal(
+            str, pi.pi_length, pi.pi_offset);
+
+        if (start == -1) {
+            pc.set_count(PCRE_ERROR_NOMATCH);
+            return false;
+        }
+
+        pc.all()->c_begin = start;
+        pc.all()->c_end = start + this->p_compiled->pc_literal.size();
+        pi.pi_next_offset = pc.all()->c_end;
+        pc.set_count(1);
+
+        return true;
+    }
     if (filtered_options & PCRE_ANCHORED) {
         filtered_options &= ~PCRE_ANCHORED;
         str         = &str[pi.pi_offset];
@@ -190,7 +221,7 @@ bool pcrepp::match(pcre_context &pc, pcre_input &pi, int options) const
         length      = pi.pi_length;
     }
     rc = pcre_exec(this->p_code,
-                   this->p_code_extra.in(),
+                   this->p_code_extra,
                    str,
                    length,
                    startoffset,
@@ -293,31 +324,10 @@ std::string pcrepp::replace(const char *str, const char *repl) const
     return retval;
 }
 
-void pcrepp::study()
+void pcrepp::load_info()
 {
-    const char *errptr;
-
-    this->p_code_extra = pcre_study(this->p_code,
-#ifdef PCRE_STUDY_JIT_COMPILE
-                                    PCRE_STUDY_JIT_COMPILE,
-#else
-        0,
-#endif
-                                    &errptr);
-    if (!this->p_code_extra && errptr) {
-        // log_error("pcre_study error: %s", errptr);
-    }
-    if (this->p_code_extra != nullptr) {
-        pcre_extra *extra = this->p_code_extra;
-
-        extra->flags |= (PCRE_EXTRA_MATCH_LIMIT |
-                         PCRE_EXTRA_MATCH_LIMIT_RECURSION);
-        extra->match_limit           = 10000;
-        extra->match_limit_recursion = 500;
-#ifdef PCRE_STUDY_JIT_COMPILE
-        // pcre_assign_jit_stack(extra, nullptr, jit_stack());
-#endif
-    }
+    this->p_code = this->p_compiled->pc_code;
+    this->p_code_extra = this->p_compiled->pc_extra;
     pcre_fullinfo(this->p_code,
                   this->p_code_extra,
                   PCRE_INFO_OPTIONS,
@@ -341,22 +351,353 @@ void pcrepp::study()
 }
 
 #ifdef PCRE_STUDY_JIT_COMPILE
+namespace {
+
+struct jit_stack_holder {
+    ~jit_stack_holder() {
+        if (this->jsh_stack != nullptr) {
+            pcre_jit_stack_free(this->jsh_stack);
+        }
+    }
+
+    pcre_jit_stack *jsh_stack{nullptr};
+};
+
+}
+
 pcre_jit_stack *pcrepp::jit_stack()
 {
-    static pcre_jit_stack *retval = nullptr;
+    static thread_local jit_stack_holder holder;
 
-    if (retval == nullptr) {
-        retval = pcre_jit_stack_alloc(JIT_STACK_MIN_SIZE, JIT_STACK_MAX_SIZE);
+    if (holder.jsh_stack == nullptr) {
+        holder.jsh_stack = pcre_jit_stack_alloc(JIT_STACK_MIN_SIZE,
+                                                JIT_STACK_MAX_SIZE);
     }
 
-    return retval;
+    return holder.jsh_stack;
+}
+
+static pcre_jit_stack *jit_stack_callback(void *)
+{
+    return pcrepp::jit_stack();
 }
 
 #else
 #warning "pcrejit is not available, search performance will be degraded"
+#endif
+
+std::shared_ptr<const pcre_compiled> pcre_compiled::wrap(pcre *code,
+                                                         std::string pattern)
+{
+    unsigned long options = 0;
+
+    pcre_fullinfo(code, nullptr, PCRE_INFO_OPTIONS, &options);
+
+    return std::make_shared<pcre_compiled>(std::move(pattern),
+                                           (int) options,
+                                           code);
+}
+
+/**
+ * Check if a pattern will only ever match a single literal string.
+ *
+ * @param pattern The pattern to check.
+ * @param options The options the pattern was compiled with.
+ * @return The literal or an empty string if the pattern has any special
+ *   characters or options that change the meaning of the literal.
+ */
+static string literal_for_pattern(const string &pattern, int options)
+{
+    static const int LITERAL_OPTIONS = (PCRE_CASELESS |
+                                        PCRE_MULTILINE |
+                                        PCRE_DOTALL |
+                                        PCRE_UTF8 |
+                                        PCRE_NO_UTF8_CHECK);
+
+    string retval;
+
+    if (options & ~LITERAL_OPTIONS) {
+        return "";
+    }
+
+    for (size_t lpc = 0; lpc < pattern.size(); lpc++) {
+        unsigned char ch = pattern[lpc];
+
+        if (ch == '\\') {
+            lpc += 1;
+            if (lpc == pattern.size()) {
+                return "";
+            }
+            ch = pattern[lpc];
+            // An escaped punctuation character is just that character,
+            // anything else is a character type, assertion, or the like.
+            if (ch & 0x80 || isalnum(ch) || iscntrl(ch)) {
+                return "";
+            }
+        } else if (strchr("^$.|?*+()[]{}", ch) != nullptr) {
+            return "";
+        }
+
+        if (options & PCRE_CASELESS) {
+            // Non-ASCII characters have to be folded using the unicode
+            // tables.  In UTF mode, 'k' and 's' also match the Kelvin sign
+            // and the long s, so leave those to pcre as well.
+            if (ch & 0x80) {
+                return "";
+            }
+            ch = tolower(ch);
+            if ((options & PCRE_UTF8) && (ch == 'k' || ch == 's')) {
+                return "";
+            }
+        }
+        retval.push_back(ch);
+    }
+
+    return retval;
+}
+
+pcre_compiled::pcre_compiled(std::string pattern, int options, pcre *code)
+    : pc_pattern(std::move(pattern)), pc_options(options), pc_code(code),
+      pc_literal(literal_for_pattern(this->pc_pattern, options))
+{
+    const char *errptr = nullptr;
+
+    pcre_refcount(this->pc_code, 1);
+    this->pc_extra = pcre_study(this->pc_code,
+#ifdef PCRE_STUDY_JIT_COMPILE
+                                PCRE_STUDY_JIT_COMPILE,
+#else
+                                0,
+#endif
+                                &errptr);
+    if (this->pc_extra != nullptr) {
+        pcre_extra *extra = this->pc_extra;
+
+        extra->flags |= (PCRE_EXTRA_MATCH_LIMIT |
+                         PCRE_EXTRA_MATCH_LIMIT_RECURSION);
+        extra->match_limit           = 10000;
+        extra->match_limit_recursion = 500;
+#ifdef PCRE_STUDY_JIT_COMPILE
+        pcre_assign_jit_stack(extra, jit_stack_callback, nullptr);
+#endif
+    }
+}
 
-void pcrepp::pcre_free_study(pcre_extra *extra)
+pcre_compiled::~pcre_compiled()
 {
-    free(extra);
+    if (this->pc_extra != nullptr) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+        pcre_free_study(this->pc_extra);
+#else
+        free(this->pc_extra);
+#endif
+    }
+    if (pcre_refcount(this->pc_code, -1) == 0) {
+        free(this->pc_code);
+    }
 }
+
+size_t pcre_compiled::memory_size() const
+{
+    size_t retval = this->pc_pattern.size(), size = 0;
+
+    if (pcre_fullinfo(this->pc_code, nullptr, PCRE_INFO_SIZE, &size) == 0) {
+        retval += size;
+    }
+    if (this->pc_extra != nullptr) {
+        if (pcre_fullinfo(this->pc_code,
+                          this->pc_extra,
+                          PCRE_INFO_STUDYSIZE,
+                          &size) == 0) {
+            retval += size;
+        }
+#ifdef PCRE_INFO_JITSIZE
+        if (pcre_fullinfo(this->pc_code,
+                          this->pc_extra,
+                          PCRE_INFO_JITSIZE,
+                          &size) == 0) {
+            retval += size;
+        }
+#endif
+    }
+
+    return retval;
+}
+
+ssize_t pcre_compiled::find_literal(const char *str, size_t len, size_t off) const
+{
+    const auto *lit = this->pc_literal.c_str();
+    auto lit_len = this->pc_literal.size();
+
+    if (off > len || len - off < lit_len) {
+        return -1;
+    }
+
+    if (!(this->pc_options & PCRE_CASELESS)) {
+        auto *hit = (const char *) memmem(&str[off], len - off, lit, lit_len);
+
+        return hit == nullptr ? -1 : hit - str;
+    }
+
+    // Look for either case of the first and last characters and then check
+    // the rest of the literal at each candidate.
+    unsigned char first_lower = lit[0];
+    unsigned char first_upper = toupper(first_lower);
+    size_t last_start = len - lit_len;
+    size_t pos = off;
+
+    auto rest_matches = [&](size_t start) {
+        for (size_t lpc = 1; lpc < lit_len; lpc++) {
+            if (tolower((unsigned char) str[start + lpc]) !=
+                (unsigned char) lit[lpc]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+#ifdef __SSE2__
+    unsigned char last_lower = lit[lit_len - 1];
+    auto first_lower_vec = _mm_set1_epi8(first_lower);
+    auto first_upper_vec = _mm_set1_epi8(first_upper);
+    auto last_lower_vec = _mm_set1_epi8(last_lower);
+    auto last_upper_vec = _mm_set1_epi8(toupper(last_lower));
+
+    while (pos + 16 <= last_start + 1) {
+        auto firsts = _mm_loadu_si128((const __m128i *) &str[pos]);
+        auto lasts = _mm_loadu_si128(
+            (const __m128i *) &str[pos + lit_len - 1]);
+        auto mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(firsts, first_lower_vec),
+                         _mm_cmpeq_epi8(firsts, first_upper_vec)),
+            _mm_or_si128(_mm_cmpeq_epi8(lasts, last_lower_vec),
+                         _mm_cmpeq_epi8(lasts, last_upper_vec))));
+
+        while (mask != 0) {
+            auto start = pos + __builtin_ctz(mask);
+
+            if (rest_matches(start)) {
+                return start;
+            }
+            mask &= mask - 1;
+        }
+        pos += 16;
+    }
 #endif
+
+    for (; pos <= last_start; pos++) {
+        unsigned char ch = str[pos];
+
+        if ((ch == first_lower || ch == first_upper) && rest_matches(pos)) {
+            return pos;
+        }
+    }
+
+    return -1;
+}
+
+pcre_registry &pcre_registry::singleton()
+{
+    static pcre_registry retval;
+
+    return retval;
+}
+
+Result<std::shared_ptr<const pcre_compiled>, pcre_compile_error>
+pcre_registry::compile(const std::string &pattern, int options)
+{
+    key_t key{pattern, options};
+
+    {
+        std::lock_guard<std::mutex> lg(this->pr_mutex);
+        auto iter = this->pr_entries.find(key);
+
+        if (iter != this->pr_entries.end()) {
+            this->pr_hits += 1;
+            this->pr_lru.splice(this->pr_lru.begin(),
+                                this->pr_lru,
+                                iter->second.e_lru_iter);
+            return Ok(iter->second.e_compiled);
+        }
+        this->pr_misses += 1;
+    }
+
+    // Compile and JIT outside of the lock since it can take a while.
+    const char *errptr;
+    int eoff;
+    auto code = pcre_compile(pattern.c_str(),
+                             options,
+                             &errptr,
+                             &eoff,
+                             nullptr);
+
+    if (code == nullptr) {
+        return Err(pcre_compile_error{errptr, eoff});
+    }
+
+    auto compiled = std::make_shared<const pcre_compiled>(pattern,
+                                                          options,
+                                                          code);
+    auto size = compiled->memory_size();
+
+    std::lock_guard<std::mutex> lg(this->pr_mutex);
+    auto iter = this->pr_entries.find(key);
+
+    if (iter != this->pr_entries.end()) {
+        // Another thread got here first, use its copy.
+        return Ok(iter->second.e_compiled);
+    }
+
+    this->pr_lru.push_front(key);
+    this->pr_entries.emplace(key, entry{compiled, size, this->pr_lru.begin()});
+    this->pr_memory_size += size;
+    this->evict();
+
+    return Ok(std::move(compiled));
+}
+
+void pcre_registry::set_budget(size_t budget)
+{
+    std::lock_guard<std::mutex> lg(this->pr_mutex);
+
+    this->pr_budget = budget;
+    this->evict();
+}
+
+size_t pcre_registry::size() const
+{
+    std::lock_guard<std::mutex> lg(this->pr_mutex);
+
+    return this->pr_entries.size();
+}
+
+size_t pcre_registry::memory_size() const
+{
+    std::lock_guard<std::mutex> lg(this->pr_mutex);
+
+    return this->pr_memory_size;
+}
+
+void pcre_registry::clear()
+{
+    std::lock_guard<std::mutex> lg(this->pr_mutex);
+
+    this->pr_entries.clear();
+    this->pr_lru.clear();
+    this->pr_memory_size = 0;
+    this->pr_hits = 0;
+    this->pr_misses = 0;
+}
+
+void pcre_registry::evict()
+{
+    // The most recently used entry is always kept, even if it is over budget
+    // by itself.
+    while (this->pr_memory_size > this->pr_budget && this->pr_lru.size() > 1) {
+        auto iter = this->pr_entries.find(this->pr_lru.back());
+
+        this->pr_memory_size -= iter->second.e_size;
+        this->pr_entries.erase(iter);
+        this->pr_lru.pop_back();
+    }
+}
@@ -50,6 +50,9 @@
 #include <string.h>
 
 #include <cassert>
+#include <list>
+#include <map>
+#include <mutex>
 #include <string>
 #include <memory>
 #include <utility>
@@ -360,6 +363,125 @@ struct pcre_extractor {
     };
 };
 
+struct pcre_compile_error {
+    const char *ce_msg;
+    int ce_offset;
+};
+
+/**
+ * A compiled and studied pattern.  Instances are immutable once built, so
+ * they can be shared by any number of pcrepp/highlighter objects and used
+ * from multiple threads at once.
+ */
+class pcre_compiled {
+public:
+    /**
+     * Wrap a pattern that was compiled outside of the registry.  A reference
+     * is taken on the code, so the caller's reference is left untouched.
+     */
+    static std::shared_ptr<const pcre_compiled> wrap(pcre *code,
+                                                     std::string pattern = "");
+
+    pcre_compiled(std::string pattern, int options, pcre *code);
+
+    pcre_compiled(const pcre_compiled &) = delete;
+
+    pcre_compiled &operator=(const pcre_compiled &) = delete;
+
+    ~pcre_compiled();
+
+    /**
+     * @return The approximate amount of memory used by the compiled code,
+     *   the study data, and any JIT code.
+     */
+    size_t memory_size() const;
+
+    /**
+     * @return True if the pattern only matches the literal in pc_literal.
+     */
+    bool is_literal() const {
+        return !this->pc_literal.empty();
+    };
+
+    /**
+     * Find the literal for a pattern that is just a literal, without running
+     * the regex.  The search is case-insensitive if the pattern is.
+     *
+     * @param str The string to search.
+     * @param len The length of the string.
+     * @param off The offset to start the search at.
+     * @return The offset of the start of the match or -1 if it was not found.
+     */
+    ssize_t find_literal(const char *str, size_t len, size_t off) const;
+
+    const std::string pc_pattern;
+    const int pc_options;
+    pcre *pc_code;
+    pcre_extra *pc_extra{nullptr};
+    /**
+     * The text matched by the pattern if it is a plain literal, lowercased
+     * if the pattern is caseless.  Otherwise, it is empty.
+     */
+    std::string pc_literal;
+};
+
+/**
+ * Registry of compiled patterns keyed by the pattern string and compile
+ * options.  Each distinct pattern is compiled and JIT'd once, no matter how
+ * many places construct it.  Entries are kept in least-recently-used order
+ * and are dropped from the registry once their total size exceeds the
+ * budget; objects that are still holding an evicted entry keep it alive.
+ */
+class pcre_registry {
+public:
+    static const size_t DEFAULT_BUDGET = 16 * 1024 * 1024;
+
+    static pcre_registry &singleton();
+
+    Result<std::shared_ptr<const pcre_compiled>, pcre_compile_error>
+    compile(const std::string &pattern, int options = 0);
+
+    void set_budget(size_t budget);
+
+    size_t get_budget() const {
+        return this->pr_budget;
+    };
+
+    size_t size() const;
+
+    size_t memory_size() const;
+
+    size_t get_hits() const {
+        return this->pr_hits;
+    };
+
+    size_t get_misses() const {
+        return this->pr_misses;
+    };
+
+    void clear();
+
+private:
+    using key_t = std::pair<std::string, int>;
+    using lru_list_t = std::list<key_t>;
+
+    struct entry {
+        std::shared_ptr<const pcre_compiled> e_compiled;
+        size_t e_size;
+        lru_list_t::iterator e_lru_iter;
+    };
+
+    void evict();
+
+    mutable std::mutex pr_mutex;
+    std::map<key_t, entry> pr_entries;
+    lru_list_t pr_lru;
+    size_t pr_budget{DEFAULT_BUDGET};
+    size_t pr_memory_size{0};
+    size_t pr_hits{0};
+    size_t pr_misses{0};
+};
+
 class pcrepp {
 public:
     class error : public std::exception {
@@ -381,117 +503,56 @@ public:
         return quote(unquoted.c_str());
     }
 
-    struct compile_error {
-        const char *ce_msg;
-        int ce_offset;
-    };
+    using compile_error = pcre_compile_error;
 
     static Result<pcrepp, compile_error> from_str(std::string pattern, int options = 0);
 
-    pcrepp(pcre *code) : p_code(code), p_code_extra(pcre_free_study)
+    pcrepp(pcre *code)
+        : p_compiled(pcre_compiled::wrap(code))
     {
-        pcre_refcount(this->p_code, 1);
-        this->study();
+        this->load_info();
     };
 
     pcrepp(std::string pattern, pcre *code)
-        : p_code(code),
-          p_pattern(std::move(pattern)),
-          p_code_extra(pcre_free_study)
+        : p_compiled(pcre_compiled::wrap(code, pattern)),
+          p_pattern(std::move(pattern))
     {
-        pcre_refcount(this->p_code, 1);
-        this->study();
+        this->load_info();
         this->find_captures(this->p_pattern.c_str());
     };
 
-    explicit pcrepp(const char *pattern, int options = 0)
-            : p_pattern(pattern), p_code_extra(pcre_free_study)
+    explicit pcrepp(std::shared_ptr<const pcre_compiled> compiled)
+        : p_compiled(std::move(compiled)),
+          p_pattern(this->p_compiled->pc_pattern)
     {
-        const char *errptr;
-        int         eoff;
-
-        if ((this->p_code = pcre_compile(pattern,
-                                         options,
-                                         &errptr,
-                                         &eoff,
-                                         nullptr)) == nullptr) {
-            throw error(errptr, eoff);
-        }
+        this->load_info();
+        this->find_captures(this->p_pattern.c_str());
+    };
 
-        pcre_refcount(this->p_code, 1);
-        this->study();
-        this->find_captures(pattern);
+    explicit pcrepp(const char *pattern, int options = 0)
+            : p_pattern(pattern)
+    {
+        this->compile(options);
     };
 
     explicit pcrepp(const std::string &pattern, int options = 0)
-            : p_pattern(pattern), p_code_extra(pcre_free_study)
+            : p_pattern(pattern)
     {
-        const char *errptr;
-        int         eoff;
-
-        if ((this->p_code = pcre_compile(pattern.c_str(),
-                                         options | PCRE_UTF8,
-                                         &errptr,
-                                         &eoff,
-                                         nullptr)) == nullptr) {
-            throw error(errptr, eoff);
-        }
-
-        pcre_refcount(this->p_code, 1);
-        this->study();
-        this->find_captures(pattern.c_str());
+        this->compile(options | PCRE_UTF8);
     };
 
     pcrepp() {
     }
 
-    pcrepp(const pcrepp &other)
-        : p_code(other.p_code),
-          p_pattern(other.p_pattern),
-          p_code_extra(pcre_free_study),
-          p_captures(other.p_captures)
-    {
-        pcre_refcount(this->p_code, 1);
-        this->study();
-    };
-
-    pcrepp(pcrepp &&other)
-        : p_code(other.p_code),
-          p_pattern(std::move(other.p_pattern)),
-          p_code_extra(pcre_free_study),
-          p_capture_count(other.p_capture_count),
-          p_named_count(other.p_named_count),
-          p_name_len(other.p_name_len),
-          p_options(other.p_options),
-          p_named_entries(other.p_named_entries),
-          p_captures(std::move(other.p_captures)) {
-        pcre_refcount(this->p_code, 1);
-        this->p_code_extra = std::move(other.p_code_extra);
-    }
-
-    virtual ~pcrepp()
-    {
-        this->clear();
-    };
+    /*
+     * Copies share the compiled pattern.  No move operations are declared
+     * so that a moved-from object is left holding a valid pattern.
+     */
+    pcrepp(const pcrepp &other) = default;
 
-    pcrepp& operator=(pcrepp&& other) noexcept {
-        if (this == &other) {
-            return *this;
-        }
+    pcrepp& operator=(const pcrepp &other) = default;
 
-        this->p_code = other.p_code;
-        pcre_refcount(this->p_code, 1);
-        this->p_pattern = std::move(other.p_pattern);
-        this->p_code_extra = std::move(other.p_code_extra);
-        this->p_capture_count = other.p_capture_count;
-        this->p_named_count = other.p_named_count;
-        this->p_name_len = other.p_name_len;
-        this->p_options = other.p_options;
-        this->p_named_entries = other.p_named_entries;
-        this->p_captures = std::move(other.p_captures);
-
-        return *this;
-    }
+    virtual ~pcrepp() = default;
 
     const std::string& get_pattern() const {
         return this->p_pattern;
@@ -502,12 +563,10 @@ public:
     }
 
     void clear() {
-        if (this->p_code && pcre_refcount(this->p_code, -1) == 0) {
-            free(this->p_code);
-            this->p_code = nullptr;
-        }
+        this->p_compiled.reset();
+        this->p_code = nullptr;
+        this->p_code_extra = nullptr;
         this->p_pattern.clear();
-        this->p_code_extra.reset();
         this->p_capture_count = 0;
         this->p_named_count = 0;
         this->p_name_len = 0;
@@ -590,7 +649,7 @@ public:
 
         do {
             rc = pcre_exec(this->p_code,
-                           this->p_code_extra.in(),
+                           this->p_code_extra,
                            pi.get_string(),
                            length,
                            pi.pi_offset,
@@ -608,21 +667,24 @@ public:
         return length;
     };
 
-// #undef PCRE_STUDY_JIT_COMPILE
 #ifdef PCRE_STUDY_JIT_COMPILE
+    /**
+     * @return The JIT stack for the calling thread.  Each thread gets its own
+     *   stack since a stack can only be used by one match at a time.
+     */
     static pcre_jit_stack *jit_stack();
-
-#else
-    static void pcre_free_study(pcre_extra *);
 #endif
 
-    void study();
+    void compile(int options);
+
+    void load_info();
 
     void find_captures(const char *pattern);
 
+    std::shared_ptr<const pcre_compiled> p_compiled;
     pcre *p_code{nullptr};
+    const pcre_extra *p_code_extra{nullptr};
     std::string p_pattern;
-    auto_mem<pcre_extra> p_code_extra;
     int p_capture_count{0};
     int p_named_count{0};
     int p_name_len{0};
@@ -173,5 +173,103 @@ int main(int argc, char *argv[])
         assert(re.captures()[0].c_end == 11);
     }
 
+    {
+        auto &registry = pcre_registry::singleton();
+
+        registry.clear();
+
+        pcrepp re1("shared (\\d+)");
+        pcrepp re2(std::string("shared (\\d+)"));
+        pcrepp re3(std::string("shared (\\d+)"));
+        pcrepp re4 = re3;
+
+        assert(re1.p_code != re2.p_code);
+        assert(re2.p_code == re3.p_code);
+        assert(re3.p_code == re4.p_code);
+        assert(registry.size() == 2);
+        assert(registry.get_misses() == 2);
+        assert(registry.get_hits() == 1);
+
+        pcre_input pi("shared 42");
+
+        assert(re3.match(context, pi));
+        assert(pi.get_substr(context.begin()) == "42");
+
+        auto bad_res = registry.compile("shared (");
+
+        assert(bad_res.isErr());
+        assert(registry.size() == 2);
+
+        // Evicting from the registry does not invalidate existing users.
+        registry.set_budget(0);
+        assert(registry.size() == 1);
+        pcre_input pi2("shared 43");
+        assert(re1.match(context, pi2));
+        assert(pi2.get_substr(context.begin()) == "43");
+
+        pcrepp re5("lru (a)");
+        pcrepp re6("lru (b)");
+
+        assert(registry.size() == 1);
+        assert(registry.compile("lru (b)").unwrap()->pc_code == re6.p_code);
+        assert(registry.compile("lru (a)").unwrap()->pc_code != re5.p_code);
+
+        registry.set_budget(pcre_registry::DEFAULT_BUDGET);
+        registry.clear();
+    }
+
+    {
+        auto &registry = pcre_registry::singleton();
+
+        assert(registry.compile("abc").unwrap()->pc_literal == "abc");
+        assert(registry.compile("a\\.b\\ c").unwrap()->pc_literal == "a.b c");
+        assert(registry.compile("AbC", PCRE_CASELESS).unwrap()->pc_literal ==
+               "abc");
+        assert(!registry.compile("a.c").unwrap()->is_literal());
+        assert(!registry.compile("a\\dc").unwrap()->is_literal());
+        assert(!registry.compile("ab?").unwrap()->is_literal());
+        assert(!registry.compile("abc", PCRE_ANCHORED).unwrap()->is_literal());
+        assert(registry.compile("disk", PCRE_CASELESS).unwrap()->is_literal());
+        assert(!registry.compile("disk", PCRE_CASELESS | PCRE_UTF8)
+                    .unwrap()->is_literal());
+        assert(!registry.compile("caf\xc3\xa9", PCRE_CASELESS)
+                    .unwrap()->is_literal());
+        assert(registry.compile("caf\xc3\xa9").unwrap()->is_literal());
+
+        // The literal search has to find the same matches as the regex.
+        const char *subject =
+            "an Error in the ERROR log, error-free errors and more ERR0RS "
+            "that are past the first sixteen bytes of the line: eRrOr";
+
+        for (auto options : {0, PCRE_CASELESS}) {
+            auto compiled = registry.compile("error", options).unwrap();
+            pcrepp fast(compiled);
+            pcre_context_static<30> fast_pc, slow_pc;
+            pcre_input fast_pi(subject), slow_pi(subject);
+
+            assert(compiled->is_literal());
+            while (true) {
+                bool fast_found = fast.match(fast_pc, fast_pi);
+                int rc = pcre_exec(compiled->pc_code,
+                                   nullptr,
+                                   subject,
+                                   strlen(subject),
+                                   slow_pi.pi_offset,
+                                   0,
+                                   (int *) slow_pc.all(),
+                                   60);
+
+                assert(fast_found == (rc > 0));
+                if (!fast_found) {
+                    break;
+                }
+                assert(fast_pc.all()->c_begin == slow_pc.all()->c_begin);
+                assert(fast_pc.all()->c_end == slow_pc.all()->c_end);
+                slow_pi.pi_offset = slow_pc.all()->c_end;
+            }
+        }
+        registry.clear();
+    }
+
     return retval;
 }
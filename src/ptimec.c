@@ -54,6 +54,57 @@ char *escape_char(char ch)
     return charstr;
 }
 
+/**
+ * Print the calls to the field parsers for the first "len" bytes of the
+ * given format.
+ */
+static void print_ptime_steps(const char *arg, size_t len, const char *indent)
+{
+    const char *end = arg + len;
+
+    for (; arg < end; arg++) {
+        if (arg[0] == '%') {
+            switch (arg[1]) {
+            case 'a':
+            case 'Z':
+                if (arg[2]) {
+                    printf("%sif (!ptime_upto('%s', str, off, len)) return false;\n",
+                        indent, escape_char(arg[2]));
+                }
+                else {
+                    printf("%sif (!ptime_upto_end(str, off, len)) return false;\n",
+                        indent);
+                }
+                arg += 1;
+                break;
+            case '@':
+                printf("%sif (!ptime_at(dst, str, off, len)) return false;\n",
+                    indent);
+                arg += 1;
+                break;
+            default:
+                printf("%sif (!ptime_%c(dst, str, off, len)) return false;\n",
+                    indent, arg[1]);
+                arg += 1;
+                break;
+            }
+        } else {
+            printf("%sif (!ptime_char('%s', str, off, len)) return false;\n",
+                indent, escape_char(arg[0]));
+        }
+    }
+}
+
+/**
+ * Formats starting with one of these are handed to the vectorized
+ * ISO-8601 parser first.
+ */
+static const char *ISO8601_HEADS[] = {
+    "%Y-%m-%dT%H:%M:%S",
+    "%Y-%m-%d %H:%M:%S",
+    NULL
+};
+
 int main(int argc, char *argv[])
 {
     int retval = EXIT_SUCCESS;
@@ -65,35 +116,19 @@ int main(int argc, char *argv[])
         printf("bool ptime_f%d(struct exttm *dst, const char *str, off_t &off, ssize_t len) {\n"
                "    // log_debug(\"ptime_f%d\");\n",
             lpc, lpc);
-        for (int index = 0; arg[index]; arg++) {
-            if (arg[index] == '%') {
-                switch (arg[index + 1]) {
-                case 'a':
-                case 'Z':
-                    if (arg[index + 2]) {
-                        printf("    if (!ptime_upto('%s', str, off, len)) return false;\n",
-                            escape_char(arg[index + 2]));
-                    }
-                    else {
-                        printf("    if (!ptime_upto_end(str, off, len)) return false;\n");
-                    }
-                    arg += 1;
-                    break;
-                case '@':
-                    printf("    if (!ptime_at(dst, str, off, len)) return false;\n");
-                    arg += 1;
-                    break;
-                default:
-                    printf("    if (!ptime_%c(dst, str, off, len)) return false;\n",
-                        arg[index + 1]);
-                    arg += 1;
-                    break;
-                }
-            } else {
-                printf("    if (!ptime_char('%s', str, off, len)) return false;\n",
-                    escape_char(arg[index]));
+        for (int lpc2 = 0; ISO8601_HEADS[lpc2]; lpc2++) {
+            size_t head_len = strlen(ISO8601_HEADS[lpc2]);
+
+            if (strncmp(arg, ISO8601_HEADS[lpc2], head_len) == 0) {
+                printf("    if (!ptime_iso8601_datetime(dst, str, off, len, '%c')) {\n",
+                    arg[8]);
+                print_ptime_steps(arg, head_len, "        ");
+                printf("    }\n");
+                arg += head_len;
+                break;
             }
         }
+        print_ptime_steps(arg, strlen(arg), "    ");
         printf("    return true;\n");
         printf("}\n\n");
     }
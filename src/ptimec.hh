@@ -42,6 +42,7 @@
 #include <sys/types.h>
 
 #include <cstdlib>
+#include <vector>
 
 #include "base/lnav_log.hh"
 #include "base/time_util.hh"
@@ -1038,6 +1039,20 @@ inline void ftime_at(char *dst, off_t &off_inout, ssize_t len, const struct extt
 
 }
 
+/**
+ * Parse the fixed-width "YYYY-mm-dd?HH:MM:SS" head of an ISO-8601
+ * timestamp in one go, where '?' is the date/time separator.  The
+ * result is the same as the sequence of ptime_Y(), ptime_m(), ... calls
+ * for the equivalent format.  If the input is not laid out exactly like
+ * this, false is returned without modifying dst or off_inout and the
+ * caller should fall back to the field-by-field parsers.
+ */
+bool ptime_iso8601_datetime(struct exttm *dst,
+                            const char *str,
+                            off_t &off_inout,
+                            ssize_t len,
+                            char sep);
+
 typedef bool (*ptime_func)(struct exttm *dst, const char *str, off_t &off, ssize_t len);
 typedef void (*ftime_func)(char *dst, off_t &off_inout, size_t len, const struct exttm &tm);
 
@@ -1050,6 +1065,45 @@ struct ptime_fmt {
     ftime_func pf_ffunc;
 };
 
+/**
+ * A timestamp format string that has been broken down into a sequence of
+ * parsing steps.  Custom formats from the log format definitions are
+ * compiled once so that the format string does not have to be interpreted
+ * for every timestamp that is parsed.  The result is equivalent to calling
+ * ptime_fmt() with the same format string.
+ */
+class ptime_compiled_fmt {
+public:
+    struct step;
+
+    typedef bool (*step_func)(const step &st,
+                              struct exttm *dst,
+                              const char *str,
+                              off_t &off,
+                              ssize_t len);
+
+    struct step {
+        step_func s_func;
+        char s_ch;
+    };
+
+    static ptime_compiled_fmt compile(const char *fmt);
+
+    bool parse(struct exttm *dst, const char *str, off_t &off, ssize_t len) const {
+        for (const auto &st : this->pcf_steps) {
+            if (!st.s_func(st, dst, str, off, len)) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    /** The format string this was compiled from. */
+    const char *pcf_fmt{nullptr};
+    std::vector<step> pcf_steps;
+};
+
 extern struct ptime_fmt PTIMEC_FORMATS[];
 
 extern const char *PTIMEC_FORMAT_STR[];
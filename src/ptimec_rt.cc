@@ -33,6 +33,10 @@
 #include <string.h>
 #include <algorithm>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "ptimec.hh"
 
 bool ptime_b_slow(struct exttm *dst, const char *str, off_t &off_inout, ssize_t len)
@@ -51,6 +55,158 @@ bool ptime_b_slow(struct exttm *dst, const char *str, off_t &off_inout, ssize_t
     return false;
 }
 
+/**
+ * The broken-down fields of an ISO-8601 date/time, in the order they
+ * appear in the string.
+ */
+struct iso8601_fields {
+    int if_year;
+    int if_mon;
+    int if_mday;
+    int if_hour;
+    int if_min;
+    int if_sec;
+};
+
+static inline bool iso8601_is_digit(char ch)
+{
+    return (unsigned char) (ch - '0') <= 9;
+}
+
+static inline int iso8601_pair(const char *str)
+{
+    return (str[0] - '0') * 10 + (str[1] - '0');
+}
+
+#ifdef __SSE2__
+/**
+ * Validate and convert "YYYY-mm-dd?HH:MM" with a single 16-byte load.  The
+ * trailing ":SS" does not fit in the vector and is handled separately.
+ */
+static bool iso8601_scan(const char *str,
+                         char sep,
+                         iso8601_fields &fields)
+{
+    static const unsigned int PUNCT_MASK =
+        (1U << 4) | (1U << 7) | (1U << 10) | (1U << 13);
+
+    if (str[16] != ':' || !iso8601_is_digit(str[17]) ||
+        !iso8601_is_digit(str[18])) {
+        return false;
+    }
+
+    const auto chunk = _mm_loadu_si128((const __m128i *) str);
+    const auto punct = _mm_setr_epi8(
+        0, 0, 0, 0, '-', 0, 0, '-', 0, 0, sep, 0, 0, ':', 0, 0);
+    const auto nine = _mm_set1_epi8(9);
+    // Non-digits wrap around to values above nine after the subtraction.
+    const auto digits = _mm_sub_epi8(chunk, _mm_set1_epi8('0'));
+    unsigned int digit_mask = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_max_epu8(digits, nine), nine));
+    unsigned int punct_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, punct));
+
+    if (((digit_mask & ~PUNCT_MASK) | (punct_mask & PUNCT_MASK)) != 0xffff) {
+        return false;
+    }
+
+    // Combine adjacent digits into two-digit values in each 16-bit lane.
+    // The month and hour start on odd offsets, so a second set of pairs is
+    // computed from the digits shifted down by one byte.
+    const auto low_byte = _mm_set1_epi16(0x00ff);
+    const auto ten = _mm_set1_epi16(10);
+    const auto even_pairs = _mm_add_epi16(
+        _mm_mullo_epi16(_mm_and_si128(digits, low_byte), ten),
+        _mm_srli_epi16(digits, 8));
+    const auto odd_digits = _mm_srli_si128(digits, 1);
+    const auto odd_pairs = _mm_add_epi16(
+        _mm_mullo_epi16(_mm_and_si128(odd_digits, low_byte), ten),
+        _mm_srli_epi16(odd_digits, 8));
+
+    fields.if_year = _mm_extract_epi16(even_pairs, 0) * 100 +
+                     _mm_extract_epi16(even_pairs, 1);
+    fields.if_mon = _mm_extract_epi16(odd_pairs, 2);
+    fields.if_mday = _mm_extract_epi16(even_pairs, 4);
+    fields.if_hour = _mm_extract_epi16(odd_pairs, 5);
+    fields.if_min = _mm_extract_epi16(even_pairs, 7);
+    fields.if_sec = iso8601_pair(&str[17]);
+
+    return true;
+}
+#else
+/** Portable version of the above that checks one byte at a time. */
+static bool iso8601_scan(const char *str,
+                         char sep,
+                         iso8601_fields &fields)
+{
+    static const char LAYOUT[] = "0000-00-00?00:00:00";
+
+    for (int lpc = 0; lpc < 19; lpc++) {
+        switch (LAYOUT[lpc]) {
+            case '0':
+                if (!iso8601_is_digit(str[lpc])) {
+                    return false;
+                }
+                break;
+            case '?':
+                if (str[lpc] != sep) {
+                    return false;
+                }
+                break;
+            default:
+                if (str[lpc] != LAYOUT[lpc]) {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    fields.if_year = iso8601_pair(&str[0]) * 100 + iso8601_pair(&str[2]);
+    fields.if_mon = iso8601_pair(&str[5]);
+    fields.if_mday = iso8601_pair(&str[8]);
+    fields.if_hour = iso8601_pair(&str[11]);
+    fields.if_min = iso8601_pair(&str[14]);
+    fields.if_sec = iso8601_pair(&str[17]);
+
+    return true;
+}
+#endif
+
+bool ptime_iso8601_datetime(struct exttm *dst,
+                            const char *str,
+                            off_t &off_inout,
+                            ssize_t len,
+                            char sep)
+{
+    iso8601_fields fields;
+
+    if (off_inout + 19 > len) {
+        return false;
+    }
+
+    if (!iso8601_scan(&str[off_inout], sep, fields)) {
+        return false;
+    }
+
+    // Same range checks as the individual field parsers.
+    if (fields.if_year < 1900 || fields.if_year > 3000 ||
+        fields.if_mon < 1 || fields.if_mon > 12 ||
+        fields.if_mday < 1 || fields.if_mday > 31 ||
+        fields.if_hour > 23 || fields.if_min > 59 || fields.if_sec > 59) {
+        return false;
+    }
+
+    dst->et_tm.tm_year = fields.if_year - 1900;
+    dst->et_tm.tm_mon = fields.if_mon - 1;
+    dst->et_tm.tm_mday = fields.if_mday;
+    dst->et_tm.tm_hour = fields.if_hour;
+    dst->et_tm.tm_min = fields.if_min;
+    dst->et_tm.tm_sec = fields.if_sec;
+    dst->et_flags |= ETF_YEAR_SET | ETF_MONTH_SET | ETF_DAY_SET;
+    off_inout += 19;
+
+    return true;
+}
+
 #define FMT_CASE(ch, c) \
     case ch: \
         if (!ptime_ ## c(dst, str, off, len)) return false; \
@@ -109,6 +265,104 @@ bool ptime_fmt(const char *fmt, struct exttm *dst, const char *str, off_t &off,
     return true;
 }
 
+template<ptime_func F>
+static bool ptime_field_step(const ptime_compiled_fmt::step &st,
+                             struct exttm *dst,
+                             const char *str,
+                             off_t &off,
+                             ssize_t len)
+{
+    return F(dst, str, off, len);
+}
+
+static bool ptime_char_step(const ptime_compiled_fmt::step &st,
+                            struct exttm *dst,
+                            const char *str,
+                            off_t &off,
+                            ssize_t len)
+{
+    return ptime_char(st.s_ch, str, off, len);
+}
+
+static bool ptime_upto_step(const ptime_compiled_fmt::step &st,
+                            struct exttm *dst,
+                            const char *str,
+                            off_t &off,
+                            ssize_t len)
+{
+    return ptime_upto(st.s_ch, str, off, len);
+}
+
+static bool ptime_upto_end_step(const ptime_compiled_fmt::step &st,
+                                struct exttm *dst,
+                                const char *str,
+                                off_t &off,
+                                ssize_t len)
+{
+    return ptime_upto_end(str, off, len);
+}
+
+#define COMPILE_FMT_CASE(ch, c) \
+    case ch: \
+        retval.pcf_steps.push_back({ptime_field_step<ptime_ ## c>, '\0'}); \
+        lpc += 1; \
+        break
+
+/*
+ * This walks the format string the same way as ptime_fmt() does, but it
+ * records the parsers instead of calling them.
+ */
+ptime_compiled_fmt ptime_compiled_fmt::compile(const char *fmt)
+{
+    ptime_compiled_fmt retval;
+
+    retval.pcf_fmt = fmt;
+    for (ssize_t lpc = 0; fmt[lpc]; lpc++) {
+        if (fmt[lpc] == '%') {
+            switch (fmt[lpc + 1]) {
+                case 'a':
+                case 'Z':
+                    if (fmt[lpc + 2]) {
+                        retval.pcf_steps.push_back(
+                            {ptime_upto_step, fmt[lpc + 2]});
+                    }
+                    else {
+                        retval.pcf_steps.push_back({ptime_upto_end_step, '\0'});
+                    }
+                    lpc += 1;
+                    break;
+                COMPILE_FMT_CASE('b', b);
+                COMPILE_FMT_CASE('S', S);
+                COMPILE_FMT_CASE('s', s);
+                COMPILE_FMT_CASE('L', L);
+                COMPILE_FMT_CASE('M', M);
+                COMPILE_FMT_CASE('H', H);
+                COMPILE_FMT_CASE('i', i);
+                COMPILE_FMT_CASE('6', 6);
+                COMPILE_FMT_CASE('I', I);
+                COMPILE_FMT_CASE('d', d);
+                COMPILE_FMT_CASE('e', e);
+                COMPILE_FMT_CASE('f', f);
+                COMPILE_FMT_CASE('k', k);
+                COMPILE_FMT_CASE('l', l);
+                COMPILE_FMT_CASE('m', m);
+                COMPILE_FMT_CASE('N', N);
+                COMPILE_FMT_CASE('p', p);
+                COMPILE_FMT_CASE('q', q);
+                COMPILE_FMT_CASE('Y', Y);
+                COMPILE_FMT_CASE('y', y);
+                COMPILE_FMT_CASE('z', z);
+                COMPILE_FMT_CASE('@', at);
+            }
+        }
+        else {
+            retval.pcf_steps.push_back({ptime_char_step, fmt[lpc]});
+        }
+    }
+
+    return retval;
+}
+
 #define FTIME_FMT_CASE(ch, c) \
     case ch: \
         ftime_ ## c(dst, off_inout, len, tm); \
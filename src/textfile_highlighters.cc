@@ -35,24 +35,19 @@
 
 using namespace std;
 
-static pcre *xpcre_compile(const char *pattern, int options = 0)
+static std::shared_ptr<const pcre_compiled> xpcre_compile(const char *pattern,
+                                                          int options = 0)
 {
-    const char *errptr;
-    pcre *      retval;
-    int         eoff;
+    auto compile_res = pcre_registry::singleton().compile(pattern, options);
 
-    if ((retval = pcre_compile(pattern,
-                               options,
-                               &errptr,
-                               &eoff,
-                               nullptr)) == nullptr) {
+    if (compile_res.isErr()) {
         fprintf(stderr, "internal error: failed to compile -- %s\n", pattern);
-        fprintf(stderr, "internal error: %s\n", errptr);
+        fprintf(stderr, "internal error: %s\n", compile_res.unwrapErr().ce_msg);
 
         exit(1);
     }
 
-    return retval;
+    return compile_res.unwrap();
 }
 
 void setup_highlights(highlight_map_t &hm)
@@ -74,9 +74,7 @@ text_filter::revert_to_last(logfile_filter_state &lfs, size_t rollback_size)
 }
 
 void text_filter::add_line(
-        logfile_filter_state &lfs, logfile::const_iterator ll, shared_buffer_ref &line) {
-    bool match_state = this->matches(*lfs.tfs_logfile, ll, line);
-
+        logfile_filter_state &lfs, logfile::const_iterator ll, bool match_state) {
     if (ll->is_message()) {
         this->end_of_message(lfs);
     }
@@ -113,6 +111,57 @@ void text_filter::end_of_message(logfile_filter_state &lfs)
     lfs.tfs_lines_for_message[this->lf_index] = 0;
 }
 
+void filter_stack::update_prefilter()
+{
+    std::vector<std::shared_ptr<text_filter>> live;
+
+    for (const auto &filter : this->fs_filters) {
+        if (!filter->lf_deleted) {
+            live.push_back(filter);
+        }
+    }
+    if (live == this->fs_prefilter_filters) {
+        return;
+    }
+
+    this->fs_prefilter.clear();
+    for (auto &filter : this->fs_prefilter_by_index) {
+        filter = nullptr;
+    }
+    for (const auto &filter : live) {
+        filter->add_to_prefilter(this->fs_prefilter);
+        this->fs_prefilter_by_index[filter->get_index()] = filter;
+    }
+    this->fs_prefilter.build();
+    this->fs_prefilter_filters = std::move(live);
+}
+
+uint32_t filter_stack::match_line(uint32_t wanted_mask,
+                                  const logfile &lf,
+                                  logfile::const_iterator ll,
+                                  shared_buffer_ref &line)
+{
+    uint32_t retval = 0;
+
+    this->fs_prefilter.match(line.get_data(), line.length(),
+                             this->fs_candidates);
+    for (size_t lpc = 0; lpc < this->fs_candidates.size(); lpc++) {
+        uint32_t bit = 1UL << lpc;
+
+        if (!(wanted_mask & bit) || !this->fs_candidates[lpc]) {
+            continue;
+        }
+
+        const auto &filter = this->fs_prefilter_by_index[lpc];
+
+        if (filter != nullptr && filter->matches(lf, ll, line)) {
+            retval |= bit;
+        }
+    }
+
+    return retval;
+}
+
 bookmark_type_t textview_curses::BM_USER("user");
 bookmark_type_t textview_curses::BM_USER_EXPR("user-expr");
 bookmark_type_t textview_curses::BM_SEARCH("search");
@@ -156,21 +205,20 @@ void textview_curses::reload_config(error_reporter &reporter)
                 continue;
             }
 
-            const char *errptr;
-            pcre *code;
-            int eoff;
+            auto compile_res = pcre_registry::singleton().compile(
+                hl_pair.second.hc_regex);
+
+            if (compile_res.isErr()) {
+                auto ce = compile_res.unwrapErr();
 
-            if ((code = pcre_compile(hl_pair.second.hc_regex.c_str(),
-                                     0,
-                                     &errptr,
-                                     &eoff,
-                                     nullptr)) == nullptr) {
                 reporter(&hl_pair.second.hc_regex,
                          fmt::format("invalid highlight regex: {} at {}",
-                                     errptr, eoff));
+                                     ce.ce_msg, ce.ce_offset));
                 continue;
             }
 
+            auto code = compile_res.unwrap();
+
             const auto &sc = hl_pair.second.hc_style;
             string fg1, bg1, fg_color, bg_color, errmsg;
             bool invalid = false;
@@ -301,6 +349,44 @@ void textview_curses::grep_match(grep_proc<vis_line_t> &gp,
     }
 }
 
+vis_line_t textview_curses::next_search_line(vis_line_t line)
+{
+    if (this->tc_sub_source == nullptr) {
+        return line;
+    }
+
+    std::vector<vis_line_t> hits;
+
+    for (;;) {
+        auto next = this->tc_sub_source->text_next_unsearched(line, hits);
+
+        if (this->tc_search_query) {
+            next = this->tc_sub_source->text_next_candidate(
+                next, *this->tc_search_query);
+        }
+        if (next == line) {
+            break;
+        }
+        line = next;
+    }
+
+    bool visible_hit = false;
+
+    for (const auto hit : hits) {
+        this->tc_bookmarks[&BM_SEARCH].insert_once(hit);
+        this->tc_sub_source->text_mark(&BM_SEARCH, hit, true);
+
+        if (this->get_top() <= hit && hit <= this->get_bottom()) {
+            visible_hit = true;
+        }
+    }
+    if (visible_hit) {
+        listview_curses::reload_data();
+    }
+
+    return line;
+}
+
 void textview_curses::listview_value_for_rows(const listview_curses &lv,
                                               vis_line_t row,
                                               vector<attr_line_t> &rows_out)
@@ -521,51 +607,63 @@ void textview_curses::textview_value_for_row(vis_line_t row,
 void textview_curses::execute_search(const std::string &regex_orig)
 {
     std::string regex = regex_orig;
-    pcre *code = nullptr;
+    std::shared_ptr<const pcre_compiled> code;
 
     if ((this->tc_search_child == nullptr) ||
         (regex != this->tc_current_search)) {
-        const char *errptr;
-        int         eoff;
+        auto &registry = pcre_registry::singleton();
 
         this->tc_previous_search = this->tc_current_search;
         this->match_reset();
 
         this->tc_search_child.reset();
         this->tc_source_search_child.reset();
+        this->tc_search_query.reset();
 
         log_debug("start search for: '%s'", regex.c_str());
 
         if (regex.empty()) {
         }
-        else if ((code = pcre_compile(regex.c_str(),
-                                      PCRE_CASELESS,
-                                      &errptr,
-                                      &eoff,
-                                      nullptr)) == nullptr) {
-            string errmsg = string(errptr);
-
-            regex = pcrepp::quote(regex);
-
-            log_info("invalid search regex, using quoted: %s", regex.c_str());
-            if ((code = pcre_compile(regex.c_str(),
-                                     PCRE_CASELESS,
-                                     &errptr,
-                                     &eoff,
-                                     nullptr)) == nullptr) {
-                log_error("Unable to compile quoted regex: %s", regex.c_str());
+        else {
+            auto compile_res = registry.compile(regex, PCRE_CASELESS);
+
+            if (compile_res.isOk()) {
+                code = compile_res.unwrap();
+            } else {
+                regex = pcrepp::quote(regex);
+
+                log_info("invalid search regex, using quoted: %s",
+                         regex.c_str());
+                auto quoted_res = registry.compile(regex, PCRE_CASELESS);
+                if (quoted_res.isOk()) {
+                    code = quoted_res.unwrap();
+                } else {
+                    log_error("Unable to compile quoted regex: %s",
+                              regex.c_str());
+                }
             }
         }
 
+        if (this->tc_sub_source != nullptr) {
+            this->tc_sub_source->text_search_changed(
+                code != nullptr ? regex : "");
+        }
+
         if (code != nullptr) {
             highlighter hl(code);
 
             hl.with_role(view_colors::VCR_SEARCH);
 
+            auto tq = std::make_unique<trigram_index::query>(
+                log_format_prefilter::required_literal(regex), true);
+            if (!tq->empty()) {
+                this->tc_search_query = std::move(tq);
+            }
+
             highlight_map_t &hm = this->get_highlights();
             hm[{highlight_source_t::PREVIEW, "search"}] = hl;
 
-            unique_ptr<grep_proc<vis_line_t>> gp = make_unique<grep_proc<vis_line_t>>(code, *this);
+            unique_ptr<grep_proc<vis_line_t>> gp = make_unique<grep_proc<vis_line_t>>(pcrepp(code), *this);
 
             gp->set_sink(this);
             auto top = this->get_top();
@@ -585,7 +683,7 @@ void textview_curses::execute_search(const std::string &regex_orig)
 
             if (this->tc_sub_source != nullptr) {
                 this->tc_sub_source->get_grepper() | [this, code] (auto pair) {
-                    shared_ptr<grep_proc<vis_line_t>> sgp = make_shared<grep_proc<vis_line_t>>(code, *pair.first);
+                    shared_ptr<grep_proc<vis_line_t>> sgp = make_shared<grep_proc<vis_line_t>>(pcrepp(code), *pair.first);
 
                     sgp->set_sink(pair.second);
                     sgp->queue_request(0_vl);
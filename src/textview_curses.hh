@@ -43,6 +43,7 @@
 #include "base/lnav_log.hh"
 #include "text_format.hh"
 #include "logfile.hh"
+#include "log_format_prefilter.hh"
 #include "highlighter.hh"
 #include "lnav_config_fwd.hh"
 #include "textview_curses_fwd.hh"
@@ -164,12 +165,28 @@ public:
 
     void revert_to_last(logfile_filter_state &lfs, size_t rollback_size);
 
-    void add_line(logfile_filter_state &lfs, logfile::const_iterator ll, shared_buffer_ref &line);
+    void add_line(logfile_filter_state &lfs, logfile::const_iterator ll, bool match_state);
 
     void end_of_message(logfile_filter_state &lfs);
 
     virtual bool matches(const logfile &lf, logfile::const_iterator ll, shared_buffer_ref &line) = 0;
 
+    /**
+     * Tell the prefilter what literal text a line needs to contain for this
+     * filter to match.  By default, the filter is tried on every line.
+     */
+    virtual void add_to_prefilter(log_format_prefilter &lp) const {
+        lp.add_unconditional(this->lf_index);
+    };
+
+    /**
+     * @return The trigrams of the literal text that a line needs to contain
+     *   for this filter to match, or nullptr if there is no such literal.
+     */
+    virtual const trigram_index::query *get_trigram_query() const {
+        return nullptr;
+    };
+
     virtual std::string to_command() = 0;
 
     bool operator==(const std::string &rhs) {
@@ -351,9 +368,34 @@ public:
         }
     };
 
+    /**
+     * Rebuild the prefilter used by match_line() if filters have been
+     * added or deleted since it was last built.
+     */
+    void update_prefilter();
+
+    /**
+     * Check a line against the filters in this stack.  All of the filters
+     * share one literal prefilter, so the line is scanned a single time to
+     * find the filters that could match and only those run their regex.
+     *
+     * @param wanted_mask The filters to check, indexed by get_index().
+     * @return A mask with a bit set for each of the wanted filters that
+     *   matched the line.
+     */
+    uint32_t match_line(uint32_t wanted_mask,
+                        const logfile &lf,
+                        logfile::const_iterator ll,
+                        shared_buffer_ref &line);
+
 private:
     const size_t fs_reserved;
     std::vector<std::shared_ptr<text_filter>> fs_filters;
+    /** The filters that were live when fs_prefilter was built. */
+    std::vector<std::shared_ptr<text_filter>> fs_prefilter_filters;
+    std::shared_ptr<text_filter> fs_prefilter_by_index[logfile_filter_state::MAX_FILTERS];
+    log_format_prefilter fs_prefilter;
+    std::vector<bool> fs_candidates;
 };
 
 class text_time_translator {
@@ -508,6 +550,41 @@ public:
         return text_format_t::TF_UNKNOWN;
     };
 
+    /**
+     * Find the first line at or after the given one that could contain the
+     * literal being searched for.  Sources that keep an index of the text
+     * can use it to skip lines, by default every line is a candidate.
+     */
+    virtual vis_line_t text_next_candidate(vis_line_t line,
+                                           const trigram_index::query &tq) {
+        return line;
+    };
+
+    /**
+     * Called when the view starts a search for a new pattern, an empty
+     * pattern means there is no search.  Sources that cache the results of
+     * searches can switch to the ones for the given pattern.
+     */
+    virtual void text_search_changed(const std::string &pattern) {
+    };
+
+    /**
+     * Find the first line at or after the given one that the current
+     * search has not looked at yet.
+     *
+     * @param hits_out The lines that were skipped over that have a match.
+     */
+    virtual vis_line_t text_next_unsearched(vis_line_t line,
+                                            std::vector<vis_line_t> &hits_out) {
+        return line;
+    };
+
+    /**
+     * Record the result of the current search for a line.
+     */
+    virtual void text_search_result(vis_line_t line, bool matched) {
+    };
+
     virtual nonstd::optional<std::pair<grep_proc_source<vis_line_t> *, grep_proc_sink<vis_line_t> *>> get_grepper() {
         return nonstd::nullopt;
     }
@@ -710,11 +787,32 @@ public:
         return retval;
     };
 
+    vis_line_t grep_initial_line(vis_line_t start, vis_line_t highest) override
+    {
+        if (start == -1) {
+            start = highest;
+        }
+        return this->next_search_line(start);
+    };
+
+    void grep_next_line(vis_line_t &line) override
+    {
+        line = this->next_search_line(line + 1_vl);
+    };
+
     void grep_begin(grep_proc<vis_line_t> &gp, vis_line_t start, vis_line_t stop);
     void grep_match(grep_proc<vis_line_t> &gp,
                     vis_line_t line,
                     int start,
                     int end);
+    void grep_line_searched(grep_proc<vis_line_t> &gp,
+                            vis_line_t line,
+                            bool matched) override
+    {
+        if (this->tc_sub_source != nullptr) {
+            this->tc_sub_source->text_search_result(line, matched);
+        }
+    };
 
     bool is_searching() const { return this->tc_searching > 0; };
 
@@ -853,6 +951,12 @@ public:
     std::function<void(textview_curses &)> tc_state_event_handler;
 
 protected:
+    /**
+     * @return The first line at or after the given one that the search
+     *   needs to read.  The lines that the source already has results for
+     *   are skipped and their hits are marked again.
+     */
+    vis_line_t next_search_line(vis_line_t line);
 
     class grep_highlighter {
     public:
@@ -902,6 +1006,8 @@ protected:
 
     std::string tc_current_search;
     std::string tc_previous_search;
+    /** The trigrams of the literal that a line needs for the search to match. */
+    std::unique_ptr<trigram_index::query> tc_search_query;
     std::unique_ptr<grep_highlighter> tc_search_child;
     std::shared_ptr<grep_proc<vis_line_t>> tc_source_search_child;
 };
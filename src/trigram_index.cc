@@ -0,0 +1,324 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file trigram_index.cc
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+
+#include "trigram_index.hh"
+
+static const size_t KEY_COUNT = 1UL << 24;
+
+static uint64_t next_index_id()
+{
+    static std::atomic<uint64_t> NEXT_ID{1};
+
+    return NEXT_ID++;
+}
+
+static inline uint32_t fold_byte(unsigned char ch)
+{
+    if ('A' <= ch && ch <= 'Z') {
+        return ch | 0x20U;
+    }
+    return ch;
+}
+
+static inline uint32_t trigram_key(const char *str)
+{
+    return (fold_byte(str[0]) << 16) |
+           (fold_byte(str[1]) << 8) |
+           fold_byte(str[2]);
+}
+
+trigram_index::query::query(const std::string &literal, bool caseless)
+{
+    for (size_t lpc = 0; lpc + 2 < literal.size(); lpc++) {
+        auto key = trigram_key(&literal[lpc]);
+
+        if (caseless) {
+            bool usable = true;
+
+            // Skip trigrams with characters that a caseless match could
+            // equate with a non-ASCII character, like 'k' and the Kelvin
+            // sign.
+            for (int shift = 0; shift <= 16; shift += 8) {
+                auto ch = (key >> shift) & 0xffU;
+
+                if (ch >= 0x80 || ch == 'k' || ch == 's') {
+                    usable = false;
+                }
+            }
+            if (!usable) {
+                continue;
+            }
+        }
+        this->q_keys.push_back(key);
+    }
+    std::sort(this->q_keys.begin(), this->q_keys.end());
+    this->q_keys.erase(std::unique(this->q_keys.begin(), this->q_keys.end()),
+                       this->q_keys.end());
+}
+
+const trigram_index::query::cached_blocks &
+trigram_index::query::blocks_for(const trigram_index &ti) const
+{
+    auto iter = this->q_cache.find(ti.ti_id);
+
+    if (iter != this->q_cache.end() &&
+        iter->second.cb_line_count == ti.ti_flushed_count) {
+        return iter->second;
+    }
+
+    auto &retval = this->q_cache[ti.ti_id];
+    std::vector<const std::vector<uint32_t> *> lists;
+
+    retval.cb_line_count = ti.ti_flushed_count;
+    retval.cb_all = false;
+    retval.cb_blocks.clear();
+    for (const auto key : this->q_keys) {
+        if (ti.ti_common.count(key)) {
+            continue;
+        }
+
+        auto post_iter = ti.ti_postings.find(key);
+
+        if (post_iter == ti.ti_postings.end()) {
+            return retval;
+        }
+        lists.push_back(&post_iter->second);
+    }
+
+    if (lists.empty()) {
+        retval.cb_all = true;
+        return retval;
+    }
+
+    std::sort(lists.begin(), lists.end(), [](auto lhs, auto rhs) {
+        return lhs->size() < rhs->size();
+    });
+    retval.cb_blocks = *lists.front();
+    for (auto list_iter = std::next(lists.begin());
+         list_iter != lists.end() && !retval.cb_blocks.empty();
+         ++list_iter) {
+        std::vector<uint32_t> both;
+
+        std::set_intersection(retval.cb_blocks.begin(),
+                              retval.cb_blocks.end(),
+                              (*list_iter)->begin(),
+                              (*list_iter)->end(),
+                              std::back_inserter(both));
+        retval.cb_blocks = std::move(both);
+    }
+
+    return retval;
+}
+
+size_t trigram_index::query::next_candidate(const trigram_index &ti,
+                                            size_t line) const
+{
+    if (this->q_keys.empty() || line >= ti.ti_flushed_count) {
+        return line;
+    }
+
+    const auto &cb = this->blocks_for(ti);
+
+    if (cb.cb_all) {
+        return line;
+    }
+
+    uint32_t block = line / BLOCK_LINES;
+    auto iter = std::lower_bound(cb.cb_blocks.begin(), cb.cb_blocks.end(),
+                                 block);
+
+    if (iter == cb.cb_blocks.end()) {
+        return ti.ti_flushed_count;
+    }
+    if (*iter == block) {
+        return line;
+    }
+    return *iter * BLOCK_LINES;
+}
+
+trigram_index::trigram_index() : ti_id(next_index_id())
+{
+}
+
+void trigram_index::add_line(const char *str, size_t len)
+{
+    if (this->ti_pending_bits.empty()) {
+        this->ti_pending_bits.resize(KEY_COUNT / 64);
+    }
+
+    for (size_t lpc = 0; lpc + 2 < len; lpc++) {
+        auto key = trigram_key(&str[lpc]);
+        auto &word = this->ti_pending_bits[key / 64];
+        auto bit = 1ULL << (key % 64);
+
+        if (!(word & bit)) {
+            word |= bit;
+            this->ti_pending.push_back(key);
+        }
+    }
+
+    this->ti_line_count += 1;
+    if ((this->ti_line_count % BLOCK_LINES) == 0) {
+        this->merge_pending();
+    }
+}
+
+void trigram_index::merge_pending()
+{
+    if (this->ti_flushed_count == this->ti_line_count) {
+        return;
+    }
+
+    uint32_t block = this->ti_flushed_count / BLOCK_LINES;
+    size_t block_count = block + 1;
+
+    for (const auto key : this->ti_pending) {
+        this->ti_pending_bits[key / 64] &= ~(1ULL << (key % 64));
+        if (this->ti_common.count(key)) {
+            continue;
+        }
+
+        auto &blocks = this->ti_postings[key];
+
+        if (!blocks.empty() && blocks.back() == block) {
+            continue;
+        }
+        blocks.push_back(block);
+        if (blocks.size() >= COMMON_MIN_BLOCKS &&
+            blocks.size() * COMMON_RATIO > block_count) {
+            this->ti_postings.erase(key);
+            this->ti_common.insert(key);
+        }
+    }
+    this->ti_pending.clear();
+    this->ti_flushed_count = this->ti_line_count;
+}
+
+void trigram_index::flush()
+{
+    this->merge_pending();
+    std::vector<uint32_t>().swap(this->ti_pending);
+    std::vector<uint64_t>().swap(this->ti_pending_bits);
+}
+
+void trigram_index::clear()
+{
+    this->ti_id = next_index_id();
+    this->ti_line_count = 0;
+    this->ti_flushed_count = 0;
+    this->ti_postings.clear();
+    this->ti_common.clear();
+    std::vector<uint32_t>().swap(this->ti_pending);
+    std::vector<uint64_t>().swap(this->ti_pending_bits);
+}
+
+bool trigram_index::save(FILE *file)
+{
+    this->flush();
+
+    uint64_t counts[2] = {
+        this->ti_common.size(),
+        this->ti_postings.size(),
+    };
+
+    if (fwrite(counts, sizeof(counts), 1, file) != 1) {
+        return false;
+    }
+
+    std::vector<uint32_t> common(this->ti_common.begin(),
+                                 this->ti_common.end());
+
+    if (fwrite(common.data(), sizeof(uint32_t), common.size(), file) !=
+        common.size()) {
+        return false;
+    }
+    for (const auto &pair : this->ti_postings) {
+        uint32_t entry[2] = {pair.first, (uint32_t) pair.second.size()};
+
+        if (fwrite(entry, sizeof(entry), 1, file) != 1 ||
+            fwrite(pair.second.data(), sizeof(uint32_t), pair.second.size(),
+                   file) != pair.second.size()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool trigram_index::load(FILE *file, size_t line_count)
+{
+    uint64_t counts[2];
+    size_t block_count = (line_count + BLOCK_LINES - 1) / BLOCK_LINES;
+
+    this->clear();
+    if (fread(counts, sizeof(counts), 1, file) != 1 ||
+        counts[0] > KEY_COUNT || counts[1] > KEY_COUNT) {
+        return false;
+    }
+
+    std::vector<uint32_t> common(counts[0]);
+
+    if (fread(common.data(), sizeof(uint32_t), common.size(), file) !=
+        common.size()) {
+        return false;
+    }
+    this->ti_common.insert(common.begin(), common.end());
+    this->ti_postings.reserve(counts[1]);
+    for (uint64_t lpc = 0; lpc < counts[1]; lpc++) {
+        uint32_t entry[2];
+
+        if (fread(entry, sizeof(entry), 1, file) != 1 ||
+            entry[1] > block_count) {
+            this->clear();
+            return false;
+        }
+
+        auto &blocks = this->ti_postings[entry[0]];
+
+        blocks.resize(entry[1]);
+        if (fread(blocks.data(), sizeof(uint32_t), blocks.size(), file) !=
+            blocks.size()) {
+            this->clear();
+            return false;
+        }
+    }
+
+    this->ti_line_count = line_count;
+    this->ti_flushed_count = line_count;
+
+    return true;
+}
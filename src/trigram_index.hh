@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @file trigram_index.hh
+ */
+
+#ifndef lnav_trigram_index_hh
+#define lnav_trigram_index_hh
+
+#include <stdio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * An index of the three-byte sequences (trigrams) found in the lines of a
+ * file.  The lines are grouped into blocks and each trigram is mapped to the
+ * list of blocks that contain it.  A search for a literal only needs to look
+ * at the blocks that contain all of the literal's trigrams, the lines in the
+ * other blocks cannot match.  ASCII letters are folded to lowercase so that
+ * the same index can be used for caseless searches.
+ *
+ * Trigrams that show up in a large fraction of the blocks are not worth
+ * keeping, so their lists are dropped and they are treated as being in every
+ * block.
+ */
+class trigram_index {
+public:
+    /** The number of lines in a block. */
+    static const size_t BLOCK_LINES = 512;
+
+    /**
+     * The trigrams of a literal being searched for, along with a cache of
+     * the blocks that matched in the indexes the query has been run on.
+     */
+    class query {
+    public:
+        /**
+         * @param literal The text that a line must contain.
+         * @param caseless True if the literal is matched without regard to
+         *   case.  Trigrams with letters that can fold to non-ASCII
+         *   characters are not used in that case.
+         */
+        query(const std::string &literal, bool caseless);
+
+        /** @return True if the literal has no usable trigrams. */
+        bool empty() const { return this->q_keys.empty(); };
+
+        /**
+         * Find the first line at or after the given one that could contain
+         * the literal.  Lines that are not covered by the index are always
+         * candidates.
+         *
+         * @param ti The index of the file the line is in.
+         * @param line The line number to start at.
+         * @return The line number of the next candidate.
+         */
+        size_t next_candidate(const trigram_index &ti, size_t line) const;
+
+    private:
+        struct cached_blocks {
+            size_t cb_line_count{0};
+            /** True if every block is a candidate. */
+            bool cb_all{false};
+            std::vector<uint32_t> cb_blocks;
+        };
+
+        const cached_blocks &blocks_for(const trigram_index &ti) const;
+
+        std::vector<uint32_t> q_keys;
+        mutable std::unordered_map<uint64_t, cached_blocks> q_cache;
+    };
+
+    trigram_index();
+
+    /** @return The number of lines that have been added to the index. */
+    size_t get_line_count() const { return this->ti_line_count; };
+
+    /**
+     * Add the next line of the file to the index.  The trigrams are not
+     * visible to queries until flush() is called.
+     */
+    void add_line(const char *str, size_t len);
+
+    /**
+     * Merge the trigrams of the lines added since the last flush into the
+     * block lists and release the scratch space used while adding.
+     */
+    void flush();
+
+    /** Remove all of the lines from the index. */
+    void clear();
+
+    /**
+     * Write the index to the given file.  Any pending lines are flushed
+     * first.
+     *
+     * @return True if the index was written successfully.
+     */
+    bool save(FILE *file);
+
+    /**
+     * Replace the contents of this index with one written by save().
+     *
+     * @param line_count The number of lines in the saved index.
+     * @return True if the index was read successfully.
+     */
+    bool load(FILE *file, size_t line_count);
+
+private:
+    /** Merge the pending trigrams into the lists for the current block. */
+    void merge_pending();
+
+    /** Drop the lists of trigrams in more than 1/COMMON_RATIO of blocks. */
+    static const size_t COMMON_RATIO = 8;
+    /** The size a list needs to reach before it can be dropped. */
+    static const size_t COMMON_MIN_BLOCKS = 256;
+
+    /** A unique ID for the contents of this index, used by query caches. */
+    uint64_t ti_id;
+    size_t ti_line_count{0};
+    /** The number of lines whose trigrams have been merged. */
+    size_t ti_flushed_count{0};
+    std::unordered_map<uint32_t, std::vector<uint32_t>> ti_postings;
+    std::unordered_set<uint32_t> ti_common;
+
+    /**
+     * The trigrams seen in the current block that have not been merged yet,
+     * along with a bitmap of the same trigrams to quickly weed out repeats.
+     */
+    std::vector<uint32_t> ti_pending;
+    std::vector<uint64_t> ti_pending_bits;
+};
+
+#endif
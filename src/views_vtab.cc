@@ -72,29 +72,27 @@ struct from_sqlite<text_filter::type_t> {
 };
 
 template<>
-struct from_sqlite<pair<string, auto_mem<pcre>>> {
-    inline pair<string, auto_mem<pcre>> operator()(int argc, sqlite3_value **val, int argi) {
+struct from_sqlite<pair<string, shared_ptr<const pcre_compiled>>> {
+    inline pair<string, shared_ptr<const pcre_compiled>> operator()(int argc, sqlite3_value **val, int argi) {
         const char *pattern = (const char *) sqlite3_value_text(val[argi]);
-        const char *errptr;
-        auto_mem<pcre> code;
-        int eoff;
 
         if (pattern == nullptr || pattern[0] == '\0') {
             throw from_sqlite_conversion_error("non-empty pattern", argi);
         }
 
-        code = pcre_compile(pattern,
-                            PCRE_CASELESS,
-                            &errptr,
-                            &eoff,
-                            nullptr);
+        auto compile_res = pcre_registry::singleton().compile(pattern,
+                                                              PCRE_CASELESS);
+
+        if (compile_res.isErr()) {
+            auto ce = compile_res.unwrapErr();
 
-        if (code == nullptr) {
             throw sqlite_func_error(
                 "Invalid regular expression in column {}: {} at offset {}",
-                argi, errptr, eoff);
+                argi, ce.ce_msg, ce.ce_offset);
         }
 
+        auto code = compile_res.unwrap();
+
         return make_pair(string(pattern), std::move(code));
     }
 };
@@ -465,7 +463,7 @@ CREATE TABLE lnav_view_filters (
                    nonstd::optional<int64_t> _filter_id,
                    nonstd::optional<bool> enabled,
                    nonstd::optional<text_filter::type_t> type,
-                   pair<string, auto_mem<pcre>> pattern) {
+                   pair<string, shared_ptr<const pcre_compiled>> pattern) {
         textview_curses &tc = lnav_data.ld_views[view_index];
         text_sub_source *tss = tc.get_sub_source();
         filter_stack &fs = tss->get_filters();
@@ -477,7 +475,7 @@ CREATE TABLE lnav_view_filters (
             type.value_or(text_filter::type_t::EXCLUDE),
             pattern.first,
             *filter_index,
-            pattern.second.release());
+            pcrepp(pattern.second));
         fs.add_filter(pf);
         if (!enabled.value_or(true)) {
             pf->disable();
@@ -513,7 +511,7 @@ CREATE TABLE lnav_view_filters (
                    int64_t new_filter_id,
                    bool enabled,
                    text_filter::type_t type,
-                   pair<string, auto_mem<pcre>> pattern) {
+                   pair<string, shared_ptr<const pcre_compiled>> pattern) {
         auto view_index = lnav_view_t(rowid >> 32);
         auto filter_index = rowid & 0xffffffffLL;
         textview_curses &tc = lnav_data.ld_views[view_index];
@@ -540,7 +538,7 @@ CREATE TABLE lnav_view_filters (
         auto pf = make_shared<pcre_filter>(type,
                                            pattern.first,
                                            tf->get_index(),
-                                           pattern.second.release());
+                                           pcrepp(pattern.second));
 
         if (!enabled) {
             pf->disable();
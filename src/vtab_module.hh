@@ -781,6 +781,8 @@ struct tvt_iterator_cursor {
 
 template<typename T>
 struct tvt_no_update : public T {
+    using T::T;
+
     int delete_row(sqlite3_vtab *vt, sqlite3_int64 rowid) {
         vt->zErrMsg = sqlite3_mprintf(
             "Rows cannot be deleted from this table");
@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "base/date_time_scanner.hh"
+
+/**
+ * Measure the per-line cost of parsing the timestamp at the start of each
+ * line with and without the date_time_scanner memo.  Lines that do not
+ * start with a timestamp are skipped.  Along with any files given on the
+ * command line, a synthetic log with a million lines in one second is
+ * generated for each of a couple of common formats.
+ *
+ * usage: bench_date_scan [<file> ...]
+ */
+
+static const int ITERATIONS = 5;
+
+struct result {
+    size_t r_lines{0};
+    double r_ns_per_line{0.0};
+};
+
+static result measure(const std::vector<std::string> &lines, bool use_memo)
+{
+    result retval;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int iter = 0; iter < ITERATIONS; iter++) {
+        date_time_scanner dts;
+
+        dts.dts_use_memo = use_memo;
+        for (const auto &line : lines) {
+            struct exttm tm;
+            struct timeval tv;
+            auto len = std::min(line.size(), (size_t) 64);
+
+            if (dts.scan(line.c_str(), len, nullptr, &tm, tv) == nullptr) {
+                dts.unlock();
+                if (dts.scan(line.c_str(), len, nullptr, &tm, tv) == nullptr) {
+                    continue;
+                }
+            }
+            retval.r_lines += 1;
+        }
+    }
+
+    auto elapsed = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+
+    if (retval.r_lines > 0) {
+        retval.r_ns_per_line = elapsed / retval.r_lines;
+        retval.r_lines /= ITERATIONS;
+    }
+
+    return retval;
+}
+
+static void report(const std::string &name,
+                   const std::vector<std::string> &lines)
+{
+    auto full = measure(lines, false);
+    auto memo = measure(lines, true);
+
+    printf("%-40s %10zu %12.1f %12.1f\n",
+           name.c_str(),
+           full.r_lines,
+           full.r_ns_per_line,
+           memo.r_ns_per_line);
+}
+
+static std::vector<std::string> synthetic(const char *fmt_name)
+{
+    static const size_t LINE_COUNT = 1000000;
+    std::vector<std::string> retval;
+    char buf[128];
+
+    retval.reserve(LINE_COUNT);
+    for (size_t lpc = 0; lpc < LINE_COUNT; lpc++) {
+        if (strcmp(fmt_name, "iso8601") == 0) {
+            snprintf(buf, sizeof(buf),
+                     "2021-03-04T05:06:07.%06zu-0800 synthetic message",
+                     lpc);
+        } else {
+            snprintf(buf, sizeof(buf),
+                     "2021-03-04 05:06:07,%03zu synthetic message",
+                     lpc / 1000);
+        }
+        retval.emplace_back(buf);
+    }
+
+    return retval;
+}
+
+int main(int argc, char *argv[])
+{
+    int retval = EXIT_SUCCESS;
+
+    setenv("TZ", "UTC", 1);
+
+    printf("%-40s %10s %12s %12s\n",
+           "file", "lines", "full ns/line", "memo ns/line");
+    for (int lpc = 1; lpc < argc; lpc++) {
+        std::ifstream in(argv[lpc]);
+        std::vector<std::string> lines;
+        std::string line;
+
+        if (!in) {
+            perror(argv[lpc]);
+            retval = EXIT_FAILURE;
+            continue;
+        }
+        while (std::getline(in, line)) {
+            lines.emplace_back(line);
+        }
+        report(argv[lpc], lines);
+    }
+
+    report("synthetic iso8601, 1M lines/s", synthetic("iso8601"));
+    report("synthetic comma millis, 1M lines/s", synthetic("comma"));
+
+    return retval;
+}
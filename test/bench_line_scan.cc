@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#if defined(HAVE_X86INTRIN_H) && defined(__SSE4_1__)
+#include "simdutf8check.h"
+#endif
+
+#include "base/is_utf8.hh"
+#include "base/lnav.utf8.hh"
+
+/**
+ * Compare the throughput of lnav::utf8::scan_line() against the code that
+ * line_buffer::load_next_line() used before it: validate_utf8_fast() when
+ * built with --enable-simd and SSE4.1, otherwise is_utf8() with a memchr()
+ * fallback for invalid lines.
+ *
+ * usage: bench_line_scan <file> [<file> ...]
+ */
+
+static const int ITERATIONS = 20;
+
+/**
+ * The test logs are only a few hundred bytes, so keep going until enough
+ * time has passed for the clock to be meaningful.
+ */
+static const double MIN_SECONDS = 0.5;
+
+template<typename F>
+static double measure(const std::string &data, F func)
+{
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    size_t bytes = 0;
+    size_t lines = 0;
+
+    do {
+        for (int iter = 0; iter < ITERATIONS; iter++) {
+            size_t off = 0;
+
+            while (off < data.size()) {
+                auto end = func(&data[off], data.size() - off);
+
+                if (end < 0) {
+                    break;
+                }
+                off += end + 1;
+                lines += 1;
+            }
+            bytes += data.size();
+        }
+
+        elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < MIN_SECONDS);
+
+    if (lines == 0) {
+        return 0.0;
+    }
+
+    return (double) bytes / elapsed / (1024.0 * 1024.0);
+}
+
+int main(int argc, char *argv[])
+{
+    int retval = EXIT_SUCCESS;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file> [<file> ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-40s %14s %14s\n", "file", "previous MB/s", "scan_line MB/s");
+    for (int lpc = 1; lpc < argc; lpc++) {
+        std::ifstream in(argv[lpc], std::ios::binary);
+        std::stringstream buffer;
+
+        if (!in) {
+            perror(argv[lpc]);
+            retval = EXIT_FAILURE;
+            continue;
+        }
+        buffer << in.rdbuf();
+
+        auto data = buffer.str();
+        auto previous = measure(data, [](const char *str, size_t len) {
+            ssize_t utf8_end = -1;
+
+#if defined(HAVE_X86INTRIN_H) && defined(__SSE4_1__)
+            validate_utf8_fast(str, len, &utf8_end);
+#else
+            const char *msg;
+            int faulty_bytes;
+
+            utf8_end = is_utf8((unsigned char *) str, len, &msg, &faulty_bytes);
+            if (msg != nullptr) {
+                auto lf = (const char *) memchr(str, '\n', len);
+
+                utf8_end = lf == nullptr ? -1 : lf - str;
+            }
+#endif
+
+            return utf8_end;
+        });
+        auto scan_line = measure(data, [](const char *str, size_t len) {
+            return lnav::utf8::scan_line(str, len).lsr_end;
+        });
+
+        printf("%-40s %14.1f %14.1f\n",
+               argv[lpc],
+               previous,
+               scan_line);
+    }
+
+    return retval;
+}
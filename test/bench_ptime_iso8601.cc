@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "ptimec.hh"
+
+/**
+ * Compare the vectorized ISO-8601 parser that the generated PTIMEC_FORMATS
+ * entries use against the field-by-field parsing they did before.
+ *
+ * usage: bench_ptime_iso8601
+ */
+
+static const int ITERATIONS = 10;
+
+static bool field_by_field(struct exttm *dst,
+                           const char *str,
+                           off_t &off,
+                           ssize_t len)
+{
+    if (!ptime_Y(dst, str, off, len)) return false;
+    if (!ptime_char('-', str, off, len)) return false;
+    if (!ptime_m(dst, str, off, len)) return false;
+    if (!ptime_char('-', str, off, len)) return false;
+    if (!ptime_d(dst, str, off, len)) return false;
+    if (!ptime_char('T', str, off, len)) return false;
+    if (!ptime_H(dst, str, off, len)) return false;
+    if (!ptime_char(':', str, off, len)) return false;
+    if (!ptime_M(dst, str, off, len)) return false;
+    if (!ptime_char(':', str, off, len)) return false;
+    if (!ptime_S(dst, str, off, len)) return false;
+    if (!ptime_char('.', str, off, len)) return false;
+    if (!ptime_f(dst, str, off, len)) return false;
+    if (!ptime_z(dst, str, off, len)) return false;
+    return true;
+}
+
+static ptime_func generated_parser()
+{
+    for (int lpc = 0; PTIMEC_FORMATS[lpc].pf_fmt != nullptr; lpc++) {
+        if (strcmp(PTIMEC_FORMATS[lpc].pf_fmt, "%Y-%m-%dT%H:%M:%S.%f%z")
+            == 0) {
+            return PTIMEC_FORMATS[lpc].pf_func;
+        }
+    }
+
+    return nullptr;
+}
+
+static double measure(const std::vector<std::string> &lines, ptime_func func)
+{
+    size_t parsed = 0;
+    time_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int iter = 0; iter < ITERATIONS; iter++) {
+        for (const auto &line : lines) {
+            struct exttm tm;
+            off_t off = 0;
+
+            memset(&tm, 0, sizeof(tm));
+            if (func(&tm, line.c_str(), off, line.size())) {
+                checksum += tm.et_tm.tm_sec + tm.et_nsec;
+                parsed += 1;
+            }
+        }
+    }
+
+    auto elapsed = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+
+    if (parsed != lines.size() * ITERATIONS) {
+        fprintf(stderr, "error: only parsed %zu lines\n", parsed);
+        exit(EXIT_FAILURE);
+    }
+    // Keep the loop from being optimized away.
+    if (checksum == 42) {
+        printf("\n");
+    }
+
+    return elapsed / parsed;
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t LINE_COUNT = 1000000;
+    std::vector<std::string> lines;
+    char buf[128];
+
+    lines.reserve(LINE_COUNT);
+    for (size_t lpc = 0; lpc < LINE_COUNT; lpc++) {
+        snprintf(buf, sizeof(buf),
+                 "2021-%02zu-%02zuT%02zu:%02zu:%02zu.%06zu-0800",
+                 1 + lpc % 12,
+                 1 + lpc % 28,
+                 lpc % 24,
+                 lpc % 60,
+                 (lpc / 60) % 60,
+                 lpc);
+        lines.emplace_back(buf);
+    }
+
+    printf("%-20s %12s\n", "parser", "ns/line");
+    printf("%-20s %12.1f\n", "field-by-field",
+           measure(lines, field_by_field));
+    printf("%-20s %12.1f\n", "generated", measure(lines, generated_parser()));
+
+    return EXIT_SUCCESS;
+}
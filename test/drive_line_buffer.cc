@@ -58,9 +58,12 @@ int main(int argc, char *argv[])
 	int offseti = 0;
 	off_t offset = 0;
 	int count = 1000;
+	int decode_threads = 0;
+	bool read_ahead = false;
+	bool use_mmap = false;
 	struct stat st;
 
-	while ((c = getopt(argc, argv, "o:i:n:c:")) != -1) {
+	while ((c = getopt(argc, argv, "o:i:n:c:t:rm")) != -1) {
 		switch (c) {
 			case 'o':
 				if (sscanf(optarg, "%d", &offseti) != 1) {
@@ -88,6 +91,20 @@ int main(int argc, char *argv[])
 					retval = EXIT_FAILURE;
 				}
 				break;
+			case 't':
+				if (sscanf(optarg, "%d", &decode_threads) != 1) {
+					fprintf(stderr,
+							"error: thread count is not an integer -- %s\n",
+							optarg);
+					retval = EXIT_FAILURE;
+				}
+				break;
+			case 'r':
+				read_ahead = true;
+				break;
+			case 'm':
+				use_mmap = true;
+				break;
 			case 'i': {
 				FILE *file;
 
@@ -148,6 +165,12 @@ int main(int argc, char *argv[])
 			int fd2 = (argc > 1) ? fd_cmp.get() : fd.get();
 			assert(fd2 >= 0);
 			lb.set_fd(fd);
+			lb.set_read_ahead(read_ahead);
+			lb.set_decode_threads(decode_threads);
+			if (use_mmap && !lb.set_mmap(true)) {
+				fprintf(stderr, "error: unable to map file\n");
+				retval = EXIT_FAILURE;
+			}
 			if (index.size() == 0) {
 				while (count) {
                     auto load_result = lb.load_next_line(last_range);
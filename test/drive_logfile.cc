@@ -42,6 +42,7 @@
 #include "logfile.hh"
 #include "log_format.hh"
 #include "log_format_loader.hh"
+#include "lnav_config.hh"
 
 using namespace std;
 
@@ -63,6 +64,7 @@ int main(int argc, char *argv[])
     int c, retval = EXIT_SUCCESS;
     dl_mode_t mode = MODE_NONE;
     string expected_format;
+    bool use_index_cache = false;
 
     {
         std::vector<std::string> errors;
@@ -74,8 +76,16 @@ int main(int argc, char *argv[])
         load_formats(paths, errors);
     }
 
-    while ((c = getopt(argc, argv, "ef:ltv")) != -1) {
+    while ((c = getopt(argc, argv, "C:c:ef:ltv")) != -1) {
         switch (c) {
+            case 'C':
+                lnav_config.lc_logfile.lc_index_cache_min_size = atoi(optarg);
+                use_index_cache = true;
+                break;
+            case 'c':
+                lnav_config.lc_logfile.lc_parallel_index_chunk_size =
+                    atoi(optarg);
+                break;
             case 'f':
                 expected_format = optarg;
                 break;
@@ -124,7 +134,8 @@ int main(int argc, char *argv[])
             lf->rebuild_index();
             assert(!lf->is_closed());
             assert(lf->get_activity().la_polls == 3);
-            if (lf->size() > 1) {
+            // A cached index can be loaded in a single read.
+            if (lf->size() > 1 && !use_index_cache) {
                 assert(lf->get_activity().la_reads == 2);
             }
             if (expected_format.empty()) {
@@ -138,6 +149,7 @@ int main(int argc, char *argv[])
             if (!lf->is_compressed()) {
                 assert(lf->get_modified_time() == st.st_mtime);
             }
+            lf->save_index_cache();
 
             switch (mode) {
                 case MODE_NONE:
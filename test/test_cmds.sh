@@ -546,6 +546,18 @@ check_output "search after filter-in is not working" <<EOF
 2009-07-20 22:59:30,221:ERROR:Goodbye, World!
 EOF
 
+run_test ${lnav_test} -n \
+    -c "/vmk" \
+    -c ":filter-out kernel" \
+    -c ":next-mark search" \
+    -c ":disable-filter kernel" \
+    -c ":next-mark search" \
+    ${test_dir}/logfile_access_log.0
+
+check_output "search hits in lines that were filtered out are not found" <<EOF
+192.168.202.254 - - [20/Jul/2009:22:59:29 +0000] "GET /vmw/vSphere/default/vmkernel.gz HTTP/1.0" 200 78929 "-" "gPXE/0.9.7"
+EOF
+
 cp ${test_dir}/logfile_multiline.0 logfile_append.0
 chmod ug+w logfile_append.0
 
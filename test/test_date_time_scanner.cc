@@ -165,4 +165,181 @@ int main(int argc, char *argv[])
         ftime_fmt(buf, sizeof(buf), "ts %q ]", tm);
         assert(strcmp(buf, epoch_str) == 0);
     }
+
+    {
+        static const struct {
+            const char *fmt;
+            const char *str;
+        } CUSTOM_TIMES[] = {
+            {"%Y-%m-%d %H:%M:%S", "2021-03-04 05:06:07"},
+            {"%a %b %d %H:%M:%S %Y", "Thu Mar 04 05:06:07 2021"},
+            {"%d/%b/%Y:%H:%M:%S %z", "04/Mar/2021:05:06:07 -0800"},
+            {"[%s]", "[1614834367]"},
+            {"%m/%d/%Y %I:%M:%S %p %Z", "03/04/2021 05:06:07 PM PST"},
+            {"%Y-%m-%d %H:%M:%S", "2021-03-04 05:06"},
+            {"%Y-%m-%d", "2021/03/04"},
+        };
+
+        for (const auto &ct : CUSTOM_TIMES) {
+            auto compiled = ptime_compiled_fmt::compile(ct.fmt);
+            struct exttm tm1, tm2;
+            off_t off1 = 0, off2 = 0;
+
+            memset(&tm1, 0, sizeof(tm1));
+            memset(&tm2, 0, sizeof(tm2));
+            bool rc1 = ptime_fmt(ct.fmt, &tm1, ct.str, off1, strlen(ct.str));
+            bool rc2 = compiled.parse(&tm2, ct.str, off2, strlen(ct.str));
+
+            printf("compiled %s %s -> %d %d\n", ct.fmt, ct.str, rc1, rc2);
+            assert(rc1 == rc2);
+            assert(off1 == off2);
+            assert(tm1 == tm2);
+        }
+    }
+
+    {
+        static const struct {
+            char sep;
+            const char *str;
+        } ISO_TIMES[] = {
+            {'T', "2021-03-04T05:06:07"},
+            {'T', "2021-03-04T05:06:07.123456-0800"},
+            {' ', "1999-12-31 23:59:59,999"},
+            {'T', "1900-01-01T00:00:00"},
+            {'T', "3000-12-31T23:59:59"},
+            {'T', "2021-03- 4T05:06:07"},
+            {'T', "2021-3-04T05:06:07Z"},
+            {'T', "2021-03-04 05:06:07"},
+            {'T', "2021-13-04T05:06:07"},
+            {'T', "2021-03-00T05:06:07"},
+            {'T', "2021-03-04T24:06:07"},
+            {'T', "2021-03-04T05:60:07"},
+            {'T', "2021-03-04T05:06:60"},
+            {'T', "2021-03-04T05:06:0x"},
+            {'T', "2021-03-04T05:06:0"},
+            {'T', "3001-03-04T05:06:07"},
+            {'T', "2021/03/04T05:06:07"},
+        };
+
+        for (const auto &it : ISO_TIMES) {
+            const char *fmt = it.sep == 'T' ? "%Y-%m-%dT%H:%M:%S"
+                                            : "%Y-%m-%d %H:%M:%S";
+            struct exttm tm1, tm2;
+            off_t off1 = 0, off2 = 0;
+
+            memset(&tm1, 0, sizeof(tm1));
+            memset(&tm2, 0, sizeof(tm2));
+            bool rc1 = ptime_fmt(fmt, &tm1, it.str, off1, strlen(it.str));
+            bool rc2 = ptime_iso8601_datetime(
+                &tm2, it.str, off2, strlen(it.str), it.sep);
+
+            printf("iso8601 %s -> %d %d\n", it.str, rc1, rc2);
+            if (rc2) {
+                assert(rc1);
+                assert(off1 == off2);
+                assert(tm1 == tm2);
+            } else {
+                struct exttm zero_tm;
+
+                memset(&zero_tm, 0, sizeof(zero_tm));
+                assert(off2 == 0);
+                assert(tm2 == zero_tm);
+            }
+        }
+
+        // The generated parsers fall back to the individual fields when
+        // the fast path declines.
+        const char *padded = "2021-03- 4T05:06:07";
+        struct exttm tm;
+        off_t off = 0;
+
+        memset(&tm, 0, sizeof(tm));
+        assert(!ptime_iso8601_datetime(&tm, padded, off, strlen(padded), 'T'));
+        for (int lpc = 0; PTIMEC_FORMATS[lpc].pf_fmt != nullptr; lpc++) {
+            if (strcmp(PTIMEC_FORMATS[lpc].pf_fmt, "%Y-%m-%dT%H:%M:%S") == 0) {
+                assert(PTIMEC_FORMATS[lpc].pf_func(
+                    &tm, padded, off, strlen(padded)));
+                assert(off == 19);
+                assert(tm.et_tm.tm_mday == 4);
+            }
+        }
+    }
+
+    {
+        static const char *FMTS1[] = {"%d/%m/%Y %H:%M:%S", nullptr};
+        static const char *FMTS2[] = {"%Y-%m-%dT%H:%M:%S", nullptr};
+        const char *ts1 = "04/03/2021 05:06:07";
+        const char *ts2 = "2021-03-04T05:06:07";
+        date_time_scanner dts;
+        struct timeval tv;
+        struct exttm tm;
+
+        assert(dts.scan(ts1, strlen(ts1), FMTS1, &tm, tv) != nullptr);
+        assert(tv.tv_sec == 1614834367);
+        assert(dts.scan(ts1, strlen(ts1), FMTS1, &tm, tv) != nullptr);
+        assert(tv.tv_sec == 1614834367);
+
+        // Switching to a different set of formats recompiles them.
+        dts.unlock();
+        assert(dts.scan(ts2, strlen(ts2), FMTS2, &tm, tv) != nullptr);
+        assert(tv.tv_sec == 1614834367);
+        assert(dts.scan(ts1, strlen(ts1), FMTS2, &tm, tv) == nullptr);
+    }
+
+    {
+        static const char *CUSTOM_FMTS[] = {"%Y-%m-%d %H:%M:%S.%L", nullptr};
+        static const char *SEQUENCE[] = {
+            "2021-03-04T05:06:07.000001-0800",
+            "2021-03-04T05:06:07.000002-0800",
+            "2021-03-04T05:06:07.123456-0800",
+            "2021-03-04T05:06:07.123456-0700",
+            "2021-03-04T05:06:08.000001-0700",
+            "2021-03-04T05:06:08.00000x-0700",
+            "2021-03-04 05:06:07,123",
+            "2021-03-04 05:06:07,456",
+            "2021-03-04 05:06:07.789",
+            "2021-03-04 05:06:07",
+            "2021-03-04 05:06:07 ",
+            "2021-03-04 05:06:17",
+            "1614834367.123456",
+            "1614834367.654321",
+            "16148343671.654321",
+            "+1614834367",
+        };
+
+        for (int custom = 0; custom < 2; custom++) {
+            auto fmts = custom ? CUSTOM_FMTS : nullptr;
+            date_time_scanner memo_dts, full_dts;
+
+            full_dts.dts_use_memo = false;
+            for (const auto *ts : SEQUENCE) {
+                struct exttm memo_tm, full_tm;
+                struct timeval memo_tv, full_tv;
+
+                memset(&memo_tm, 0, sizeof(memo_tm));
+                memset(&full_tm, 0, sizeof(full_tm));
+                auto memo_rc = memo_dts.scan(ts, strlen(ts), fmts,
+                                             &memo_tm, memo_tv);
+                auto full_rc = full_dts.scan(ts, strlen(ts), fmts,
+                                             &full_tm, full_tv);
+                if (full_rc == nullptr) {
+                    memo_dts.unlock();
+                    full_dts.unlock();
+                    memo_rc = memo_dts.scan(ts, strlen(ts), fmts,
+                                            &memo_tm, memo_tv);
+                    full_rc = full_dts.scan(ts, strlen(ts), fmts,
+                                            &full_tm, full_tv);
+                }
+
+                printf("memo %s -> %p %p\n", ts, memo_rc, full_rc);
+                assert(memo_rc == full_rc);
+                if (full_rc != nullptr) {
+                    assert(memo_tm == full_tm);
+                    assert(memo_tv.tv_sec == full_tv.tv_sec);
+                    assert(memo_tv.tv_usec == full_tv.tv_usec);
+                    assert(memo_dts.dts_fmt_len == full_dts.dts_fmt_len);
+                }
+            }
+        }
+    }
 }
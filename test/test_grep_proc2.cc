@@ -34,7 +34,8 @@
 #include <stdlib.h>
 
 #include <sys/types.h>
-#include <sys/wait.h>
+
+#include <map>
 
 #include "grep_proc.hh"
 #include "listview_curses.hh"
@@ -73,11 +74,49 @@ public:
     int ms_current_line;
 };
 
-class my_sleeper_source : public grep_proc_source<vis_line_t> {
+class my_endless_source : public grep_proc_source<vis_line_t> {
+public:
     bool grep_value_for_line(vis_line_t line_number, string &value_out) {
-       sleep(1000);
+       value_out = "foobar";
+       this->mes_count += 1;
        return true;
     };
+
+    int mes_count{0};
+};
+
+class my_counted_source : public grep_proc_source<vis_line_t> {
+public:
+    bool grep_value_for_line(vis_line_t line_number, string &value_out) {
+       if (line_number >= 10000) {
+           return false;
+       }
+       value_out = (line_number % 2) == 0 ? "foobar" : "";
+       return true;
+    };
+};
+
+class my_searched_sink : public grep_proc_sink<vis_line_t> {
+public:
+    void grep_match(grep_proc<vis_line_t> &gp,
+                    vis_line_t line,
+                    int start,
+                    int end) {
+    };
+
+    void grep_line_searched(grep_proc<vis_line_t> &gp,
+                            vis_line_t line,
+                            bool matched) {
+       assert(matched == ((line % 2) == 0));
+       this->mss_counts[line] += 1;
+    };
+
+    void grep_end(grep_proc<vis_line_t> &gp) {
+       this->mss_ended += 1;
+    };
+
+    map<int, int> mss_counts;
+    int mss_ended{0};
 };
 
 class my_sink : public grep_proc_sink<vis_line_t> {
@@ -139,19 +178,58 @@ int main(int argc, char *argv[])
     }
 
     {
-       my_sleeper_source mss;
-       grep_proc<vis_line_t> *gp = new grep_proc<vis_line_t>(code, mss);
-       int status;
+       my_endless_source mes;
+       grep_proc<vis_line_t> *gp = new grep_proc<vis_line_t>(code, mes);
+       vector<struct pollfd> pollfds;
 
        gp->queue_request();
        gp->start();
 
-       assert(wait3(&status, WNOHANG, NULL) == 0);
+       // Nothing is read until the main loop gets around to it.
+       assert(mes.mes_count == 0);
+
+       gp->update_poll_set(pollfds);
+       poll(&pollfds[0], pollfds.size(), -1);
+       gp->check_poll_set(pollfds);
+
+       int count = mes.mes_count;
 
+       assert(count > 0);
+
+       // Deleting the grep_proc waits for the workers and stops reading.
        delete gp;
 
-       assert(wait(&status) == -1);
-       assert(errno == ECHILD);
+       assert(mes.mes_count == count);
+    }
+
+    {
+       my_counted_source mcs;
+       my_searched_sink mss;
+       grep_proc<vis_line_t> gp(code, mcs);
+       vector<struct pollfd> pollfds;
+
+       gp.set_sink(&mss);
+       gp.queue_request(0_vl);
+       gp.start();
+
+       gp.update_poll_set(pollfds);
+       poll(&pollfds[0], pollfds.size(), -1);
+       gp.check_poll_set(pollfds);
+
+       // The first lines are out with a worker, so the results for the
+       // lines that are queued again should only be reported once.
+       gp.queue_request(0_vl, 100_vl);
+       while (mss.mss_ended < 2) {
+           pollfds.clear();
+           gp.update_poll_set(pollfds);
+           poll(&pollfds[0], pollfds.size(), -1);
+           gp.check_poll_set(pollfds);
+       }
+
+       assert(mss.mss_counts.size() == 10000);
+       for (const auto &pair : mss.mss_counts) {
+           assert(pair.second == 1);
+       }
     }
 
     free(code);
@@ -75,4 +75,89 @@ run_test ./drive_line_buffer -i lb-3.index -n 10 lb-3.gz lb-3.dat
 
 check_output "Random gzipped reads don't match input" <<EOF
 All done
-EOF
\ No newline at end of file
+EOF
+rm -f lb-4-part.*
+split -b 100000 lb-3.dat lb-4-part.
+for part in lb-4-part.*; do
+    gzip -c $part
+done > lb-4.gz
+
+run_test ./drive_line_buffer -i lb-3.index -n 10 lb-4.gz lb-3.dat
+
+check_output "Random multi-member gzipped reads don't match input" <<EOF
+All done
+EOF
+
+run_test ./drive_line_buffer -t 1 -i lb-3.index -n 10 lb-4.gz lb-3.dat
+
+check_output "Multi-member gzipped reads on one thread don't match input" <<EOF
+All done
+EOF
+
+run_test ./drive_line_buffer -t 1 -r -c 10000000 lb-4.gz
+
+check_output "Sequential multi-member gzipped reads on one thread don't match" \
+    < lb-3.dat
+
+run_test ./drive_line_buffer -m -i lb.index -n 10 lb-2.dat
+
+check_output "Random reads from a mapped file don't match input?" <<EOF
+All done
+EOF
+
+run_test ./drive_line_buffer -m -c 10000000 lb-3.dat
+
+check_output "Sequential reads from a mapped file don't match input" < lb-3.dat
+
+for lb_file in lb-2.dat lb-3.gz lb-4.gz; do
+    run_test ./drive_line_buffer -r -c 10000000 $lb_file
+
+    gzip -dcf $lb_file | \
+        check_output "Sequential reads with read-ahead don't match $lb_file"
+done
+
+if [ "$BZIP2_SUPPORT" -eq 1 ] && [ x"$BZIP2_CMD" != x"" ] ; then
+    $BZIP2_CMD -z -c lb-2.dat > lb-2.bz2
+    $BZIP2_CMD -z -c ${test_dir}/logfile_access_log.1 >> lb-2.bz2
+    cat lb-2.dat ${test_dir}/logfile_access_log.1 > lb-2-bz.dat
+    grep -b '$' lb-2-bz.dat | cut -f 1 -d : > lb-2-bz.index
+
+    run_test ./drive_line_buffer -i lb-2-bz.index -n 10 lb-2.bz2 lb-2-bz.dat
+
+    check_output "Random bzip2 reads don't match input" <<EOF
+All done
+EOF
+
+    run_test ./drive_line_buffer -t 1 -c 10000000 lb-2.bz2
+
+    check_output "bzip2 reads on one thread don't match input" < lb-2-bz.dat
+
+    # The header of each block has a bitmap of the byte values used in the
+    # block.  Using only newlines and these characters makes the bitmap
+    # contain the block magic number, so there is a fake one in every block.
+    awk 'BEGIN {
+        split("34 35 39 41 47 49 51 52 55 58 61 62 65 67 70 71 73 75 76 79",
+              codes, " ");
+        for (i = 0; i < 6000; i++) {
+            line = "";
+            for (j = 0; j < 60; j++) {
+                line = line sprintf("%c", codes[(i * 7 + j * 3) % 20 + 1]);
+            }
+            print line;
+        }
+    }' > lb-fake-magic.dat
+    $BZIP2_CMD -z -1 -c lb-fake-magic.dat > lb-fake-magic.bz2
+    grep -b '$' lb-fake-magic.dat | cut -f 1 -d : > lb-fake-magic.index
+
+    run_test ./drive_line_buffer -i lb-fake-magic.index -n 10 \
+        lb-fake-magic.bz2 lb-fake-magic.dat
+
+    check_output "bzip2 blocks with a fake magic number are not read?" <<EOF
+All done
+EOF
+
+    run_test ./drive_line_buffer -c 10000000 lb-fake-magic.bz2
+
+    check_output "bzip2 file with a fake magic number is cut short?" \
+        < lb-fake-magic.dat
+fi
@@ -33,6 +33,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "auto_fd.hh"
 #include "line_buffer.hh"
@@ -92,6 +93,46 @@ int main(int argc, char *argv[])
         assert(result.isErr());
     }
 
+    {
+        char fn_template[] = "test_line_buffer.XXXXXX";
+
+        auto fd = auto_fd(mkstemp(fn_template));
+        remove(fn_template);
+        line_buffer lb;
+
+        for (int lpc = 0; lpc < 8192; lpc++) {
+            char line[32];
+
+            snprintf(line, sizeof(line), "line %05d\n", lpc);
+            log_perror(write(fd, line, strlen(line)));
+        }
+
+        auto lb_fd = auto_fd::dup_of(fd);
+        lb.set_fd(lb_fd);
+        assert(lb.set_mmap(true));
+        assert(lb.is_mmapped());
+
+        auto li = lb.load_next_line({0}).unwrap();
+        assert(li.li_file_range.fr_size == 11);
+        auto sbr = lb.read_range(li.li_file_range).unwrap();
+        assert(strncmp(sbr.get_data(), "line 00000\n", 11) == 0);
+        while (!li.li_file_range.empty()) {
+            li = lb.load_next_line(li.li_file_range).unwrap();
+        }
+        assert(lb.is_mmapped());
+
+        // Truncating the file out from under the mapping should not crash,
+        // the pages that are gone read back as zeroes.
+        log_perror(ftruncate(fd, 0));
+        auto sbr2 = lb.read_range({11 * 8000, 11}).unwrap();
+        assert(sbr2.get_data()[0] == '\0');
+
+        // ... and the next load falls back to regular reads.
+        auto li2 = lb.load_next_line({0}).unwrap();
+        assert(!lb.is_mmapped());
+        assert(li2.li_file_range.empty());
+    }
+
     {
         static string first = "Hello";
         static string second = ", World!";
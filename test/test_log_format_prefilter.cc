@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+
+#include <string>
+#include <vector>
+
+#include "log_format_prefilter.hh"
+
+using namespace std;
+
+static void check_literal(const char *regex, const char *expected)
+{
+    auto actual = log_format_prefilter::required_literal(regex);
+
+    if (actual != expected) {
+        fprintf(stderr, "error: %s -> '%s', expected '%s'\n",
+                regex, actual.c_str(), expected);
+        assert(false);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    check_literal("abc", "abc");
+    check_literal("^abc$", "abc");
+    check_literal("ab\\d+cdef", "cdef");
+    check_literal("abc?def", "def");
+    check_literal("abcd*e", "abc");
+    check_literal("abc+", "abc");
+    check_literal("abcd{0,2}", "abc");
+    check_literal("abcd{2}", "abcd");
+    check_literal("ab{c", "ab{c");
+    check_literal("\\w+\\[pid\\]: ", "[pid]: ");
+    check_literal("\\x41bc", "bc");
+    check_literal("ab[^\\]x]+cd", "ab");
+    check_literal("(?<body>abcd)e", "abcd");
+    check_literal("(?:abcd)?e", "e");
+    check_literal("(?:ab|cd)e", "e");
+    check_literal("abc|defg", "");
+    check_literal("(?i)abcdef", "");
+    check_literal("(?=abcd)e", "e");
+    check_literal("(?:(?:abcd))+", "abcd");
+    check_literal("caf\xc3\xa9?x", "caf");
+    check_literal("x\\Qabc\\E", "");
+    check_literal("(abc", "");
+    check_literal("abc)", "");
+    check_literal("\\d+", "");
+    check_literal(
+        "^(?<login>\\S+)\\s*: (?:(?<error_msg>[^;]+);)?\\s*TTY=(?<tty>[^;]+)"
+        "\\s+;\\s*COMMAND=(?<command>.*)$",
+        "COMMAND=");
+
+    {
+        log_format_prefilter pf;
+        vector<bool> candidates;
+
+        pf.add_literal(0, "he");
+        pf.add_literal(1, "she");
+        pf.add_literal(1, "his");
+        pf.add_literal(2, "hers");
+        pf.add_unconditional(3);
+        pf.add_literal(4, "");
+        pf.add_literal(5, "xyz");
+        pf.build();
+
+        assert(pf.size() == 6);
+        assert(pf.literal_count() == 5);
+
+        pf.match("ushers", 6, candidates);
+        assert(candidates == vector<bool>({true, true, true, true, true, false}));
+
+        pf.match("this", 4, candidates);
+        assert(candidates == vector<bool>({false, true, false, true, true, false}));
+
+        pf.match("", 0, candidates);
+        assert(candidates == vector<bool>({false, false, false, true, true, false}));
+
+        pf.match("axyzb", 5, candidates);
+        assert(candidates == vector<bool>({false, false, false, true, true, true}));
+
+        pf.clear();
+        pf.add_literal(0, "abc");
+        pf.build();
+        pf.match("xabcx", 5, candidates);
+        assert(candidates == vector<bool>({true}));
+    }
+
+    {
+        log_format_prefilter pf;
+        vector<bool> candidates;
+
+        pf.add_unconditional(1);
+        pf.build();
+        pf.match("abc", 3, candidates);
+        assert(candidates == vector<bool>({false, true}));
+    }
+
+    {
+        log_format_prefilter pf;
+        vector<bool> candidates;
+
+        pf.add_literal(0, "Error:", true);
+        pf.add_literal(1, "WARN");
+        // Letters that fold to non-ASCII characters split the literal.
+        pf.add_literal(2, "disk full", true);
+        pf.add_literal(3, "sk", true);
+        pf.add_literal(4, "caf\xc3\xa9", true);
+        pf.build();
+
+        pf.match("an ERROR: occurred", 18, candidates);
+        assert(candidates == vector<bool>({true, false, false, true, false}));
+
+        // Case-sensitive literals are also folded once the automaton is.
+        pf.match("warn", 4, candidates);
+        assert(candidates == vector<bool>({false, true, false, true, false}));
+
+        pf.match("the DI\xc5\xbf\xe2\x84\xaa FULL", 16, candidates);
+        assert(candidates == vector<bool>({false, false, true, true, false}));
+
+        pf.match("Disk Ful Cafe", 13, candidates);
+        assert(candidates == vector<bool>({false, false, false, true, true}));
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -396,6 +396,87 @@ Sep 13 03:46:03 2015 -- 000
 EOF
 
 
+awk 'BEGIN {
+    for (i = 0; i < 3000; i++) {
+        t = 3600 + i;
+        if (i % 97 == 0) {
+            t -= 100;
+        }
+        printf("2013-06-06 %02d:%02d:%02d,%03d [main-1] %s com.example.Chunk - message %d\n",
+               int(t / 3600), int(t / 60) % 60, t % 60, i % 1000,
+               (i % 7 == 0) ? "ERROR" : "INFO", i);
+        if (i % 5 == 0) {
+            printf("    at com.example.Chunk.run(Chunk.java:%d)\n", i);
+        }
+    }
+}' > logfile_parallel.0
+
+./drive_logfile -c 0 -t -f java_log logfile_parallel.0 > logfile_parallel.0.times
+./drive_logfile -c 0 -v -f java_log logfile_parallel.0 > logfile_parallel.0.levels
+
+run_test ./drive_logfile -c 4096 -t -f java_log logfile_parallel.0
+
+check_output "parallel indexing changed the timestamps?" < logfile_parallel.0.times
+
+run_test ./drive_logfile -c 4096 -v -f java_log logfile_parallel.0
+
+check_output "parallel indexing changed the levels?" < logfile_parallel.0.levels
+
+for parity in 0 1; do
+    awk -v parity=${parity} 'BEGIN {
+        for (i = parity; i < 8000; i += 2) {
+            t = 3600 + i;
+            printf("2013-06-06 %02d:%02d:%02d,000 [main-%d] INFO com.example.Merge - message %d\n",
+                   int(t / 3600), int(t / 60) % 60, t % 60, parity, i);
+        }
+    }' > logfile_parallel.${parity}.merge
+done
+
+sort logfile_parallel.0.merge logfile_parallel.1.merge > logfile_parallel.merged
+
+run_test ${lnav_test} -n logfile_parallel.0.merge logfile_parallel.1.merge
+
+check_output "files indexed concurrently are not merged correctly?" < logfile_parallel.merged
+
+rm -rf tmp/lnav-*/index
+mkdir -p tmp
+cp logfile_parallel.0 logfile_parallel.cached
+env TMPDIR=tmp ./drive_logfile -C 1 -f java_log logfile_parallel.cached
+
+if ! test -f tmp/lnav-*/index/idx-*; then
+    echo "index cache not saved?"
+    exit 1
+fi
+
+grep "message 1[0-9]$" logfile_parallel.0 >> logfile_parallel.cached
+
+./drive_logfile -t -f java_log logfile_parallel.cached > logfile_parallel.cached.times
+
+run_test env TMPDIR=tmp ./drive_logfile -C 1 -t -f java_log logfile_parallel.cached
+
+check_output "index cache changed the timestamps?" < logfile_parallel.cached.times
+
+grep "message 2[0-9]$" logfile_parallel.0 >> logfile_parallel.cached
+
+./drive_logfile -v -f java_log logfile_parallel.cached > logfile_parallel.cached.levels
+
+run_test env TMPDIR=tmp ./drive_logfile -C 1 -v -f java_log logfile_parallel.cached
+
+check_output "index cache changed the levels?" < logfile_parallel.cached.levels
+
+gzip -c logfile_parallel.0 > logfile_parallel.0.gz
+env TMPDIR=tmp ./drive_logfile -C 1 -f java_log logfile_parallel.0.gz
+
+if ! test -f tmp/lnav-*/index/gz-*; then
+    echo "gzip syncpoints not saved?"
+    exit 1
+fi
+
+run_test env TMPDIR=tmp ./drive_logfile -C 1 -t -f java_log logfile_parallel.0.gz
+
+check_output "index cache changed the timestamps of a gzipped file?" < logfile_parallel.0.times
+
+
 ##
 
 run_test ./drive_logfile -v -f syslog_log ${srcdir}/logfile_syslog.0
@@ -565,6 +646,21 @@ count(*)
       17
 EOF
 
+run_test ${lnav_test} -n -I ${test_dir} \
+    -c ';SELECT pattern, hits FROM lnav_file_pattern_stats' \
+    -c ':write-csv-to -' \
+    ${srcdir}/logfile_haproxy.0
+
+check_output "pattern hits are not counted?" <<EOF
+pattern,hits
+haproxy_log/regex/event_started,3
+haproxy_log/regex/event_stopped,0
+haproxy_log/regex/event_stopping,0
+haproxy_log/regex/http,13
+haproxy_log/regex/ssl,1
+haproxy_log/regex/tcp,0
+EOF
+
 run_test ${lnav_test} -n \
     ${srcdir}/logfile_syslog_with_header.0
 
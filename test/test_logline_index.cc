@@ -0,0 +1,257 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "logline_index.hh"
+
+using namespace std;
+
+static bool same_line(const logline &lhs, const logline &rhs)
+{
+    return lhs.get_offset() == rhs.get_offset() &&
+           lhs.get_sub_offset() == rhs.get_sub_offset() &&
+           lhs.get_time() == rhs.get_time() &&
+           lhs.get_millis() == rhs.get_millis() &&
+           lhs.get_level_and_flags() == rhs.get_level_and_flags() &&
+           lhs.get_module_id() == rhs.get_module_id() &&
+           lhs.get_opid() == rhs.get_opid() &&
+           lhs.is_valid_utf() == rhs.is_valid_utf() &&
+           lhs.is_expr_marked() == rhs.is_expr_marked() &&
+           memcmp(&lhs, &rhs, sizeof(lhs)) == 0;
+}
+
+static void check_index(const logline_index &index,
+                        const vector<logline> &expected)
+{
+    assert(index.size() == expected.size());
+    for (size_t lpc = 0; lpc < expected.size(); lpc++) {
+        assert(same_line(index[lpc], expected[lpc]));
+    }
+    assert(std::equal(index.begin(), index.end(),
+                      expected.begin(), same_line));
+}
+
+/** Exposes compact(), which is normally only called by logfile. */
+class compactable_index : public logline_index {
+public:
+    using logline_index::compact;
+};
+
+int main(int argc, char *argv[])
+{
+    const size_t LINE_COUNT = logline_index::BLOCK_SIZE * 5 + 123;
+    vector<logline> expected;
+    compactable_index index;
+    file_off_t off = 0;
+    time_t base_time = 1600000000;
+
+    for (size_t lpc = 0; lpc < LINE_COUNT; lpc++) {
+        logline ll(off,
+                   base_time + lpc / 7,
+                   (lpc * 37) % 1000,
+                   (log_level_t) (lpc % LEVEL__MAX),
+                   lpc % 5,
+                   lpc % 64);
+
+        if (lpc % 11 == 0) {
+            ll.set_sub_offset(lpc % 3);
+        }
+        if (lpc % 13 == 0) {
+            ll.set_valid_utf(false);
+        }
+        if (lpc % 17 == 0) {
+            ll.set_mark(true);
+        }
+        if (lpc % 19 == 0) {
+            ll.set_expr_mark(true);
+        }
+        if (lpc == 4000) {
+            // Make sure a large jump backwards in time round-trips.
+            ll.set_time(0);
+        }
+        if (lpc > 2048 && lpc < 3072) {
+            byte_array<2, uint64_t> ba;
+
+            ba.clear();
+            *ba.out(0) = lpc;
+            ll.set_schema(ba);
+        }
+        expected.push_back(ll);
+        index.push_back(ll);
+        off += 80 + lpc % 50;
+        if (lpc == 3500) {
+            // A line in a huge file.
+            off += 1LL << 40;
+        }
+    }
+    check_index(index, expected);
+
+    assert(index.compact() == 5);
+    assert(index.compact() == 0);
+    check_index(index, expected);
+
+    // Changes to a line in a compacted block are kept when it is compacted
+    // again.
+    for (size_t lpc = 0; lpc < LINE_COUNT; lpc += 100) {
+        index[lpc].set_mark(true);
+        index[lpc].set_time(index[lpc].get_time() + 1);
+        expected[lpc].set_mark(true);
+        expected[lpc].set_time(expected[lpc].get_time() + 1);
+    }
+    assert(index.compact() == 5);
+    check_index(index, expected);
+
+    // An iterator looks its block up again after the block is compacted.
+    {
+        auto iter = index.begin() + 1500;
+
+        assert(same_line(*iter, expected[1500]));
+        assert(index.compact() == 5);
+        assert(same_line(*iter, expected[1500]));
+        assert(same_line(iter[1], expected[1501]));
+    }
+
+    {
+        struct timeval tv = {
+            (time_t) (base_time + 300), 500 * 1000,
+        };
+        vector<logline> sorted_lines(expected.begin(), expected.begin() + 3500);
+        compactable_index sorted;
+
+        sorted.insert(sorted.cend(), sorted_lines.begin(), sorted_lines.end());
+        sorted.compact();
+
+        auto iter = sorted.lower_bound(tv);
+        auto expected_iter = std::lower_bound(
+            sorted_lines.begin(), sorted_lines.end(), tv);
+        assert((iter - sorted.cbegin()) ==
+               (expected_iter - sorted_lines.begin()));
+
+        tv.tv_sec = base_time + 100000;
+        assert(sorted.lower_bound(tv) == sorted.cend());
+        tv.tv_sec = 0;
+        assert(sorted.lower_bound(tv) == sorted.cbegin());
+    }
+
+    {
+        compactable_index typical;
+        file_off_t typical_off = 0;
+
+        for (size_t lpc = 0; lpc < logline_index::BLOCK_SIZE * 8; lpc++) {
+            typical.emplace_back(typical_off,
+                                 base_time + lpc / 100,
+                                 (lpc % 100) * 10,
+                                 lpc % 50 == 0 ? LEVEL_ERROR : LEVEL_INFO);
+            typical_off += 60 + (lpc * 7919) % 200;
+        }
+
+        auto full_size = typical.memory_usage();
+        typical.compact();
+        assert(typical.memory_usage() < full_size / 2);
+    }
+
+    // Only a limited number of blocks are kept decoded while a large index
+    // is filled and scanned.
+    {
+        const size_t BIG_BLOCKS = logline_index::MAX_DECODED_BLOCKS * 3;
+        const size_t DECODED_LIMIT = (logline_index::MAX_DECODED_BLOCKS + 1)
+            * logline_index::BLOCK_SIZE * sizeof(logline);
+        vector<logline> big_expected;
+        compactable_index big;
+        file_off_t big_off = 0;
+
+        for (size_t lpc = 0; lpc < logline_index::BLOCK_SIZE * BIG_BLOCKS;
+             lpc++) {
+            big_expected.emplace_back(big_off,
+                                      base_time + lpc / 100,
+                                      (lpc % 100) * 10,
+                                      LEVEL_INFO);
+            big.push_back(big_expected.back());
+            big_off += 60 + (lpc * 7919) % 200;
+        }
+        auto filled_usage = big.memory_usage();
+        big.compact();
+        auto packed_usage = big.memory_usage();
+        assert(filled_usage <= packed_usage + DECODED_LIMIT);
+        assert(big.is_sorted());
+        check_index(big, big_expected);
+        assert(big.memory_usage() <= packed_usage + DECODED_LIMIT);
+
+        // Changes are kept when the block is compacted to make room.
+        for (size_t lpc = 0; lpc < big.size(); lpc += 500) {
+            big[lpc].set_mark(true);
+            big_expected[lpc].set_mark(true);
+        }
+        check_index(big, big_expected);
+
+        // An iterator held while the rest of the index is scanned still
+        // points at the same line.
+        auto held = big.cbegin() + 10;
+        assert(std::equal(big.begin(), big.end(),
+                          big_expected.begin(), same_line));
+        assert(same_line(*held, big_expected[10]));
+
+        // A line out of order in a compacted block and at the start of a
+        // block.
+        for (size_t line : {(size_t) 5000, logline_index::BLOCK_SIZE * 20}) {
+            auto tv = big_expected[line].get_timeval();
+
+            tv.tv_sec += 1000;
+            big[line - 1].set_time(tv);
+            big_expected[line - 1].set_time(tv);
+            big.compact();
+            assert(!big.is_sorted());
+            assert(!std::is_sorted(big_expected.begin(), big_expected.end()));
+            big[line - 1].set_time(big_expected[line - 2].get_timeval());
+            big_expected[line - 1].set_time(
+                big_expected[line - 2].get_timeval());
+            assert(big.is_sorted());
+        }
+        check_index(big, big_expected);
+    }
+
+    // Removing lines from a compacted block.
+    while (index.size() > logline_index::BLOCK_SIZE * 4 - 10) {
+        index.pop_back();
+        expected.pop_back();
+    }
+    check_index(index, expected);
+    index.emplace_back(off, base_time, 0, LEVEL_INFO);
+    expected.emplace_back(off, base_time, 0, LEVEL_INFO);
+    check_index(index, expected);
+
+    return EXIT_SUCCESS;
+}
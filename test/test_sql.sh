@@ -507,6 +507,53 @@ log_line,log_part,log_time,log_idle_msecs,log_level,log_mark,log_comment,log_tag
 118,<NULL>,2011-11-03 00:19:49.337,18,error,0,<NULL>,<NULL>,<NULL>,1320279589.337053,CBHHuR1xFnm5C5CQBc,192.168.2.76,52074,74.125.225.76,80,1,GET,i4.ytimg.com,/vi/gDbg_GeuiSY/hqdefault.jpg,<NULL>,1.1,Mozilla/5.0 (Macintosh; Intel Mac OS X 10.6; rv:7.0.1) Gecko/20100101 Firefox/7.0.1,0,893,404,Not Found,<NULL>,<NULL>,,<NULL>,<NULL>,<NULL>,<NULL>,<NULL>,<NULL>,F2GiAw3j1m22R2yIg2,<NULL>,image/jpeg
 EOF
 
+run_test ${lnav_test} -n \
+    -c ";SELECT log_line, log_format FROM all_logs WHERE log_level IN ('warning', 'error') AND log_format = 'generic_log'" \
+    -c ":write-csv-to -" \
+    ${test_dir}/logfile_syslog.0 \
+    ${test_dir}/logfile_generic.0
+
+check_output "level and format constraints are not applied?" <<EOF
+log_line,log_format
+5,generic_log
+EOF
+
+run_test ${lnav_test} -n \
+    -c ";SELECT log_line, log_level FROM all_logs WHERE log_level IN ('warning', 'error', 'debug')" \
+    -c ":write-csv-to -" \
+    ${test_dir}/logfile_syslog.0 \
+    ${test_dir}/logfile_generic.0
+
+check_output "level constraints with IN are not in log order?" <<EOF
+log_line,log_level
+0,error
+2,error
+4,debug
+5,warning
+EOF
+
+run_test ${lnav_test} -n \
+    -c ";SELECT log_line, log_pid FROM syslog_log WHERE log_pid IN ('7998', '16442')" \
+    -c ":write-csv-to -" \
+    ${test_dir}/logfile_syslog.0
+
+check_output "opid constraints are not applied?" <<EOF
+log_line,log_pid
+0,7998
+1,16442
+EOF
+
+run_test ${lnav_test} -n \
+    -I ${test_dir} \
+    -c ";SELECT log_line, \"response/status\" FROM json_log3 WHERE \"response/status\" = '500'" \
+    -c ":write-csv-to -" \
+    ${test_dir}/logfile_json3.json
+
+check_output "numeric JSON opids are skipped?" <<EOF
+log_line,response/status
+1,500
+EOF
+
 run_test ${lnav_test} -n \
     -c ';select log_time from access_log where log_line > 100000' \
     -c ':switch-to-view db' \
@@ -1056,7 +1103,7 @@ EOF
 
 
 schema_dump() {
-    ${lnav_test} -n -c ';.schema' ${test_dir}/logfile_access_log.0 | head -n19
+    ${lnav_test} -n -c ';.schema' ${test_dir}/logfile_access_log.0 | head -n20
 }
 
 run_test schema_dump
@@ -1070,6 +1117,7 @@ CREATE VIRTUAL TABLE lnav_view_files USING lnav_view_files_impl();
 CREATE VIRTUAL TABLE lnav_view_stack USING lnav_view_stack_impl();
 CREATE VIRTUAL TABLE lnav_view_filters USING lnav_view_filters_impl();
 CREATE VIRTUAL TABLE lnav_file USING lnav_file_impl();
+CREATE VIRTUAL TABLE lnav_file_pattern_stats USING lnav_file_pattern_stats_impl();
 CREATE VIEW lnav_view_filters_and_stats AS
   SELECT * FROM lnav_view_filters LEFT NATURAL JOIN lnav_view_filter_stats;
 CREATE VIRTUAL TABLE regexp_capture USING regexp_capture_impl();
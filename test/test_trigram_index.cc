@@ -0,0 +1,173 @@
+/**
+ * Copyright (c) 2021, Timothy Stack
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither the name of Timothy Stack nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "trigram_index.hh"
+
+using namespace std;
+
+static void add_lines(trigram_index &ti, const vector<string> &lines)
+{
+    for (const auto &line : lines) {
+        ti.add_line(line.c_str(), line.size());
+    }
+}
+
+/**
+ * Collect the lines that are candidates for the query, the result should
+ * always include the lines that actually contain the literal.
+ */
+static vector<size_t> candidates(const trigram_index &ti,
+                                 const trigram_index::query &tq,
+                                 size_t line_count)
+{
+    vector<size_t> retval;
+
+    for (size_t line = tq.next_candidate(ti, 0);
+         line < line_count;
+         line = tq.next_candidate(ti, line + 1)) {
+        retval.push_back(line);
+    }
+
+    return retval;
+}
+
+int main(int argc, char *argv[])
+{
+    const auto BL = trigram_index::BLOCK_LINES;
+
+    {
+        trigram_index ti;
+        trigram_index::query tq("zebracorn", false);
+        vector<string> lines(BL * 4, "an ordinary line of text");
+
+        lines[BL + 3] = "a ZebraCorn appears";
+        lines[BL * 3 + 10] = "another zebracorn";
+        add_lines(ti, lines);
+        ti.flush();
+
+        assert(ti.get_line_count() == lines.size());
+
+        auto cands = candidates(ti, tq, lines.size());
+
+        assert(cands.size() == BL * 2);
+        assert(cands.front() == BL);
+        assert(cands[BL] == BL * 3);
+
+        assert(tq.next_candidate(ti, BL * 2) == BL * 3);
+        assert(tq.next_candidate(ti, BL * 3 + 1) == BL * 3 + 1);
+
+        // Lines that are not in the index yet are always candidates.
+        ti.add_line("nothing", 7);
+        assert(tq.next_candidate(ti, BL * 4) == BL * 4);
+        ti.flush();
+        assert(tq.next_candidate(ti, BL * 4) == BL * 4 + 1);
+
+        trigram_index::query missing("unicorn", false);
+
+        assert(missing.next_candidate(ti, 0) == ti.get_line_count());
+
+        // Too short to have a trigram, so every line is a candidate.
+        trigram_index::query too_short("ze", false);
+
+        assert(too_short.empty());
+        assert(too_short.next_candidate(ti, 5) == 5);
+    }
+
+    {
+        // 'k' and 's' can match non-ASCII characters when caseless, so the
+        // trigrams with them are not used.
+        trigram_index::query tq("disk full", true);
+        trigram_index::query tq2("disks", true);
+
+        assert(!tq.empty());
+        assert(tq2.empty());
+    }
+
+    {
+        trigram_index ti;
+        trigram_index::query common("common", false);
+        trigram_index::query rare("rare", false);
+
+        for (size_t lpc = 0; lpc < BL * 1024; lpc++) {
+            if (lpc == BL * 1000) {
+                ti.add_line("a rare common line", 18);
+            } else {
+                ti.add_line("common", 6);
+            }
+        }
+        ti.flush();
+
+        // The trigrams in every block are dropped from the index.
+        assert(common.next_candidate(ti, 0) == 0);
+        assert(common.next_candidate(ti, BL * 5 + 1) == BL * 5 + 1);
+        assert(rare.next_candidate(ti, 0) == BL * 1000);
+
+        {
+            auto *file = tmpfile();
+
+            assert(file != nullptr);
+            assert(ti.save(file));
+            rewind(file);
+
+            trigram_index loaded;
+
+            assert(loaded.load(file, ti.get_line_count()));
+            assert(loaded.get_line_count() == ti.get_line_count());
+            assert(rare.next_candidate(loaded, 0) == BL * 1000);
+            assert(rare.next_candidate(loaded, BL * 1000 + 1) ==
+                   BL * 1000 + 1);
+            assert(rare.next_candidate(loaded, BL * 1001) ==
+                   ti.get_line_count());
+            assert(common.next_candidate(loaded, 7) == 7);
+
+            // A truncated file is rejected.
+            auto *truncated = tmpfile();
+            char buffer[20];
+
+            rewind(file);
+            assert(fread(buffer, sizeof(buffer), 1, file) == 1);
+            assert(fwrite(buffer, sizeof(buffer), 1, truncated) == 1);
+            rewind(truncated);
+            assert(!loaded.load(truncated, ti.get_line_count()));
+            assert(loaded.get_line_count() == 0);
+            fclose(truncated);
+            fclose(file);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}